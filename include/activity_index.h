@@ -0,0 +1,65 @@
+/** @file
+    Activity index of a recording, the sample regions with detected packages.
+
+    Copyright (C) 2026 agent <agent@local>
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+*/
+
+#ifndef INCLUDE_ACTIVITY_INDEX_H_
+#define INCLUDE_ACTIVITY_INDEX_H_
+
+#include "pulse_data.h"
+
+#include <stdint.h>
+#include <stdio.h>
+
+/// Padding in seconds around the indexed packages when reading a recording.
+#define ACTIVITY_INDEX_PAD_SEC 0.5
+
+/// An activity index loaded to read the active regions of a recording.
+typedef struct activity_index activity_index_t;
+
+/// Print the header of an activity index file.
+void activity_index_print_header(FILE *file);
+
+/** Print a detected package to an activity index file.
+
+    The line lists the sample offset, the length in samples, the modulation, RSSI, and SNR.
+
+    @param file the index file
+    @param data the detected package
+    @param modulation "ook" or "fsk"
+*/
+void activity_index_print(FILE *file, pulse_data_t const *data, char const *modulation);
+
+/** Load an activity index file.
+
+    The indexed packages are padded and overlapping regions are merged.
+
+    @param path the index file path
+    @param pad padding in samples before and after each package
+    @return the loaded index or NULL on error
+*/
+activity_index_t *activity_index_load(char const *path, uint64_t pad);
+
+/** Find the next active sample.
+
+    The calls need to be in increasing order of samples.
+
+    @param index the loaded index
+    @param sample the sample offset to start from
+    @return the sample itself if active, the start of the next active region,
+        or UINT64_MAX if there are no more active regions
+*/
+uint64_t activity_index_next(activity_index_t *index, uint64_t sample);
+
+/// Number of active regions and the number of active samples.
+unsigned activity_index_regions(activity_index_t const *index, uint64_t *samples);
+
+void activity_index_free(activity_index_t *index);
+
+#endif /* INCLUDE_ACTIVITY_INDEX_H_ */
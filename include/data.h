@@ -53,6 +53,40 @@ typedef enum {
     DATA_COND,   /**< add data only if condition is true, skip otherwise */
 } data_type_t;
 
+/** Well-known keys, these are interned and can be compared by id.
+
+    Keep in sync with the names in data.c.
+*/
+typedef enum {
+    DATA_KEY_OTHER,         /**< not a well-known key */
+    DATA_KEY_TIME,
+    DATA_KEY_MODEL,
+    DATA_KEY_TYPE,
+    DATA_KEY_SUBTYPE,
+    DATA_KEY_ID,
+    DATA_KEY_CHANNEL,
+    DATA_KEY_BATTERY_OK,
+    DATA_KEY_TEMPERATURE_C,
+    DATA_KEY_HUMIDITY,
+    DATA_KEY_MIC,
+    DATA_KEY_PROTOCOL,
+    DATA_KEY_DESCRIPTION,
+    DATA_KEY_MOD,
+    DATA_KEY_FREQ,
+    DATA_KEY_FREQ1,
+    DATA_KEY_FREQ2,
+    DATA_KEY_RSSI,
+    DATA_KEY_SNR,
+    DATA_KEY_NOISE,
+    DATA_KEY_TAG,
+    DATA_KEY_CODES,
+    DATA_KEY_SRC,
+    DATA_KEY_LVL,
+    DATA_KEY_MSG,
+    DATA_KEY_NUM_ROWS,
+    DATA_KEY_COUNT,         /**< invalid */
+} data_key_id_t;
+
 typedef struct data_array {
     int         num_values;
     data_type_t type;
@@ -69,12 +103,14 @@ typedef union data_value {
 
 typedef struct data {
     struct data *next; /**< chaining to the next element in the linked list; NULL indicates end-of-list */
-    char        *key;
-    char        *pretty_key; /**< the name used for displaying data to user in with a nicer name */
-    char        *format; /**< if not null, contains special formatting string */
+    char const  *key;
+    char const  *pretty_key; /**< the name used for displaying data to user in with a nicer name */
+    char const  *format; /**< if not null, contains special formatting string */
     data_value_t value;
     data_type_t type;
+    data_key_id_t key_id; /**< id of a well-known key, DATA_KEY_OTHER otherwise */
     unsigned    retain; /**< incremented on data_retain, data_free only frees if this is zero */
+    struct data_arena *arena; /**< storage of this element and its strings, shared with the whole list */
 } data_t;
 
 /** Constructs a structured data object.
@@ -96,6 +132,10 @@ typedef struct data {
     Things it moves:
     - recursive data_t* and data_array_t* values
 
+    The elements of a list and their copied strings are allocated from a
+    shared arena, which is released in one step once all elements are freed.
+    Well-known keys (see data_key_id_t) are interned and not copied.
+
     The rule is: if an object is boxed (look at the dmt structure in the data.c)
     and it has a array_elementwise_import in the same structure, then it is
     copied deeply. Otherwise, it is copied shallowly.
@@ -110,6 +150,13 @@ typedef struct data {
 */
 R_API data_t *data_make(const char *key, const char *pretty_key, ...);
 
+/** Constructs a structured data object, keys, pretty keys, and formats are not copied.
+
+    Same as `data_make()` but the key, pretty key, and format strings must outlive
+    the data object, typically these are string literals. Values are copied as usual.
+*/
+R_API data_t *data_make_static(const char *key, const char *pretty_key, ...);
+
 /** Adds to a structured data object, by prepending data.
 
     @see data_make()
@@ -170,6 +217,21 @@ R_API data_array_t *data_array(int num_values, data_type_t type, void const *ptr
 /** Releases a data array. */
 R_API void data_array_free(data_array_t *array);
 
+/** Returns the id of a well-known key, DATA_KEY_OTHER otherwise. */
+R_API data_key_id_t data_key_id(char const *key);
+
+/** Replaces the key of a data element, the string is copied.
+
+    @return 0 on success, -1 if there was a memory allocation error.
+*/
+R_API int data_set_key(data_t *data, char const *key);
+
+/** Replaces the format of a data element, the string is copied.
+
+    @return 0 on success, -1 if there was a memory allocation error.
+*/
+R_API int data_set_format(data_t *data, char const *format);
+
 /** Retain a structure object, returns the structure object passed in. */
 R_API data_t *data_retain(data_t *data);
 
@@ -187,7 +249,12 @@ typedef struct data_output {
     void (R_API_CALLCONV *output_start)(struct data_output *output, char const *const *fields, int num_fields);
     void (R_API_CALLCONV *output_print)(struct data_output *output, data_t *data);
     void (R_API_CALLCONV *output_free)(struct data_output *output);
+    void (R_API_CALLCONV *output_flush)(struct data_output *output);
     int log_level; ///< the maximum log level (verbosity) allowed, more verbose messages must be ignored.
+    int async_safe; ///< output does not use the main loop and may print on a dispatch thread.
+    int flush_events; ///< flush after this many events, 0 to flush every event, -1 to flush on full buffer only.
+    int flush_msec; ///< flush pending events at this interval in milliseconds, 0 for no timer.
+    unsigned flush_pending; ///< number of events printed since the last flush.
 } data_output_t;
 
 /** Setup known field keys and start output, used by CSV only.
@@ -204,6 +271,12 @@ R_API void data_output_print(struct data_output *output, data_t *data);
 
 R_API void data_output_free(struct data_output *output);
 
+/** Counts a printed event, returns nonzero if the output should flush now according to its flush policy. */
+R_API int data_output_flush_due(struct data_output *output);
+
+/** Flushes pending events of an output, if applicable. */
+R_API void data_output_flush(struct data_output *output);
+
 /* data output helpers */
 
 R_API void print_value(data_output_t *output, data_type_t type, data_value_t value, char const *format);
@@ -212,4 +285,18 @@ R_API void print_array_value(data_output_t *output, data_array_t *array, char co
 
 R_API size_t data_print_jsons(data_t *data, char *dst, size_t len);
 
+/** Returns the compact JSON encoding of a structured data object.
+
+    The object is encoded once on first use and the result is cached with the
+    object, all JSON outputs share the same buffer. The buffer is owned by the
+    object and valid until the object is released, use data_retain() to keep it.
+    The object must not be modified after it was encoded.
+    Objects of any size are encoded without truncation.
+
+    @param data the data object
+    @param[out] len length of the encoding without the terminating zero, may be NULL
+    @return the JSON string or NULL if there was a memory allocation error
+*/
+R_API char const *data_jsons(data_t *data, size_t *len);
+
 #endif // INCLUDE_DATA_H_
@@ -0,0 +1,47 @@
+/** @file
+    Unit conversion of data struct fields.
+
+    Copyright (C) 2026 agent <agent@local>
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+*/
+
+#ifndef INCLUDE_DATA_CONVERT_H_
+#define INCLUDE_DATA_CONVERT_H_
+
+struct data;
+struct convert_plan;
+
+/** Cache of conversion plans.
+
+    A plan is decided once for each (mode, owner, key, format) and holds the
+    conversion function and the precomputed replacement key and format.
+*/
+typedef struct data_convert {
+    struct convert_plan *plans;
+    unsigned size; ///< number of slots, a power of two
+    unsigned used; ///< number of used slots
+} data_convert_t;
+
+/// Create a conversion plan cache.
+data_convert_t *data_convert_create(void);
+
+/// Free a conversion plan cache.
+void data_convert_free(data_convert_t *conv);
+
+/** Convert units of all fields in a data struct.
+
+    The converted fields refer to the keys and formats of the cache,
+    free the cache only after the converted data.
+
+    @param conv the conversion plan cache
+    @param mode the conversion mode, CONVERT_SI or CONVERT_CUSTOMARY
+    @param owner the producer of the data, e.g. the decoder, used as cache key
+    @param data the data to convert in place
+*/
+void data_convert_apply(data_convert_t *conv, int mode, void const *owner, struct data *data);
+
+#endif /* INCLUDE_DATA_CONVERT_H_ */
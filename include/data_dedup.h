@@ -0,0 +1,55 @@
+/** @file
+    Suppression of repeated identical events.
+
+    Copyright (C) 2026 agent <agent@local>
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+*/
+
+#ifndef INCLUDE_DATA_DEDUP_H_
+#define INCLUDE_DATA_DEDUP_H_
+
+#include <stdint.h>
+
+struct data;
+
+#define DEDUP_SLOTS 256 // power of two, number of devices tracked at once
+
+typedef struct dedup_slot {
+    uint64_t ident;   ///< hash of model, id, and channel, 0 if unused
+    uint64_t content; ///< hash of all fields
+    uint64_t seen;    ///< sample position when last seen
+} dedup_slot_t;
+
+typedef struct data_dedup {
+    uint64_t window;     ///< suppression window in samples
+    unsigned window_ms;  ///< suppression window in ms
+    uint32_t samp_rate;  ///< sample rate the window was computed for
+    unsigned suppressed; ///< counter of suppressed events for report interval statistic
+    unsigned total_suppressed; ///< total suppressed events statistic
+    dedup_slot_t slots[DEDUP_SLOTS];
+} data_dedup_t;
+
+/// Create a dedup stage with a suppression window in ms.
+data_dedup_t *data_dedup_create(unsigned window_ms);
+
+/// Free a dedup stage.
+void data_dedup_free(data_dedup_t *dedup);
+
+/** Check an event against recently seen events.
+
+    The event is identified by model, id, and channel and compared on the
+    content of all fields, except for time and level meta data.
+
+    @param dedup the dedup stage
+    @param data the event data
+    @param sample_pos current input position in samples, used as clock
+    @param samp_rate current sample rate
+    @return 1 if the event is a duplicate and should be dropped, 0 otherwise
+*/
+int data_dedup_check(data_dedup_t *dedup, struct data *data, uint64_t sample_pos, uint32_t samp_rate);
+
+#endif /* INCLUDE_DATA_DEDUP_H_ */
@@ -41,6 +41,7 @@ enum file_type {
     F_LOGIC    = 5 << 16,
     F_VCD      = 6 << 16,
     F_OOK      = 7 << 16,
+    F_IDX      = 8 << 16,
     // format types
     F_U8       = F_1CH | F_UNSIGNED | F_INT | F_W8,
     F_S8       = F_1CH | F_SIGNED   | F_INT | F_W8,
@@ -70,6 +71,14 @@ enum file_type {
     U8_LOGIC   = F_LOGIC | F_U8,
     VCD_LOGIC  = F_VCD,
     PULSE_OOK  = F_OOK,
+    ACTIVITY_INDEX = F_IDX,
+};
+
+/// compression of a file, detected from the suffix.
+enum file_compression {
+    COMPRESS_NONE = 0,
+    COMPRESS_GZIP = 1,
+    COMPRESS_ZSTD = 2,
 };
 
 typedef struct {
@@ -77,6 +86,8 @@ typedef struct {
     uint32_t raw_format;
     uint32_t center_frequency;
     uint32_t sample_rate;
+    uint32_t compression;
+    int activity_index;
     char const *spec;
     char const *path;
     FILE *file;
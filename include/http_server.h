@@ -17,6 +17,7 @@
 struct mg_mgr;
 struct r_cfg;
 
-struct data_output *data_output_http_create(struct mg_mgr *mgr, const char *host, const char *port, struct r_cfg *cfg);
+/// Start the HTTP server, keeps @p history events (0 for the default) for replay to new clients.
+struct data_output *data_output_http_create(struct mg_mgr *mgr, const char *host, const char *port, int history, struct r_cfg *cfg);
 
 #endif /* INCLUDE_HTTP_SERVER_H_ */
@@ -0,0 +1,62 @@
+/** @file
+    Sample file input, memory mapped where available.
+
+    Copyright (C) 2026 agent <agent@local>
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+*/
+
+#ifndef INCLUDE_INPUT_FILE_H_
+#define INCLUDE_INPUT_FILE_H_
+
+#include "fileformat.h"
+
+#include <stdint.h>
+
+/// A sample file opened for reading blocks.
+typedef struct input_file input_file_t;
+
+/** Open a sample file.
+
+    Regular files are memory mapped if supported, otherwise (and for stdin) blocks are read.
+    Compressed files (gzip, zstd) are decompressed ahead on a thread into two alternating buffers.
+
+    @param info the file info, with the path ("-" reads from stdin), the format
+        (one of CU8_IQ, CS8_IQ, CS16_IQ, CF32_IQ, S16_AM, S16_FM) and the compression
+    @param block_size the block size in bytes returned by input_file_read(), a multiple of 4
+    @return the opened file or NULL on error
+*/
+input_file_t *input_file_open(file_info_t const *info, uint32_t block_size);
+
+/** Get the next block of samples.
+
+    CU8, CS16, S16 are returned as-is, from the mapping if possible.
+    CS8 is converted to CU8 and CF32 is converted to CS16 into a reused buffer.
+    The block is valid until the next call and must not be modified.
+
+    @param in the opened file
+    @param[out] buf the block of samples
+    @return the block length in bytes, 0 at the end of the file
+*/
+uint32_t input_file_read(input_file_t *in, uint8_t **buf);
+
+/// Size of the file in bytes, 0 if unknown, e.g. for stdin or compressed files.
+uint64_t input_file_size(input_file_t const *in);
+
+/// Continue reading at a byte offset of the file, returns 0 on success.
+/// Compressed files only seek forward to a block boundary.
+int input_file_seek(input_file_t *in, uint64_t offset);
+
+/// Current byte offset in the file, the bytes read so far plus any seeks.
+uint64_t input_file_bytes(input_file_t const *in);
+
+/// Returns 1 if the file is memory mapped.
+int input_file_mapped(input_file_t const *in);
+
+/// Close the file and release the mapping and buffers.
+void input_file_close(input_file_t *in);
+
+#endif /* INCLUDE_INPUT_FILE_H_ */
@@ -0,0 +1,76 @@
+/** @file
+    Segmented and parallel decoding of sample files on multiple threads.
+
+    Copyright (C) 2026 agent <agent@local>
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+*/
+
+#ifndef INCLUDE_INPUT_SEGMENTS_H_
+#define INCLUDE_INPUT_SEGMENTS_H_
+
+#include "rtl_433.h"
+#include "input_file.h"
+
+#include <stdint.h>
+
+/// Maximum number of threads to decode an input file.
+#define SEGMENT_THREADS_MAX 64
+
+/// Process a block of samples, i.e. the sample callback of the main loop.
+typedef void (*input_process_fn)(unsigned char *iq_buf, uint32_t len, void *ctx);
+
+/// Returns 1 if no option depends on the sample history other than the demod state, 0 otherwise.
+int input_segments_possible(r_cfg_t *cfg);
+
+/** Decode an input file in segments on multiple threads.
+
+    Each segment copies the config and decoders, a segment uses a guard of earlier blocks
+    to settle the demod state. The events are replayed in order on the calling thread,
+    the output is the same as if the file was read serially.
+
+    @param cfg the config, with the file info of the input file loaded
+    @param in_file the opened input file, only used for the file size
+    @param process the function to process a block of samples with a copy of the config
+    @param[out] n_blocks number of blocks read
+    @param[out] n_bytes number of converted bytes read
+    @return the number of segments, or 0 if the file needs to be decoded serially
+*/
+int input_segments_decode(r_cfg_t *cfg, input_file_t *in_file, input_process_fn process, int *n_blocks, uint64_t *n_bytes);
+
+/// Workers which decode whole input files concurrently.
+typedef struct input_pool input_pool_t;
+
+/// Returns 1 if no option depends on the sample history of all files, 0 otherwise.
+int input_pool_possible(r_cfg_t *cfg);
+
+/** Start workers to decode the input files concurrently.
+
+    Each worker copies the config and decoders and decodes whole files, each file with
+    a fresh demod state. The workers stay a few files ahead of the output.
+
+    @param cfg the config, with all input files added
+    @param process the function to process a block of samples with a copy of the config
+    @return the started pool, or NULL if the files need to be decoded serially
+*/
+input_pool_t *input_pool_start(r_cfg_t *cfg, input_process_fn process);
+
+/** Wait for an input file to be decoded and replay the events on the calling thread.
+
+    Must be called in order of the input files, files can be skipped.
+
+    @param pool the started pool
+    @param index the index of the input file in cfg->in_files
+    @param[out] n_blocks number of blocks read
+    @param[out] n_bytes number of converted bytes read
+    @return 1 if the file was decoded, 0 if the file needs to be decoded serially
+*/
+int input_pool_decode(input_pool_t *pool, int index, int *n_blocks, uint64_t *n_bytes);
+
+/// Stop the workers and release the pool.
+void input_pool_stop(input_pool_t *pool);
+
+#endif /* INCLUDE_INPUT_SEGMENTS_H_ */
@@ -0,0 +1,98 @@
+/** @file
+    OpenMetrics registry and text exposition.
+
+    Copyright (C) 2026 agent <agent@local>
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+*/
+
+#ifndef INCLUDE_METRICS_H_
+#define INCLUDE_METRICS_H_
+
+#include <stddef.h>
+
+// Defined in newer <sal.h> for MSVC.
+#ifndef _Printf_format_string_
+#define _Printf_format_string_
+#endif
+
+/// A registry of collectors, modules register to add their metrics.
+typedef struct metrics metrics_t;
+
+/// A growing text buffer collectors write to.
+typedef struct metrics_out metrics_out_t;
+
+/// A collector writes one or more metric families.
+typedef void (*metrics_collect_fn)(metrics_out_t *out, void *ctx);
+
+#define HISTOGRAM_BUCKETS 16
+
+/// A histogram of durations in seconds, the bucket bounds double from 100 us to 3.3 s.
+typedef struct histogram {
+    unsigned buckets[HISTOGRAM_BUCKETS + 1]; ///< counts per bucket, the last is +Inf
+    unsigned count;
+    double sum;
+} histogram_t;
+
+/// Create a registry, returns NULL on alloc failure.
+metrics_t *metrics_create(void);
+
+/// Free a registry, the collectors are not called again.
+void metrics_free(metrics_t *metrics);
+
+/** Register a collector.
+
+    Collectors are called in the order they were registered.
+
+    @return 0 on success, -1 on alloc failure
+*/
+int metrics_register(metrics_t *metrics, metrics_collect_fn collect, void *ctx);
+
+/// Remove a collector registered with the same function and context.
+void metrics_unregister(metrics_t *metrics, metrics_collect_fn collect, void *ctx);
+
+/** Render all metrics in the OpenMetrics text format.
+
+    @param metrics the registry
+    @param[out] len the length of the text
+    @return the text, to be freed by the caller, or NULL on alloc failure
+*/
+char *metrics_render(metrics_t *metrics, size_t *len);
+
+/// Write the TYPE, UNIT (if not NULL), and HELP lines of a metric family.
+void metrics_family(metrics_out_t *out, char const *name, char const *type, char const *unit, char const *help);
+
+/// Write a sample, the name includes any suffix, labels are e.g. `a="1",b="2"` or NULL.
+void metrics_value(metrics_out_t *out, char const *name, char const *labels, double value);
+
+/// Write a sample with an unsigned integer value.
+void metrics_count(metrics_out_t *out, char const *name, char const *labels, unsigned value);
+
+/** Escape a label value, backslash, double-quote, and line feed are escaped with a backslash.
+
+    The value is truncated to fit the buffer.
+
+    @param[out] buf the buffer for the escaped value
+    @param size the size of the buffer
+    @param value the label value
+    @return the escaped value in @p buf
+*/
+char const *metrics_label_escape(char *buf, size_t size, char const *value);
+
+/// Write free-form text, e.g. samples with formatted labels, label values need to be escaped.
+void metrics_printf(metrics_out_t *out, _Printf_format_string_ char const *fmt, ...)
+#if defined(__GNUC__) || defined(__clang__)
+        __attribute__((format(printf, 2, 3)))
+#endif
+        ;
+
+/// Write a complete histogram family with unit seconds.
+void metrics_histogram(metrics_out_t *out, char const *name, char const *help, histogram_t const *hist);
+
+/// Count a duration in seconds.
+void histogram_observe(histogram_t *hist, double seconds);
+
+#endif /* INCLUDE_METRICS_H_ */
@@ -0,0 +1,48 @@
+/** @file
+    Asynchronous output dispatch on a separate thread.
+
+    Copyright (C) 2026 agent <agent@local>
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+*/
+
+#ifndef INCLUDE_OUTPUT_ASYNC_H_
+#define INCLUDE_OUTPUT_ASYNC_H_
+
+#include "data.h"
+
+/// A dispatch thread with a bounded event queue shared by all wrapped outputs.
+typedef struct output_async output_async_t;
+
+/** Create a dispatch thread.
+
+    @param depth maximum number of queued events
+    @param block if set wait for space on overflow, drop the event otherwise
+    @return the dispatcher or NULL if threads are not available or on error
+*/
+output_async_t *output_async_create(unsigned depth, int block);
+
+/** Wrap an output to print on the dispatch thread.
+
+    Events are retained and printed in the order they were queued.
+    The wrapper takes ownership of the output.
+*/
+struct data_output *output_async_wrap(output_async_t *async, struct data_output *output);
+
+/** Get queue statistics.
+
+    @param async the dispatcher
+    @param[out] queued current number of queued events
+    @param[out] peak maximum number of queued events since the last reset
+    @param[out] dropped number of dropped events since the last reset
+    @param reset if set, reset the peak and dropped counters
+*/
+void output_async_stats(output_async_t *async, unsigned *queued, unsigned *peak, unsigned *dropped, int reset);
+
+/// Print all queued events, stop the dispatch thread, and free the dispatcher.
+void output_async_free(output_async_t *async);
+
+#endif /* INCLUDE_OUTPUT_ASYNC_H_ */
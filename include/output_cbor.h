@@ -0,0 +1,46 @@
+/** @file
+    CBOR output for rtl_433 events.
+
+    Copyright (C) 2026 agent <agent@local>
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+*/
+
+#ifndef INCLUDE_OUTPUT_CBOR_H_
+#define INCLUDE_OUTPUT_CBOR_H_
+
+#include "data.h"
+#include <stdint.h>
+#include <stdio.h>
+
+/// Framing of CBOR items in a stream.
+typedef enum {
+    CBOR_FRAMING_SEQUENCE, ///< plain CBOR sequence (RFC 8742), items are self-delimiting
+    CBOR_FRAMING_LENGTH,   ///< each item is prefixed with a 32-bit big-endian length
+} cbor_framing_t;
+
+/** Encode a structured data object to CBOR.
+
+    Objects are encoded as maps, arrays as arrays, integers as integers,
+    doubles as floats (single precision if exact), and strings as text strings.
+
+    @param data the data object
+    @param dst the output buffer
+    @param len the size of the output buffer
+    @return the length of the complete encoding, if this exceeds @p len the output is incomplete
+*/
+size_t data_print_cbor(data_t *data, uint8_t *dst, size_t len);
+
+/** Construct data output for CBOR encoded events.
+
+    @param log_level the highest log level to process
+    @param file the output stream
+    @param framing the framing of items in the stream
+    @return the data output or NULL if there was a memory allocation error.
+*/
+struct data_output *data_output_cbor_create(int log_level, FILE *file, cbor_framing_t framing);
+
+#endif /* INCLUDE_OUTPUT_CBOR_H_ */
@@ -28,4 +28,16 @@ struct data_output *data_output_json_create(int log_level, FILE *file);
 
 struct data_output *data_output_kv_create(int log_level, FILE *file);
 
+/** Wrap a file output to write its stream through a full buffer.
+
+    The stream is switched to a full buffer of @p size bytes, this must happen before the first I/O.
+    The wrapper takes ownership of the output and the stream, the stream is closed before the buffer is freed.
+
+    @param output the file output to wrap
+    @param file the output stream of the file output
+    @param size the size of the stream buffer
+    @return the wrapped output, or @p output unchanged if the buffer could not be set
+*/
+struct data_output *data_output_file_buffer_wrap(struct data_output *output, FILE *file, size_t size);
+
 #endif /* INCLUDE_OUTPUT_FILE_H_ */
@@ -20,9 +20,15 @@ struct r_cfg;
 
 /** Construct rtl_tcp data output.
 
+    Clients can request their own stream with the commands
+    0x80 (decimation), 0x81 (frequency shift in Hz), and 0x82 (sample format:
+    0 unchanged, 1 CU8, 2 CS8, 3 CS16), clients with the same settings share the conversion.
+
     @param host the server host to bind
     @param port the server port to bind
-    @param opts additional options, currently "control" enables write access
+    @param opts additional options, "control" enables write access,
+                "clients=<n>" accepts up to n clients (default 8),
+                "queue=<n>" keeps up to n frames per client (default 16), the oldest are dropped
     @param cfg the r_api config to use
     @return The initialized rtltcp output instance.
             You must release this object with raw_output_free once you're done with it.
@@ -16,4 +16,10 @@
 
 struct data_output *data_output_syslog_create(int log_level, const char *host, const char *port);
 
+/** Construct data output for CBOR encoded events over UDP.
+
+    Each datagram carries exactly one CBOR item, events too large for a datagram are dropped.
+*/
+struct data_output *data_output_cbor_udp_create(int log_level, const char *host, const char *port);
+
 #endif /* INCLUDE_OUTPUT_UDP_H_ */
@@ -34,6 +34,13 @@ enum {
 
 typedef struct pulse_detect pulse_detect_t;
 
+/// Levels of an idle pulse detector.
+typedef struct pulse_detect_idle {
+    int lead_in_counter;
+    int ook_low_estimate;
+    int ook_high_estimate;
+} pulse_detect_idle_t;
+
 pulse_detect_t *pulse_detect_create(void);
 
 void pulse_detect_free(pulse_detect_t *pulse_detect);
@@ -48,6 +55,15 @@ void pulse_detect_free(pulse_detect_t *pulse_detect);
 /// @param verbosity Debug output verbosity, 0=None, 1=Levels, 2=Histograms
 void pulse_detect_set_levels(pulse_detect_t *pulse_detect, int use_mag_est, float fixed_high_level, float min_high_level, float high_low_ratio, int verbosity);
 
+/// Get the levels of an idle pulse detector.
+///
+/// Two idle detectors with the same levels will detect the same packages from the same samples.
+///
+/// @param pulse_detect The pulse_detect instance
+/// @param[out] idle The current levels
+/// @return 1 if the detector is idle, 0 if a package is in progress
+int pulse_detect_get_idle(pulse_detect_t const *pulse_detect, pulse_detect_idle_t *idle);
+
 /// Demodulate On/Off Keying (OOK) and Frequency Shift Keying (FSK) from an envelope signal.
 ///
 /// Function is stateful and can be called with chunks of input data.
@@ -20,6 +20,7 @@ struct data;
 struct pulse_data;
 struct list;
 struct mg_mgr;
+struct dm_state;
 
 /* general */
 
@@ -31,6 +32,14 @@ void r_init_cfg(struct r_cfg *cfg);
 
 void r_free_cfg(struct r_cfg *cfg);
 
+/** Reset the demodulator state, a package in progress is dropped.
+
+    The pulse detector is recreated with the levels of the demod.
+
+    @return 0 on success, -1 on alloc failure
+*/
+int r_reset_demod(struct dm_state *demod);
+
 /* device decoder protocols */
 
 void register_protocol(struct r_cfg *cfg, struct r_device *r_dev, char *arg);
@@ -39,6 +48,18 @@ void free_protocol(struct r_device *r_dev);
 
 void unregister_protocol(struct r_cfg *cfg, struct r_device *r_dev);
 
+/** Create an independent copy of a registered decoder, e.g. for another demod on another thread.
+
+    Decoders with a create function get a new context, others share the (read-only) context.
+    The output and log functions need to be set by the caller.
+    Release the copy with free_protocol_copy().
+
+    @return the copy or NULL on alloc failure
+*/
+struct r_device *copy_protocol(struct r_device const *r_dev);
+
+void free_protocol_copy(struct r_device *r_dev);
+
 void register_all_protocols(struct r_cfg *cfg, unsigned disabled);
 
 /* output helper */
@@ -75,6 +96,8 @@ void add_json_output(struct r_cfg *cfg, char *param);
 
 void add_csv_output(struct r_cfg *cfg, char *param);
 
+void add_cbor_output(struct r_cfg *cfg, char *param);
+
 void add_log_output(struct r_cfg *cfg, char *param);
 
 void add_kv_output(struct r_cfg *cfg, char *param);
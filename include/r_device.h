@@ -69,6 +69,7 @@ typedef struct r_device {
     float tolerance;
     int (*decode_fn)(struct r_device *decoder, struct bitbuffer *bitbuffer);
     struct r_device *(*create_fn)(char *args);
+    void (*free_fn)(struct r_device *decoder); ///< Release the decode_ctx, if it owns more than a plain allocation
     unsigned priority; ///< Run later and only if no previous events were produced
     unsigned disabled; ///< 0: default enabled, 1: default disabled, 2: disabled, 3: disabled and hidden
     char const *const *fields; ///< List of fields this decoder produces; required for CSV output. NULL-terminated.
@@ -88,6 +89,7 @@ typedef struct r_device {
     /* private for flex decoder and output callback */
     void *decode_ctx;
     void *output_ctx;
+    char *create_arg; ///< the argument given to create_fn, to create copies of the decoder
 } r_device;
 
 #endif /* INCLUDE_R_DEVICE_H_ */
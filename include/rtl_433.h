@@ -7,6 +7,7 @@
 
 #include <stdint.h>
 #include "list.h"
+#include "metrics.h"
 #include <time.h>
 #include <signal.h>
 
@@ -27,6 +28,9 @@
 struct sdr_dev;
 struct r_device;
 struct mg_mgr;
+struct data_dedup;
+struct data_convert;
+struct output_async;
 
 typedef enum {
     CONVERT_NATIVE,
@@ -70,6 +74,7 @@ typedef struct r_cfg {
     list_t in_files;
     char const *in_filename;
     int in_replay;
+    int in_threads; ///< number of threads to decode input files, 0 or 1 for serial
     volatile sig_atomic_t hop_now;
     volatile sig_atomic_t exit_async;
     volatile sig_atomic_t exit_code; ///< 0=no err, 1=params or cmd line err, 2=sdr device read error, 3=usb init error, 5=USB error (reset), other=other error
@@ -93,6 +98,7 @@ typedef struct r_cfg {
     int verbosity; ///< 0=normal, 1=verbose, 2=verbose decoders, 3=debug decoders, 4=trace decoding.
     int verbose_bits;
     conversion_mode_t conversion_mode;
+    struct data_convert *convert; ///< cached unit conversion plans
     int report_meta;
     int report_noise;
     int report_protocol;
@@ -109,7 +115,9 @@ typedef struct r_cfg {
     struct r_device *devices;
     uint16_t num_r_devices;
     list_t data_tags;
+    struct data_dedup *dedup; ///< optional suppression of repeated events
     list_t output_handler;
+    struct output_async *output_async; ///< optional dispatch thread for outputs
     list_t raw_handler;
     int has_logout;
     struct dm_state *demod;
@@ -125,6 +133,13 @@ typedef struct r_cfg {
     unsigned total_frames_events;   ///< total frames with decoder events statistic
     /* sdr stats */
     time_t sdr_since; ///< time of last SDR connect statistic
+    unsigned acquire_seq;       ///< sequence number of the next sample buffer, only used by the acquire thread
+    unsigned receive_seq;       ///< sequence number of the next expected sample buffer
+    unsigned dropped_buffers;   ///< sample buffers lost between acquire thread and main loop statistic
+    double acquired_time;       ///< time the current sample buffer was acquired, 0 if not live input
+    histogram_t buffer_time;    ///< sample buffer processing time statistic
+    histogram_t output_latency; ///< time from sample buffer acquisition to event output statistic
+    struct metrics *metrics;    ///< collectors for the OpenMetrics endpoint
     /* per report interval stats */
     time_t frames_since;    ///< time at start of report interval statistic
     unsigned frames_ook;    ///< counter of ook demods for report interval statistic
@@ -0,0 +1,167 @@
+/** @file
+    Activity index of a recording, the sample regions with detected packages.
+
+    Copyright (C) 2026 agent <agent@local>
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+*/
+
+#include "activity_index.h"
+
+#include "r_util.h"
+#include "fatal.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct {
+    uint64_t start;
+    uint64_t end;
+} activity_region_t;
+
+struct activity_index {
+    activity_region_t *regions;
+    unsigned len;
+    unsigned size;
+    unsigned cur; ///< the region of the last lookup
+};
+
+static inline void chk_ret(int ret)
+{
+    if (ret < 0) {
+        perror("File output error");
+        exit(1);
+    }
+}
+
+void activity_index_print_header(FILE *file)
+{
+    if (!file) {
+        FATAL("Invalid stream in activity_index_print_header()");
+    }
+
+    char time_str[LOCAL_TIME_BUFLEN];
+
+    chk_ret(fprintf(file, ";activity index\n"));
+    chk_ret(fprintf(file, ";version 1\n"));
+    chk_ret(fprintf(file, ";timescale 1 sample\n"));
+    chk_ret(fprintf(file, ";created %s\n", usecs_time_str(time_str, NULL, 1, 0)));
+    chk_ret(fprintf(file, ";offset length modulation rssi snr\n"));
+}
+
+void activity_index_print(FILE *file, pulse_data_t const *data, char const *modulation)
+{
+    if (!file) {
+        FATAL("Invalid stream in activity_index_print()");
+    }
+
+    unsigned length = data->start_ago > data->end_ago ? data->start_ago - data->end_ago : 0;
+    chk_ret(fprintf(file, "%llu %u %s %.1f %.1f\n", (unsigned long long)data->offset, length, modulation, data->rssi_db, data->snr_db));
+}
+
+static int region_cmp(void const *a, void const *b)
+{
+    activity_region_t const *ra = a;
+    activity_region_t const *rb = b;
+    return ra->start < rb->start ? -1 : ra->start > rb->start;
+}
+
+activity_index_t *activity_index_load(char const *path, uint64_t pad)
+{
+    FILE *file = fopen(path, "r");
+    if (!file) {
+        return NULL;
+    }
+
+    activity_index_t *index = calloc(1, sizeof(*index));
+    if (!index) {
+        WARN_CALLOC("activity_index_load()");
+        fclose(file);
+        return NULL; // NOTE: returns NULL on alloc failure.
+    }
+
+    char line[256];
+    while (fgets(line, sizeof(line), file)) {
+        if (*line == ';' || *line == '\n') {
+            continue; // header or comment
+        }
+        char *p;
+        uint64_t offset = strtoull(line, &p, 10);
+        uint64_t length = strtoull(p, NULL, 10);
+        if (p == line) {
+            continue; // not an index line
+        }
+
+        if (index->len == index->size) {
+            unsigned size = index->size ? index->size * 2 : 256;
+            activity_region_t *regions = realloc(index->regions, size * sizeof(*regions));
+            if (!regions) {
+                WARN_REALLOC("activity_index_load()");
+                activity_index_free(index);
+                fclose(file);
+                return NULL;
+            }
+            index->regions = regions;
+            index->size    = size;
+        }
+        activity_region_t *region = &index->regions[index->len++];
+        region->start = offset > pad ? offset - pad : 0;
+        region->end   = offset + length + pad;
+    }
+    fclose(file);
+
+    // packages are written as detected, OOK and FSK might be slightly out of order
+    if (index->len)
+        qsort(index->regions, index->len, sizeof(*index->regions), region_cmp);
+
+    // merge overlapping regions
+    unsigned n = 0;
+    for (unsigned i = 0; i < index->len; ++i) {
+        activity_region_t *region = &index->regions[i];
+        if (n && region->start <= index->regions[n - 1].end) {
+            if (region->end > index->regions[n - 1].end)
+                index->regions[n - 1].end = region->end;
+        }
+        else {
+            index->regions[n++] = *region;
+        }
+    }
+    index->len = n;
+
+    return index;
+}
+
+uint64_t activity_index_next(activity_index_t *index, uint64_t sample)
+{
+    while (index->cur < index->len && index->regions[index->cur].end <= sample) {
+        index->cur++;
+    }
+    if (index->cur == index->len)
+        return UINT64_MAX;
+
+    activity_region_t const *region = &index->regions[index->cur];
+    return sample > region->start ? sample : region->start;
+}
+
+unsigned activity_index_regions(activity_index_t const *index, uint64_t *samples)
+{
+    if (samples) {
+        *samples = 0;
+        for (unsigned i = 0; i < index->len; ++i)
+            *samples += index->regions[i].end - index->regions[i].start;
+    }
+    return index->len;
+}
+
+void activity_index_free(activity_index_t *index)
+{
+    if (!index)
+        return;
+
+    free(index->regions);
+    free(index);
+}
@@ -22,6 +22,10 @@
 #include <stdlib.h>
 #include <stdbool.h>
 
+#if defined(THREADS) && !defined(_WIN32)
+#include <pthread.h>
+#endif
+
 // Macro to prevent unused variables (passed into a function)
 // from generating a warning.
 #define UNUSED(x) (void)(x)
@@ -81,7 +85,7 @@ static data_meta_type_t dmt[DATA_COUNT] = {
       .array_is_boxed           = true,
       .array_elementwise_import = (array_elementwise_import_fn) strdup,
       .array_element_release    = (array_element_release_fn) free,
-      .value_release            = (value_release_fn) free },
+      .value_release            = NULL }, // string values are stored in the arena
 
     //  DATA_ARRAY
     { .array_element_size       = sizeof(data_array_t*),
@@ -115,6 +119,184 @@ static bool import_values(void *dst, void const *src, int num_values, data_type_
     return true; // error is returned early
 }
 
+/* arena */
+
+/// Size of a regular arena chunk, a typical event fits in one chunk.
+#define ARENA_CHUNK_SIZE 2048
+/// Maximum number of regular chunks kept for reuse.
+#define ARENA_POOL_MAX 64
+/// Alignment of allocations, suits data_t and doubles.
+#define ARENA_ALIGN 16
+#define ARENA_ROUND(n) (((n) + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1))
+
+/// A chunk of arena memory, the first chunk of an arena also holds the arena state.
+typedef struct data_arena {
+    struct data_arena *next; ///< next chunk of this arena, or next chunk in the pool
+    struct data_arena *tail; ///< chunk currently allocated from (first chunk only)
+    size_t size;             ///< usable size of this chunk
+    size_t used;             ///< bytes used in this chunk
+    unsigned refs;           ///< number of live elements in this arena (first chunk only)
+    data_t *jsons_head;      ///< list the cached JSON encoding is for (first chunk only)
+    char *jsons;             ///< cached JSON encoding (first chunk only)
+    size_t jsons_len;        ///< length of the cached JSON encoding (first chunk only)
+} data_arena_t;
+
+#define ARENA_HEADER ARENA_ROUND(sizeof(data_arena_t))
+
+static data_arena_t *arena_pool;
+static unsigned arena_pool_len;
+#if defined(THREADS) && !defined(_WIN32)
+static pthread_mutex_t arena_pool_lock = PTHREAD_MUTEX_INITIALIZER;
+#define ARENA_POOL_LOCK() pthread_mutex_lock(&arena_pool_lock)
+#define ARENA_POOL_UNLOCK() pthread_mutex_unlock(&arena_pool_lock)
+#define ARENA_POOL_ENABLED 1
+#elif defined(THREADS)
+// no static mutex initializer with the WIN32 compat, don't recycle chunks there
+#define ARENA_POOL_LOCK()
+#define ARENA_POOL_UNLOCK()
+#define ARENA_POOL_ENABLED 0
+#else
+#define ARENA_POOL_LOCK()
+#define ARENA_POOL_UNLOCK()
+#define ARENA_POOL_ENABLED 1
+#endif
+
+/// Get a chunk with at least @p size usable bytes, reuses pooled chunks if possible.
+static data_arena_t *arena_chunk(size_t size)
+{
+    data_arena_t *chunk = NULL;
+    if (size <= ARENA_CHUNK_SIZE - ARENA_HEADER) {
+        size = ARENA_CHUNK_SIZE - ARENA_HEADER;
+        ARENA_POOL_LOCK();
+        chunk = arena_pool;
+        if (chunk) {
+            arena_pool = chunk->next;
+            arena_pool_len--;
+        }
+        ARENA_POOL_UNLOCK();
+    }
+    if (!chunk) {
+        chunk = malloc(ARENA_HEADER + size);
+        if (!chunk) {
+            WARN_MALLOC("arena_chunk()");
+            return NULL; // NOTE: returns NULL on alloc failure.
+        }
+    }
+    chunk->next = NULL;
+    chunk->tail = chunk;
+    chunk->size = size;
+    chunk->used = 0;
+    chunk->refs = 0;
+    chunk->jsons_head = NULL;
+    chunk->jsons      = NULL;
+    chunk->jsons_len  = 0;
+    return chunk;
+}
+
+/// Return all chunks of an arena to the pool, oversized chunks are freed.
+static void arena_release(data_arena_t *arena)
+{
+    while (arena) {
+        data_arena_t *chunk = arena;
+        arena = arena->next;
+        if (ARENA_POOL_ENABLED && chunk->size == ARENA_CHUNK_SIZE - ARENA_HEADER) {
+            ARENA_POOL_LOCK();
+            if (arena_pool_len < ARENA_POOL_MAX) {
+                chunk->next = arena_pool;
+                arena_pool  = chunk;
+                arena_pool_len++;
+                chunk = NULL;
+            }
+            ARENA_POOL_UNLOCK();
+        }
+        free(chunk);
+    }
+}
+
+/// Bump allocate @p size bytes from an arena, adds a chunk if needed.
+static void *arena_bump(data_arena_t *arena, size_t size)
+{
+    size = ARENA_ROUND(size);
+    data_arena_t *chunk = arena->tail;
+    if (chunk->size - chunk->used < size) {
+        chunk = arena_chunk(size);
+        if (!chunk)
+            return NULL; // NOTE: returns NULL on alloc failure.
+        arena->tail->next = chunk;
+        arena->tail       = chunk;
+    }
+    void *ptr = (char *)chunk + ARENA_HEADER + chunk->used;
+    chunk->used += size;
+    return ptr;
+}
+
+/// Copy a string into an arena.
+static char *arena_copy(data_arena_t *arena, char const *str)
+{
+    size_t len = strlen(str) + 1;
+    char *dup  = arena_bump(arena, len);
+    if (!dup)
+        return NULL; // NOTE: returns NULL on alloc failure.
+    memcpy(dup, str, len);
+    return dup;
+}
+
+/* well-known keys */
+
+static char const *const data_keys[DATA_KEY_COUNT] = {
+        [DATA_KEY_OTHER]         = "",
+        [DATA_KEY_TIME]          = "time",
+        [DATA_KEY_MODEL]         = "model",
+        [DATA_KEY_TYPE]          = "type",
+        [DATA_KEY_SUBTYPE]       = "subtype",
+        [DATA_KEY_ID]            = "id",
+        [DATA_KEY_CHANNEL]       = "channel",
+        [DATA_KEY_BATTERY_OK]    = "battery_ok",
+        [DATA_KEY_TEMPERATURE_C] = "temperature_C",
+        [DATA_KEY_HUMIDITY]      = "humidity",
+        [DATA_KEY_MIC]           = "mic",
+        [DATA_KEY_PROTOCOL]      = "protocol",
+        [DATA_KEY_DESCRIPTION]   = "description",
+        [DATA_KEY_MOD]           = "mod",
+        [DATA_KEY_FREQ]          = "freq",
+        [DATA_KEY_FREQ1]         = "freq1",
+        [DATA_KEY_FREQ2]         = "freq2",
+        [DATA_KEY_RSSI]          = "rssi",
+        [DATA_KEY_SNR]           = "snr",
+        [DATA_KEY_NOISE]         = "noise",
+        [DATA_KEY_TAG]           = "tag",
+        [DATA_KEY_CODES]         = "codes",
+        [DATA_KEY_SRC]           = "src",
+        [DATA_KEY_LVL]           = "lvl",
+        [DATA_KEY_MSG]           = "msg",
+        [DATA_KEY_NUM_ROWS]      = "num_rows",
+};
+
+R_API data_key_id_t data_key_id(char const *key)
+{
+    // the first char rejects most keys without a full compare
+    for (int i = DATA_KEY_OTHER + 1; i < DATA_KEY_COUNT; ++i) {
+        if (data_keys[i][0] == key[0] && !strcmp(data_keys[i], key))
+            return (data_key_id_t)i;
+    }
+    return DATA_KEY_OTHER;
+}
+
+/// Set the key of an element, interned if well-known, copied to the arena otherwise.
+static int set_key(data_t *data, char const *key, int copy)
+{
+    data_key_id_t key_id = data_key_id(key);
+    if (key_id != DATA_KEY_OTHER)
+        key = data_keys[key_id];
+    else if (copy)
+        key = arena_copy(data->arena, key);
+    if (!key)
+        return -1; // NOTE: the element keeps the old key on alloc failure.
+    data->key_id = key_id;
+    data->key    = key;
+    return 0;
+}
+
 /* data */
 
 R_API data_array_t *data_array(int num_values, data_type_t type, void const *values)
@@ -156,13 +338,17 @@ alloc_error:
 #pragma GCC diagnostic ignored "-Wunknown-warning-option"
 #pragma GCC diagnostic ignored "-Wanalyzer-malloc-leak"
 
-static data_t *vdata_make(data_t *first, const char *key, const char *pretty_key, va_list ap)
+/// Make or append data, keys, pretty keys, and formats are copied if @p copy is set.
+static data_t *vdata_make(data_t *first, int copy, const char *key, const char *pretty_key, va_list ap)
 {
     data_type_t type;
     data_t *prev = first;
     while (prev && prev->next)
         prev = prev->next;
-    char *format = NULL;
+    // appended elements share the arena of the list, a new list gets a new arena
+    data_arena_t *arena = prev ? prev->arena : NULL;
+    char const *format = NULL;
+    int has_format = 0;
     int skip = 0; // skip the data item if this is set
     type = va_arg(ap, data_type_t);
     do {
@@ -177,19 +363,13 @@ static data_t *vdata_make(data_t *first, const char *key, const char *pretty_key
             type = va_arg(ap, data_type_t);
             continue;
         case DATA_FORMAT:
-            if (format) {
+            if (has_format) {
                 fprintf(stderr, "vdata_make() format type used twice\n");
                 goto alloc_error;
             }
-            format = va_arg(ap, char *);
-            if (format) {
-                format = strdup(format);
-                if (!format) {
-                    WARN_STRDUP("vdata_make()");
-                    goto alloc_error;
-                }
-            }
-            type = va_arg(ap, data_type_t);
+            format     = va_arg(ap, char const *);
+            has_format = 1;
+            type       = va_arg(ap, data_type_t);
             continue;
         case DATA_COUNT:
             assert(0);
@@ -205,10 +385,8 @@ static data_t *vdata_make(data_t *first, const char *key, const char *pretty_key
             value.v_dbl = va_arg(ap, double);
             break;
         case DATA_STRING:
-            value_release = (value_release_fn)free; // appease CSA checker
-            value.v_ptr = strdup(va_arg(ap, char const *));
-            if (!value.v_ptr)
-                WARN_STRDUP("vdata_make()");
+            // copied into the arena below
+            value.v_ptr = (void *)va_arg(ap, char const *);
             break;
         case DATA_ARRAY:
             value_release = (value_release_fn)data_array_free; // appease CSA checker
@@ -222,23 +400,23 @@ static data_t *vdata_make(data_t *first, const char *key, const char *pretty_key
         if (skip) {
             if (value_release) // could use dmt[type].value_release
                 value_release(value.v_ptr);
-            free(format);
-            format = NULL;
             skip = 0;
         }
         else {
-            current = calloc(1, sizeof(*current));
+            if (!arena)
+                arena = arena_chunk(0);
+            current = arena ? arena_bump(arena, sizeof(*current)) : NULL;
             if (!current) {
                 WARN_CALLOC("vdata_make()");
                 if (value_release) // could use dmt[type].value_release
                     value_release(value.v_ptr);
                 goto alloc_error;
             }
-            current->type   = type;
-            current->format = format;
-            format          = NULL; // consumed
-            current->value  = value;
-            current->next   = NULL;
+            memset(current, 0, sizeof(*current));
+            current->arena = arena;
+            arena->refs++;
+            current->type  = type;
+            current->value = value;
 
             if (prev)
                 prev->next = current;
@@ -246,17 +424,32 @@ static data_t *vdata_make(data_t *first, const char *key, const char *pretty_key
             if (!first)
                 first = current;
 
-            current->key = strdup(key);
-            if (!current->key) {
+            if (type == DATA_STRING) {
+                current->value.v_ptr = arena_copy(arena, value.v_ptr);
+                if (!current->value.v_ptr) {
+                    WARN_STRDUP("vdata_make()");
+                    goto alloc_error;
+                }
+            }
+            if (format) {
+                current->format = copy ? arena_copy(arena, format) : format;
+                if (!current->format) {
+                    WARN_STRDUP("vdata_make()");
+                    goto alloc_error;
+                }
+            }
+            if (set_key(current, key, copy)) {
                 WARN_STRDUP("vdata_make()");
                 goto alloc_error;
             }
-            current->pretty_key = strdup(pretty_key ? pretty_key : key);
+            current->pretty_key = !pretty_key ? current->key : copy ? arena_copy(arena, pretty_key) : pretty_key;
             if (!current->pretty_key) {
                 WARN_STRDUP("vdata_make()");
                 goto alloc_error;
             }
         }
+        format     = NULL;
+        has_format = 0;
 
         // next args
         key = va_arg(ap, const char *);
@@ -265,15 +458,19 @@ static data_t *vdata_make(data_t *first, const char *key, const char *pretty_key
             type = va_arg(ap, data_type_t);
         }
     } while (key);
-    if (format) {
+    if (has_format) {
         fprintf(stderr, "vdata_make() format type without data\n");
         goto alloc_error;
     }
+    // all elements skipped, the new arena is unused
+    if (arena && !arena->refs)
+        arena_release(arena);
 
     return first;
 
 alloc_error:
-    free(format); // if not consumed
+    if (arena && !arena->refs)
+        arena_release(arena);
     data_free(first);
     return NULL;
 }
@@ -282,7 +479,16 @@ R_API data_t *data_make(const char *key, const char *pretty_key, ...)
 {
     va_list ap;
     va_start(ap, pretty_key);
-    data_t *result = vdata_make(NULL, key, pretty_key, ap);
+    data_t *result = vdata_make(NULL, 1, key, pretty_key, ap);
+    va_end(ap);
+    return result;
+}
+
+R_API data_t *data_make_static(const char *key, const char *pretty_key, ...)
+{
+    va_list ap;
+    va_start(ap, pretty_key);
+    data_t *result = vdata_make(NULL, 0, key, pretty_key, ap);
     va_end(ap);
     return result;
 }
@@ -291,7 +497,7 @@ static data_t *data_append(data_t *first, const char *key, const char *pretty_ke
 {
     va_list ap;
     va_start(ap, pretty_key);
-    data_t *result = vdata_make(first, key, pretty_key, ap);
+    data_t *result = vdata_make(first, 1, key, pretty_key, ap);
     va_end(ap);
     return result;
 }
@@ -359,10 +565,44 @@ R_API void data_array_free(data_array_t *array)
     free(array);
 }
 
+R_API int data_set_key(data_t *data, char const *key)
+{
+    // the pretty key may still refer to the old key, which stays valid
+    if (set_key(data, key, 1)) {
+        WARN_STRDUP("data_set_key()");
+        return -1;
+    }
+    return 0;
+}
+
+R_API int data_set_format(data_t *data, char const *format)
+{
+    char *dup = format ? arena_copy(data->arena, format) : NULL;
+    if (format && !dup) {
+        WARN_STRDUP("data_set_format()");
+        return -1;
+    }
+    data->format = dup;
+    return 0;
+}
+
+// retain counts may be changed from output threads, use atomic operations if available
+#if defined(THREADS) && (defined(__GNUC__) || defined(__clang__))
+#define RETAIN_INC(p) __atomic_fetch_add((p), 1, __ATOMIC_RELAXED)
+#define RETAIN_DEC(p) __atomic_fetch_sub((p), 1, __ATOMIC_ACQ_REL)
+#elif defined(THREADS) && defined(_MSC_VER)
+#include <windows.h>
+#define RETAIN_INC(p) ((unsigned)InterlockedIncrement((LONG volatile *)(p)) - 1)
+#define RETAIN_DEC(p) ((unsigned)InterlockedDecrement((LONG volatile *)(p)) + 1)
+#else
+#define RETAIN_INC(p) ((*(p))++)
+#define RETAIN_DEC(p) ((*(p))--)
+#endif
+
 R_API data_t *data_retain(data_t *data)
 {
     if (data)
-        ++data->retain;
+        RETAIN_INC(&data->retain);
     return data;
 }
 
@@ -372,19 +612,18 @@ R_API data_t *data_retain(data_t *data)
 #endif
 R_API void data_free(data_t *data)
 {
-    if (data && data->retain) {
-        --data->retain;
+    // a retain count of zero means a single owner, the count wraps on the final release
+    if (data && RETAIN_DEC(&data->retain) != 0) {
         return;
     }
     while (data) {
-        data_t *prev_data = data;
+        data_arena_t *arena = data->arena;
         if (dmt[data->type].value_release)
             dmt[data->type].value_release(data->value.v_ptr);
-        free(data->format);
-        free(data->pretty_key);
-        free(data->key);
         data = data->next;
-        free(prev_data);
+        // keys, formats, and strings are released with the arena
+        if (--arena->refs == 0)
+            arena_release(arena);
     }
 }
 
@@ -418,6 +657,24 @@ R_API void data_output_free(data_output_t *output)
     output->output_free(output);
 }
 
+R_API int data_output_flush_due(data_output_t *output)
+{
+    output->flush_pending++;
+    if (output->flush_events == 0
+            || (output->flush_events > 0 && output->flush_pending >= (unsigned)output->flush_events)) {
+        output->flush_pending = 0;
+        return 1;
+    }
+    return 0;
+}
+
+R_API void data_output_flush(data_output_t *output)
+{
+    if (!output || !output->output_flush)
+        return;
+    output->output_flush(output);
+}
+
 /* output helpers */
 
 R_API void print_value(data_output_t *output, data_type_t type, data_value_t value, char const *format)
@@ -466,19 +723,27 @@ R_API void print_array_value(data_output_t *output, data_array_t *array, char co
 typedef struct {
     struct data_output output;
     abuf_t msg;
+    int overflow; ///< set if anything was dropped for lack of space
 } data_print_jsons_t;
 
+static void jsons_cat(data_print_jsons_t *jsons, char const *str)
+{
+    if (jsons->msg.left < strlen(str) + 1)
+        jsons->overflow = 1;
+    abuf_cat(&jsons->msg, str);
+}
+
 static void R_API_CALLCONV format_jsons_array(data_output_t *output, data_array_t *array, char const *format)
 {
     data_print_jsons_t *jsons = (data_print_jsons_t *)output;
 
-    abuf_cat(&jsons->msg, "[");
+    jsons_cat(jsons, "[");
     for (int c = 0; c < array->num_values; ++c) {
         if (c)
-            abuf_cat(&jsons->msg, ",");
+            jsons_cat(jsons, ",");
         print_array_value(output, array, format, c);
     }
-    abuf_cat(&jsons->msg, "]");
+    jsons_cat(jsons, "]");
 }
 
 static void R_API_CALLCONV format_jsons_object(data_output_t *output, data_t *data, char const *format)
@@ -487,17 +752,17 @@ static void R_API_CALLCONV format_jsons_object(data_output_t *output, data_t *da
     data_print_jsons_t *jsons = (data_print_jsons_t *)output;
 
     bool separator = false;
-    abuf_cat(&jsons->msg, "{");
+    jsons_cat(jsons, "{");
     while (data) {
         if (separator)
-            abuf_cat(&jsons->msg, ",");
+            jsons_cat(jsons, ",");
         output->print_string(output, data->key, NULL);
-        abuf_cat(&jsons->msg, ":");
+        jsons_cat(jsons, ":");
         print_value(output, data->type, data->value, data->format);
         separator = true;
         data      = data->next;
     }
-    abuf_cat(&jsons->msg, "}");
+    jsons_cat(jsons, "}");
 }
 
 static void R_API_CALLCONV format_jsons_string(data_output_t *output, const char *str, char const *format)
@@ -510,12 +775,13 @@ static void R_API_CALLCONV format_jsons_string(data_output_t *output, const char
 
     size_t str_len = strlen(str);
     if (size < str_len + 3) {
+        jsons->overflow = 1;
         return;
     }
 
     if (str[0] == '{' && str[str_len - 1] == '}') {
         // Print embedded JSON object verbatim
-        abuf_cat(&jsons->msg, str);
+        jsons_cat(jsons, str);
         return;
     }
 
@@ -550,7 +816,10 @@ static void R_API_CALLCONV format_jsons_string(data_output_t *output, const char
         *buf++ = *str;
         size--;
     }
-    if (size >= 2) {
+    if (*str || size < 2) {
+        jsons->overflow = 1;
+    }
+    else {
         *buf++ = '"';
         size--;
     }
@@ -565,11 +834,14 @@ static void R_API_CALLCONV format_jsons_double(data_output_t *output, double dat
     UNUSED(format);
     data_print_jsons_t *jsons = (data_print_jsons_t *)output;
     // use scientific notation for very big/small values
+    size_t left = jsons->msg.left;
     if (data > 1e7 || data < 1e-4) {
-        abuf_printf(&jsons->msg, "%g", data);
+        if (abuf_printf(&jsons->msg, "%g", data) >= (int)left)
+            jsons->overflow = 1;
     }
     else {
-        abuf_printf(&jsons->msg, "%.5f", data);
+        if (abuf_printf(&jsons->msg, "%.5f", data) >= (int)left)
+            jsons->overflow = 1;
         // remove trailing zeros, always keep one digit after the decimal point
         while (jsons->msg.left > 0 && *(jsons->msg.tail - 1) == '0' && *(jsons->msg.tail - 2) != '.') {
             jsons->msg.tail--;
@@ -583,7 +855,9 @@ static void R_API_CALLCONV format_jsons_int(data_output_t *output, int data, cha
 {
     UNUSED(format);
     data_print_jsons_t *jsons = (data_print_jsons_t *)output;
-    abuf_printf(&jsons->msg, "%d", data);
+    size_t left = jsons->msg.left;
+    if (abuf_printf(&jsons->msg, "%d", data) >= (int)left)
+        jsons->overflow = 1;
 }
 
 R_API size_t data_print_jsons(data_t *data, char *dst, size_t len)
@@ -604,3 +878,66 @@ R_API size_t data_print_jsons(data_t *data, char *dst, size_t len)
 
     return len - jsons.msg.left;
 }
+
+/// Encode to JSON, returns a malloc'd buffer if the encoding does not fit @p buf.
+static char *print_jsons_grow(data_t *data, char *buf, size_t *len)
+{
+    data_print_jsons_t jsons = {
+            .output = {
+                    .print_data   = format_jsons_object,
+                    .print_array  = format_jsons_array,
+                    .print_string = format_jsons_string,
+                    .print_double = format_jsons_double,
+                    .print_int    = format_jsons_int,
+            },
+    };
+
+    char *heap  = NULL;
+    size_t size = *len;
+    for (;;) {
+        abuf_init(&jsons.msg, heap ? heap : buf, size);
+        jsons.overflow = 0;
+        format_jsons_object(&jsons.output, data, NULL);
+        if (!jsons.overflow) {
+            *len = size - jsons.msg.left;
+            return heap ? heap : buf;
+        }
+        free(heap);
+        size *= 2;
+        heap = malloc(size);
+        if (!heap) {
+            WARN_MALLOC("data_jsons()");
+            return NULL; // NOTE: returns NULL on alloc failure.
+        }
+    }
+}
+
+R_API char const *data_jsons(data_t *data, size_t *len)
+{
+    if (!data) {
+        if (len)
+            *len = 2;
+        return "{}";
+    }
+    data_arena_t *arena = data->arena;
+    if (arena->jsons_head != data) {
+        char stack[2048];
+        size_t size = sizeof(stack);
+        char *enc   = print_jsons_grow(data, stack, &size);
+        char *copy  = enc ? arena_bump(arena, size + 1) : NULL;
+        if (!copy) {
+            if (enc != stack)
+                free(enc);
+            return NULL; // NOTE: returns NULL on alloc failure.
+        }
+        memcpy(copy, enc, size + 1);
+        if (enc != stack)
+            free(enc);
+        arena->jsons_head = data;
+        arena->jsons      = copy;
+        arena->jsons_len  = size;
+    }
+    if (len)
+        *len = arena->jsons_len;
+    return arena->jsons;
+}
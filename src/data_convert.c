@@ -0,0 +1,227 @@
+/** @file
+    Unit conversion of data struct fields.
+
+    Copyright (C) 2026 agent <agent@local>
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+*/
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "data_convert.h"
+#include "data.h"
+#include "rtl_433.h"
+#include "r_util.h"
+#include "fatal.h"
+
+typedef struct convert_rule {
+    char const *suffix;     ///< key suffix to match
+    char const *new_suffix; ///< key suffix replacement
+    char const *unit;       ///< unit string to replace in the format
+    char const *new_unit;   ///< unit string replacement in the format
+    int last_char_only;     ///< only replace the last occurrence of the unit char in the format
+    float (*fn)(float);     ///< value conversion
+} convert_rule_t;
+
+// Rules are checked in order, the first matching suffix wins.
+static convert_rule_t const si_rules[] = {
+        {"_F", "_C", "F", "C", 1, fahrenheit2celsius},
+        {"_mi_h", "_km_h", "mi/h", "km/h", 0, mph2kmph},
+        {"_in", "_mm", "in", "mm", 0, inch2mm},
+        {"_in_h", "_mm_h", "in/h", "mm/h", 0, inch2mm},
+        {"_inHg", "_hPa", "inHg", "hPa", 0, inhg2hpa},
+        {"_PSI", "_kPa", "PSI", "kPa", 0, psi2kpa},
+        {NULL, NULL, NULL, NULL, 0, NULL},
+};
+
+static convert_rule_t const customary_rules[] = {
+        {"_C", "_F", "C", "F", 1, celsius2fahrenheit},
+        {"_km_h", "_mi_h", "km/h", "mi/h", 0, kmph2mph},
+        {"_mm", "_in", "mm", "in", 0, mm2inch},
+        {"_mm_h", "_in_h", "mm/h", "in/h", 0, mm2inch},
+        {"_hPa", "_inHg", "hPa", "inHg", 0, hpa2inhg},
+        {"_kPa", "_PSI", "kPa", "PSI", 0, kpa2psi},
+        {NULL, NULL, NULL, NULL, 0, NULL},
+};
+
+typedef struct convert_plan {
+    void const *owner;          ///< producer of the data, NULL if the slot is unused
+    int mode;                   ///< conversion mode
+    uint32_t hash;              ///< hash of owner, mode, key, and format
+    char *key;                  ///< original key
+    char *format;               ///< original format, NULL if none
+    convert_rule_t const *rule; ///< NULL if the field is not converted
+    char *new_key;              ///< replacement key
+    data_key_id_t new_key_id;   ///< id of the replacement key
+    char *new_format;           ///< replacement format, NULL if none
+} convert_plan_t;
+
+static uint32_t plan_hash(void const *owner, int mode, char const *key, char const *format)
+{
+    uint32_t h = 2166136261U ^ (uint32_t)(uintptr_t)owner ^ (uint32_t)mode;
+    for (; *key; ++key) {
+        h ^= (unsigned char)*key;
+        h *= 16777619U;
+    }
+    if (format) {
+        // the terminating zero separates the key and the format
+        h *= 16777619U;
+        for (; *format; ++format) {
+            h ^= (unsigned char)*format;
+            h *= 16777619U;
+        }
+    }
+    return h;
+}
+
+static int str_equal(char const *a, char const *b)
+{
+    return a == b || (a && b && !strcmp(a, b));
+}
+
+static char *convert_format(convert_rule_t const *rule, char const *format)
+{
+    if (!format)
+        return NULL;
+    if (rule->last_char_only) {
+        char *new_format = strdup(format);
+        if (!new_format) {
+            WARN_STRDUP("convert_format()");
+            return NULL;
+        }
+        char *pos = strrchr(new_format, rule->unit[0]);
+        if (pos)
+            *pos = rule->new_unit[0];
+        return new_format;
+    }
+    return str_replace(format, rule->unit, rule->new_unit);
+}
+
+static void plan_init(convert_plan_t *plan, void const *owner, int mode, uint32_t hash, char const *key, char const *format)
+{
+    convert_rule_t const *rules = mode == CONVERT_SI ? si_rules : customary_rules;
+
+    plan->owner = owner;
+    plan->mode  = mode;
+    plan->hash  = hash;
+    plan->key   = strdup(key);
+    if (!plan->key)
+        FATAL_STRDUP("plan_init()");
+    if (format) {
+        plan->format = strdup(format);
+        if (!plan->format)
+            FATAL_STRDUP("plan_init()");
+    }
+
+    for (convert_rule_t const *rule = rules; rule->suffix; ++rule) {
+        if (str_endswith(key, rule->suffix)) {
+            plan->new_key = str_replace(key, rule->suffix, rule->new_suffix);
+            if (!plan->new_key)
+                FATAL_STRDUP("plan_init()");
+            plan->new_key_id = data_key_id(plan->new_key);
+            plan->new_format = convert_format(rule, format);
+            if (format && !plan->new_format)
+                FATAL_STRDUP("plan_init()");
+            plan->rule = rule;
+            break;
+        }
+    }
+}
+
+static void plans_grow(data_convert_t *conv)
+{
+    unsigned size         = conv->size ? conv->size * 2 : 64;
+    convert_plan_t *plans = calloc(size, sizeof(*plans));
+    if (!plans)
+        FATAL_CALLOC("plans_grow()");
+
+    for (unsigned i = 0; i < conv->size; ++i) {
+        convert_plan_t *plan = &conv->plans[i];
+        if (!plan->owner)
+            continue;
+        unsigned h = plan->hash & (size - 1);
+        while (plans[h].owner)
+            h = (h + 1) & (size - 1);
+        plans[h] = *plan;
+    }
+    free(conv->plans);
+    conv->plans = plans;
+    conv->size  = size;
+}
+
+static convert_plan_t *plan_lookup(data_convert_t *conv, int mode, void const *owner, char const *key, char const *format)
+{
+    uint32_t hash = plan_hash(owner, mode, key, format);
+    unsigned h    = hash & (conv->size - 1);
+    for (;; h = (h + 1) & (conv->size - 1)) {
+        convert_plan_t *plan = &conv->plans[h];
+        if (!plan->owner)
+            break;
+        if (plan->hash == hash && plan->owner == owner && plan->mode == mode && !strcmp(plan->key, key) && str_equal(plan->format, format))
+            return plan;
+    }
+
+    // keep the load factor below one half
+    if ((conv->used + 1) * 2 > conv->size) {
+        plans_grow(conv);
+        h = hash & (conv->size - 1);
+        while (conv->plans[h].owner)
+            h = (h + 1) & (conv->size - 1);
+    }
+    conv->used++;
+    plan_init(&conv->plans[h], owner, mode, hash, key, format);
+    return &conv->plans[h];
+}
+
+data_convert_t *data_convert_create(void)
+{
+    data_convert_t *conv = calloc(1, sizeof(*conv));
+    if (!conv) {
+        WARN_CALLOC("data_convert_create()");
+        return NULL; // NOTE: returns NULL on alloc failure.
+    }
+    plans_grow(conv);
+    return conv;
+}
+
+void data_convert_free(data_convert_t *conv)
+{
+    if (!conv)
+        return;
+    for (unsigned i = 0; i < conv->size; ++i) {
+        convert_plan_t *plan = &conv->plans[i];
+        free(plan->key);
+        free(plan->new_key);
+        free(plan->format);
+        free(plan->new_format);
+    }
+    free(conv->plans);
+    free(conv);
+}
+
+void data_convert_apply(data_convert_t *conv, int mode, void const *owner, struct data *data)
+{
+    if (!conv || (mode != CONVERT_SI && mode != CONVERT_CUSTOMARY))
+        return;
+    if (!owner)
+        owner = conv; // any non-NULL value to mark the slot used
+
+    for (data_t *d = data; d; d = d->next) {
+        if (d->type != DATA_DOUBLE)
+            continue;
+        convert_plan_t *plan = plan_lookup(conv, mode, owner, d->key, d->format);
+        if (!plan->rule)
+            continue;
+
+        // the plan strings are kept until the cache is freed, no need to copy
+        d->value.v_dbl = plan->rule->fn(d->value.v_dbl);
+        d->key         = plan->new_key;
+        d->key_id      = plan->new_key_id;
+        d->format      = plan->new_format;
+    }
+}
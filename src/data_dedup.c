@@ -0,0 +1,169 @@
+/** @file
+    Suppression of repeated identical events.
+
+    Copyright (C) 2026 agent <agent@local>
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+*/
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "data_dedup.h"
+#include "data.h"
+#include "fatal.h"
+
+#define FNV_OFFSET 14695981039346656037ULL
+#define FNV_PRIME 1099511628211ULL
+#define PROBE_LIMIT 8
+
+// meta data keys which differ between repeats of the same transmission
+static int is_ignored(data_key_id_t key_id)
+{
+    switch (key_id) {
+    case DATA_KEY_TIME:
+    case DATA_KEY_MOD:
+    case DATA_KEY_FREQ:
+    case DATA_KEY_FREQ1:
+    case DATA_KEY_FREQ2:
+    case DATA_KEY_RSSI:
+    case DATA_KEY_SNR:
+    case DATA_KEY_NOISE:
+        return 1;
+    default:
+        return 0;
+    }
+}
+
+static uint64_t hash_bytes(uint64_t h, void const *buf, size_t len)
+{
+    unsigned char const *p = buf;
+    for (size_t i = 0; i < len; ++i) {
+        h ^= p[i];
+        h *= FNV_PRIME;
+    }
+    return h;
+}
+
+static uint64_t hash_str(uint64_t h, char const *str)
+{
+    // include the terminator to separate consecutive strings
+    return hash_bytes(h, str, strlen(str) + 1);
+}
+
+static uint64_t hash_data(uint64_t h, struct data *data, int top_level);
+
+static uint64_t hash_value(uint64_t h, int type, data_value_t value)
+{
+    h = hash_bytes(h, &type, sizeof(type));
+    switch (type) {
+    case DATA_DATA:
+        return hash_data(h, value.v_ptr, 0);
+    case DATA_INT:
+        return hash_bytes(h, &value.v_int, sizeof(value.v_int));
+    case DATA_DOUBLE:
+        return hash_bytes(h, &value.v_dbl, sizeof(value.v_dbl));
+    case DATA_STRING:
+        return hash_str(h, value.v_ptr);
+    case DATA_ARRAY: {
+        data_array_t *array = value.v_ptr;
+        h = hash_bytes(h, &array->num_values, sizeof(array->num_values));
+        for (int i = 0; i < array->num_values; ++i) {
+            data_value_t elem = {0};
+            if (array->type == DATA_INT)
+                elem.v_int = ((int *)array->values)[i];
+            else if (array->type == DATA_DOUBLE)
+                elem.v_dbl = ((double *)array->values)[i];
+            else
+                elem.v_ptr = ((void **)array->values)[i];
+            h = hash_value(h, array->type, elem);
+        }
+        return h;
+    }
+    default:
+        return h;
+    }
+}
+
+static uint64_t hash_data(uint64_t h, struct data *data, int top_level)
+{
+    for (; data; data = data->next) {
+        if (top_level && is_ignored(data->key_id))
+            continue;
+        h = hash_str(h, data->key);
+        h = hash_value(h, data->type, data->value);
+    }
+    return h;
+}
+
+static uint64_t hash_ident(struct data *data)
+{
+    uint64_t h = FNV_OFFSET;
+    for (; data; data = data->next) {
+        if (data->key_id == DATA_KEY_MODEL || data->key_id == DATA_KEY_ID || data->key_id == DATA_KEY_CHANNEL) {
+            h = hash_str(h, data->key);
+            h = hash_value(h, data->type, data->value);
+        }
+    }
+    return h ? h : 1; // 0 marks an unused slot
+}
+
+data_dedup_t *data_dedup_create(unsigned window_ms)
+{
+    data_dedup_t *dedup = calloc(1, sizeof(*dedup));
+    if (!dedup) {
+        WARN_CALLOC("data_dedup_create()");
+        return NULL; // NOTE: returns NULL on alloc failure.
+    }
+    dedup->window_ms = window_ms;
+    return dedup;
+}
+
+void data_dedup_free(data_dedup_t *dedup)
+{
+    free(dedup);
+}
+
+int data_dedup_check(data_dedup_t *dedup, struct data *data, uint64_t sample_pos, uint32_t samp_rate)
+{
+    if (!dedup || !data)
+        return 0;
+
+    if (dedup->samp_rate != samp_rate) {
+        dedup->samp_rate = samp_rate;
+        dedup->window    = (uint64_t)dedup->window_ms * samp_rate / 1000;
+    }
+
+    uint64_t ident   = hash_ident(data);
+    uint64_t content = hash_data(FNV_OFFSET, data, 1);
+
+    // find the slot for this device, or the least recently seen slot to replace
+    dedup_slot_t *slot   = NULL;
+    dedup_slot_t *oldest = NULL;
+    for (unsigned i = 0; i < PROBE_LIMIT; ++i) {
+        dedup_slot_t *s = &dedup->slots[(ident + i) & (DEDUP_SLOTS - 1)];
+        if (s->ident == ident) {
+            slot = s;
+            break;
+        }
+        if (!oldest || !s->ident || (oldest->ident && s->seen < oldest->seen))
+            oldest = s;
+    }
+
+    if (slot && slot->content == content && sample_pos - slot->seen <= dedup->window) {
+        // keep the window anchored at the first transmission
+        dedup->suppressed++;
+        dedup->total_suppressed++;
+        return 1;
+    }
+
+    if (!slot)
+        slot = oldest;
+    slot->ident   = ident;
+    slot->content = content;
+    slot->seen    = sample_pos;
+    return 0;
+}
@@ -30,7 +30,9 @@ typedef struct gpsd_client {
     char address[253 + 6 + 1]; // dns max + port
     char const *init_str;
     char const *filter_str;
+    char const **includes;
     char msg[1024]; // GPSd TPV should about 600 bytes
+    data_t *tags; // filtered tag data parsed from msg, shared by all events
 } gpsd_client_t;
 
 // GPSd JSON mode
@@ -40,10 +42,64 @@ char const filter_json[] = "{\"class\":\"TPV\",";
 char const watch_nmea[] = "?WATCH={\"enable\":true,\"nmea\":true}\n";
 char const filter_nmea[] = "$GPGGA,";
 
+static char const *find_list_strncmp(char const **list, char const *key, size_t len)
+{
+    for (; list && *list; ++list) {
+        char const *elem = *list;
+        if (elem && strncmp(elem, key, len) == 0) {
+            return elem;
+        }
+    }
+    return NULL;
+}
+
+#define MAX_JSON_TOKENS 128
+
+static data_t *append_filtered_json(data_t *data, char const *json, char const **includes)
+{
+    jsmn_parser parser = {0};
+    jsmn_init(&parser);
+    jsmntok_t tok[MAX_JSON_TOKENS] = {{0}}; // make the compiler happy, should be {0}
+
+    int toks = jsmn_parse(&parser, json, strlen(json), tok, MAX_JSON_TOKENS);
+    if (toks < 1 || tok[0].type != JSMN_OBJECT) {
+        fprintf(stderr, "invalid json (%d): %s\n", toks, json);
+        return data; // invalid json
+    }
+
+    // check all tokens
+    for (int i = 1; i < toks - 1; ++i) {
+        jsmntok_t *k = tok + i;
+        jsmntok_t *v = tok + i + 1;
+        i += k->size + v->size;
+        //fprintf(stderr, "TOK (%d %d) %.*s : (%d %d) %.*s\n",
+        //        k->type, k->size, k->end - k->start, json + k->start,
+        //        v->type, v->size, v->end - v->start, json + v->start);
+
+        // check all includes
+        char const *key = find_list_strncmp(includes, json + k->start, k->end - k->start);
+        if (key) {
+            // append json tag
+            char buf[1024];
+            int len = MIN(v->end - v->start, (int)sizeof(buf) - 1);
+            memcpy(buf, json + v->start, len);
+            buf[len] = '\0';
+            data = data_str(data, key, "", NULL, buf);
+        }
+    }
+
+    return data;
+}
+
 static void gpsd_client_line(gpsd_client_t *ctx, char *line)
 {
     if (!ctx->filter_str || strncmp(line, ctx->filter_str, strlen(ctx->filter_str)) == 0) {
         snprintf(ctx->msg, sizeof(ctx->msg), "%s", line);
+        if (ctx->includes) {
+            // parse once per line, events only take a reference
+            data_free(ctx->tags);
+            ctx->tags = append_filtered_json(NULL, ctx->msg, ctx->includes);
+        }
     }
 }
 
@@ -117,7 +173,7 @@ static struct mg_connection *gpsd_client_connect(gpsd_client_t *ctx, struct mg_m
     return ctx->conn;
 }
 
-static gpsd_client_t *gpsd_client_init(char const *host, char const *port, char const *init_str, char const *filter_str, struct mg_mgr *mgr)
+static gpsd_client_t *gpsd_client_init(char const *host, char const *port, char const *init_str, char const *filter_str, char const **includes, struct mg_mgr *mgr)
 {
     gpsd_client_t *ctx;
     ctx = calloc(1, sizeof(gpsd_client_t));
@@ -134,6 +190,7 @@ static gpsd_client_t *gpsd_client_init(char const *host, char const *port, char
 
     ctx->init_str = init_str;
     ctx->filter_str = filter_str;
+    ctx->includes = includes;
     ctx->connect_opts.user_data = ctx;
 
     if (!gpsd_client_connect(ctx, mgr)) {
@@ -149,6 +206,8 @@ static void gpsd_client_free(gpsd_client_t *ctx)
         ctx->conn->user_data = NULL;
         ctx->conn->flags |= MG_F_CLOSE_IMMEDIATELY;
     }
+    if (ctx)
+        data_free(ctx->tags);
     free(ctx);
 }
 
@@ -220,7 +279,7 @@ data_tag_t *data_tag_create(char *param, struct mg_mgr *mgr)
 
         fprintf(stderr, "Getting %s data from %s port %s\n", mode, host, port);
 
-        tag->gpsd_client = gpsd_client_init(host, port, init_str, filter_str, mgr);
+        tag->gpsd_client = gpsd_client_init(host, port, init_str, filter_str, tag->includes, mgr);
     }
     else {
         if (!tag->key)
@@ -238,70 +297,21 @@ void data_tag_free(data_tag_t *tag)
     free(tag);
 }
 
-static char const *find_list_strncmp(char const **list, char const *key, size_t len)
-{
-    for (; list && *list; ++list) {
-        char const *elem = *list;
-        if (elem && strncmp(elem, key, len) == 0) {
-            return elem;
-        }
-    }
-    return NULL;
-}
-
-#define MAX_JSON_TOKENS 128
-
-static data_t *append_filtered_json(data_t *data, char const *json, char const **includes)
-{
-    jsmn_parser parser = {0};
-    jsmn_init(&parser);
-    jsmntok_t tok[MAX_JSON_TOKENS] = {{0}}; // make the compiler happy, should be {0}
-
-    int toks = jsmn_parse(&parser, json, strlen(json), tok, MAX_JSON_TOKENS);
-    if (toks < 1 || tok[0].type != JSMN_OBJECT) {
-        fprintf(stderr, "invalid json (%d): %s\n", toks, json);
-        return data; // invalid json
-    }
-
-    // check all tokens
-    for (int i = 1; i < toks - 1; ++i) {
-        jsmntok_t *k = tok + i;
-        jsmntok_t *v = tok + i + 1;
-        i += k->size + v->size;
-        //fprintf(stderr, "TOK (%d %d) %.*s : (%d %d) %.*s\n",
-        //        k->type, k->size, k->end - k->start, json + k->start,
-        //        v->type, v->size, v->end - v->start, json + v->start);
-
-        // check all includes
-        char const *key = find_list_strncmp(includes, json + k->start, k->end - k->start);
-        if (key) {
-            // append json tag
-            char buf[1024];
-            int len = MIN(v->end - v->start, (int)sizeof(buf) - 1);
-            memcpy(buf, json + v->start, len);
-            buf[len] = '\0';
-            data = data_str(data, key, "", NULL, buf);
-        }
-    }
-
-    return data;
-}
-
 data_t *data_tag_apply(data_tag_t *tag, data_t *data, char const *filename)
 {
     char const *val = tag->val;
     if (tag->gpsd_client) {
         val = tag->gpsd_client->msg;
         if (tag->includes) {
+            data_t *tags = tag->gpsd_client->tags;
             if (tag->key) {
-                // wrap tag includes
-                data_t *obj = append_filtered_json(NULL, val, tag->includes);
-                // append tag wrapper
-                data = data_dat(data, tag->key, "", NULL, obj);
+                // append tag wrapper, the parsed includes are shared
+                data = data_dat(data, tag->key, "", NULL, data_retain(tags));
             }
             else {
-                // append tag includes
-                data = append_filtered_json(data, val, tag->includes);
+                // append a copy of the parsed includes
+                for (; tags; tags = tags->next)
+                    data = data_str(data, tags->key, "", NULL, tags->value.v_ptr);
             }
         }
         else {
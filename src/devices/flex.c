@@ -13,30 +13,13 @@
 #include "optparse.h"
 #include "fatal.h"
 #include <stdlib.h>
+#include <limits.h>
 
 static inline int bit(const uint8_t *bytes, unsigned b)
 {
     return bytes[b >> 3] >> (7 - (b & 7)) & 1;
 }
 
-/// extract all mask bits skipping unmasked bits of a number up to 32/64 bits
-static unsigned long compact_number(uint8_t *data, unsigned bit_offset, unsigned long mask)
-{
-    // clz (fls) is not worth the trouble
-    int top_bit = 0;
-    while (mask >> top_bit)
-        top_bit++;
-    unsigned long val = 0;
-    for (int b = top_bit - 1; b >= 0; --b) {
-        if (mask & (1 << b)) {
-            val <<= 1;
-            val |= bit(data, bit_offset);
-        }
-        bit_offset++;
-    }
-    return val;
-}
-
 /// extract a number up to 32/64 bits from given offset with given bit length
 static unsigned long extract_number(uint8_t *data, unsigned bit_offset, unsigned bit_count)
 {
@@ -64,6 +47,9 @@ struct flex_map {
 };
 
 #define GETTER_MAP_SLOTS 16
+#define GETTER_HASH_SLOTS 32 // power of two, at least twice GETTER_MAP_SLOTS
+#define GETTER_HASH_SHIFT 27 // 32 - log2(GETTER_HASH_SLOTS)
+#define GETTER_RUN_SLOTS 32  // a 64 bit mask has at most 32 runs of ones
 
 struct flex_get {
     unsigned bit_offset;
@@ -72,6 +58,23 @@ struct flex_get {
     const char *name;
     struct flex_map map[GETTER_MAP_SLOTS];
     const char *format;
+    // compiled plan, see compile_getter()
+    unsigned width;      ///< number of raw bits to extract at bit_offset
+    unsigned byte_pos;   ///< first byte to load
+    unsigned byte_len;   ///< number of bytes to load, 0 if extract_number() is needed
+    unsigned shr;        ///< right shift to align the loaded bytes
+    uint64_t width_mask; ///< mask of the low width bits
+    unsigned num_runs;   ///< number of runs of ones in the mask, 0 if no compaction needed
+    uint8_t run_shift[GETTER_RUN_SLOTS];
+    uint8_t run_width[GETTER_RUN_SLOTS];
+    struct flex_map hash[GETTER_HASH_SLOTS]; ///< open addressing map, empty slots have a NULL val
+};
+
+/// Compiled bit pattern for match and preamble, limited to 64 bits.
+struct flex_pattern {
+    unsigned len;  ///< pattern length in bits, 0 if the pattern needs bitbuffer_search()
+    uint64_t bits; ///< pattern bits, right aligned
+    uint64_t mask; ///< mask of the low len bits
 };
 
 #define GETTER_SLOTS 12
@@ -92,6 +95,8 @@ struct flex_params {
     uint8_t match_bits[128];
     unsigned preamble_len;
     uint8_t preamble_bits[128];
+    struct flex_pattern match_plan;
+    struct flex_pattern preamble_plan;
     uint32_t symbol_zero;
     uint32_t symbol_one;
     uint32_t symbol_sync;
@@ -112,29 +117,88 @@ static void print_row_bytes(char *row_bytes, uint8_t *bits, int num_bits)
     row_bytes[2 * (num_bits + 3) / 8] = '\0';
 }
 
+static inline unsigned map_hash(unsigned key)
+{
+    return (key * 2654435761U) >> GETTER_HASH_SHIFT;
+}
+
+static char const *lookup_map(struct flex_get const *getter, unsigned long val)
+{
+    if (val > UINT_MAX)
+        return NULL;
+    unsigned key = (unsigned)val;
+    for (unsigned h = map_hash(key);; h = (h + 1) & (GETTER_HASH_SLOTS - 1)) {
+        if (!getter->hash[h].val || getter->hash[h].key == key)
+            return getter->hash[h].val;
+    }
+}
+
+/// extract the raw bits and gather the mask bits as given by the compiled getter plan
+static unsigned long run_getter(struct flex_get const *getter, uint8_t *bits)
+{
+    uint64_t raw;
+    if (getter->byte_len) {
+        uint8_t const *p = &bits[getter->byte_pos];
+        raw = 0;
+        for (unsigned i = 0; i < getter->byte_len; ++i)
+            raw = raw << 8 | p[i];
+        raw = (raw >> getter->shr) & getter->width_mask;
+    }
+    else {
+        raw = extract_number(bits, getter->bit_offset, getter->width);
+    }
+
+    if (!getter->num_runs)
+        return raw;
+
+    uint64_t val = 0;
+    for (unsigned r = 0; r < getter->num_runs; ++r) {
+        unsigned width = getter->run_width[r];
+        val = val << width | ((raw >> getter->run_shift[r]) & ((1ULL << width) - 1));
+    }
+    return val;
+}
+
 static void render_getters(data_t *data, uint8_t *bits, struct flex_params *params)
 {
     // add a data line for each getter
     for (int g = 0; g < GETTER_SLOTS && params->getter[g].bit_count > 0; ++g) {
         struct flex_get *getter = &params->getter[g];
-        unsigned long val;
-        if (getter->mask)
-            val = compact_number(bits, getter->bit_offset, getter->mask);
-        else
-            val = extract_number(bits, getter->bit_offset, getter->bit_count);
-        int m;
-        for (m = 0; getter->map[m].val; m++) {
-            if (getter->map[m].key == val) {
-                data_str(data, getter->name, "", NULL, getter->map[m].val);
-                break;
-            }
+        unsigned long val = run_getter(getter, bits);
+        char const *str = lookup_map(getter, val);
+        if (str) {
+            data_str(data, getter->name, "", NULL, str);
         }
-        if (!getter->map[m].val) {
+        else {
             data_int(data, getter->name, "", getter->format, val);
         }
     }
 }
 
+/// find a compiled pattern in a row, returns the row length if not found, same as bitbuffer_search()
+static unsigned search_pattern(bitbuffer_t *bitbuffer, unsigned row, struct flex_pattern const *pattern)
+{
+    uint8_t const *bits = bitbuffer->bb[row];
+    unsigned len        = bitbuffer->bits_per_row[row];
+    uint64_t window     = 0;
+
+    for (unsigned pos = 0; pos < len; ++pos) {
+        window = window << 1 | bit(bits, pos);
+        if (pos + 1 >= pattern->len && (window & pattern->mask) == pattern->bits)
+            return pos + 1 - pattern->len;
+    }
+
+    // Not found
+    return len;
+}
+
+static unsigned search_row(bitbuffer_t *bitbuffer, unsigned row, struct flex_pattern const *pattern, uint8_t const *bits, unsigned bits_len)
+{
+    if (pattern->len)
+        return search_pattern(bitbuffer, row, pattern);
+    return bitbuffer_search(bitbuffer, row, 0, bits, bits_len);
+}
+
 /**
 Generic flex decoder.
 */
@@ -185,7 +249,7 @@ static int flex_callback(r_device *decoder, bitbuffer_t *bitbuffer)
         r = -1;
         match_count = 0;
         for (i = 0; i < bitbuffer->num_rows; i++) {
-            if (bitbuffer_search(bitbuffer, i, 0, params->match_bits, params->match_len) < bitbuffer->bits_per_row[i]) {
+            if (search_row(bitbuffer, i, &params->match_plan, params->match_bits, params->match_len) < bitbuffer->bits_per_row[i]) {
                 if (r < 0)
                     r = i;
                 match_count++;
@@ -200,7 +264,7 @@ static int flex_callback(r_device *decoder, bitbuffer_t *bitbuffer)
         r = -1;
         match_count = 0;
         for (i = 0; i < bitbuffer->num_rows; i++) {
-            unsigned pos = bitbuffer_search(bitbuffer, i, 0, params->preamble_bits, params->preamble_len);
+            unsigned pos = search_row(bitbuffer, i, &params->preamble_plan, params->preamble_bits, params->preamble_len);
             if (pos < bitbuffer->bits_per_row[i]) {
                 if (r < 0)
                     r = i;
@@ -569,6 +633,10 @@ static const char *parse_map(const char *arg, struct flex_get *getter)
         c = e;
 
         // store result
+        if (i >= GETTER_MAP_SLOTS) {
+            fprintf(stderr, "Maximum map slots exceeded (%d)!\n", GETTER_MAP_SLOTS);
+            usage();
+        }
         getter->map[i].key = key;
         getter->map[i].val = val;
         i++;
@@ -594,11 +662,13 @@ static void parse_getter(const char *arg, struct flex_get *getter)
             getter->mask = extract_number(bitrow, 0, getter->bit_count);
         }
         else if (*arg == '%') {
+            free((char *)getter->format); // the last one given wins
             getter->format = strdup(arg);
             if (!getter->format)
                 FATAL_STRDUP("parse_getter()");
         }
         else {
+            free((char *)getter->name); // the last one given wins
             getter->name = strdup(arg);
             if (!getter->name)
                 FATAL_STRDUP("parse_getter()");
@@ -615,6 +685,83 @@ static void parse_getter(const char *arg, struct flex_get *getter)
     */
 }
 
+/// compile a match or preamble to a single 64 bit compare, longer patterns are left to bitbuffer_search()
+static void compile_pattern(struct flex_pattern *pattern, uint8_t const *bits, unsigned len)
+{
+    if (!len || len > 64)
+        return;
+    pattern->len  = len;
+    pattern->bits = 0;
+    for (unsigned b = 0; b < len; ++b)
+        pattern->bits = pattern->bits << 1 | bit(bits, b);
+    pattern->mask = len == 64 ? ~0ULL : (1ULL << len) - 1;
+}
+
+/// compile a getter to a fixed offset load, a list of mask runs, and a hashed value map
+static void compile_getter(struct flex_get *getter)
+{
+    // the mask is aligned to the first set bit, leading zeros are skipped
+    uint64_t mask = getter->mask;
+    getter->width = getter->bit_count;
+    if (mask) {
+        getter->width = 0;
+        while (getter->width < 64 && mask >> getter->width)
+            getter->width++;
+    }
+    getter->width_mask = getter->width >= 64 ? ~0ULL : (1ULL << getter->width) - 1;
+
+    unsigned shl = getter->bit_offset & 7;
+    if (getter->width && shl + getter->width <= 64) {
+        getter->byte_pos = getter->bit_offset / 8;
+        getter->byte_len = (shl + getter->width + 7) / 8;
+        getter->shr      = getter->byte_len * 8 - shl - getter->width;
+    }
+
+    // split the mask into runs of ones, most significant first
+    if (mask && mask != getter->width_mask) {
+        for (int b = getter->width - 1; b >= 0;) {
+            if (!(mask >> b & 1)) {
+                b--;
+                continue;
+            }
+            int top = b;
+            while (b >= 0 && (mask >> b & 1))
+                b--;
+            getter->run_shift[getter->num_runs] = b + 1;
+            getter->run_width[getter->num_runs] = top - b;
+            getter->num_runs++;
+        }
+    }
+
+    // insert the map entries, the first entry for a key wins
+    for (int m = 0; m < GETTER_MAP_SLOTS && getter->map[m].val; m++) {
+        unsigned key = getter->map[m].key;
+        unsigned h   = map_hash(key);
+        while (getter->hash[h].val && getter->hash[h].key != key)
+            h = (h + 1) & (GETTER_HASH_SLOTS - 1);
+        if (!getter->hash[h].val)
+            getter->hash[h] = getter->map[m];
+    }
+}
+
+static void flex_free(r_device *dev)
+{
+    struct flex_params *params = decoder_user_data(dev);
+
+    for (int g = 0; g < GETTER_SLOTS; ++g) {
+        struct flex_get *getter = &params->getter[g];
+        free((char *)getter->name);
+        free((char *)getter->format);
+        // the hashed map shares the strings
+        for (int m = 0; m < GETTER_MAP_SLOTS; ++m) {
+            free((char *)getter->map[m].val);
+        }
+    }
+    free(params->name);
+    free((char *)dev->name);
+    free(params);
+}
+
 // NOTE: this is declared in rtl_433.c also.
 r_device *flex_create_device(char *spec);
 
@@ -631,11 +778,13 @@ r_device *flex_create_device(char *spec)
     struct flex_params *params = decoder_user_data(dev);
     int get_count = 0;
 
-    spec = strdup(spec);
-    if (!spec)
+    char *spec_buf = strdup(spec);
+    if (!spec_buf)
         FATAL_STRDUP("flex_create_device()");
+    spec = spec_buf;
 
     dev->decode_fn = flex_callback;
+    dev->free_fn   = flex_free;
     dev->fields = output_fields;
 
     char *key, *val;
@@ -744,6 +893,13 @@ r_device *flex_create_device(char *spec)
     if (params->min_bits > 0 && params->min_repeats < 1)
         params->min_repeats = 1;
 
+    // compile the spec into match and extract plans
+    compile_pattern(&params->match_plan, params->match_bits, params->match_len);
+    compile_pattern(&params->preamble_plan, params->preamble_bits, params->preamble_len);
+    for (int g = 0; g < GETTER_SLOTS && params->getter[g].bit_count > 0; ++g) {
+        compile_getter(&params->getter[g]);
+    }
+
     // add getter fields if unique requested
     if (params->unique) {
         int i = 0;
@@ -814,6 +970,6 @@ r_device *flex_create_device(char *spec)
                 params->min_rows, params->min_bits, params->min_repeats, params->invert, params->reflect, params->match_len, params->preamble_len);
     */
 
-    free(spec);
+    free(spec_buf);
     return dev;
 }
@@ -90,6 +90,7 @@ char const *file_info_string(file_info_t *info)
     case VCD_LOGIC: return "VCD logic (text)";
     case U8_LOGIC:  return "U8 logic (1ch uint8)";
     case PULSE_OOK: return "OOK pulse data (text)";
+    case ACTIVITY_INDEX: return "Activity index (text)";
     default:        return "Unknown";
     }
 }
@@ -206,6 +207,9 @@ static void file_type(char const *filename, file_info_t *info)
             else if (len == 3 && !strncasecmp("complex16u", t, 10)) file_type_set_format(&info->format, F_CU8); // compat
             else if (len == 3 && !strncasecmp("complex16s", t, 10)) file_type_set_format(&info->format, F_CS8); // compat
             else if (len == 4 && !strncasecmp("complex", t, 7)) file_type_set_format(&info->format, F_CF32); // compat
+            else if (len == 2 && !strncasecmp("gz", t, 2)) info->compression = COMPRESS_GZIP;
+            else if (len == 3 && !strncasecmp("zst", t, 3)) info->compression = COMPRESS_ZSTD;
+            else if (len == 3 && !strncasecmp("idx", t, 3)) info->activity_index = 1;
             //else fprintf(stderr, "Skipping type (len %ld) %s\n", len, t);
         } else {
             p++; // skip non-alphanum char otherwise
@@ -238,6 +242,8 @@ Parse "[A-Za-z][0-9A-Za-z]+" as format or content specifier:
 1ch formats: "u8", "s8", "s16", "u16", "s32", "u32", "f32"
 text formats: "vcd", "ook"
 content types: "iq", "i", "q", "am", "fm", "logic"
+compression: "gz", "zst"
+activity index: "idx", of the recording named without the "idx" suffix
 
 Parses left to right, with the exception of a prefix up to the last colon ":"
 This prefix is the forced override, parsed last and removed from the filename.
@@ -245,6 +251,7 @@ This prefix is the forced override, parsed last and removed from the filename.
 All matches are case-insensitive.
 
 default detection, e.g.: path/filename.am.s16
+compressed, e.g.: path/filename.cu8.gz, path/filename.cu8.zst
 overrides, e.g.: am:s16:path/filename.ext
 other styles are detected but discouraged, e.g.:
   am-s16:path/filename.ext, am.s16:path/filename.ext, path/filename.am_s16
@@ -289,6 +296,17 @@ static void assert_file_type(int check, char const *spec)
     }
 }
 
+static void assert_compression(uint32_t check, char const *spec)
+{
+    file_info_t info = {0};
+    file_info_parse_filename(&info, spec);
+    if (check != info.compression) {
+        fprintf(stderr, "\nTEST failed: compression of \"%s\" = %u == %u\n", spec, info.compression, check);
+    } else {
+        fprintf(stderr, ".");
+    }
+}
+
 static void assert_str_equal(char const *a, char const *b)
 {
     if (a != b && (!a || !b || strcmp(a, b))) {
@@ -351,6 +369,15 @@ int main(void)
     assert_file_type(S16_FM, ".s16_fm");
     assert_file_type(S16_FM, ".s16,fm");
 
+    assert_file_type(CU8_IQ, "g001_433.92M_250k.cu8.gz");
+    assert_file_type(CS16_IQ, ".cs16.zst");
+    assert_compression(COMPRESS_NONE, ".cu8");
+    assert_compression(COMPRESS_GZIP, ".cu8.gz");
+    assert_compression(COMPRESS_ZSTD, ".cu8.zst");
+    assert_compression(COMPRESS_GZIP, "gz:path/filename.cu8");
+    assert_file_type(CU8_IQ, "g001_433.92M_250k.cu8.idx");
+    assert_file_type(CS16_IQ, ".cs16.gz.idx");
+
     fprintf(stderr, "\nDone!\n");
 }
 #endif /* _TEST */
@@ -19,6 +19,7 @@ A choice of endpoints are available:
 - "/cmd": simple JSON command API
 - "/events": HTTP (chunked) streaming API, streams JSON events
 - "/stream": HTTP (plain) streaming API, streams JSON events
+- "/metrics": OpenMetrics (Prometheus) counters, gauges and histograms
 - "/api": RESTful API (not implemented)
 - "ws:": Websocket API (similar to cmd/events API)
 
@@ -49,6 +50,35 @@ On Events and Stream endpoints a keep-alive of CRLF will be send every 60 second
 Use e.g. httpie with `http --stream --timeout=70 :8433/events`
 or `(echo "GET /stream HTTP/1.0\n"; sleep 600) | socat - tcp:127.0.0.1:8433`
 
+The last 100 events are kept, set the depth with e.g. `-F http:0.0.0.0:8433,history=1000`.
+Websocket clients get the history replayed on connect, Events and Stream clients don't.
+Request a replay of up to N events with `?replay=N`, e.g. `:8433/events?replay=10`.
+
+Clients can filter events with `model=`, `id=`, `channel=` (any of comma separated values),
+and `has=` (comma separated keys which all need to be present), e.g.
+`:8433/stream?model=Acurite-Tower,LaCrosse-TX141THBv2&has=temperature_C`.
+Websocket clients can change the filter with `{"cmd": "subscribe", "arg": "model=Acurite-Tower&id=42"}`,
+an empty arg removes the filter. Clients with identical filters share the evaluation, at most 64
+distinct filters are accepted. Filter values are limited to 255 characters, a request with a
+longer value is rejected.
+
+Events are held back while more than 256 KiB (set with e.g. `?queue=65536`) are waiting to be sent.
+A client that falls behind by more than the history depth is dropped.
+
+## Metrics
+
+"/metrics" renders all collectors registered with the metrics registry: receiver frame counters,
+squelch ratio, noise level, lost sample buffers, per-decoder counts (labeled by protocol and name,
+gauges as these reset with `-M stats` reports), output queue depths, and histograms of buffer
+processing time and of the latency from sample buffer to event output.
+
+## Threading
+
+With threads enabled the server runs its own event loop on a separate thread,
+slow or many clients won't stall the decoder. Events are handed over in a lock-free queue,
+commands and queries are executed on the main loop and answered from the server thread.
+Input files are decoded without the main loop, commands and queries are then answered with an error.
+
 ## Queries
 
 - "registered_protocols"
@@ -102,12 +132,16 @@ or `(echo "GET /stream HTTP/1.0\n"; sleep 600) | socat - tcp:127.0.0.1:8433`
 #include "r_util.h"
 #include "optparse.h"
 #include "abuf.h"
+#include "metrics.h"
 #include "list.h" // used for protocols
 #include "jsmn.h"
 #include "mongoose.h"
 #include "logger.h"
 #include "fatal.h"
+#include "compat_pthread.h"
 #include <stdbool.h>
+#include <stdint.h>
+#include <signal.h>
 
 // embed index.html so browsers allow access as local
 #define INDEX_HTML \
@@ -128,102 +162,302 @@ or `(echo "GET /stream HTTP/1.0\n"; sleep 600) | socat - tcp:127.0.0.1:8433`
     "<script src=\"https://triq.org/rxui/js/chunk-vendors.js\"></script>" \
     "<script src=\"https://triq.org/rxui/js/app.js\"></script>"
 
-// generic ring list
+// event history
 
 #define DEFAULT_HISTORY_SIZE 100
+#define MAX_HISTORY_SIZE 100000
+#define DEFAULT_SEND_QUEUE (256 * 1024) /* hold back events while a client has this much unsent */
+
+typedef struct {
+    data_t *data;     ///< retained event
+    char const *json; ///< JSON encoding of the event, owned by the data
+    size_t len;
+    uint64_t match;   ///< bit n is set if filter group n matches the event
+} event_entry_t;
 
+/// Ring of retained events, the cached JSON encoding is shared by all clients.
 typedef struct {
+    event_entry_t *entries;
     unsigned size;
-    void **data;
-    void **head;
-    void **tail;
-} ring_list_t;
+    uint64_t seq; ///< sequence number of the next event, event n is kept at n % size
+} event_history_t;
 
-static ring_list_t *ring_list_new(unsigned size)
+static int event_history_init(event_history_t *history, unsigned size)
 {
-    ring_list_t *ring = calloc(1, sizeof(ring_list_t));
-    if (!ring) {
-        WARN_CALLOC("ring_list_new()");
-        return NULL;
-    }
-
-    ring->data = calloc(size, sizeof(void *));
-    if (!ring->data) {
-        WARN_CALLOC("ring_list_new()");
-        free(ring);
-        return NULL;
+    history->entries = calloc(size, sizeof(event_entry_t));
+    if (!history->entries) {
+        WARN_CALLOC("event_history_init()");
+        return -1;
     }
+    history->size = size;
+    history->seq  = 0;
+    return 0;
+}
 
-    ring->size = size;
-    ring->tail = ring->data;
+static void event_history_free(event_history_t *history)
+{
+    for (unsigned i = 0; history->entries && i < history->size; ++i)
+        data_free(history->entries[i].data);
+    free(history->entries);
+    history->entries = NULL;
+}
 
-    return ring;
+// retains the data, releases the oldest event once the ring is full
+static void event_history_push(event_history_t *history, data_t *data, char const *json, size_t len, uint64_t match)
+{
+    event_entry_t *entry = &history->entries[history->seq % history->size];
+    data_free(entry->data);
+    entry->data  = data_retain(data);
+    entry->json  = json;
+    entry->len   = len;
+    entry->match = match;
+    history->seq++;
 }
 
-// the ring needs to be empty before calling this
-static void ring_list_free(ring_list_t *ring)
+// sequence number of the oldest event still kept
+static uint64_t event_history_first(event_history_t const *history)
 {
-    if (ring) {
-        if (ring->data)
-            free(ring->data);
-        free(ring);
-    }
+    return history->seq > history->size ? history->seq - history->size : 0;
 }
 
-// free the data returned
-static void *ring_list_shift(ring_list_t *ring)
+static event_entry_t *event_history_at(event_history_t const *history, uint64_t seq)
 {
-    if (!ring->head)
-        return NULL;
+    return &history->entries[seq % history->size];
+}
 
-    void *ret = *ring->head;
+// event filters
 
-    ++ring->head;
-    if (ring->head >= ring->data + ring->size)
-        ring->head -= ring->size;
-    if (ring->head == ring->tail)
-        ring->head = NULL;
+#define MAX_FILTER_GROUPS 64 /* one bit in event_entry_t match each */
+#define MAX_FILTER_TERMS 16
 
-    return ret;
+typedef struct {
+    char const *key;    ///< field which needs to be present
+    char const *values; ///< comma separated values of which any needs to match, NULL to only test presence
+} filter_term_t;
+
+/// Compiled filter, clients with identical filters share a group which is evaluated once per event.
+typedef struct {
+    char *spec; ///< canonical filter
+    char *buf;  ///< split copy of the spec, the terms point into this
+    unsigned refs;
+    unsigned terms_len;
+    filter_term_t terms[MAX_FILTER_TERMS];
+} filter_group_t;
+
+static char const *const filter_keys[] = {"model", "id", "channel"};
+
+// Parse a filter from a query string like "model=Foo,Bar&id=42&has=temperature_C,humidity".
+// Sets the canonical filter, or NULL if there are no filter terms.
+// Returns -1 if a value is too long or can't be decoded, or on alloc failure.
+static int filter_spec(struct mg_str const *query, char **spec)
+{
+    abuf_t out;
+    char buf[256];
+    char str[(sizeof(filter_keys) / sizeof(*filter_keys) + 1) * (sizeof(buf) + 16)];
+    abuf_init(&out, str, sizeof(str));
+    *spec = NULL;
+    for (unsigned i = 0; i <= sizeof(filter_keys) / sizeof(*filter_keys); ++i) {
+        char const *key = i < sizeof(filter_keys) / sizeof(*filter_keys) ? filter_keys[i] : "has";
+        int ret         = mg_get_http_var(query, key, buf, sizeof(buf));
+        if (ret == -3) {
+            print_logf(LOG_WARNING, "HTTP server", "Invalid or too long filter value for \"%s\"", key);
+            return -1;
+        }
+        if (ret > 0)
+            abuf_printf(&out, "%s%s=%s", out.tail != str ? "&" : "", key, buf);
+    }
+    if (out.tail == str)
+        return 0;
+
+    *spec = strdup(str);
+    if (!*spec) {
+        WARN_STRDUP("filter_spec()");
+        return -1; // NOTE: reject on alloc failure.
+    }
+    return 0;
 }
 
-// retain data before passing in and free the data returned.
-static void *ring_list_push(ring_list_t *ring, void *data)
+// Compile a canonical filter, takes ownership of the spec.
+static filter_group_t *filter_group_create(char *spec)
 {
-    *ring->tail = data;
+    filter_group_t *group = calloc(1, sizeof(*group));
+    if (!group) {
+        WARN_CALLOC("filter_group_create()");
+        free(spec);
+        return NULL; // NOTE: returns NULL on alloc failure.
+    }
+    group->spec = spec;
+    group->buf  = strdup(spec);
+    if (!group->buf) {
+        WARN_STRDUP("filter_group_create()");
+        free(group->spec);
+        free(group);
+        return NULL; // NOTE: returns NULL on alloc failure.
+    }
+
+    for (char *term = group->buf, *next; term; term = next) {
+        next = strchr(term, '&');
+        if (next)
+            *next++ = '\0';
+        char *values = strchr(term, '=');
+        *values++ = '\0';
+        if (strcmp(term, "has") != 0) {
+            if (group->terms_len < MAX_FILTER_TERMS)
+                group->terms[group->terms_len++] = (filter_term_t){.key = term, .values = values};
+            continue;
+        }
+        for (char *key = values; key; key = values) {
+            values = strchr(key, ',');
+            if (values)
+                *values++ = '\0';
+            if (*key && group->terms_len < MAX_FILTER_TERMS)
+                group->terms[group->terms_len++] = (filter_term_t){.key = key};
+        }
+    }
+    return group;
+}
 
-    if (!ring->head)
-        ring->head = ring->tail;
+static void filter_group_free(filter_group_t *group)
+{
+    if (!group)
+        return;
+    free(group->buf);
+    free(group->spec);
+    free(group);
+}
 
-    ++ring->tail;
-    if (ring->tail >= ring->data + ring->size)
-        ring->tail -= ring->size;
+static int filter_value_match(data_t const *d, char const *values)
+{
+    char str[32];
+    char const *val = str;
+    if (d->type == DATA_STRING)
+        val = d->value.v_ptr;
+    else if (d->type == DATA_INT)
+        snprintf(str, sizeof(str), "%d", d->value.v_int);
+    else
+        return 0;
 
-    if (ring->tail == ring->head)
-        return ring_list_shift(ring);
+    size_t len = strlen(val);
+    for (char const *p = values; p; p = strchr(p, ',')) {
+        if (*p == ',')
+            p++;
+        if (!strncmp(p, val, len) && (p[len] == ',' || p[len] == '\0'))
+            return 1;
+    }
+    return 0;
+}
 
-    return NULL;
+static int filter_group_match(filter_group_t const *group, data_t const *data)
+{
+    for (unsigned i = 0; i < group->terms_len; ++i) {
+        filter_term_t const *term = &group->terms[i];
+        data_t const *d = data;
+        while (d && strcmp(d->key, term->key) != 0)
+            d = d->next;
+        if (!d)
+            return 0;
+        if (term->values && !filter_value_match(d, term->values))
+            return 0;
+    }
+    return 1;
 }
 
-static void **ring_list_iter(ring_list_t *ring)
+// event queue
+
+#if defined(THREADS) && (defined(__GNUC__) || defined(__clang__))
+#define HTTP_SERVER_THREAD
+#define ATOMIC_LOAD(p)            __atomic_load_n((p), __ATOMIC_SEQ_CST)
+#define ATOMIC_STORE(p, v)        __atomic_store_n((p), (v), __ATOMIC_SEQ_CST)
+#define ATOMIC_EXCHANGE(p, v)     __atomic_exchange_n((p), (v), __ATOMIC_SEQ_CST)
+#define ATOMIC_INC(p)             __atomic_fetch_add((p), 1, __ATOMIC_RELAXED)
+#define ATOMIC_DEC(p)             __atomic_fetch_sub((p), 1, __ATOMIC_RELAXED)
+#define ATOMIC_CAS(p, expect, v)  __atomic_compare_exchange_n((p), (expect), (v), 0, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST)
+#elif defined(THREADS) && defined(_MSC_VER)
+#define HTTP_SERVER_THREAD
+#define ATOMIC_LOAD(p)            ((unsigned)InterlockedCompareExchange((LONG volatile *)(p), 0, 0))
+#define ATOMIC_STORE(p, v)        ((void)InterlockedExchange((LONG volatile *)(p), (LONG)(v)))
+#define ATOMIC_EXCHANGE(p, v)     ((unsigned)InterlockedExchange((LONG volatile *)(p), (LONG)(v)))
+#define ATOMIC_INC(p)             ((unsigned)InterlockedIncrement((LONG volatile *)(p)) - 1)
+#define ATOMIC_DEC(p)             ((unsigned)InterlockedDecrement((LONG volatile *)(p)) + 1)
+#define ATOMIC_CAS(p, expect, v)  atomic_cas((p), (expect), (v))
+static int atomic_cas(unsigned *p, unsigned *expect, unsigned v)
 {
-    return ring->head;
+    unsigned old = (unsigned)InterlockedCompareExchange((LONG volatile *)p, (LONG)v, (LONG)*expect);
+    if (old == *expect)
+        return 1;
+    *expect = old;
+    return 0;
 }
+#endif
+
+#ifdef HTTP_SERVER_THREAD
 
-static void **ring_list_next(ring_list_t *ring, void **iter)
+#define EVENT_QUEUE_SIZE 4096 /* a power of two */
+
+typedef struct {
+    unsigned seq; ///< pos + 1 once the cell at pos is filled, pos + size once it is free again
+    data_t *data;
+    char const *json;
+    size_t len;
+} queue_cell_t;
+
+/// Bounded lock-free queue, events from any thread to the server thread.
+typedef struct {
+    queue_cell_t cells[EVENT_QUEUE_SIZE];
+    unsigned head;    ///< next cell to read, only written by the server thread
+    unsigned tail;    ///< next cell to write
+    unsigned wake;    ///< set while a wake up of the server thread is pending
+    unsigned dropped; ///< events dropped on a full queue
+} event_queue_t;
+
+static void event_queue_init(event_queue_t *queue)
 {
-    if (!iter)
-        return NULL;
+    for (unsigned i = 0; i < EVENT_QUEUE_SIZE; ++i)
+        queue->cells[i].seq = i;
+}
 
-    ++iter;
-    if (iter >= ring->data + ring->size)
-        iter -= ring->size;
-    if (iter == ring->tail)
-        iter = NULL;
+// takes ownership of the retained data, returns 0 if the queue is full
+static int event_queue_push(event_queue_t *queue, data_t *data, char const *json, size_t len)
+{
+    unsigned pos = ATOMIC_LOAD(&queue->tail);
+    queue_cell_t *cell;
+    for (;;) {
+        cell = &queue->cells[pos % EVENT_QUEUE_SIZE];
+        int diff = (int)(ATOMIC_LOAD(&cell->seq) - pos);
+        if (diff < 0)
+            return 0; // full
+        if (diff > 0)
+            pos = ATOMIC_LOAD(&queue->tail); // another thread got this cell
+        else if (ATOMIC_CAS(&queue->tail, &pos, pos + 1))
+            break;
+    }
+    cell->data = data;
+    cell->json = json;
+    cell->len  = len;
+    ATOMIC_STORE(&cell->seq, pos + 1);
+    return 1;
+}
 
-    return iter;
+// only called on the server thread, returns 0 if the queue is empty
+static int event_queue_pop(event_queue_t *queue, queue_cell_t *out)
+{
+    unsigned pos = queue->head;
+    queue_cell_t *cell = &queue->cells[pos % EVENT_QUEUE_SIZE];
+    if ((int)(ATOMIC_LOAD(&cell->seq) - (pos + 1)) < 0)
+        return 0; // empty
+    *out = *cell;
+    ATOMIC_STORE(&cell->seq, pos + EVENT_QUEUE_SIZE);
+    ATOMIC_STORE(&queue->head, pos + 1);
+    return 1;
 }
 
+#else
+// without the server thread everything runs on the main loop
+#define ATOMIC_LOAD(p) (*(p))
+#define ATOMIC_INC(p)  ((*(p))++)
+#define ATOMIC_DEC(p)  ((*(p))--)
+#endif /* HTTP_SERVER_THREAD */
+
 // data helpers that could go into r_api
 
 static data_t *meta_data(r_cfg_t *cfg)
@@ -559,25 +793,22 @@ static void rpc_exec(rpc_t *rpc, r_cfg_t *cfg)
         rpc->response(rpc, 2, NULL, cfg->conversion_mode);
     }
     else if (!strcmp(rpc->method, "get_stats")) {
-        char buf[20480]; // we expect the stats string to be around 15k bytes.
         data_t *data = create_report_data(cfg, 2/*report active devices*/);
         // flush_report_data(cfg); // snapshot, do not flush
-        data_print_jsons(data, buf, sizeof(buf));
-        rpc->response(rpc, 1, buf, 0);
+        char const *json = data_jsons(data, NULL);
+        rpc->response(rpc, json ? 1 : -1, json ? json : "Out of memory", 0);
         data_free(data);
     }
     else if (!strcmp(rpc->method, "get_meta")) {
-        char buf[2048]; // we expect the meta string to be around 500 bytes.
         data_t *data = meta_data(cfg);
-        data_print_jsons(data, buf, sizeof(buf));
-        rpc->response(rpc, 1, buf, 0);
+        char const *json = data_jsons(data, NULL);
+        rpc->response(rpc, json ? 1 : -1, json ? json : "Out of memory", 0);
         data_free(data);
     }
     else if (!strcmp(rpc->method, "get_protocols")) {
-        char buf[102400]; // we expect the protocol string to be around 80k bytes.
         data_t *data = protocols_data(cfg);
-        data_print_jsons(data, buf, sizeof(buf));
-        rpc->response(rpc, 1, buf, 0);
+        char const *json = data_jsons(data, NULL);
+        rpc->response(rpc, json ? 1 : -1, json ? json : "Out of memory", 0);
         data_free(data);
     }
 
@@ -675,18 +906,109 @@ static void rpc_exec(rpc_t *rpc, r_cfg_t *cfg)
 
 #define KEEP_ALIVE 60 /* seconds */
 
+/// Marks event stream connections, their user_data is a struct nc_context.
+#define MG_F_EVENT_STREAM MG_F_USER_1
+
+typedef struct rpc_call rpc_call_t;
+
 struct http_server_context {
     struct mg_connection *conn;
     struct mg_serve_http_opts server_opts;
     r_cfg_t *cfg;
     struct data_output *output;
-    ring_list_t *history;
+    event_history_t history;
+    filter_group_t *groups[MAX_FILTER_GROUPS];
+    unsigned clients;               ///< number of event stream connections
+    struct mg_mgr *mgr;             ///< the server manager, polled on the server thread
+    struct mg_mgr *main_mgr;        ///< the main manager, rpc calls are executed on its thread
+#ifdef HTTP_SERVER_THREAD
+    struct mg_mgr server_mgr;
+    struct mg_connection *main_conn; ///< receives rpc calls on the main manager
+    rpc_call_t *calls;              ///< pending rpc calls, only used on the server thread
+    event_queue_t queue;
+    pthread_t thread;
+    unsigned stop;                  ///< set to stop the server thread
+#endif
+};
+
+enum stream_type {
+    STREAM_WEBSOCKET,
+    STREAM_CHUNKED,
+    STREAM_PLAIN,
 };
 
 struct nc_context {
-    int is_chunked;
+    struct http_server_context *server;
+    enum stream_type type;
+    uint64_t seq;     ///< sequence number of the next event to send
+    int group;        ///< filter group, -1 for all events
+    size_t queue_max; ///< hold back events while this many bytes are unsent
+    int paused;       ///< don't send events until the meta was sent
 };
 
+static struct http_server_context *server_context(struct mg_connection *nc)
+{
+    if (nc->flags & MG_F_EVENT_STREAM) {
+        struct nc_context *cctx = nc->user_data;
+        return cctx->server;
+    }
+    return nc->user_data;
+}
+
+// Find or create the filter group for a query.
+// Returns -1 for no filter, -2 if there are too many distinct filters, and -3 for an invalid filter.
+static int filter_group_acquire(struct http_server_context *ctx, struct mg_str const *query)
+{
+    char *spec;
+    if (filter_spec(query, &spec) < 0)
+        return -3;
+    if (!spec)
+        return -1;
+
+    int slot = -1;
+    for (int i = 0; i < MAX_FILTER_GROUPS; ++i) {
+        if (ctx->groups[i] && !strcmp(ctx->groups[i]->spec, spec)) {
+            free(spec);
+            ctx->groups[i]->refs++;
+            return i;
+        }
+        if (!ctx->groups[i] && slot < 0)
+            slot = i;
+    }
+    if (slot < 0) {
+        print_logf(LOG_WARNING, "HTTP server", "Too many distinct filters, rejecting \"%s\"", spec);
+        free(spec);
+        return -2;
+    }
+
+    filter_group_t *group = filter_group_create(spec);
+    if (!group)
+        return -2; // NOTE: reject on alloc failure.
+    group->refs       = 1;
+    ctx->groups[slot] = group;
+
+    // evaluate the new filter on the history for replay
+    uint64_t bit = (uint64_t)1 << slot;
+    for (uint64_t seq = event_history_first(&ctx->history); seq < ctx->history.seq; ++seq) {
+        event_entry_t *entry = event_history_at(&ctx->history, seq);
+        if (filter_group_match(group, entry->data))
+            entry->match |= bit;
+        else
+            entry->match &= ~bit;
+    }
+    return slot;
+}
+
+static void filter_group_release(struct http_server_context *ctx, int slot)
+{
+    if (slot < 0 || !ctx->groups[slot])
+        return;
+    if (--ctx->groups[slot]->refs == 0) {
+        filter_group_free(ctx->groups[slot]);
+        ctx->groups[slot] = NULL;
+    }
+}
+
 static void handle_options(struct mg_connection *nc, struct http_message *hm)
 {
     UNUSED(hm);
@@ -735,76 +1057,6 @@ static void handle_redirect(struct mg_connection *nc, struct http_message *hm)
             "\r\n\r\n");
 }
 
-static void handle_openmetrics(struct mg_connection *nc, struct http_message *hm)
-{
-    if (mg_vcmp(&hm->method, "GET") != 0) {
-        mg_http_send_error(nc, 405, NULL); // 405 Method Not Allowed
-        return;
-    }
-
-    struct http_server_context *ctx = nc->user_data;
-    r_cfg_t *cfg = ctx->cfg;
-
-    time_t now;
-    time(&now);
-
-    char buf[2000];
-    int len = snprintf(buf, sizeof(buf),
-            "# TYPE uptime_seconds counter\n"
-            "# UNIT uptime_seconds seconds\n"
-            "# HELP uptime_seconds Program uptime.\n"
-            "uptime_seconds_total %.1f\n"
-            "uptime_seconds_created %.1f\n"
-            "# TYPE decoder_enabled gauge\n"
-            "# HELP decoder_enabled Number of enabled decoders.\n"
-            "decoder_enabled %u\n"
-            "# TYPE input_uptime_seconds counter\n"
-            "# UNIT input_uptime_seconds seconds\n"
-            "# HELP input_uptime_seconds SDR Receiver uptime.\n"
-            "input_uptime_seconds_total %.1f\n"
-            "input_uptime_seconds_created %.1f\n"
-            "# TYPE input_count_frames counter\n"
-            "# UNIT input_count_frames frames\n"
-            "# HELP input_count_frames Number of SDR frames received.\n"
-            "input_count_frames_total %u\n"
-            "# TYPE input_squelch_frames counter\n"
-            "# UNIT input_squelch_frames frames\n"
-            "# HELP input_squelch_frames Number of SDR frames skipped by squelch.\n"
-            "input_squelch_frames_total %u\n"
-            "# TYPE input_ook_frames counter\n"
-            "# UNIT input_ook_frames frames\n"
-            "# HELP input_ook_frames Number of SDR frames with OOK demodulation.\n"
-            "input_ook_frames_total %u\n"
-            "# TYPE input_fsk_frames counter\n"
-            "# UNIT input_fsk_frames frames\n"
-            "# HELP input_fsk_frames Number of SDR frames with FSK demodulation.\n"
-            "input_fsk_frames_total %u\n"
-            "# TYPE input_event_frames counter\n"
-            "# UNIT input_event_frames frames\n"
-            "# HELP input_event_frames Number of SDR frames with decode events.\n"
-            "input_event_frames_total %u\n"
-            "# EOF\n",
-            (float)(now - cfg->running_since), // uptime_seconds_total,
-            (float)cfg->running_since,         // uptime_seconds_created,
-            (unsigned)cfg->demod->r_devs.len,  // decoder_enabled,
-            (float)(now - cfg->sdr_since),     // input_uptime_seconds_total,
-            (float)cfg->sdr_since,             // input_uptime_seconds_created,
-            cfg->total_frames_count,           // input_count_frames_total,
-            cfg->total_frames_squelch,         // input_squelch_frames_total,
-            cfg->total_frames_ook,             // input_ook_frames_total,
-            cfg->total_frames_fsk,             // input_fsk_frames_total,
-            cfg->total_frames_events);         // input_event_frames_total,
-
-    mg_printf(nc,
-            "HTTP/1.1 200 OK\r\n"
-            "Content-Length: %u\r\n"
-            "Content-Type: text/plain; version=0.0.4; charset=utf-8\r\n"
-            "\r\n",
-            len);
-    mg_send(nc, buf, (size_t)len);
-    nc->flags |= MG_F_SEND_AND_CLOSE;
-}
-
 // reply to ws command
 static void rpc_response_ws(rpc_t *rpc, int ret_code, char const *message, int arg)
 {
@@ -909,46 +1161,350 @@ static void rpc_response_jsoncmd(rpc_t *rpc, int ret_code, char const *message,
     mg_send_http_chunk(rpc->nc, "", 0); /* Send empty chunk, the end of response */
 }
 
+static int event_wanted(struct nc_context const *cctx, event_entry_t const *entry)
+{
+    return cctx->group < 0 || (entry->match >> cctx->group & 1);
+}
+
+// Send the events a client has not seen yet, HTTP streams get all of them in a single chunk.
+static void send_events(struct mg_connection *nc)
+{
+    struct nc_context *cctx = nc->user_data;
+    event_history_t *history = &cctx->server->history;
+
+    if (cctx->paused || cctx->seq == history->seq)
+        return; // nothing new
+    if (nc->send_mbuf.len > cctx->queue_max)
+        return; // slow client, hold back events
+
+    if (cctx->seq < event_history_first(history)) {
+        print_logf(LOG_NOTICE, "HTTP server", "Dropping slow client, %u events behind",
+                (unsigned)(history->seq - cctx->seq));
+        nc->flags |= MG_F_CLOSE_IMMEDIATELY;
+        return;
+    }
+
+    if (cctx->type == STREAM_WEBSOCKET) {
+        for (; cctx->seq < history->seq; ++cctx->seq) {
+            event_entry_t *entry = event_history_at(history, cctx->seq);
+            if (event_wanted(cctx, entry))
+                mg_send_websocket_frame(nc, WEBSOCKET_OP_TEXT, entry->json, entry->len);
+        }
+        return;
+    }
+
+    size_t total = 0;
+    for (uint64_t seq = cctx->seq; seq < history->seq; ++seq) {
+        event_entry_t *entry = event_history_at(history, seq);
+        if (event_wanted(cctx, entry))
+            total += entry->len + 2; // CRLF
+    }
+    if (!total) {
+        cctx->seq = history->seq;
+        return; // nothing matched
+    }
+
+    if (cctx->type == STREAM_CHUNKED)
+        mg_printf(nc, "%lX\r\n", (unsigned long)total);
+    for (; cctx->seq < history->seq; ++cctx->seq) {
+        event_entry_t *entry = event_history_at(history, cctx->seq);
+        if (event_wanted(cctx, entry)) {
+            mg_send(nc, entry->json, entry->len);
+            mg_send(nc, "\r\n", 2);
+        }
+    }
+    if (cctx->type == STREAM_CHUNKED)
+        mg_send(nc, "\r\n", 2);
+
+    mg_set_timer(nc, mg_time() + KEEP_ALIVE); // reset keep alive timer
+}
+
+// Subscribe a connection to events, with up to "replay" events from the history.
+// The query can set "replay", a send "queue" limit in bytes, and filters on model, id, channel and has.
+// Returns -2 if there are too many filters and -3 if the filter is invalid.
+static int subscribe_events(struct mg_connection *nc, struct http_message *hm, enum stream_type type, unsigned replay)
+{
+    struct http_server_context *ctx = nc->user_data;
+
+    char buf[16];
+    size_t queue_max = DEFAULT_SEND_QUEUE;
+    if (hm && mg_get_http_var(&hm->query_string, "replay", buf, sizeof(buf)) > 0)
+        replay = (unsigned)atoiv(buf, 0);
+    if (hm && mg_get_http_var(&hm->query_string, "queue", buf, sizeof(buf)) > 0)
+        queue_max = (size_t)atoiv(buf, DEFAULT_SEND_QUEUE);
+
+    int group = hm ? filter_group_acquire(ctx, &hm->query_string) : -1;
+    if (group < -1)
+        return group;
+
+    struct nc_context *cctx = calloc(1, sizeof(*cctx));
+    if (!cctx) {
+        WARN_CALLOC("subscribe_events()");
+        filter_group_release(ctx, group);
+        return 0; // NOTE: the client receives no events on alloc failure.
+    }
+    cctx->server    = ctx;
+    cctx->type      = type;
+    cctx->group     = group;
+    cctx->queue_max = queue_max;
+    uint64_t first  = event_history_first(&ctx->history);
+    cctx->seq       = ctx->history.seq - first > replay ? ctx->history.seq - replay : first;
+
+    nc->user_data = cctx;
+    nc->flags |= MG_F_EVENT_STREAM;
+    ATOMIC_INC(&ctx->clients);
+    return 0;
+}
+
+static void handle_filter_rejected(struct mg_connection *nc, int reason)
+{
+    if (reason == -3) {
+        mg_printf(nc, "HTTP/1.1 400 Bad Request\r\n"
+                      "Content-Length: 0\r\n"
+                      "\r\n");
+    }
+    else {
+        mg_printf(nc, "HTTP/1.1 503 Service Unavailable\r\n"
+                      "Content-Length: 0\r\n"
+                      "\r\n");
+    }
+    nc->flags |= MG_F_SEND_AND_CLOSE;
+}
+
 // {"cmd":"sample_rate","val":1024000}
 // http --stream --timeout=70 :8433/events
 //s.a. https://developer.twitter.com/en/docs/tutorials/consuming-streaming-data.html
 static void handle_json_events(struct mg_connection *nc, struct http_message *hm)
 {
-    UNUSED(hm);
-    /* Send headers */
-    mg_printf(nc, "HTTP/1.1 200 OK\r\nTransfer-Encoding: chunked\r\n\r\n");
-
     /* Mark connection */
-    struct nc_context *ctx = calloc(1, sizeof(*ctx));
-    if (!ctx) {
-        WARN_CALLOC("handle_json_events()");
+    int ret = subscribe_events(nc, hm, STREAM_CHUNKED, 0);
+    if (ret < 0) {
+        handle_filter_rejected(nc, ret);
         return;
     }
-    ctx->is_chunked = 1;
-    nc->user_data   = ctx;
 
+    /* Send headers */
+    mg_printf(nc, "HTTP/1.1 200 OK\r\nTransfer-Encoding: chunked\r\n\r\n");
+
+    if (nc->flags & MG_F_EVENT_STREAM)
+        send_events(nc);
     mg_set_timer(nc, mg_time() + KEEP_ALIVE); // set keep alive timer
 }
 
 // (echo "GET /stream HTTP/1.0\n"; sleep 600) | socat - tcp:127.0.0.1:8433
 static void handle_json_stream(struct mg_connection *nc, struct http_message *hm)
 {
-    UNUSED(hm);
+    /* Mark connection */
+    int ret = subscribe_events(nc, hm, STREAM_PLAIN, 0);
+    if (ret < 0) {
+        handle_filter_rejected(nc, ret);
+        return;
+    }
+
     /* Send headers */
     mg_printf(nc, "HTTP/1.1 200 OK\r\n\r\n");
 
-    /* Mark connection */
-    struct nc_context *ctx = calloc(1, sizeof(*ctx));
-    if (!ctx) {
-        WARN_CALLOC("handle_json_stream()");
+    if (nc->flags & MG_F_EVENT_STREAM)
+        send_events(nc);
+    mg_set_timer(nc, mg_time() + KEEP_ALIVE); // set keep alive timer
+}
+
+// rpc calls
+
+typedef void (*rpc_exec_fn)(rpc_t *rpc, r_cfg_t *cfg);
+
+/// A request executed on the main thread, the response is sent on the server thread.
+struct rpc_call {
+    rpc_t rpc;               ///< the request, the response is captured
+    rpc_response_fn respond; ///< sends the captured response
+    rpc_exec_fn exec;
+    int answered;
+    int ret_code;
+    char *message;
+    int arg;
+    struct rpc_call *next;
+};
+
+typedef struct {
+    struct http_server_context *server;
+    rpc_call_t *call;
+} rpc_call_msg_t;
+
+// keep the first response, it is sent later on the server thread
+static void rpc_response_capture(rpc_t *rpc, int ret_code, char const *message, int arg)
+{
+    rpc_call_t *call = (rpc_call_t *)rpc;
+    if (call->answered)
         return;
+    call->answered = 1;
+    call->ret_code = ret_code;
+    call->arg      = arg;
+    if (message) {
+        call->message = strdup(message);
+        if (!call->message) {
+            WARN_STRDUP("rpc_response_capture()");
+            call->ret_code = -1;
+        }
     }
-    ctx->is_chunked = 0;
-    nc->user_data   = ctx;
+}
 
-    mg_set_timer(nc, mg_time() + KEEP_ALIVE); // set keep alive timer
+static void rpc_call_reply(rpc_call_t *call)
+{
+    if (!call->rpc.nc || !call->answered)
+        return; // the connection was closed
+    char const *message = call->message;
+    if (!message && call->ret_code < 0)
+        message = "Out of memory";
+    call->rpc.response = call->respond;
+    call->respond(&call->rpc, call->ret_code, message, call->arg);
+}
+
+static void rpc_call_free(rpc_call_t *call)
+{
+    free(call->rpc.method);
+    free(call->rpc.arg);
+    free(call->rpc.id);
+    free(call->message);
+    free(call);
+}
+
+#ifdef HTTP_SERVER_THREAD
+// the handler of the connection on the main manager
+static void http_main_handler(struct mg_connection *nc, int ev, void *ev_data)
+{
+    UNUSED(nc);
+    UNUSED(ev);
+    UNUSED(ev_data);
+}
+
+// called on the server thread for each connection
+static void rpc_reply_handler(struct mg_connection *nc, int ev, void *ev_data)
+{
+    rpc_call_msg_t *msg = ev_data;
+    if (ev != MG_EV_POLL || nc != msg->server->conn)
+        return;
+
+    for (rpc_call_t **p = &msg->server->calls; *p; p = &(*p)->next) {
+        if (*p == msg->call) {
+            *p = msg->call->next;
+            rpc_call_reply(msg->call);
+            rpc_call_free(msg->call);
+            break;
+        }
+    }
+}
+
+// called on the main thread for each connection
+static void rpc_call_handler(struct mg_connection *nc, int ev, void *ev_data)
+{
+    rpc_call_msg_t *msg = ev_data;
+    if (ev != MG_EV_POLL || nc->handler != http_main_handler || nc->user_data != msg->server)
+        return; // not our connection or the server was stopped
+
+    msg->call->exec(&msg->call->rpc, msg->server->cfg);
+    mg_broadcast(msg->server->mgr, rpc_reply_handler, msg, sizeof(*msg));
+}
+#endif
+
+// Execute a request on the main thread, takes ownership of the method, arg, and id strings.
+// The response is sent to the connection later, returns -1 on alloc failure.
+static int rpc_dispatch(struct mg_connection *nc, rpc_t const *rpc, rpc_exec_fn exec)
+{
+    struct http_server_context *ctx = server_context(nc);
+
+    rpc_call_t *call = calloc(1, sizeof(*call));
+    if (!call) {
+        WARN_CALLOC("rpc_dispatch()");
+        free(rpc->method);
+        free(rpc->arg);
+        free(rpc->id);
+        return -1;
+    }
+    call->rpc          = *rpc;
+    call->rpc.nc       = nc;
+    call->rpc.response = rpc_response_capture;
+    call->respond      = rpc->response;
+    call->exec         = exec;
+
+#ifdef HTTP_SERVER_THREAD
+    // input files are decoded without polling the main manager, a call would never be executed
+    if (ctx->cfg->in_files.len) {
+        call->rpc.response(&call->rpc, -1, "Not available with file input", 0);
+        rpc_call_reply(call);
+        rpc_call_free(call);
+        return 0;
+    }
+    call->next = ctx->calls;
+    ctx->calls = call;
+    rpc_call_msg_t msg = {.server = ctx, .call = call};
+    mg_broadcast(ctx->main_mgr, rpc_call_handler, &msg, sizeof(msg));
+#else
+    exec(&call->rpc, ctx->cfg);
+    rpc_call_reply(call);
+    rpc_call_free(call);
+#endif
+    return 0;
+}
+
+static void openmetrics_exec(rpc_t *rpc, r_cfg_t *cfg)
+{
+    size_t len = 0;
+    char *buf = metrics_render(cfg->metrics, &len);
+    if (!buf) {
+        rpc->response(rpc, -1, "Out of memory", 0);
+        return;
+    }
+    rpc->response(rpc, 1, buf, (int)len);
+    free(buf);
+}
+
+// OpenMetrics of the server, called on the main thread
+static void collect_http_metrics(metrics_out_t *out, void *ctx)
+{
+    struct http_server_context *server = ctx;
+
+    metrics_family(out, "http_clients", "gauge", NULL, "Number of HTTP event stream clients.");
+    metrics_count(out, "http_clients", NULL, ATOMIC_LOAD(&server->clients));
+#ifdef HTTP_SERVER_THREAD
+    event_queue_t *queue = &server->queue;
+    metrics_family(out, "http_queued_events", "gauge", "events", "Number of events queued for the HTTP server thread.");
+    metrics_count(out, "http_queued_events", NULL, ATOMIC_LOAD(&queue->tail) - ATOMIC_LOAD(&queue->head));
+    metrics_family(out, "http_dropped_events", "counter", "events", "Number of events dropped on a full HTTP server queue.");
+    metrics_count(out, "http_dropped_events_total", NULL, ATOMIC_LOAD(&queue->dropped));
+#endif
+}
+
+static void rpc_response_openmetrics(rpc_t *rpc, int ret_code, char const *message, int arg)
+{
+    if (ret_code < 0) {
+        mg_http_send_error(rpc->nc, 500, NULL); // 500 Internal Server Error
+        return;
+    }
+    mg_printf(rpc->nc,
+            "HTTP/1.1 200 OK\r\n"
+            "Content-Length: %u\r\n"
+            "Content-Type: text/plain; version=0.0.4; charset=utf-8\r\n"
+            "\r\n",
+            (unsigned)arg);
+    mg_send(rpc->nc, message, (size_t)arg);
+    rpc->nc->flags |= MG_F_SEND_AND_CLOSE;
+}
+
+static void handle_openmetrics(struct mg_connection *nc, struct http_message *hm)
+{
+    if (mg_vcmp(&hm->method, "GET") != 0) {
+        mg_http_send_error(nc, 405, NULL); // 405 Method Not Allowed
+        return;
+    }
+
+    rpc_t rpc = {
+            .nc       = nc,
+            .response = rpc_response_openmetrics,
+    };
+    rpc_dispatch(nc, &rpc, openmetrics_exec);
 }
 
+
 // Handles GET with query string and POST with form-encoded body
 // curl -D - 'http://127.0.0.1:8433/cmd?cmd=report_meta&arg=level'
 // curl -D - -d "cmd=report_meta&arg=level" -X POST 'http://127.0.0.1:8433/cmd'
@@ -959,13 +1515,10 @@ static void handle_json_stream(struct mg_connection *nc, struct http_message *hm
 // xh :8433/cmd cmd==gain arg==10
 static void handle_cmd_rpc(struct mg_connection *nc, struct http_message *hm)
 {
-    struct http_server_context *ctx = nc->user_data;
     char cmd[100], arg[100], val[100];
     rpc_t rpc = {
             .nc = nc,
             .response = rpc_response_jsoncmd,
-            .method = cmd,
-            .arg = arg,
     };
 
     /* Send headers */
@@ -987,15 +1540,27 @@ static void handle_cmd_rpc(struct mg_connection *nc, struct http_message *hm)
     rpc.val = strtol(val, &endptr, 10);
     fprintf(stderr, "POST Got %s, arg %s, val %s (%u)\n", cmd, arg, val, rpc.val);
 
-    rpc_exec(&rpc, ctx->cfg);
+    rpc.method = strdup(cmd);
+    if (!rpc.method) {
+        WARN_STRDUP("handle_cmd_rpc()");
+        rpc_response_jsoncmd(&rpc, -1, "Out of memory", 0);
+        return;
+    }
+    rpc.arg = strdup(arg);
+    if (!rpc.arg) {
+        WARN_STRDUP("handle_cmd_rpc()");
+        rpc_response_jsoncmd(&rpc, -1, "Out of memory", 0);
+        free(rpc.method);
+        return;
+    }
+    if (rpc_dispatch(nc, &rpc, rpc_exec) < 0)
+        rpc_response_jsoncmd(&rpc, -1, "Out of memory", 0);
 }
 
 // Handles POST with JSONRPC command
 // http POST :8433/jsonrpc jsonrpc=2.0 method=sample_rate params:='[1024000]'
 static void handle_json_rpc(struct mg_connection *nc, struct http_message *hm)
 {
-    struct http_server_context *ctx = nc->user_data;
-
     rpc_t rpc = {
             .nc       = nc,
             .response = rpc_response_jsonrpc,
@@ -1007,7 +1572,9 @@ static void handle_json_rpc(struct mg_connection *nc, struct http_message *hm)
     /* Parse JSON */
     int ret = jsonrpc_parse(&rpc, &hm->body);
     if (!ret) {
-        rpc_exec(&rpc, ctx->cfg);
+        if (rpc_dispatch(nc, &rpc, rpc_exec) < 0)
+            rpc_response_jsonrpc(&rpc, -1, "Out of memory", 0);
+        return; // the call owns the strings
     }
     else {
         char *error = "{\"error\":\"Invalid command\"}";
@@ -1022,7 +1589,7 @@ static void handle_json_rpc(struct mg_connection *nc, struct http_message *hm)
 // Handles WS with JSON command
 static void handle_ws_rpc(struct mg_connection *nc, struct websocket_message *wm)
 {
-    struct http_server_context *ctx = nc->user_data;
+    struct http_server_context *ctx = server_context(nc);
 
     rpc_t rpc = {
             .nc       = nc,
@@ -1033,8 +1600,27 @@ static void handle_ws_rpc(struct mg_connection *nc, struct websocket_message *wm
 
     /* Parse JSON */
     int ret = json_parse(&rpc, &d);
-    if (!ret) {
-        rpc_exec(&rpc, ctx->cfg);
+    if (!ret && !strcmp(rpc.method, "subscribe") && (nc->flags & MG_F_EVENT_STREAM)) {
+        // {"cmd":"subscribe","arg":"model=Foo&has=temperature_C"}, an empty arg removes the filter
+        struct nc_context *cctx = nc->user_data;
+        struct mg_str query     = mg_mk_str(rpc.arg ? rpc.arg : "");
+        int group               = filter_group_acquire(ctx, &query);
+        if (group == -3) {
+            rpc_response_ws(&rpc, -1, "Invalid filter", 0);
+        }
+        else if (group < -1) {
+            rpc_response_ws(&rpc, -1, "Too many filters", 0);
+        }
+        else {
+            filter_group_release(ctx, cctx->group);
+            cctx->group = group;
+            rpc_response_ws(&rpc, 0, "Ok", 0);
+        }
+    }
+    else if (!ret) {
+        if (rpc_dispatch(nc, &rpc, rpc_exec) < 0)
+            rpc_response_ws(&rpc, -1, "Out of memory", 0);
+        return; // the call owns the strings
     }
     else {
         char *error = "{\"error\":\"Invalid command\"}";
@@ -1046,6 +1632,53 @@ static void handle_ws_rpc(struct mg_connection *nc, struct websocket_message *wm
     free(rpc.arg);
 }
 
+// send the meta, then the history
+static void rpc_response_meta(rpc_t *rpc, int ret_code, char const *message, int arg)
+{
+    struct mg_connection *nc = rpc->nc;
+    if (ret_code == 1)
+        rpc_response_ws(rpc, ret_code, message, arg);
+    if (nc->flags & MG_F_EVENT_STREAM) {
+        struct nc_context *cctx = nc->user_data;
+        cctx->paused = 0;
+        send_events(nc);
+    }
+}
+
+// New websocket request, subscribe with the query while the request is still intact.
+static void handle_ws_request(struct mg_connection *nc, struct http_message *hm)
+{
+    struct http_server_context *ctx = nc->user_data;
+
+    int ret = subscribe_events(nc, hm, STREAM_WEBSOCKET, ctx->history.size);
+    if (ret < 0) {
+        handle_filter_rejected(nc, ret); // the handshake is skipped
+        return;
+    }
+
+    // the meta is read on the main thread, hold back events until it was sent
+    if (nc->flags & MG_F_EVENT_STREAM) {
+        struct nc_context *cctx = nc->user_data;
+        cctx->paused = 1;
+    }
+}
+
+// New websocket connection, send meta and history.
+static void handle_ws_connect(struct mg_connection *nc)
+{
+    rpc_t rpc = {
+            .nc       = nc,
+            .response = rpc_response_meta,
+    };
+    rpc.method = strdup("get_meta");
+    if (!rpc.method) {
+        WARN_STRDUP("handle_ws_connect()");
+    }
+    if (!rpc.method || rpc_dispatch(nc, &rpc, rpc_exec) < 0) {
+        rpc_response_meta(&rpc, -1, NULL, 0);
+    }
+}
+
 static void ev_handler(struct mg_connection *nc, int ev, void *ev_data);
 
 static void send_keep_alive(struct mg_connection *nc)
@@ -1053,11 +1686,11 @@ static void send_keep_alive(struct mg_connection *nc)
     if (nc->handler != ev_handler)
         return; // this should not happen
 
-    struct nc_context *ctx = nc->user_data;
-    if (!ctx)
+    if (!(nc->flags & MG_F_EVENT_STREAM))
         return; // this should not happen
 
-    if (ctx->is_chunked) {
+    struct nc_context *ctx = nc->user_data;
+    if (ctx->type == STREAM_CHUNKED) {
         mg_send_http_chunk(nc, "\r\n", 2);
     }
     else {
@@ -1068,21 +1701,24 @@ static void send_keep_alive(struct mg_connection *nc)
 
 static void ev_handler(struct mg_connection *nc, int ev, void *ev_data)
 {
+    if (!server_context(nc) && ev != MG_EV_CLOSE)
+        return; // the server was stopped
+
     switch (ev) {
+    case MG_EV_POLL:
+        if (nc->flags & MG_F_EVENT_STREAM)
+            send_events(nc);
+        break;
     case MG_EV_TIMER:
         send_keep_alive(nc);
         break;
-    case MG_EV_WEBSOCKET_HANDSHAKE_DONE: {
-        struct http_server_context *ctx = nc->user_data;
-        /* New websocket connection. Send meta. */
-        data_t *meta = meta_data(ctx->cfg);
-        data_output_print(ctx->output, meta);
-        data_free(meta);
-        /* Send history */
-        for (void **iter = ring_list_iter(ctx->history); iter; iter = ring_list_next(ctx->history, iter))
-            mg_send_websocket_frame(nc, WEBSOCKET_OP_TEXT, (char *)*iter, strlen((char *)*iter));
+    case MG_EV_WEBSOCKET_HANDSHAKE_REQUEST:
+        handle_ws_request(nc, (struct http_message *)ev_data);
+        break;
+    case MG_EV_WEBSOCKET_HANDSHAKE_DONE:
+        // NOTE: the request was already removed from the receive buffer
+        handle_ws_connect(nc);
         break;
-    }
     case MG_EV_WEBSOCKET_FRAME: {
         struct websocket_message *wm = (struct websocket_message *)ev_data;
 
@@ -1130,53 +1766,128 @@ static void ev_handler(struct mg_connection *nc, int ev, void *ev_data)
     }
     case MG_EV_CLOSE:
         //fprintf(stderr, "MG_EV_CLOSE %p %p %p\n", ev_data, nc, nc->user_data);
+#ifdef HTTP_SERVER_THREAD
+        if (server_context(nc)) {
+            // drop the responses to pending calls
+            for (rpc_call_t *call = server_context(nc)->calls; call; call = call->next) {
+                if (call->rpc.nc == nc)
+                    call->rpc.nc = NULL;
+            }
+        }
+#endif
+        if (nc->flags & MG_F_EVENT_STREAM) {
+            struct nc_context *cctx = nc->user_data;
+            if (cctx->server) {
+                filter_group_release(cctx->server, cctx->group);
+                ATOMIC_DEC(&cctx->server->clients);
+            }
+            free(nc->user_data);
+            nc->user_data = NULL;
+            nc->flags &= ~MG_F_EVENT_STREAM;
+        }
         break;
     default:
         break;
     }
 }
 
-static int is_websocket(const struct mg_connection *nc)
+// queue an event for all clients, each connection sends it on the next poll
+static void http_broadcast_send(struct http_server_context *ctx, data_t *data, char const *json, size_t len)
 {
-    return nc->flags & MG_F_IS_WEBSOCKET;
+    // a burst can outrun the polls, once per lap send all events the ring is about to overwrite
+    if (ctx->history.seq && ctx->history.seq % ctx->history.size == 0) {
+        struct mg_mgr *mgr = ctx->mgr;
+        for (struct mg_connection *nc = mg_next(mgr, NULL); nc != NULL; nc = mg_next(mgr, nc)) {
+            if (nc->handler == ev_handler && (nc->flags & MG_F_EVENT_STREAM))
+                send_events(nc);
+        }
+    }
+
+    uint64_t match = 0;
+    for (int i = 0; i < MAX_FILTER_GROUPS; ++i) {
+        if (ctx->groups[i] && filter_group_match(ctx->groups[i], data))
+            match |= (uint64_t)1 << i;
+    }
+    event_history_push(&ctx->history, data, json, len, match);
 }
 
-// event handler to broadcast to all our sockets
-static void http_broadcast_send(struct http_server_context *ctx, char const *msg, size_t len)
-{
-    struct mg_connection *nc;
-    struct mg_mgr *mgr = ctx->conn->mgr;
+#define SHUTDOWN_JSON "{\"shutdown\":\"goodbye\"}"
 
-    char *dup = strdup(msg);
-    if (!dup) {
-        WARN_STRDUP("http_broadcast_send()");
-    }
-    else {
-        free(ring_list_push(ctx->history, dup));
-    }
+// close the server, send pending events and close connections with a goodbye
+static void http_server_goodbye(struct http_server_context *ctx)
+{
+    ctx->conn->user_data = NULL;
+    ctx->conn->flags |= MG_F_CLOSE_IMMEDIATELY;
 
-    for (nc = mg_next(mgr, NULL); nc != NULL; nc = mg_next(mgr, nc)) {
-        if (nc->handler != ev_handler)
+    struct mg_mgr *mgr = ctx->mgr;
+    for (struct mg_connection *nc = mg_next(mgr, NULL); nc != NULL; nc = mg_next(mgr, nc)) {
+        if (nc->handler != ev_handler || !(nc->flags & MG_F_EVENT_STREAM))
             continue;
 
-        struct nc_context *cctx = nc->user_data; // might not be valid
-        if (is_websocket(nc)) {
-            mg_send_websocket_frame(nc, WEBSOCKET_OP_TEXT, msg, len);
+        struct nc_context *cctx = nc->user_data;
+        send_events(nc);
+        if (cctx->type == STREAM_WEBSOCKET) {
+            mg_send_websocket_frame(nc, WEBSOCKET_OP_TEXT, SHUTDOWN_JSON, sizeof(SHUTDOWN_JSON) - 1);
         }
-        else if (cctx && cctx->is_chunked) {
-            mg_send_http_chunk(nc, msg, len);
+        else if (cctx->type == STREAM_CHUNKED) {
+            mg_send_http_chunk(nc, SHUTDOWN_JSON, sizeof(SHUTDOWN_JSON) - 1);
             mg_send_http_chunk(nc, "\r\n", 2);
-            mg_set_timer(nc, mg_time() + KEEP_ALIVE); // reset keep alive timer
+            mg_send_http_chunk(nc, "", 0);            /* Send empty chunk, the end of response */
         }
-        else if (cctx && !cctx->is_chunked) {
-            mg_send(nc, msg, len);
+        else {
+            mg_send(nc, SHUTDOWN_JSON, sizeof(SHUTDOWN_JSON) - 1);
             mg_send(nc, "\r\n", 2);
-            mg_set_timer(nc, mg_time() + KEEP_ALIVE); // reset keep alive timer
         }
+#ifndef HTTP_SERVER_THREAD
+        cctx->server = NULL; // the connection outlives the server on the shared manager
+#endif
+        nc->flags |= MG_F_SEND_AND_CLOSE;
+    }
+}
+
+#ifdef HTTP_SERVER_THREAD
+// move queued events to the history
+static void http_drain_queue(struct http_server_context *ctx)
+{
+    queue_cell_t cell;
+    ATOMIC_EXCHANGE(&ctx->queue.wake, 0);
+    while (event_queue_pop(&ctx->queue, &cell)) {
+        if (ctx->conn)
+            http_broadcast_send(ctx, cell.data, cell.json, cell.len);
+        data_free(cell.data);
+    }
+}
+
+// called on the server thread for each connection
+static void http_wake_handler(struct mg_connection *nc, int ev, void *ev_data)
+{
+    struct http_server_context *ctx = *(struct http_server_context **)ev_data;
+    if (ev != MG_EV_POLL || nc != ctx->conn)
+        return;
+    http_drain_queue(ctx);
+}
+
+static THREAD_RETURN THREAD_CALL server_thread(void *arg)
+{
+    struct http_server_context *ctx = arg;
+
+    while (!ATOMIC_LOAD(&ctx->stop)) {
+        mg_mgr_poll(ctx->mgr, 500);
+        http_drain_queue(ctx); // in case a wake up was lost
     }
+
+    http_drain_queue(ctx);
+    http_server_goodbye(ctx);
+    // give the goodbyes some time to go out
+    for (int i = 0; i < 20 && mg_next(ctx->mgr, NULL); ++i) {
+        mg_mgr_poll(ctx->mgr, 10);
+    }
+
+    return (THREAD_RETURN)(intptr_t)0;
 }
+#endif
 
-static struct http_server_context *http_server_start(struct mg_mgr *mgr, char const *host, char const *port, r_cfg_t *cfg, struct data_output *output)
+static struct http_server_context *http_server_start(struct mg_mgr *mgr, char const *host, char const *port, unsigned history, r_cfg_t *cfg, struct data_output *output)
 {
     struct mg_bind_opts bind_opts;
     const char *err_str;
@@ -1188,9 +1899,19 @@ static struct http_server_context *http_server_start(struct mg_mgr *mgr, char co
         return NULL;
     }
 
-    ctx->cfg     = cfg;
-    ctx->output  = output;
-    ctx->history = ring_list_new(DEFAULT_HISTORY_SIZE);
+    ctx->cfg      = cfg;
+    ctx->output   = output;
+    ctx->main_mgr = mgr;
+    ctx->mgr      = mgr;
+    if (event_history_init(&ctx->history, history) < 0) {
+        free(ctx);
+        return NULL; // NOTE: returns NULL on alloc failure.
+    }
+#ifdef HTTP_SERVER_THREAD
+    event_queue_init(&ctx->queue);
+    mg_mgr_init(&ctx->server_mgr, NULL);
+    ctx->mgr = &ctx->server_mgr;
+#endif
 
     char address[253 + 6 + 1]; // dns max + port
     // if the host is an IPv6 address it needs quoting
@@ -1204,11 +1925,14 @@ static struct http_server_context *http_server_start(struct mg_mgr *mgr, char co
     bind_opts.user_data = ctx;
     bind_opts.error_string = &err_str;
 
-    ctx->conn = mg_bind_opt(mgr, address, ev_handler, bind_opts);
+    ctx->conn = mg_bind_opt(ctx->mgr, address, ev_handler, bind_opts);
     if (ctx->conn == NULL) {
         print_logf(LOG_ERROR, __func__, "Error starting server on address %s: %s", address,
                 *bind_opts.error_string);
-        ring_list_free(ctx->history);
+#ifdef HTTP_SERVER_THREAD
+        mg_mgr_free(&ctx->server_mgr);
+#endif
+        event_history_free(&ctx->history);
         free(ctx);
         return NULL;
     }
@@ -1217,47 +1941,78 @@ static struct http_server_context *http_server_start(struct mg_mgr *mgr, char co
     ctx->server_opts.document_root            = "."; // Serve current directory
     ctx->server_opts.enable_directory_listing = "yes";
 
+#ifdef HTTP_SERVER_THREAD
+    // add dummy socket to receive rpc calls on the main manager
+    struct mg_add_sock_opts opts = {.user_data = ctx};
+    ctx->main_conn = mg_add_sock_opt(mgr, INVALID_SOCKET, http_main_handler, opts);
+
+#ifndef _WIN32
+    // Block all signals from the server thread
+    sigset_t sigset;
+    sigset_t oldset;
+    sigfillset(&sigset);
+    pthread_sigmask(SIG_SETMASK, &sigset, &oldset);
+#endif
+    int r = ctx->main_conn ? pthread_create(&ctx->thread, NULL, server_thread, ctx) : -1;
+#ifndef _WIN32
+    pthread_sigmask(SIG_SETMASK, &oldset, NULL);
+#endif
+    if (r) {
+        print_logf(LOG_ERROR, __func__, "error in pthread_create, rc: %d", r);
+        if (ctx->main_conn) {
+            ctx->main_conn->user_data = NULL;
+            ctx->main_conn->flags |= MG_F_CLOSE_IMMEDIATELY;
+        }
+        mg_mgr_free(&ctx->server_mgr);
+        event_history_free(&ctx->history);
+        free(ctx);
+        return NULL;
+    }
+#endif
+
+    metrics_register(cfg->metrics, collect_http_metrics, ctx);
+
     print_logf(LOG_NOTICE, "HTTP server", "Serving HTTP-API on address %s, serving %s", address,
             ctx->server_opts.document_root);
 
     return ctx;
 }
 
-#define SHUTDOWN_JSON "{\"shutdown\":\"goodbye\"}"
-
 static int http_server_stop(struct http_server_context *ctx)
 {
     if (!ctx)
         return 0;
 
-    // close the server
-    ctx->conn->user_data = NULL;
-    ctx->conn->flags |= MG_F_CLOSE_IMMEDIATELY;
+    metrics_unregister(ctx->cfg->metrics, collect_http_metrics, ctx);
 
-    // close connections with a goodbye
-    struct mg_mgr *mgr = ctx->conn->mgr;
-    for (struct mg_connection *nc = mg_next(mgr, NULL); nc != NULL; nc = mg_next(mgr, nc)) {
-        if (nc->handler != ev_handler)
-            continue;
+#ifdef HTTP_SERVER_THREAD
+    ATOMIC_STORE(&ctx->stop, 1);
+    mg_broadcast(ctx->mgr, http_wake_handler, &ctx, sizeof(ctx));
+    pthread_join(ctx->thread, NULL);
 
-        struct nc_context *cctx = nc->user_data; // might not be valid
-        if (is_websocket(nc)) {
-            mg_send_websocket_frame(nc, WEBSOCKET_OP_TEXT, SHUTDOWN_JSON, sizeof(SHUTDOWN_JSON) - 1);
-        }
-        else if (cctx && cctx->is_chunked) {
-            mg_send_http_chunk(nc, SHUTDOWN_JSON, sizeof(SHUTDOWN_JSON) - 1);
-            mg_send_http_chunk(nc, "\r\n", 2);
-            mg_send_http_chunk(nc, "", 0);            /* Send empty chunk, the end of response */
-        }
-        else if (cctx && !cctx->is_chunked) {
-            mg_send(nc, SHUTDOWN_JSON, sizeof(SHUTDOWN_JSON) - 1);
-            mg_send(nc, "\r\n", 2);
-        }
+    // stop receiving rpc calls
+    ctx->main_conn->user_data = NULL;
+    ctx->main_conn->flags |= MG_F_CLOSE_IMMEDIATELY;
+
+    // closes the remaining connections
+    mg_mgr_free(&ctx->server_mgr);
+    while (ctx->calls) {
+        rpc_call_t *call = ctx->calls;
+        ctx->calls = call->next;
+        rpc_call_free(call);
     }
+    ctx->conn = NULL;
+    http_drain_queue(ctx); // events queued after the thread stopped
 
-    for (void **iter = ring_list_iter(ctx->history); iter; iter = ring_list_next(ctx->history, iter))
-        free((data_t *)*iter);
-    ring_list_free(ctx->history);
+    if (ctx->queue.dropped)
+        print_logf(LOG_NOTICE, "HTTP server", "Dropped %u events on a full queue", ctx->queue.dropped);
+#else
+    http_server_goodbye(ctx);
+#endif
+
+    for (int i = 0; i < MAX_FILTER_GROUPS; ++i)
+        filter_group_free(ctx->groups[i]);
+    event_history_free(&ctx->history);
 
     free(ctx);
 
@@ -1275,32 +2030,25 @@ static void R_API_CALLCONV print_http_data(data_output_t *output, data_t *data,
 {
     UNUSED(format);
     data_output_http_t *http = (data_output_http_t *)output;
+    struct http_server_context *ctx = http->server;
 
-    // collect well-known top level keys
-    data_t *data_model = NULL;
-    for (data_t *d = data; d; d = d->next) {
-        if (!strcmp(d->key, "model"))
-            data_model = d;
-    }
+    // "events" and "states", the encoding is shared with other outputs and all clients
+    size_t len;
+    char const *json = data_jsons(data, &len);
+    if (!json)
+        return; // NOTE: skip output on alloc failure.
 
-    if (data_model) {
-        // "events"
-        char buf[2048]; // we expect the biggest strings to be around 500 bytes.
-        size_t len = data_print_jsons(data, buf, sizeof(buf));
-        http_broadcast_send(http->server, buf, len);
-    }
-    else {
-        // "states"
-        size_t buf_size = 20000; // state message need a large buffer
-        char *buf       = malloc(buf_size);
-        if (!buf) {
-            WARN_MALLOC("print_http_data()");
-            return; // NOTE: skip output on alloc failure.
-        }
-        size_t len = data_print_jsons(data, buf, buf_size);
-        http_broadcast_send(http->server, buf, len);
-        free(buf);
+#ifdef HTTP_SERVER_THREAD
+    // hand the event to the server thread
+    if (!event_queue_push(&ctx->queue, data_retain(data), json, len)) {
+        data_free(data);
+        ATOMIC_INC(&ctx->queue.dropped);
     }
+    if (!ATOMIC_EXCHANGE(&ctx->queue.wake, 1))
+        mg_broadcast(ctx->mgr, http_wake_handler, &ctx, sizeof(ctx));
+#else
+    http_broadcast_send(ctx, data, json, len);
+#endif
 }
 
 static void R_API_CALLCONV data_output_http_free(data_output_t *output)
@@ -1315,7 +2063,7 @@ static void R_API_CALLCONV data_output_http_free(data_output_t *output)
     free(http);
 }
 
-struct data_output *data_output_http_create(struct mg_mgr *mgr, char const *host, char const *port, r_cfg_t *cfg)
+struct data_output *data_output_http_create(struct mg_mgr *mgr, char const *host, char const *port, int history, r_cfg_t *cfg)
 {
     data_output_http_t *http = calloc(1, sizeof(data_output_http_t));
     if (!http) {
@@ -1327,7 +2075,15 @@ struct data_output *data_output_http_create(struct mg_mgr *mgr, char const *host
     http->output.print_data   = print_http_data;
     http->output.output_free  = data_output_http_free;
 
-    http->server = http_server_start(mgr, host, port, cfg, &http->output);
+    if (history <= 0) {
+        history = DEFAULT_HISTORY_SIZE;
+    }
+    if (history > MAX_HISTORY_SIZE) {
+        print_logf(LOG_WARNING, "HTTP server", "History of %d events limited to %d", history, MAX_HISTORY_SIZE);
+        history = MAX_HISTORY_SIZE;
+    }
+
+    http->server = http_server_start(mgr, host, port, (unsigned)history, cfg, &http->output);
     if (!http->server) {
         exit(1);
     }
@@ -0,0 +1,521 @@
+/** @file
+    Sample file input, memory mapped where available, or decompressed on a thread.
+
+    Copyright (C) 2026 agent <agent@local>
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+*/
+
+#include "input_file.h"
+
+#include "fileformat.h"
+#include "logger.h"
+#include "fatal.h"
+#include "compat_pthread.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+
+#ifdef ZLIB
+#include <zlib.h>
+#endif
+#ifdef ZSTD
+#include <zstd.h>
+#endif
+
+#ifndef _WIN32
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#define HAVE_MMAP
+#endif
+
+#ifdef _WIN32
+#define fseeko _fseeki64
+#define ftello _ftelli64
+#endif
+
+struct input_file {
+    FILE *file;
+    int format;
+    uint32_t block_size; ///< output block size in bytes
+    uint8_t const *map;  ///< the file mapping or NULL
+    size_t map_len;
+    size_t map_pos;
+    uint8_t *buf;        ///< conversion buffer, or read buffer without a mapping
+    float *float_buf;    ///< CF32 read buffer without a mapping
+    uint64_t size;       ///< file size in bytes, 0 if unknown
+    uint64_t bytes;      ///< byte offset in the file, advanced by reads and seeks
+    /* decompression, the decompressed stream is read in blocks into two buffers */
+    uint32_t compression;
+#ifdef ZLIB
+    gzFile gz;
+#endif
+#ifdef ZSTD
+    ZSTD_DStream *zds;
+    ZSTD_inBuffer zin;
+    void *zin_buf;
+    size_t zin_size;
+    size_t zret;         ///< the last ZSTD_decompressStream() result, 0 at the end of a frame
+#endif
+    uint8_t *zbuf[2];
+    uint32_t zbuf_size;
+    uint32_t zlen[2];
+    int zfull[2];        ///< the buffer is filled and not released by the reader
+    int zcur;            ///< the buffer returned to the reader, -1 if none
+    int zend;            ///< the last block was returned
+    int zerror;          ///< decompression failed
+#ifdef THREADS
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    int started;
+    int stop;
+#endif
+};
+
+// CS8 to CU8, flipping the sign bit is the same as adding 128, vectorizes well
+static void convert_cs8_cu8(uint8_t const *src, uint8_t *dst, uint32_t len)
+{
+    for (uint32_t n = 0; n < len; ++n) {
+        dst[n] = src[n] ^ 0x80;
+    }
+}
+
+// CF32 to CS16, clamp to [-1,1] and scale to Q0.15, branch-free to vectorize well
+static void convert_cf32_cs16(float const *src, int16_t *dst, uint32_t len)
+{
+    for (uint32_t n = 0; n < len; ++n) {
+        float f = src[n] * INT16_MAX;
+        f       = f < -INT16_MAX ? -INT16_MAX : f;
+        f       = f > INT16_MAX ? INT16_MAX : f;
+        dst[n]  = (int16_t)f;
+    }
+}
+
+// fill a buffer from the decompressed stream, a short count is the end of the stream
+static uint32_t decompress_fill(input_file_t *in, uint8_t *buf, uint32_t len)
+{
+    uint32_t n = 0;
+#ifdef ZLIB
+    if (in->gz) {
+        while (n < len) {
+            int r = gzread(in->gz, buf + n, len - n);
+            if (r <= 0)
+                break;
+            n += (uint32_t)r;
+        }
+        int err = Z_OK;
+        if (n < len)
+            gzerror(in->gz, &err); // a truncated stream is a Z_BUF_ERROR
+        if (err != Z_OK)
+            in->zerror = 1;
+    }
+#endif
+#ifdef ZSTD
+    if (in->zds) {
+        ZSTD_outBuffer out = {buf, len, 0};
+        while (out.pos < out.size) {
+            if (in->zin.pos == in->zin.size) {
+                in->zin.size = fread(in->zin_buf, 1, in->zin_size, in->file);
+                in->zin.pos  = 0;
+                if (in->zin.size == 0) {
+                    if (in->zret != 0 || ferror(in->file))
+                        in->zerror = 1; // a truncated stream ends inside a frame
+                    break;
+                }
+            }
+            in->zret = ZSTD_decompressStream(in->zds, &out, &in->zin);
+            if (ZSTD_isError(in->zret)) {
+                in->zerror = 1;
+                break;
+            }
+        }
+        n = (uint32_t)out.pos;
+    }
+#endif
+#if !defined(ZLIB) && !defined(ZSTD)
+    (void)in;
+    (void)buf;
+    (void)len;
+#endif
+    return n;
+}
+
+#ifdef THREADS
+// decompress ahead of the reader, alternating between the two buffers
+static THREAD_RETURN THREAD_CALL decompress_thread(void *arg)
+{
+    input_file_t *in = arg;
+
+    for (int w = 0;; w ^= 1) {
+        pthread_mutex_lock(&in->lock);
+        while (in->zfull[w] && !in->stop) {
+            pthread_cond_wait(&in->cond, &in->lock);
+        }
+        int stop = in->stop;
+        pthread_mutex_unlock(&in->lock);
+        if (stop)
+            break;
+
+        uint32_t len = decompress_fill(in, in->zbuf[w], in->zbuf_size);
+
+        pthread_mutex_lock(&in->lock);
+        in->zlen[w]  = len;
+        in->zfull[w] = 1;
+        pthread_cond_broadcast(&in->cond);
+        pthread_mutex_unlock(&in->lock);
+        if (len < in->zbuf_size)
+            break; // end of the stream
+    }
+
+    return (THREAD_RETURN)0;
+}
+#endif
+
+// get the next decompressed block, the block is valid until the next call
+static uint32_t decompress_next(input_file_t *in, uint8_t **buf)
+{
+    *buf = NULL;
+    if (in->zend)
+        return 0;
+
+#ifdef THREADS
+    pthread_mutex_lock(&in->lock);
+    if (in->zcur >= 0) {
+        // release the previous block to the decompressor
+        in->zfull[in->zcur] = 0;
+        pthread_cond_broadcast(&in->cond);
+    }
+    in->zcur = in->zcur < 0 ? 0 : in->zcur ^ 1;
+    while (!in->zfull[in->zcur]) {
+        pthread_cond_wait(&in->cond, &in->lock);
+    }
+    uint32_t len = in->zlen[in->zcur];
+    pthread_mutex_unlock(&in->lock);
+#else
+    in->zcur = 0;
+    uint32_t len = decompress_fill(in, in->zbuf[0], in->zbuf_size);
+#endif
+
+    if (len < in->zbuf_size) {
+        in->zend = 1;
+        if (in->zerror)
+            print_log(LOG_ERROR, "Input", "Decompressing the input failed, the file might be corrupt.");
+    }
+    *buf = in->zbuf[in->zcur];
+    return len;
+}
+
+static int decompress_open(input_file_t *in, char const *path, uint32_t in_len)
+{
+    int use_stdin = strcmp(path, "-") == 0;
+    (void)use_stdin; // without zlib and zstd
+
+    if (in->compression == COMPRESS_GZIP) {
+#ifdef ZLIB
+        in->gz = use_stdin ? gzdopen(fileno(stdin), "rb") : gzopen(path, "rb");
+        if (!in->gz)
+            return -1;
+        gzbuffer(in->gz, 128 * 1024);
+#else
+        print_log(LOG_ERROR, "Input", "Reading gzip files needs zlib support.");
+        return -1;
+#endif
+    }
+    else if (in->compression == COMPRESS_ZSTD) {
+#ifdef ZSTD
+        in->file = use_stdin ? stdin : fopen(path, "rb");
+        if (!in->file)
+            return -1;
+        in->zds = ZSTD_createDStream();
+        if (!in->zds) {
+            WARN_CALLOC("decompress_open()");
+            return -1;
+        }
+        ZSTD_initDStream(in->zds);
+        in->zin_size = ZSTD_DStreamInSize();
+        in->zin_buf  = malloc(in->zin_size);
+        if (!in->zin_buf) {
+            WARN_MALLOC("decompress_open()");
+            return -1;
+        }
+        in->zin.src = in->zin_buf;
+#else
+        print_log(LOG_ERROR, "Input", "Reading zstd files needs zstd support.");
+        return -1;
+#endif
+    }
+    else {
+        return -1;
+    }
+
+    in->zbuf_size = in_len;
+    in->zcur      = -1;
+    for (int i = 0; i < 2; ++i) {
+        in->zbuf[i] = malloc(in_len);
+        if (!in->zbuf[i]) {
+            WARN_MALLOC("decompress_open()");
+            return -1;
+        }
+    }
+
+#ifdef THREADS
+    pthread_mutex_init(&in->lock, NULL);
+    pthread_cond_init(&in->cond, NULL);
+#ifndef _WIN32
+    // Block all signals from the decompressor thread
+    sigset_t sigset;
+    sigset_t oldset;
+    sigfillset(&sigset);
+    pthread_sigmask(SIG_SETMASK, &sigset, &oldset);
+#endif
+    int r = pthread_create(&in->thread, NULL, decompress_thread, in);
+#ifndef _WIN32
+    pthread_sigmask(SIG_SETMASK, &oldset, NULL);
+#endif
+    if (r) {
+        print_logf(LOG_ERROR, __func__, "error in pthread_create, rc: %d", r);
+        pthread_mutex_destroy(&in->lock);
+        pthread_cond_destroy(&in->cond);
+        return -1;
+    }
+    in->started = 1;
+#endif
+
+    return 0;
+}
+
+static void decompress_close(input_file_t *in)
+{
+#ifdef THREADS
+    if (in->started) {
+        pthread_mutex_lock(&in->lock);
+        in->stop = 1;
+        pthread_cond_broadcast(&in->cond);
+        pthread_mutex_unlock(&in->lock);
+        pthread_join(in->thread, NULL);
+        pthread_mutex_destroy(&in->lock);
+        pthread_cond_destroy(&in->cond);
+    }
+#endif
+#ifdef ZLIB
+    if (in->gz)
+        gzclose(in->gz);
+#endif
+#ifdef ZSTD
+    ZSTD_freeDStream(in->zds);
+    free(in->zin_buf);
+#endif
+    free(in->zbuf[0]);
+    free(in->zbuf[1]);
+}
+
+input_file_t *input_file_open(file_info_t const *info, uint32_t block_size)
+{
+    char const *path = info->path;
+    int format       = (int)info->format;
+
+    input_file_t *in = calloc(1, sizeof(*in));
+    if (!in) {
+        WARN_CALLOC("input_file_open()");
+        return NULL; // NOTE: returns NULL on alloc failure.
+    }
+    in->format      = format;
+    in->block_size  = block_size & ~3u; // whole CS16 samples
+    in->compression = info->compression;
+
+    if (in->compression) {
+        // CF32 is converted to CS16, reading twice the output size
+        uint32_t in_len = format == CF32_IQ ? in->block_size * 2 : in->block_size;
+        if (decompress_open(in, path, in_len) < 0) {
+            input_file_close(in);
+            return NULL;
+        }
+        if (format == CF32_IQ) {
+            in->buf = malloc(in->block_size);
+            if (!in->buf) {
+                WARN_MALLOC("input_file_open()");
+                input_file_close(in);
+                return NULL;
+            }
+        }
+        return in;
+    }
+
+    if (strcmp(path, "-") == 0) {
+        in->file = stdin;
+    }
+    else {
+        in->file = fopen(path, "rb");
+        if (!in->file) {
+            free(in);
+            return NULL;
+        }
+    }
+
+#ifdef HAVE_MMAP
+    struct stat st;
+    if (in->file != stdin && fstat(fileno(in->file), &st) == 0
+            && S_ISREG(st.st_mode) && st.st_size > 0 && (uint64_t)st.st_size <= SIZE_MAX) {
+        void *map = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fileno(in->file), 0);
+        if (map != MAP_FAILED) {
+            in->map     = map;
+            in->map_len = (size_t)st.st_size;
+            in->size    = (uint64_t)st.st_size;
+#ifdef MADV_SEQUENTIAL
+            madvise(map, in->map_len, MADV_SEQUENTIAL);
+#endif
+        }
+    }
+#endif
+    if (!in->map && in->file != stdin && fseeko(in->file, 0, SEEK_END) == 0) {
+        long long size = ftello(in->file);
+        in->size = size > 0 ? (uint64_t)size : 0;
+        fseeko(in->file, 0, SEEK_SET);
+    }
+
+    if (!in->map || format == CS8_IQ || format == CF32_IQ) {
+        in->buf = malloc(in->block_size);
+        if (!in->buf) {
+            WARN_MALLOC("input_file_open()");
+            input_file_close(in);
+            return NULL;
+        }
+    }
+    if (!in->map && format == CF32_IQ) {
+        // a CS16 block is read from twice the size of CF32
+        in->float_buf = malloc(in->block_size / sizeof(int16_t) * sizeof(float));
+        if (!in->float_buf) {
+            WARN_MALLOC("input_file_open()");
+            input_file_close(in);
+            return NULL;
+        }
+    }
+
+    return in;
+}
+
+uint32_t input_file_read(input_file_t *in, uint8_t **buf)
+{
+    // CF32 is converted to CS16, reading twice the output size
+    uint32_t in_len = in->format == CF32_IQ ? in->block_size * 2 : in->block_size;
+
+    if (in->compression) {
+        uint8_t *src;
+        uint32_t len = decompress_next(in, &src);
+        in->bytes += len;
+        if (in->format == CF32_IQ) {
+            convert_cf32_cs16((float const *)src, (int16_t *)in->buf, len / sizeof(float));
+            *buf = in->buf;
+            return len / sizeof(float) * sizeof(int16_t);
+        }
+        if (in->format == CS8_IQ) {
+            convert_cs8_cu8(src, src, len); // the block is ours until the next call
+        }
+        *buf = src;
+        return len;
+    }
+
+    if (in->map) {
+        size_t avail = in->map_len - in->map_pos;
+        uint32_t len = avail < in_len ? (uint32_t)avail : in_len;
+        uint8_t const *src = in->map + in->map_pos;
+        in->map_pos += len;
+        in->bytes += len;
+
+        if (in->format == CF32_IQ) {
+            convert_cf32_cs16((float const *)src, (int16_t *)in->buf, len / sizeof(float));
+            *buf = in->buf;
+            return len / sizeof(float) * sizeof(int16_t);
+        }
+        if (in->format == CS8_IQ) {
+            convert_cs8_cu8(src, in->buf, len);
+            *buf = in->buf;
+            return len;
+        }
+        // the demod does not write to the samples
+        *buf = (uint8_t *)src;
+        return len;
+    }
+
+    if (in->format == CF32_IQ) {
+        size_t n_read = fread(in->float_buf, sizeof(float), in_len / sizeof(float), in->file);
+        in->bytes += n_read * sizeof(float);
+        convert_cf32_cs16(in->float_buf, (int16_t *)in->buf, (uint32_t)n_read);
+        *buf = in->buf;
+        return (uint32_t)(n_read * sizeof(int16_t));
+    }
+
+    size_t n_read = fread(in->buf, 1, in_len, in->file);
+    in->bytes += n_read;
+    if (in->format == CS8_IQ) {
+        convert_cs8_cu8(in->buf, in->buf, (uint32_t)n_read);
+    }
+    *buf = in->buf;
+    return (uint32_t)n_read;
+}
+
+uint64_t input_file_size(input_file_t const *in)
+{
+    return in->size;
+}
+
+int input_file_seek(input_file_t *in, uint64_t offset)
+{
+    if (in->compression) {
+        // streams only seek forward, by decompressing whole blocks
+        while (in->bytes < offset) {
+            uint8_t *buf;
+            uint32_t len = decompress_next(in, &buf);
+            in->bytes += len;
+            if (len == 0)
+                break;
+        }
+        return offset == in->bytes ? 0 : -1;
+    }
+    if (in->map) {
+        in->map_pos = offset < in->map_len ? (size_t)offset : in->map_len;
+        in->bytes   = in->map_pos;
+        return 0;
+    }
+    if (in->file == stdin)
+        return -1;
+    if (fseeko(in->file, (long long)offset, SEEK_SET) != 0)
+        return -1;
+    in->bytes = offset;
+    return 0;
+}
+
+uint64_t input_file_bytes(input_file_t const *in)
+{
+    return in->bytes;
+}
+
+int input_file_mapped(input_file_t const *in)
+{
+    return in->map != NULL;
+}
+
+void input_file_close(input_file_t *in)
+{
+    if (!in)
+        return;
+
+#ifdef HAVE_MMAP
+    if (in->map)
+        munmap((void *)in->map, in->map_len);
+#endif
+    if (in->compression)
+        decompress_close(in);
+    if (in->file && in->file != stdin)
+        fclose(in->file);
+    free(in->buf);
+    free(in->float_buf);
+    free(in);
+}
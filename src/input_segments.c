@@ -0,0 +1,995 @@
+/** @file
+    Segmented and parallel decoding of sample files on multiple threads.
+
+    Copyright (C) 2026 agent <agent@local>
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+*/
+
+#include "input_segments.h"
+
+#include "r_private.h"
+#include "r_device.h"
+#include "r_api.h"
+#include "pulse_detect.h"
+#include "fileformat.h"
+#include "data.h"
+#include "list.h"
+#include "logger.h"
+#include "fatal.h"
+#include "compat_pthread.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+
+#define SEGMENT_GUARD_SEC   2   ///< minimum guard in seconds to settle filters and pulse detector
+#define SEGMENT_GUARD_RESET 16  ///< minimum guard in multiples of the longest reset limit
+#define SEGMENT_MIN_GUARDS  4   ///< minimum length of a segment in multiples of the guard
+#define POOL_FILES_AHEAD    2   ///< files decoded ahead of the output in multiples of the workers
+
+#ifdef THREADS
+
+/// A decoder output captured on a segment thread, replayed in order on the main thread.
+typedef struct {
+    uint64_t block;     ///< the block the event was detected in
+    unsigned dev_index; ///< decoder index in r_devs
+    int log_level;      ///< log level for log_fn, 0 for output_fn
+    data_t *data;
+    uint64_t input_pos;
+    float sample_file_pos;
+    struct timeval now;
+    /* pulse data fields used by the output handlers */
+    unsigned start_ago;
+    float freq1_hz;
+    float rssi_db;
+    float snr_db;
+    float noise_db;
+    int fsk_f2_est;
+    float fsk_freq1_hz;
+    float fsk_freq2_hz;
+    float fsk_rssi_db;
+    float fsk_snr_db;
+    float fsk_noise_db;
+} segment_event_t;
+
+/// The demod state which determines all further output.
+typedef struct {
+    int idle; ///< the pulse detector is idle, otherwise the state is not comparable
+    pulse_detect_idle_t levels;
+    filter_state_t lowpass_filter_state;
+    int32_t fm_xr;
+    int32_t fm_xi;
+    int32_t fm_xf;
+    int32_t fm_yf;
+    uint32_t fm_rate;
+} segment_sync_t;
+
+/// Statistics of the blocks owned by a segment.
+typedef struct {
+    unsigned total_frames_count;
+    unsigned total_frames_squelch;
+    unsigned total_frames_ook;
+    unsigned total_frames_fsk;
+    unsigned total_frames_events;
+    unsigned frames_ook;
+    unsigned frames_fsk;
+    unsigned frames_events;
+    histogram_t buffer_time;
+    unsigned *dev_stats; ///< decode_events, decode_ok, decode_messages, decode_fails[5] of each decoder
+} segment_stats_t;
+
+#define SEGMENT_DEV_STATS 8
+
+/** A segment of an input file with its own demod state.
+
+    A segment reads a guard before the owned blocks to settle the filters and the pulse detector.
+    At the end of the owned blocks the segment continues to read until the demod state matches
+    the state the following segment recorded for that block, from there on the results of the
+    following segment are the same as if the blocks were read serially.
+*/
+typedef struct file_segment {
+    r_cfg_t cfg;         ///< copy of the main config, with the demod of this segment
+    struct file_segment *segs; ///< all segments
+    int n_segs;
+    uint64_t first;      ///< first block to read, including the guard
+    uint64_t owned;      ///< first block owned, events are kept from here
+    uint64_t end;        ///< block after the last owned block
+    int is_owned;        ///< set when the owned blocks are reached
+    uint64_t block;      ///< the block currently processed
+    uint64_t n_bytes;    ///< converted bytes up to the last block read
+    list_t events;       ///< captured segment_event_t
+    segment_stats_t stats;
+    int next;            ///< index of the segment to continue with, -1 if the end of the file was reached
+    uint64_t handover;   ///< the block the next segment continues with
+    /* shared with other segments */
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    segment_sync_t *syncs; ///< demod state before each owned block
+    uint64_t n_syncs;    ///< number of recorded states
+    int done;            ///< no more states will be recorded
+    int cancel;          ///< stop reading, the results are discarded
+    input_process_fn process;
+    pthread_t thread;
+    int failed;
+    struct input_pool *pool; ///< the pool of a worker, NULL for a segment
+} file_segment_t;
+
+enum file_state {
+    FILE_QUEUED,
+    FILE_DONE,
+    FILE_SKIPPED,
+};
+
+/// The result of an input file decoded by a worker, kept until the main thread replays it.
+typedef struct {
+    enum file_state state;
+    int failed;
+    list_t events;       ///< captured segment_event_t
+    segment_stats_t stats;
+    uint64_t n_blocks;
+    uint64_t n_bytes;
+} file_result_t;
+
+/// Workers which decode whole input files, each with its own demod state.
+struct input_pool {
+    r_cfg_t *cfg;
+    uint32_t sample_rate;       ///< default sample rate if the file info has none
+    uint32_t center_frequency;  ///< default center frequency if the file info has none
+    int n_files;
+    file_result_t *results;     ///< a result for each input file
+    file_segment_t *workers;
+    int n_workers;
+    int started;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    int next_file;              ///< the next file to decode
+    int current;                ///< the file the main thread waits for
+    int stop;
+};
+
+static void segment_event_free(segment_event_t *ev)
+{
+    data_free(ev->data);
+    free(ev);
+}
+
+static void segment_capture(r_device *r_dev, int log_level, data_t *data)
+{
+    file_segment_t *seg = r_dev->output_ctx;
+    struct dm_state *demod = seg->cfg.demod;
+
+    if (!seg->is_owned) {
+        data_free(data); // an event of the guard, owned by a previous segment
+        return;
+    }
+
+    segment_event_t *ev = calloc(1, sizeof(*ev));
+    if (!ev) {
+        WARN_CALLOC("segment_capture()");
+        data_free(data);
+        return;
+    }
+    for (size_t i = 0; i < demod->r_devs.len; ++i) {
+        if (demod->r_devs.elems[i] == r_dev) {
+            ev->dev_index = (unsigned)i;
+            break;
+        }
+    }
+    ev->block           = seg->block;
+    ev->log_level       = log_level;
+    ev->data            = data;
+    ev->input_pos       = seg->cfg.input_pos;
+    ev->sample_file_pos = demod->sample_file_pos;
+    ev->now             = demod->now;
+    ev->start_ago       = demod->pulse_data.start_ago;
+    ev->freq1_hz        = demod->pulse_data.freq1_hz;
+    ev->rssi_db         = demod->pulse_data.rssi_db;
+    ev->snr_db          = demod->pulse_data.snr_db;
+    ev->noise_db        = demod->pulse_data.noise_db;
+    ev->fsk_f2_est      = demod->fsk_pulse_data.fsk_f2_est;
+    ev->fsk_freq1_hz    = demod->fsk_pulse_data.freq1_hz;
+    ev->fsk_freq2_hz    = demod->fsk_pulse_data.freq2_hz;
+    ev->fsk_rssi_db     = demod->fsk_pulse_data.rssi_db;
+    ev->fsk_snr_db      = demod->fsk_pulse_data.snr_db;
+    ev->fsk_noise_db    = demod->fsk_pulse_data.noise_db;
+    list_push(&seg->events, ev);
+}
+
+static void segment_output_handler(r_device *r_dev, data_t *data)
+{
+    segment_capture(r_dev, 0, data);
+}
+
+static void segment_log_handler(r_device *r_dev, int level, data_t *data)
+{
+    segment_capture(r_dev, level, data);
+}
+
+int input_pool_possible(r_cfg_t *cfg)
+{
+    struct dm_state *demod = cfg->demod;
+
+    return !demod->dumper.len && !demod->samp_grab && !demod->am_analyze && !demod->analyze_pulses
+            && demod->auto_level <= 0 && demod->squelch_offset <= 0
+            && !cfg->raw_mode && !cfg->raw_handler.len && !cfg->report_noise
+            && !(cfg->report_stats && cfg->stats_interval)
+            && !cfg->in_replay && !cfg->bytes_to_read && !cfg->duration && !cfg->after_successful_events_flag
+            && cfg->frequencies <= 1 && cfg->verbosity < LOG_TRACE;
+}
+
+int input_segments_possible(r_cfg_t *cfg)
+{
+    return strcmp(cfg->demod->load_info.path, "-") != 0 && !cfg->demod->load_info.activity_index
+            && input_pool_possible(cfg);
+}
+
+static void segment_get_sync(struct dm_state *demod, segment_sync_t *sync)
+{
+    sync->idle                 = pulse_detect_get_idle(demod->pulse_detect, &sync->levels);
+    sync->lowpass_filter_state = demod->lowpass_filter_state;
+    sync->fm_xr                = demod->demod_FM_state.xr;
+    sync->fm_xi                = demod->demod_FM_state.xi;
+    sync->fm_xf                = demod->demod_FM_state.xf;
+    sync->fm_yf                = demod->demod_FM_state.yf;
+    sync->fm_rate              = demod->demod_FM_state.rate;
+}
+
+static int segment_sync_equal(segment_sync_t const *a, segment_sync_t const *b)
+{
+    return a->idle && b->idle
+            && a->levels.lead_in_counter == b->levels.lead_in_counter
+            && a->levels.ook_low_estimate == b->levels.ook_low_estimate
+            && a->levels.ook_high_estimate == b->levels.ook_high_estimate
+            && !memcmp(&a->lowpass_filter_state, &b->lowpass_filter_state, sizeof(a->lowpass_filter_state))
+            && a->fm_xr == b->fm_xr && a->fm_xi == b->fm_xi
+            && a->fm_xf == b->fm_xf && a->fm_yf == b->fm_yf
+            && a->fm_rate == b->fm_rate;
+}
+
+static void segment_free(file_segment_t *seg)
+{
+    struct dm_state *demod = seg->cfg.demod;
+    if (demod) {
+        pulse_detect_free(demod->pulse_detect);
+        list_free_elems(&demod->r_devs, (list_elem_free_fn)free_protocol_copy);
+        free(demod);
+    }
+    pthread_mutex_destroy(&seg->lock);
+    pthread_cond_destroy(&seg->cond);
+    list_free_elems(&seg->events, (list_elem_free_fn)segment_event_free);
+    free(seg->stats.dev_stats);
+    free(seg->syncs);
+}
+
+static int segment_init(file_segment_t *seg, r_cfg_t *cfg)
+{
+    struct dm_state *main_demod = cfg->demod;
+
+    seg->cfg = *cfg;
+    // nothing shared with the main thread, events are captured and replayed
+    list_t empty = {0};
+    seg->cfg.in_files       = empty;
+    seg->cfg.output_handler = empty;
+    seg->cfg.raw_handler    = empty;
+    seg->cfg.data_tags      = empty;
+    seg->cfg.dedup          = NULL;
+    seg->cfg.convert        = NULL;
+    seg->cfg.output_async   = NULL;
+    seg->cfg.metrics        = NULL;
+    seg->cfg.dev            = NULL;
+    seg->cfg.mgr            = NULL;
+    seg->cfg.report_stats   = 0;
+    seg->cfg.stats_now      = 0;
+
+    // the demod buffers are large, only copy the settings and filter states
+    struct dm_state *demod = calloc(1, sizeof(*demod));
+    if (!demod) {
+        WARN_CALLOC("segment_init()");
+        return -1;
+    }
+    seg->cfg.demod = demod;
+    demod->auto_level            = main_demod->auto_level;
+    demod->squelch_offset        = main_demod->squelch_offset;
+    demod->level_limit           = main_demod->level_limit;
+    demod->noise_level           = main_demod->noise_level;
+    demod->min_level_auto        = main_demod->min_level_auto;
+    demod->min_level             = main_demod->min_level;
+    demod->min_snr               = main_demod->min_snr;
+    demod->low_pass              = main_demod->low_pass;
+    demod->use_mag_est           = main_demod->use_mag_est;
+    demod->detect_verbosity      = main_demod->detect_verbosity;
+    demod->sample_size           = main_demod->sample_size;
+    demod->enable_FM_demod       = main_demod->enable_FM_demod;
+    demod->fsk_pulse_detect_mode = main_demod->fsk_pulse_detect_mode;
+    demod->frequency             = main_demod->frequency;
+    demod->load_info             = main_demod->load_info;
+    demod->now                   = main_demod->now;
+
+    if (r_reset_demod(demod) < 0) {
+        return -1;
+    }
+
+    list_ensure_size(&demod->r_devs, main_demod->r_devs.len);
+    for (void **iter = main_demod->r_devs.elems; iter && *iter; ++iter) {
+        r_device *r_dev = copy_protocol(*iter);
+        if (!r_dev) {
+            return -1;
+        }
+        r_dev->log_fn     = segment_log_handler;
+        r_dev->output_fn  = segment_output_handler;
+        r_dev->output_ctx = seg;
+        list_push(&demod->r_devs, r_dev);
+    }
+
+    seg->stats.dev_stats = calloc(demod->r_devs.len + 1, SEGMENT_DEV_STATS * sizeof(unsigned));
+    if (!seg->stats.dev_stats) {
+        WARN_CALLOC("segment_init()");
+        return -1;
+    }
+    // a worker of the pool decodes whole files, there is nothing to synchronize
+    if (seg->pool)
+        return 0;
+    seg->syncs = calloc(seg->end - seg->owned, sizeof(*seg->syncs));
+    if (!seg->syncs) {
+        WARN_CALLOC("segment_init()");
+        return -1;
+    }
+
+    return 0;
+}
+
+// start a new file with the demod state of the start of a serial run
+static int segment_reset(file_segment_t *seg)
+{
+    struct dm_state *demod = seg->cfg.demod;
+
+    demod->sample_file_pos = 0.0;
+    seg->cfg.input_pos     = 0;
+    if (r_reset_demod(demod) < 0) {
+        return -1;
+    }
+
+    // decoders with a context keep state between packages, start those fresh too
+    struct dm_state *main_demod = seg->pool->cfg->demod;
+    for (size_t i = 0; i < demod->r_devs.len; ++i) {
+        r_device *old_dev = demod->r_devs.elems[i];
+        if (!old_dev->create_fn)
+            continue;
+        r_device *r_dev = copy_protocol(main_demod->r_devs.elems[i]);
+        if (!r_dev) {
+            return -1;
+        }
+        r_dev->log_fn     = old_dev->log_fn;
+        r_dev->output_fn  = old_dev->output_fn;
+        r_dev->output_ctx = old_dev->output_ctx;
+        free_protocol_copy(old_dev);
+        demod->r_devs.elems[i] = r_dev;
+    }
+    return 0;
+}
+
+// the statistics cover the owned blocks, count from the first to the end
+static void segment_stats(file_segment_t *seg, int restart)
+{
+    r_cfg_t *cfg = &seg->cfg;
+    segment_stats_t *stats = &seg->stats;
+
+    if (restart) {
+        cfg->total_frames_count   = 0;
+        cfg->total_frames_squelch = 0;
+        cfg->total_frames_ook     = 0;
+        cfg->total_frames_fsk     = 0;
+        cfg->total_frames_events  = 0;
+        cfg->frames_ook           = 0;
+        cfg->frames_fsk           = 0;
+        cfg->frames_events        = 0;
+        memset(&cfg->buffer_time, 0, sizeof(cfg->buffer_time));
+    }
+    stats->total_frames_count   = cfg->total_frames_count;
+    stats->total_frames_squelch = cfg->total_frames_squelch;
+    stats->total_frames_ook     = cfg->total_frames_ook;
+    stats->total_frames_fsk     = cfg->total_frames_fsk;
+    stats->total_frames_events  = cfg->total_frames_events;
+    stats->frames_ook           = cfg->frames_ook;
+    stats->frames_fsk           = cfg->frames_fsk;
+    stats->frames_events        = cfg->frames_events;
+    stats->buffer_time          = cfg->buffer_time;
+
+    unsigned *dev_stats = stats->dev_stats;
+    for (void **iter = cfg->demod->r_devs.elems; iter && *iter; ++iter) {
+        r_device *r_dev = *iter;
+        if (restart) {
+            r_dev->decode_events   = 0;
+            r_dev->decode_ok       = 0;
+            r_dev->decode_messages = 0;
+            memset(r_dev->decode_fails, 0, sizeof(r_dev->decode_fails));
+        }
+        dev_stats[0] = r_dev->decode_events;
+        dev_stats[1] = r_dev->decode_ok;
+        dev_stats[2] = r_dev->decode_messages;
+        memcpy(&dev_stats[3], r_dev->decode_fails, sizeof(r_dev->decode_fails));
+        dev_stats += SEGMENT_DEV_STATS;
+    }
+}
+
+// record the demod state before an owned block
+static void segment_put_sync(file_segment_t *seg)
+{
+    segment_sync_t sync;
+    segment_get_sync(seg->cfg.demod, &sync);
+
+    pthread_mutex_lock(&seg->lock);
+    seg->syncs[seg->n_syncs++] = sync;
+    pthread_cond_broadcast(&seg->cond);
+    pthread_mutex_unlock(&seg->lock);
+}
+
+static void segment_done(file_segment_t *seg)
+{
+    pthread_mutex_lock(&seg->lock);
+    seg->done = 1;
+    pthread_cond_broadcast(&seg->cond);
+    pthread_mutex_unlock(&seg->lock);
+}
+
+// compare the demod state before a block with the state the owner of that block recorded
+static int segment_synced(file_segment_t *seg, file_segment_t *owner, uint64_t block)
+{
+    uint64_t idx = block - owner->owned;
+
+    pthread_mutex_lock(&owner->lock);
+    while (owner->n_syncs <= idx && !owner->done) {
+        pthread_cond_wait(&owner->cond, &owner->lock);
+    }
+    int have_sync = owner->n_syncs > idx;
+    pthread_mutex_unlock(&owner->lock);
+    if (!have_sync)
+        return 0;
+
+    // recorded states don't change, no need to hold the lock
+    segment_sync_t sync;
+    segment_get_sync(seg->cfg.demod, &sync);
+    return segment_sync_equal(&sync, &owner->syncs[idx]);
+}
+
+static void segment_cancel(file_segment_t *seg)
+{
+    pthread_mutex_lock(&seg->lock);
+    seg->cancel = 1;
+    seg->done   = 1;
+    pthread_cond_broadcast(&seg->cond);
+    pthread_mutex_unlock(&seg->lock);
+}
+
+static int segment_cancelled(file_segment_t *seg)
+{
+    pthread_mutex_lock(&seg->lock);
+    int cancel = seg->cancel;
+    pthread_mutex_unlock(&seg->lock);
+    return cancel;
+}
+
+// read and process the blocks of a segment, sets failed on error
+static void segment_decode(file_segment_t *seg)
+{
+    r_cfg_t *cfg = &seg->cfg;
+    struct dm_state *demod = cfg->demod;
+    uint32_t block_size = cfg->out_block_size & ~3u;
+    // CF32 blocks are read from twice the size
+    uint64_t in_block_size = demod->load_info.format == CF32_IQ ? block_size * 2 : block_size;
+
+    seg->next = -1;
+    input_file_t *in_file = input_file_open(&demod->load_info, block_size);
+    if (!in_file || input_file_seek(in_file, seg->first * in_block_size) != 0) {
+        input_file_close(in_file);
+        seg->failed = 1;
+        segment_done(seg);
+        return;
+    }
+
+    seg->n_bytes   = seg->first * block_size;
+    cfg->input_pos = seg->n_bytes / demod->sample_size;
+    int owner_idx  = seg - seg->segs + 1;
+    for (seg->block = seg->first; !cfg->exit_async && !segment_cancelled(seg); ++seg->block) {
+        if (seg->block == seg->owned) {
+            segment_stats(seg, 1);
+            seg->is_owned = 1;
+        }
+        if (seg->block == seg->end) {
+            segment_stats(seg, 0);
+            segment_done(seg);
+        }
+        if (seg->block < seg->end) {
+            if (seg->is_owned && seg->syncs)
+                segment_put_sync(seg);
+        }
+        else {
+            // find the owner of this block, none if past the last segment
+            while (owner_idx < seg->n_segs && seg->segs[owner_idx].end <= seg->block)
+                owner_idx++;
+            if (owner_idx < seg->n_segs && segment_synced(seg, &seg->segs[owner_idx], seg->block)) {
+                seg->next     = owner_idx;
+                seg->handover = seg->block;
+                break;
+            }
+        }
+
+        uint8_t *buf;
+        uint32_t n_read = input_file_read(in_file, &buf);
+        if (n_read == 0)
+            break;
+        seg->n_bytes += n_read;
+        demod->sample_file_pos = (float)seg->n_bytes / cfg->samp_rate / demod->sample_size;
+        seg->process(buf, n_read, cfg);
+    }
+    input_file_close(in_file);
+    segment_done(seg); // in case of an early exit
+
+    // the segment reaching the end ensures EOP detection like the serial case
+    if (seg->next < 0 && seg->is_owned && !cfg->exit_async && !segment_cancelled(seg)) {
+        uint8_t *buf = malloc(block_size);
+        if (!buf) {
+            WARN_MALLOC("segment_decode()");
+            seg->failed = 1;
+            return;
+        }
+        memset(buf, demod->sample_size == 2 ? 128 : 0, block_size); // 128 is 0 in unsigned data
+        demod->sample_file_pos = ((float)seg->n_bytes + block_size) / cfg->samp_rate / demod->sample_size;
+        seg->process(buf, block_size, cfg);
+        free(buf);
+    }
+}
+
+static THREAD_RETURN THREAD_CALL segment_thread(void *arg)
+{
+    file_segment_t *seg = arg;
+    segment_decode(seg);
+    return (THREAD_RETURN)0;
+}
+
+static int segment_start(pthread_t *thread, THREAD_RETURN (THREAD_CALL *fn)(void *), void *arg)
+{
+#ifndef _WIN32
+    // Block all signals from the worker thread
+    sigset_t sigset;
+    sigset_t oldset;
+    sigfillset(&sigset);
+    pthread_sigmask(SIG_SETMASK, &sigset, &oldset);
+#endif
+    int r = pthread_create(thread, NULL, fn, arg);
+#ifndef _WIN32
+    pthread_sigmask(SIG_SETMASK, &oldset, NULL);
+#endif
+    if (r) {
+        print_logf(LOG_ERROR, __func__, "error in pthread_create, rc: %d", r);
+    }
+    return r;
+}
+
+// replay the captured events as if the main demod had produced them
+static void segment_replay(r_cfg_t *cfg, list_t *events, uint64_t valid_from, uint64_t valid_to)
+{
+    struct dm_state *demod = cfg->demod;
+
+    for (void **iter = events->elems; iter && *iter; ++iter) {
+        segment_event_t *ev = *iter;
+        if (ev->block < valid_from || ev->block >= valid_to)
+            continue;
+        r_device *r_dev = demod->r_devs.elems[ev->dev_index];
+
+        cfg->input_pos                   = ev->input_pos;
+        demod->sample_file_pos           = ev->sample_file_pos;
+        demod->now                       = ev->now;
+        demod->pulse_data.start_ago      = ev->start_ago;
+        demod->pulse_data.freq1_hz       = ev->freq1_hz;
+        demod->pulse_data.rssi_db        = ev->rssi_db;
+        demod->pulse_data.snr_db         = ev->snr_db;
+        demod->pulse_data.noise_db       = ev->noise_db;
+        demod->fsk_pulse_data.fsk_f2_est = ev->fsk_f2_est;
+        demod->fsk_pulse_data.freq1_hz   = ev->fsk_freq1_hz;
+        demod->fsk_pulse_data.freq2_hz   = ev->fsk_freq2_hz;
+        demod->fsk_pulse_data.rssi_db    = ev->fsk_rssi_db;
+        demod->fsk_pulse_data.snr_db     = ev->fsk_snr_db;
+        demod->fsk_pulse_data.noise_db   = ev->fsk_noise_db;
+
+        if (ev->log_level)
+            r_dev->log_fn(r_dev, ev->log_level, ev->data);
+        else
+            r_dev->output_fn(r_dev, ev->data);
+        ev->data = NULL; // the handlers free the data
+    }
+    list_clear(events, (list_elem_free_fn)segment_event_free);
+}
+
+static void segment_add_stats(r_cfg_t *cfg, segment_stats_t const *stats)
+{
+    cfg->total_frames_count += stats->total_frames_count;
+    cfg->total_frames_squelch += stats->total_frames_squelch;
+    cfg->total_frames_ook += stats->total_frames_ook;
+    cfg->total_frames_fsk += stats->total_frames_fsk;
+    cfg->total_frames_events += stats->total_frames_events;
+    cfg->frames_ook += stats->frames_ook;
+    cfg->frames_fsk += stats->frames_fsk;
+    cfg->frames_events += stats->frames_events;
+    for (int i = 0; i <= HISTOGRAM_BUCKETS; ++i)
+        cfg->buffer_time.buckets[i] += stats->buffer_time.buckets[i];
+    cfg->buffer_time.count += stats->buffer_time.count;
+    cfg->buffer_time.sum += stats->buffer_time.sum;
+
+    unsigned *dev_stats = stats->dev_stats;
+    for (void **iter = cfg->demod->r_devs.elems; iter && *iter; ++iter) {
+        r_device *r_dev = *iter;
+        r_dev->decode_events += dev_stats[0];
+        r_dev->decode_ok += dev_stats[1];
+        r_dev->decode_messages += dev_stats[2];
+        for (int j = 0; j < 5; ++j)
+            r_dev->decode_fails[j] += dev_stats[3 + j];
+        dev_stats += SEGMENT_DEV_STATS;
+    }
+}
+
+int input_segments_decode(r_cfg_t *cfg, input_file_t *in_file, input_process_fn process, int *n_blocks, uint64_t *n_bytes)
+{
+    struct dm_state *demod = cfg->demod;
+    uint32_t block_size = cfg->out_block_size & ~3u;
+    uint64_t in_block_size = demod->load_info.format == CF32_IQ ? block_size * 2 : block_size;
+    uint64_t block_samples = block_size / demod->sample_size;
+
+    uint64_t total_blocks = (input_file_size(in_file) + in_block_size - 1) / in_block_size;
+
+    // the guard covers some seconds and a number of the longest reset limit
+    float reset_limit = 0.0f;
+    for (void **iter = demod->r_devs.elems; iter && *iter; ++iter) {
+        r_device *r_dev = *iter;
+        if (r_dev->reset_limit > reset_limit)
+            reset_limit = r_dev->reset_limit;
+    }
+    double guard_sec = SEGMENT_GUARD_RESET * reset_limit / 1e6;
+    if (guard_sec < SEGMENT_GUARD_SEC)
+        guard_sec = SEGMENT_GUARD_SEC;
+    uint64_t guard_blocks = ((uint64_t)(guard_sec * cfg->samp_rate) + block_samples - 1) / block_samples;
+
+    uint64_t n_segments = total_blocks / (guard_blocks * SEGMENT_MIN_GUARDS);
+    if (n_segments > (uint64_t)cfg->in_threads)
+        n_segments = cfg->in_threads;
+    if (n_segments < 2)
+        return 0;
+
+    file_segment_t *segs = calloc(n_segments, sizeof(*segs));
+    if (!segs) {
+        WARN_CALLOC("input_segments_decode()");
+        return 0;
+    }
+
+    int started = 0;
+    for (uint64_t i = 0; i < n_segments; ++i) {
+        file_segment_t *seg = &segs[i];
+        seg->segs    = segs;
+        seg->n_segs  = (int)n_segments;
+        seg->owned   = total_blocks * i / n_segments;
+        seg->first   = seg->owned > guard_blocks ? seg->owned - guard_blocks : 0;
+        seg->end     = total_blocks * (i + 1) / n_segments;
+        seg->process = process;
+        pthread_mutex_init(&seg->lock, NULL);
+        pthread_cond_init(&seg->cond, NULL);
+    }
+    for (uint64_t i = 0; i < n_segments; ++i) {
+        file_segment_t *seg = &segs[i];
+        if (segment_init(seg, cfg) < 0)
+            break;
+
+        if (segment_start(&seg->thread, segment_thread, seg) != 0)
+            break;
+        started++;
+    }
+
+    if (started < (int)n_segments) {
+        // not all segments started, discard all and fall back to serial
+        for (int i = 0; i < (int)n_segments; ++i)
+            segment_cancel(&segs[i]);
+        for (int i = 0; i < started; ++i)
+            pthread_join(segs[i].thread, NULL);
+        for (uint64_t i = 0; i < n_segments; ++i)
+            segment_free(&segs[i]);
+        free(segs);
+        return 0;
+    }
+
+    if (cfg->verbosity >= LOG_NOTICE) {
+        print_logf(LOG_NOTICE, "Input", "Decoding in %d segments with a guard of %.1f s",
+                (int)n_segments, (double)(guard_blocks * block_samples) / cfg->samp_rate);
+    }
+
+    // output in order as the segments finish, skip segments which did not synchronize
+    int failed  = 0;
+    int valid   = 0; // the next segment with valid results
+    uint64_t valid_from = 0;
+    for (int i = 0; i < (int)n_segments; ++i) {
+        file_segment_t *seg = &segs[i];
+        pthread_join(seg->thread, NULL);
+        failed |= seg->failed;
+        segment_add_stats(cfg, &seg->stats);
+        if (!failed && i == valid) {
+            uint64_t valid_to = seg->next < 0 ? UINT64_MAX : seg->handover;
+            segment_replay(cfg, &seg->events, valid_from, valid_to);
+            if (seg->next < 0) {
+                // continue with the state at the end of the file
+                cfg->input_pos              = seg->cfg.input_pos;
+                demod->sample_file_pos      = seg->cfg.demod->sample_file_pos;
+                demod->now                  = seg->cfg.demod->now;
+                demod->lowpass_filter_state = seg->cfg.demod->lowpass_filter_state;
+                demod->demod_FM_state       = seg->cfg.demod->demod_FM_state;
+                *n_blocks = (int)seg->block;
+                *n_bytes  = seg->n_bytes;
+                valid     = (int)n_segments;
+            }
+            else {
+                valid      = seg->next;
+                valid_from = seg->handover;
+            }
+        }
+        else if (!failed && cfg->verbosity >= LOG_NOTICE) {
+            print_logf(LOG_NOTICE, "Input", "Segment %d did not synchronize, the previous segment decoded it", i + 1);
+        }
+        segment_free(seg);
+    }
+    free(segs);
+
+    if (failed)
+        print_logf(LOG_ERROR, "Input", "Reading file \"%s\" failed!", cfg->in_filename);
+    return (int)n_segments;
+}
+
+// decode a whole input file with the demod state of a worker
+static enum file_state pool_decode_file(input_pool_t *pool, file_segment_t *seg, char const *filename, file_result_t *res)
+{
+    r_cfg_t *cfg = &seg->cfg;
+    struct dm_state *demod = cfg->demod;
+
+    file_info_t info;
+    file_info_clear(&info);
+    file_info_parse_filename(&info, filename);
+    if (strcmp(info.path, "-") == 0 || info.activity_index)
+        return FILE_SKIPPED; // stdin and activity indexes are read by the main thread
+    if (info.format == CU8_IQ || info.format == CS8_IQ || info.format == S16_AM || info.format == S16_FM)
+        demod->sample_size = sizeof(uint8_t) * 2; // CU8, AM, FM
+    else if (info.format == CS16_IQ || info.format == CF32_IQ)
+        demod->sample_size = sizeof(int16_t) * 2; // CS16, CF32 (after conversion)
+    else
+        return FILE_SKIPPED; // pulse data and invalid formats are handled by the main thread
+
+    demod->load_info      = info;
+    cfg->in_filename      = filename;
+    cfg->samp_rate        = info.sample_rate ? info.sample_rate : pool->sample_rate;
+    cfg->center_frequency = info.center_frequency ? info.center_frequency : pool->center_frequency;
+
+    seg->first    = 0;
+    seg->owned    = 0;
+    seg->end      = UINT64_MAX;
+    seg->is_owned = 0;
+    if (segment_reset(seg) < 0) {
+        res->failed = 1;
+        return FILE_DONE;
+    }
+    segment_decode(seg);
+    segment_stats(seg, 0);
+
+    size_t stats_size = (demod->r_devs.len + 1) * SEGMENT_DEV_STATS * sizeof(unsigned);
+    res->stats = seg->stats;
+    res->stats.dev_stats = malloc(stats_size);
+    if (!res->stats.dev_stats) {
+        WARN_MALLOC("pool_decode_file()");
+        res->failed = 1;
+        return FILE_DONE;
+    }
+    memcpy(res->stats.dev_stats, seg->stats.dev_stats, stats_size);
+
+    list_t empty  = {0};
+    res->events   = seg->events;
+    seg->events   = empty;
+    res->failed   = seg->failed;
+    res->n_blocks = seg->block;
+    res->n_bytes  = seg->n_bytes;
+    seg->failed   = 0;
+    return FILE_DONE;
+}
+
+static THREAD_RETURN THREAD_CALL pool_thread(void *arg)
+{
+    file_segment_t *seg = arg;
+    input_pool_t *pool  = seg->pool;
+
+    for (;;) {
+        // stay a few files ahead of the output
+        pthread_mutex_lock(&pool->lock);
+        while (!pool->stop && pool->next_file < pool->n_files
+                && pool->next_file >= pool->current + POOL_FILES_AHEAD * pool->n_workers) {
+            pthread_cond_wait(&pool->cond, &pool->lock);
+        }
+        int idx = pool->stop ? pool->n_files : pool->next_file;
+        if (idx < pool->n_files)
+            pool->next_file++;
+        pthread_mutex_unlock(&pool->lock);
+        if (idx >= pool->n_files)
+            break;
+
+        file_result_t *res = &pool->results[idx];
+        enum file_state state = pool_decode_file(pool, seg, pool->cfg->in_files.elems[idx], res);
+
+        pthread_mutex_lock(&pool->lock);
+        res->state = state;
+        pthread_cond_broadcast(&pool->cond);
+        pthread_mutex_unlock(&pool->lock);
+    }
+
+    return (THREAD_RETURN)0;
+}
+
+static void pool_result_free(file_result_t *res)
+{
+    list_free_elems(&res->events, (list_elem_free_fn)segment_event_free);
+    free(res->stats.dev_stats);
+    res->stats.dev_stats = NULL;
+}
+
+input_pool_t *input_pool_start(r_cfg_t *cfg, input_process_fn process)
+{
+    int n_workers = cfg->in_threads;
+    if (n_workers > (int)cfg->in_files.len)
+        n_workers = (int)cfg->in_files.len;
+    if (n_workers < 2)
+        return NULL;
+
+    input_pool_t *pool = calloc(1, sizeof(*pool));
+    if (!pool) {
+        WARN_CALLOC("input_pool_start()");
+        return NULL;
+    }
+    pool->results = calloc(cfg->in_files.len, sizeof(*pool->results));
+    if (!pool->results) {
+        WARN_CALLOC("input_pool_start()");
+        free(pool);
+        return NULL;
+    }
+    pool->workers = calloc(n_workers, sizeof(*pool->workers));
+    if (!pool->workers) {
+        WARN_CALLOC("input_pool_start()");
+        free(pool->results);
+        free(pool);
+        return NULL;
+    }
+    pool->cfg              = cfg;
+    pool->sample_rate      = cfg->samp_rate;
+    pool->center_frequency = cfg->frequency[0];
+    pool->n_files          = (int)cfg->in_files.len;
+    pool->n_workers        = n_workers;
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->cond, NULL);
+    for (int i = 0; i < n_workers; ++i) {
+        file_segment_t *seg = &pool->workers[i];
+        seg->segs    = seg;
+        seg->n_segs  = 1;
+        seg->process = process;
+        seg->pool    = pool;
+        pthread_mutex_init(&seg->lock, NULL);
+        pthread_cond_init(&seg->cond, NULL);
+    }
+
+    for (int i = 0; i < n_workers; ++i) {
+        file_segment_t *seg = &pool->workers[i];
+        if (segment_init(seg, cfg) < 0 || segment_start(&seg->thread, pool_thread, seg) != 0) {
+            input_pool_stop(pool);
+            return NULL;
+        }
+        pool->started++;
+    }
+
+    if (cfg->verbosity >= LOG_NOTICE) {
+        print_logf(LOG_NOTICE, "Input", "Decoding %d files on %d threads", pool->n_files, n_workers);
+    }
+    return pool;
+}
+
+int input_pool_decode(input_pool_t *pool, int index, int *n_blocks, uint64_t *n_bytes)
+{
+    r_cfg_t *cfg = pool->cfg;
+    file_result_t *res = &pool->results[index];
+
+    pthread_mutex_lock(&pool->lock);
+    pool->current = index;
+    pthread_cond_broadcast(&pool->cond);
+    while (res->state == FILE_QUEUED) {
+        pthread_cond_wait(&pool->cond, &pool->lock);
+    }
+    pthread_mutex_unlock(&pool->lock);
+
+    if (res->state == FILE_SKIPPED)
+        return 0;
+
+    if (res->stats.dev_stats)
+        segment_add_stats(cfg, &res->stats);
+    segment_replay(cfg, &res->events, 0, UINT64_MAX);
+    *n_blocks = (int)res->n_blocks;
+    *n_bytes  = res->n_bytes;
+    if (res->failed)
+        print_logf(LOG_ERROR, "Input", "Reading file \"%s\" failed!", cfg->in_filename);
+    pool_result_free(res);
+    return 1;
+}
+
+void input_pool_stop(input_pool_t *pool)
+{
+    if (!pool)
+        return;
+
+    pthread_mutex_lock(&pool->lock);
+    pool->stop = 1;
+    pthread_cond_broadcast(&pool->cond);
+    pthread_mutex_unlock(&pool->lock);
+    for (int i = 0; i < pool->started; ++i) {
+        segment_cancel(&pool->workers[i]);
+        pthread_join(pool->workers[i].thread, NULL);
+    }
+
+    for (int i = 0; i < pool->n_workers; ++i)
+        segment_free(&pool->workers[i]);
+    for (int i = 0; i < pool->n_files; ++i)
+        pool_result_free(&pool->results[i]);
+    pthread_mutex_destroy(&pool->lock);
+    pthread_cond_destroy(&pool->cond);
+    free(pool->workers);
+    free(pool->results);
+    free(pool);
+}
+
+#else
+
+int input_segments_possible(r_cfg_t *cfg)
+{
+    (void)cfg;
+    return 0;
+}
+
+int input_segments_decode(r_cfg_t *cfg, input_file_t *in_file, input_process_fn process, int *n_blocks, uint64_t *n_bytes)
+{
+    (void)cfg;
+    (void)in_file;
+    (void)process;
+    (void)n_blocks;
+    (void)n_bytes;
+    return 0;
+}
+
+
+int input_pool_possible(r_cfg_t *cfg)
+{
+    (void)cfg;
+    return 0;
+}
+
+input_pool_t *input_pool_start(r_cfg_t *cfg, input_process_fn process)
+{
+    (void)cfg;
+    (void)process;
+    return NULL;
+}
+
+int input_pool_decode(input_pool_t *pool, int index, int *n_blocks, uint64_t *n_bytes)
+{
+    (void)pool;
+    (void)index;
+    (void)n_blocks;
+    (void)n_bytes;
+    return 0;
+}
+
+void input_pool_stop(input_pool_t *pool)
+{
+    (void)pool;
+}
+
+#endif
@@ -0,0 +1,236 @@
+/** @file
+    OpenMetrics registry and text exposition.
+
+    Copyright (C) 2026 agent <agent@local>
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+*/
+
+#include "metrics.h"
+
+#include "list.h"
+#include "fatal.h"
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define HISTOGRAM_FIRST_BOUND 0.0001 /* seconds */
+
+typedef struct collector {
+    metrics_collect_fn collect;
+    void *ctx;
+} collector_t;
+
+struct metrics {
+    list_t collectors;
+    size_t size_hint; ///< buffer size of the last rendering
+};
+
+struct metrics_out {
+    char *buf;
+    size_t len;
+    size_t size;
+    int oom; ///< set on alloc failure, further output is ignored
+};
+
+metrics_t *metrics_create(void)
+{
+    metrics_t *metrics = calloc(1, sizeof(*metrics));
+    if (!metrics) {
+        WARN_CALLOC("metrics_create()");
+        return NULL; // NOTE: returns NULL on alloc failure.
+    }
+    return metrics;
+}
+
+void metrics_free(metrics_t *metrics)
+{
+    if (!metrics)
+        return;
+
+    list_free_elems(&metrics->collectors, free);
+    free(metrics);
+}
+
+int metrics_register(metrics_t *metrics, metrics_collect_fn collect, void *ctx)
+{
+    if (!metrics)
+        return 0;
+
+    collector_t *collector = calloc(1, sizeof(*collector));
+    if (!collector) {
+        WARN_CALLOC("metrics_register()");
+        return -1;
+    }
+    collector->collect = collect;
+    collector->ctx     = ctx;
+    list_push(&metrics->collectors, collector);
+    return 0;
+}
+
+void metrics_unregister(metrics_t *metrics, metrics_collect_fn collect, void *ctx)
+{
+    if (!metrics)
+        return;
+
+    for (size_t i = 0; i < metrics->collectors.len; ++i) {
+        collector_t *collector = metrics->collectors.elems[i];
+        if (collector->collect == collect && collector->ctx == ctx) {
+            list_remove(&metrics->collectors, i, free);
+            return;
+        }
+    }
+}
+
+// make room for at least len more chars and the terminating NUL
+static int metrics_reserve(metrics_out_t *out, size_t len)
+{
+    if (out->oom)
+        return -1;
+    if (out->len + len < out->size)
+        return 0;
+
+    size_t size = out->size * 2;
+    if (size < out->len + len + 1)
+        size = out->len + len + 1;
+    char *buf = realloc(out->buf, size);
+    if (!buf) {
+        WARN_REALLOC("metrics_reserve()");
+        out->oom = 1;
+        return -1;
+    }
+    out->buf  = buf;
+    out->size = size;
+    return 0;
+}
+
+static void metrics_puts(metrics_out_t *out, char const *str)
+{
+    size_t len = strlen(str);
+    if (metrics_reserve(out, len) < 0)
+        return;
+    memcpy(out->buf + out->len, str, len + 1);
+    out->len += len;
+}
+
+void metrics_printf(metrics_out_t *out, char const *fmt, ...)
+{
+    if (out->oom)
+        return;
+
+    va_list ap;
+    va_start(ap, fmt);
+    int len = vsnprintf(out->buf + out->len, out->size - out->len, fmt, ap);
+    va_end(ap);
+    if (len < 0)
+        return; // NOTE: encoding errors are not expected.
+
+    if ((size_t)len >= out->size - out->len) {
+        // truncated, grow and print again
+        if (metrics_reserve(out, (size_t)len) < 0)
+            return;
+        va_start(ap, fmt);
+        vsnprintf(out->buf + out->len, out->size - out->len, fmt, ap);
+        va_end(ap);
+    }
+    out->len += (size_t)len;
+}
+
+char const *metrics_label_escape(char *buf, size_t size, char const *value)
+{
+    char *p   = buf;
+    char *end = buf + size - 1;
+    for (; value && *value && p < end; ++value) {
+        char c = *value;
+        if (c == '\\' || c == '"' || c == '\n') {
+            if (p + 1 >= end)
+                break; // don't split an escape
+            *p++ = '\\';
+            c    = c == '\n' ? 'n' : c;
+        }
+        *p++ = c;
+    }
+    *p = '\0';
+    return buf;
+}
+
+void metrics_family(metrics_out_t *out, char const *name, char const *type, char const *unit, char const *help)
+{
+    metrics_printf(out, "# TYPE %s %s\n", name, type);
+    if (unit)
+        metrics_printf(out, "# UNIT %s %s\n", name, unit);
+    metrics_printf(out, "# HELP %s %s\n", name, help);
+}
+
+void metrics_value(metrics_out_t *out, char const *name, char const *labels, double value)
+{
+    if (labels)
+        metrics_printf(out, "%s{%s} %.15g\n", name, labels, value);
+    else
+        metrics_printf(out, "%s %.15g\n", name, value);
+}
+
+void metrics_count(metrics_out_t *out, char const *name, char const *labels, unsigned value)
+{
+    if (labels)
+        metrics_printf(out, "%s{%s} %u\n", name, labels, value);
+    else
+        metrics_printf(out, "%s %u\n", name, value);
+}
+
+void metrics_histogram(metrics_out_t *out, char const *name, char const *help, histogram_t const *hist)
+{
+    metrics_family(out, name, "histogram", "seconds", help);
+
+    unsigned count = 0;
+    double bound   = HISTOGRAM_FIRST_BOUND;
+    for (int i = 0; i < HISTOGRAM_BUCKETS; ++i) {
+        count += hist->buckets[i];
+        metrics_printf(out, "%s_bucket{le=\"%g\"} %u\n", name, bound, count);
+        bound *= 2;
+    }
+    metrics_printf(out, "%s_bucket{le=\"+Inf\"} %u\n", name, hist->count);
+    metrics_printf(out, "%s_count %u\n", name, hist->count);
+    metrics_printf(out, "%s_sum %.6f\n", name, hist->sum);
+}
+
+void histogram_observe(histogram_t *hist, double seconds)
+{
+    int i        = 0;
+    double bound = HISTOGRAM_FIRST_BOUND;
+    while (i < HISTOGRAM_BUCKETS && seconds > bound) {
+        bound *= 2;
+        i += 1;
+    }
+    hist->buckets[i] += 1;
+    hist->count += 1;
+    hist->sum += seconds;
+}
+
+char *metrics_render(metrics_t *metrics, size_t *len)
+{
+    metrics_out_t out = {0};
+    if (metrics_reserve(&out, metrics->size_hint ? metrics->size_hint : 4096) < 0)
+        return NULL;
+
+    for (void **iter = metrics->collectors.elems; iter && *iter; ++iter) {
+        collector_t *collector = *iter;
+        collector->collect(&out, collector->ctx);
+    }
+    metrics_puts(&out, "# EOF\n");
+
+    if (out.oom) {
+        free(out.buf);
+        return NULL;
+    }
+    // reserve a little more next time, to avoid growing the buffer
+    metrics->size_hint = out.len + out.len / 8;
+    if (len)
+        *len = out.len;
+    return out.buf;
+}
@@ -0,0 +1,277 @@
+/** @file
+    Asynchronous output dispatch on a separate thread.
+
+    Copyright (C) 2026 agent <agent@local>
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+*/
+
+#include "output_async.h"
+
+#include "data.h"
+#include "logger.h"
+#include "fatal.h"
+#include "compat_pthread.h"
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <signal.h>
+
+#ifdef THREADS
+
+typedef struct async_entry {
+    data_output_t *output; ///< the wrapped output to print to
+    data_t *data;          ///< retained event data, NULL to flush the output
+} async_entry_t;
+
+struct output_async {
+    async_entry_t *queue; ///< ring buffer of queued events
+    unsigned depth;       ///< capacity of the ring buffer
+    unsigned head;        ///< next entry to print
+    unsigned len;         ///< number of queued entries
+    unsigned peak;        ///< maximum number of queued entries for report interval statistic
+    unsigned dropped;     ///< counter of dropped events for report interval statistic
+    int block;            ///< wait for space on overflow instead of dropping
+    int stop;             ///< set to stop the thread once the queue is empty
+
+    pthread_t thread;
+    pthread_mutex_t lock;   ///< lock for the queue
+    pthread_cond_t not_empty; ///< wait for events to print
+    pthread_cond_t not_full;  ///< wait for space to queue
+};
+
+typedef struct {
+    struct data_output output;
+    output_async_t *async;
+    data_output_t *inner;
+} data_output_async_t;
+
+static THREAD_RETURN THREAD_CALL dispatch_thread(void *arg)
+{
+    output_async_t *async = arg;
+
+    pthread_mutex_lock(&async->lock);
+    for (;;) {
+        while (!async->len && !async->stop)
+            pthread_cond_wait(&async->not_empty, &async->lock);
+        if (!async->len)
+            break; // stopped and drained
+        async_entry_t entry = async->queue[async->head];
+        async->head = (async->head + 1) % async->depth;
+        async->len--;
+        pthread_mutex_unlock(&async->lock);
+        pthread_cond_signal(&async->not_full);
+
+        if (entry.data) {
+            data_output_print(entry.output, entry.data);
+            data_free(entry.data);
+        }
+        else {
+            data_output_flush(entry.output);
+        }
+
+        pthread_mutex_lock(&async->lock);
+    }
+    pthread_mutex_unlock(&async->lock);
+
+    return (THREAD_RETURN)(intptr_t)0;
+}
+
+static void async_push(output_async_t *async, data_output_t *output, data_t *data)
+{
+    // never block the dispatch thread itself, e.g. on log messages from outputs
+    // a flush request is skipped if the queue is full, there will be a flush soon anyway
+    int block = data && async->block && !pthread_equal(pthread_self(), async->thread);
+
+    pthread_mutex_lock(&async->lock);
+    while (block && async->len == async->depth && !async->stop)
+        pthread_cond_wait(&async->not_full, &async->lock);
+    if (async->len == async->depth || async->stop) {
+        if (data)
+            async->dropped++;
+        pthread_mutex_unlock(&async->lock);
+        return;
+    }
+    async_entry_t *entry = &async->queue[(async->head + async->len) % async->depth];
+    entry->output = output;
+    entry->data   = data ? data_retain(data) : NULL;
+    async->len++;
+    if (async->len > async->peak)
+        async->peak = async->len;
+    pthread_mutex_unlock(&async->lock);
+    pthread_cond_signal(&async->not_empty);
+}
+
+static void R_API_CALLCONV print_async_data(data_output_t *output, data_t *data)
+{
+    data_output_async_t *wrap = (data_output_async_t *)output;
+
+    // encode now, outputs on both threads then only read the data
+    data_jsons(data, NULL);
+    async_push(wrap->async, wrap->inner, data);
+}
+
+static void R_API_CALLCONV start_async_data(data_output_t *output, char const *const *fields, int num_fields)
+{
+    data_output_async_t *wrap = (data_output_async_t *)output;
+
+    // only called before any events are queued
+    data_output_start(wrap->inner, fields, num_fields);
+}
+
+static void R_API_CALLCONV flush_async_data(data_output_t *output)
+{
+    data_output_async_t *wrap = (data_output_async_t *)output;
+
+    // flush on the dispatch thread, after all events queued so far
+    async_push(wrap->async, wrap->inner, NULL);
+}
+
+static void R_API_CALLCONV free_async_data(data_output_t *output)
+{
+    data_output_async_t *wrap = (data_output_async_t *)output;
+
+    // the dispatch thread is already stopped
+    data_output_free(wrap->inner);
+    free(wrap);
+}
+
+output_async_t *output_async_create(unsigned depth, int block)
+{
+    output_async_t *async = calloc(1, sizeof(*async));
+    if (!async) {
+        WARN_CALLOC("output_async_create()");
+        return NULL; // NOTE: returns NULL on alloc failure.
+    }
+    async->depth = depth ? depth : 1;
+    async->block = block;
+    async->queue = calloc(async->depth, sizeof(*async->queue));
+    if (!async->queue) {
+        WARN_CALLOC("output_async_create()");
+        free(async);
+        return NULL; // NOTE: returns NULL on alloc failure.
+    }
+
+    pthread_mutex_init(&async->lock, NULL);
+    pthread_cond_init(&async->not_empty, NULL);
+    pthread_cond_init(&async->not_full, NULL);
+
+#ifndef _WIN32
+    // Block all signals from the worker thread
+    sigset_t sigset;
+    sigset_t oldset;
+    sigfillset(&sigset);
+    pthread_sigmask(SIG_SETMASK, &sigset, &oldset);
+#endif
+    int r = pthread_create(&async->thread, NULL, dispatch_thread, async);
+#ifndef _WIN32
+    pthread_sigmask(SIG_SETMASK, &oldset, NULL);
+#endif
+    if (r) {
+        print_logf(LOG_ERROR, __func__, "error in pthread_create, rc: %d", r);
+        pthread_mutex_destroy(&async->lock);
+        pthread_cond_destroy(&async->not_empty);
+        pthread_cond_destroy(&async->not_full);
+        free(async->queue);
+        free(async);
+        return NULL;
+    }
+
+    return async;
+}
+
+struct data_output *output_async_wrap(output_async_t *async, struct data_output *output)
+{
+    if (!async || !output)
+        return output;
+
+    data_output_async_t *wrap = calloc(1, sizeof(*wrap));
+    if (!wrap) {
+        WARN_CALLOC("output_async_wrap()");
+        return output; // NOTE: stays synchronous on alloc failure.
+    }
+    wrap->output.output_print = print_async_data;
+    wrap->output.output_start = start_async_data;
+    wrap->output.output_free  = free_async_data;
+    wrap->output.output_flush = output->output_flush ? flush_async_data : NULL;
+    wrap->output.log_level    = output->log_level;
+    wrap->output.flush_msec   = output->flush_msec;
+    wrap->async               = async;
+    wrap->inner               = output;
+
+    return &wrap->output;
+}
+
+void output_async_stats(output_async_t *async, unsigned *queued, unsigned *peak, unsigned *dropped, int reset)
+{
+    pthread_mutex_lock(&async->lock);
+    if (queued)
+        *queued = async->len;
+    if (peak)
+        *peak = async->peak;
+    if (dropped)
+        *dropped = async->dropped;
+    if (reset) {
+        async->peak    = async->len;
+        async->dropped = 0;
+    }
+    pthread_mutex_unlock(&async->lock);
+}
+
+void output_async_free(output_async_t *async)
+{
+    if (!async)
+        return;
+
+    pthread_mutex_lock(&async->lock);
+    async->stop = 1;
+    pthread_mutex_unlock(&async->lock);
+    pthread_cond_broadcast(&async->not_empty);
+    pthread_cond_broadcast(&async->not_full);
+
+    pthread_join(async->thread, NULL);
+
+    pthread_mutex_destroy(&async->lock);
+    pthread_cond_destroy(&async->not_empty);
+    pthread_cond_destroy(&async->not_full);
+    free(async->queue);
+    free(async);
+}
+
+#else
+
+output_async_t *output_async_create(unsigned depth, int block)
+{
+    (void)depth;
+    (void)block;
+    print_log(LOG_ERROR, __func__, "Asynchronous outputs are only available with threads.");
+    return NULL;
+}
+
+struct data_output *output_async_wrap(output_async_t *async, struct data_output *output)
+{
+    (void)async;
+    return output;
+}
+
+void output_async_stats(output_async_t *async, unsigned *queued, unsigned *peak, unsigned *dropped, int reset)
+{
+    (void)async;
+    (void)reset;
+    if (queued)
+        *queued = 0;
+    if (peak)
+        *peak = 0;
+    if (dropped)
+        *dropped = 0;
+}
+
+void output_async_free(output_async_t *async)
+{
+    (void)async;
+}
+
+#endif
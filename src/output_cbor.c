@@ -0,0 +1,251 @@
+/** @file
+    CBOR output for rtl_433 events.
+
+    Copyright (C) 2026 agent <agent@local>
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+*/
+
+#include "output_cbor.h"
+
+#include "data.h"
+#include "fatal.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+/* CBOR encoder */
+
+enum cbor_major {
+    CBOR_UINT   = 0,
+    CBOR_NINT   = 1,
+    CBOR_TEXT   = 3,
+    CBOR_ARRAY  = 4,
+    CBOR_MAP    = 5,
+    CBOR_SIMPLE = 7,
+};
+
+typedef struct {
+    struct data_output output;
+    uint8_t *buf; ///< output buffer
+    size_t size;  ///< size of the output buffer
+    size_t len;   ///< length of the encoding, may exceed the buffer size
+} cbor_enc_t;
+
+static void cbor_put(cbor_enc_t *enc, void const *src, size_t len)
+{
+    if (enc->len + len <= enc->size)
+        memcpy(enc->buf + enc->len, src, len);
+    enc->len += len; // keep counting to report the needed size
+}
+
+static void cbor_head(cbor_enc_t *enc, unsigned major, uint64_t val)
+{
+    uint8_t b[9];
+    size_t n;
+    if (val < 24) {
+        b[0] = (uint8_t)(major << 5 | val);
+        n    = 1;
+    }
+    else if (val <= 0xff) {
+        b[0] = (uint8_t)(major << 5 | 24);
+        b[1] = (uint8_t)val;
+        n    = 2;
+    }
+    else if (val <= 0xffff) {
+        b[0] = (uint8_t)(major << 5 | 25);
+        b[1] = (uint8_t)(val >> 8);
+        b[2] = (uint8_t)val;
+        n    = 3;
+    }
+    else if (val <= 0xffffffff) {
+        b[0] = (uint8_t)(major << 5 | 26);
+        for (int i = 0; i < 4; ++i)
+            b[1 + i] = (uint8_t)(val >> (24 - 8 * i));
+        n = 5;
+    }
+    else {
+        b[0] = (uint8_t)(major << 5 | 27);
+        for (int i = 0; i < 8; ++i)
+            b[1 + i] = (uint8_t)(val >> (56 - 8 * i));
+        n = 9;
+    }
+    cbor_put(enc, b, n);
+}
+
+static void R_API_CALLCONV print_cbor_array(data_output_t *output, data_array_t *array, char const *format)
+{
+    cbor_enc_t *enc = (cbor_enc_t *)output;
+
+    cbor_head(enc, CBOR_ARRAY, (uint64_t)array->num_values);
+    for (int c = 0; c < array->num_values; ++c) {
+        print_array_value(output, array, format, c);
+    }
+}
+
+static void R_API_CALLCONV print_cbor_string(data_output_t *output, char const *str, char const *format)
+{
+    (void)format;
+    cbor_enc_t *enc = (cbor_enc_t *)output;
+
+    size_t len = strlen(str);
+    cbor_head(enc, CBOR_TEXT, len);
+    cbor_put(enc, str, len);
+}
+
+static void R_API_CALLCONV print_cbor_data(data_output_t *output, data_t *data, char const *format)
+{
+    (void)format;
+    cbor_enc_t *enc = (cbor_enc_t *)output;
+
+    unsigned count = 0;
+    for (data_t *d = data; d; d = d->next)
+        count++;
+
+    cbor_head(enc, CBOR_MAP, count);
+    for (; data; data = data->next) {
+        print_cbor_string(output, data->key, NULL);
+        print_value(output, data->type, data->value, data->format);
+    }
+}
+
+static void R_API_CALLCONV print_cbor_double(data_output_t *output, double data, char const *format)
+{
+    (void)format;
+    cbor_enc_t *enc = (cbor_enc_t *)output;
+
+    uint8_t b[9];
+    float f = (float)data;
+    if ((double)f == data) {
+        // single precision is exact, most readings are
+        uint32_t u;
+        memcpy(&u, &f, sizeof(u));
+        b[0] = CBOR_SIMPLE << 5 | 26;
+        for (int i = 0; i < 4; ++i)
+            b[1 + i] = (uint8_t)(u >> (24 - 8 * i));
+        cbor_put(enc, b, 5);
+    }
+    else {
+        uint64_t u;
+        memcpy(&u, &data, sizeof(u));
+        b[0] = CBOR_SIMPLE << 5 | 27;
+        for (int i = 0; i < 8; ++i)
+            b[1 + i] = (uint8_t)(u >> (56 - 8 * i));
+        cbor_put(enc, b, 9);
+    }
+}
+
+static void R_API_CALLCONV print_cbor_int(data_output_t *output, int data, char const *format)
+{
+    (void)format;
+    cbor_enc_t *enc = (cbor_enc_t *)output;
+
+    if (data >= 0)
+        cbor_head(enc, CBOR_UINT, (uint64_t)data);
+    else
+        cbor_head(enc, CBOR_NINT, (uint64_t)(-1 - (int64_t)data));
+}
+
+size_t data_print_cbor(data_t *data, uint8_t *dst, size_t len)
+{
+    cbor_enc_t enc = {
+            .output = {
+                    .print_data   = print_cbor_data,
+                    .print_array  = print_cbor_array,
+                    .print_string = print_cbor_string,
+                    .print_double = print_cbor_double,
+                    .print_int    = print_cbor_int,
+            },
+            .buf  = dst,
+            .size = len,
+    };
+
+    print_cbor_data(&enc.output, data, NULL);
+
+    return enc.len;
+}
+
+/* CBOR stream output */
+
+typedef struct {
+    struct data_output output;
+    FILE *file;
+    cbor_framing_t framing;
+    uint8_t *buf; ///< encoding buffer, grows to the largest event
+    size_t size;  ///< size of the encoding buffer
+} data_output_cbor_t;
+
+static void R_API_CALLCONV data_output_cbor_print(data_output_t *output, data_t *data)
+{
+    data_output_cbor_t *cbor = (data_output_cbor_t *)output;
+
+    if (!cbor || !cbor->file)
+        return;
+
+    size_t len = data_print_cbor(data, cbor->buf, cbor->size);
+    if (len > cbor->size) {
+        uint8_t *buf = realloc(cbor->buf, len);
+        if (!buf) {
+            WARN_REALLOC("data_output_cbor_print()");
+            return; // NOTE: skip output on alloc failure.
+        }
+        cbor->buf  = buf;
+        cbor->size = len;
+        len = data_print_cbor(data, cbor->buf, cbor->size);
+    }
+
+    if (cbor->framing == CBOR_FRAMING_LENGTH) {
+        uint8_t prefix[4] = {
+                (uint8_t)(len >> 24),
+                (uint8_t)(len >> 16),
+                (uint8_t)(len >> 8),
+                (uint8_t)len,
+        };
+        fwrite(prefix, 1, sizeof(prefix), cbor->file);
+    }
+    fwrite(cbor->buf, 1, len, cbor->file);
+    if (data_output_flush_due(output))
+        fflush(cbor->file);
+}
+
+static void R_API_CALLCONV data_output_cbor_flush(data_output_t *output)
+{
+    data_output_cbor_t *cbor = (data_output_cbor_t *)output;
+
+    if (cbor->file)
+        fflush(cbor->file);
+    output->flush_pending = 0;
+}
+
+static void R_API_CALLCONV data_output_cbor_free(data_output_t *output)
+{
+    data_output_cbor_t *cbor = (data_output_cbor_t *)output;
+
+    if (!cbor)
+        return;
+
+    free(cbor->buf);
+    free(cbor);
+}
+
+struct data_output *data_output_cbor_create(int log_level, FILE *file, cbor_framing_t framing)
+{
+    data_output_cbor_t *cbor = calloc(1, sizeof(data_output_cbor_t));
+    if (!cbor) {
+        WARN_CALLOC("data_output_cbor_create()");
+        return NULL; // NOTE: returns NULL on alloc failure.
+    }
+
+    cbor->output.log_level    = log_level;
+    cbor->output.output_print = data_output_cbor_print;
+    cbor->output.output_free  = data_output_cbor_free;
+    cbor->output.output_flush = data_output_cbor_flush;
+    cbor->output.async_safe   = 1;
+    cbor->file                = file;
+    cbor->framing             = framing;
+
+    return (struct data_output *)cbor;
+}
@@ -17,6 +17,7 @@
 #include "logger.h"
 #include "fatal.h"
 
+#include <stdint.h>
 #include <string.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -118,10 +119,20 @@ static void R_API_CALLCONV data_output_json_print(data_output_t *output, data_t
     if (json && json->file) {
         json->output.print_data(output, data, NULL);
         fputc('\n', json->file);
-        fflush(json->file);
+        if (data_output_flush_due(output))
+            fflush(json->file);
     }
 }
 
+static void R_API_CALLCONV data_output_json_flush(data_output_t *output)
+{
+    data_output_json_t *json = (data_output_json_t *)output;
+
+    if (json->file)
+        fflush(json->file);
+    output->flush_pending = 0;
+}
+
 static void R_API_CALLCONV data_output_json_free(data_output_t *output)
 {
     if (!output)
@@ -146,6 +157,8 @@ struct data_output *data_output_json_create(int log_level, FILE *file)
     json->output.print_int    = print_json_int;
     json->output.output_print = data_output_json_print;
     json->output.output_free  = data_output_json_free;
+    json->output.output_flush = data_output_json_flush;
+    json->output.async_safe   = 1;
     json->file                = file;
 
     return (struct data_output *)json;
@@ -153,39 +166,40 @@ struct data_output *data_output_json_create(int log_level, FILE *file)
 
 /* Pretty Key-Value printer */
 
-static int kv_color_for_key(char const *key)
+static int kv_color_for_key(data_key_id_t key_id)
 {
-    if (!key || !*key)
-        return TERM_COLOR_RESET;
-    if (!strcmp(key, "tag") || !strcmp(key, "time"))
+    switch (key_id) {
+    case DATA_KEY_TAG:
+    case DATA_KEY_TIME:
         return TERM_COLOR_BLUE;
-    if (!strcmp(key, "model") || !strcmp(key, "type") || !strcmp(key, "id"))
+    case DATA_KEY_MODEL:
+    case DATA_KEY_TYPE:
+    case DATA_KEY_ID:
         return TERM_COLOR_RED;
-    if (!strcmp(key, "mic"))
+    case DATA_KEY_MIC:
         return TERM_COLOR_CYAN;
-    if (!strcmp(key, "mod") || !strcmp(key, "freq") || !strcmp(key, "freq1") || !strcmp(key, "freq2"))
+    case DATA_KEY_MOD:
+    case DATA_KEY_FREQ:
+    case DATA_KEY_FREQ1:
+    case DATA_KEY_FREQ2:
         return TERM_COLOR_MAGENTA;
-    if (!strcmp(key, "rssi") || !strcmp(key, "snr") || !strcmp(key, "noise"))
+    case DATA_KEY_RSSI:
+    case DATA_KEY_SNR:
+    case DATA_KEY_NOISE:
         return TERM_COLOR_YELLOW;
-    return TERM_COLOR_GREEN;
+    default:
+        return TERM_COLOR_GREEN;
+    }
 }
 
-static int kv_break_before_key(char const *key)
+static int kv_break_before_key(data_key_id_t key_id)
 {
-    if (!key || !*key)
-        return 0;
-    if (!strcmp(key, "model") || !strcmp(key, "mod") || !strcmp(key, "rssi") || !strcmp(key, "codes"))
-        return 1;
-    return 0;
+    return key_id == DATA_KEY_MODEL || key_id == DATA_KEY_MOD || key_id == DATA_KEY_RSSI || key_id == DATA_KEY_CODES;
 }
 
-static int kv_break_after_key(char const *key)
+static int kv_break_after_key(data_key_id_t key_id)
 {
-    if (!key || !*key)
-        return 0;
-    if (!strcmp(key, "id") || !strcmp(key, "mic"))
-        return 1;
-    return 0;
+    return key_id == DATA_KEY_ID || key_id == DATA_KEY_MIC;
 }
 
 typedef struct {
@@ -217,11 +231,11 @@ static void R_API_CALLCONV print_kv_data(data_output_t *output, data_t *data, ch
         data_t *data_lvl  = NULL;
         data_t *data_msg  = NULL;
         for (data_t *d = data; d; d = d->next) {
-            if (!strcmp(d->key, "src"))
+            if (d->key_id == DATA_KEY_SRC)
                 data_src = d;
-            else if (!strcmp(d->key, "lvl"))
+            else if (d->key_id == DATA_KEY_LVL)
                 data_lvl = d;
-            else if (!strcmp(d->key, "msg"))
+            else if (d->key_id == DATA_KEY_MSG)
                 data_msg = d;
         }
         is_log = data_src && data_lvl && data_msg;
@@ -300,13 +314,13 @@ static void R_API_CALLCONV print_kv_data(data_output_t *output, data_t *data, ch
     ++kv->data_recursion;
     for (; data; data = data->next) {
         // skip logging keys
-        if (is_log && (!strcmp(data->key, "time") || !strcmp(data->key, "src") || !strcmp(data->key, "lvl")
-                || !strcmp(data->key, "msg") || !strcmp(data->key, "num_rows"))) {
+        if (is_log && (data->key_id == DATA_KEY_TIME || data->key_id == DATA_KEY_SRC || data->key_id == DATA_KEY_LVL
+                || data->key_id == DATA_KEY_MSG || data->key_id == DATA_KEY_NUM_ROWS)) {
             continue;
         }
 
         // break before some known keys
-        if (kv->column > 0 && kv_break_before_key(data->key)) {
+        if (kv->column > 0 && kv_break_before_key(data->key_id)) {
             fprintf(kv->file, "\n");
             kv->column = 0;
         }
@@ -321,17 +335,17 @@ static void R_API_CALLCONV print_kv_data(data_output_t *output, data_t *data, ch
         }
 
         // print key
-        char *key = *data->pretty_key ? data->pretty_key : data->key;
+        char const *key = *data->pretty_key ? data->pretty_key : data->key;
         kv->column += fprintf(kv->file, "%-10s: ", key);
         // print value
         if (color)
-            term_set_fg(kv->term, kv_color_for_key(data->key));
+            term_set_fg(kv->term, kv_color_for_key(data->key_id));
         print_value(output, data->type, data->value, data->format);
         if (color)
             term_set_fg(kv->term, TERM_COLOR_RESET);
 
         // force break after some known keys
-        if (kv->column > 0 && kv_break_after_key(data->key)) {
+        if (kv->column > 0 && kv_break_after_key(data->key_id)) {
             kv->column = kv->term_width; // force break;
         }
     }
@@ -385,10 +399,20 @@ static void R_API_CALLCONV data_output_kv_print(data_output_t *output, data_t *d
     if (kv && kv->file) {
         kv->output.print_data(output, data, NULL);
         fputc('\n', kv->file);
-        fflush(kv->file);
+        if (data_output_flush_due(output))
+            fflush(kv->file);
     }
 }
 
+static void R_API_CALLCONV data_output_kv_flush(data_output_t *output)
+{
+    data_output_kv_t *kv = (data_output_kv_t *)output;
+
+    if (kv->file)
+        fflush(kv->file);
+    output->flush_pending = 0;
+}
+
 static void R_API_CALLCONV data_output_kv_free(data_output_t *output)
 {
     data_output_kv_t *kv = (data_output_kv_t *)output;
@@ -417,6 +441,8 @@ struct data_output *data_output_kv_create(int log_level, FILE *file)
     kv->output.print_int    = print_kv_int;
     kv->output.output_print = data_output_kv_print;
     kv->output.output_free  = data_output_kv_free;
+    kv->output.output_flush = data_output_kv_flush;
+    kv->output.async_safe   = 1;
     kv->file                = file;
 
     kv->term = term_init(file);
@@ -429,13 +455,44 @@ struct data_output *data_output_kv_create(int log_level, FILE *file)
 
 /* CSV printer */
 
+typedef struct {
+    uint32_t hash; ///< hash of the field key
+    int column;    ///< column index, -1 if the slot is unused
+} csv_column_t;
+
 typedef struct {
     struct data_output output;
     FILE *file;
     const char **fields;
     const char *separator;
+    csv_column_t *index; ///< open addressing hash of field keys to columns
+    unsigned index_mask; ///< size of the index minus one, the size is a power of two
+    data_t **row;        ///< column slots for the current event, NULL if empty
 } data_output_csv_t;
 
+static uint32_t csv_key_hash(char const *key)
+{
+    uint32_t h = 2166136261U;
+    for (; *key; ++key) {
+        h ^= (unsigned char)*key;
+        h *= 16777619U;
+    }
+    return h;
+}
+
+/// Returns the column index of a key, or -1 if the key is not a column.
+static int csv_column(data_output_csv_t *csv, char const *key)
+{
+    uint32_t hash = csv_key_hash(key);
+    for (unsigned i = hash & csv->index_mask;; i = (i + 1) & csv->index_mask) {
+        csv_column_t *slot = &csv->index[i];
+        if (slot->column < 0)
+            return -1;
+        if (slot->hash == hash && strcmp(csv->fields[slot->column], key) == 0)
+            return slot->column;
+    }
+}
+
 static void R_API_CALLCONV print_csv_data(data_output_t *output, data_t *data, char const *format)
 {
     UNUSED(format);
@@ -545,7 +602,36 @@ static void R_API_CALLCONV data_output_csv_start(struct data_output *output, cha
     }
     csv->fields[csv_fields] = NULL;
     free((void *)allowed);
+    allowed = NULL;
     free(use_count);
+    use_count = NULL;
+
+    // index the columns by key, at most half full
+    unsigned index_size = 16;
+    while (index_size < 2 * (unsigned)csv_fields)
+        index_size *= 2;
+    csv->index = calloc(index_size, sizeof(*csv->index));
+    if (!csv->index) {
+        WARN_CALLOC("data_output_csv_start()");
+        goto alloc_error;
+    }
+    csv->index_mask = index_size - 1;
+    for (unsigned k = 0; k < index_size; ++k)
+        csv->index[k].column = -1;
+    for (i = 0; i < csv_fields; ++i) {
+        uint32_t hash = csv_key_hash(csv->fields[i]);
+        unsigned k    = hash & csv->index_mask;
+        while (csv->index[k].column >= 0)
+            k = (k + 1) & csv->index_mask;
+        csv->index[k].hash   = hash;
+        csv->index[k].column = i;
+    }
+
+    csv->row = calloc(csv_fields + 1, sizeof(*csv->row)); // '+ 1' so we never alloc size 0
+    if (!csv->row) {
+        WARN_CALLOC("data_output_csv_start()");
+        goto alloc_error;
+    }
 
     // Output the CSV header
     for (i = 0; csv->fields[i]; ++i) {
@@ -557,8 +643,11 @@ static void R_API_CALLCONV data_output_csv_start(struct data_output *output, cha
 alloc_error:
     free(use_count);
     free((void *)allowed);
-    if (csv)
+    if (csv) {
         free((void *)csv->fields);
+        free(csv->index);
+        free(csv->row);
+    }
     free(csv);
 }
 
@@ -583,32 +672,43 @@ static void R_API_CALLCONV data_output_csv_print(data_output_t *output, data_t *
     data_output_csv_t *csv = (data_output_csv_t *)output;
 
     const char **fields = csv->fields;
+    data_t **row        = csv->row;
 
+    // scatter the fields to their columns, the first of duplicate keys wins
     int regular = 0; // skip "states" output
     for (data_t *d = data; d; d = d->next) {
-        if (!strcmp(d->key, "msg") || !strcmp(d->key, "codes") || !strcmp(d->key, "model")) {
+        if (d->key_id == DATA_KEY_MSG || d->key_id == DATA_KEY_CODES || d->key_id == DATA_KEY_MODEL)
             regular = 1;
-            break;
-        }
+        int column = csv_column(csv, d->key);
+        if (column >= 0 && !row[column])
+            row[column] = d;
     }
-    if (!regular)
-        return;
 
     for (int i = 0; fields[i]; ++i) {
-        const char *key = fields[i];
-        data_t *found   = NULL;
+        data_t *found = row[i];
+        row[i]        = NULL;
+        if (!regular)
+            continue;
         if (i)
             fprintf(csv->file, "%s", csv->separator);
-        for (data_t *iter = data; !found && iter; iter = iter->next)
-            if (strcmp(iter->key, key) == 0)
-                found = iter;
-
         if (found)
             print_value(output, found->type, found->value, found->format);
     }
+    if (!regular)
+        return;
 
     fputc('\n', csv->file);
-    fflush(csv->file);
+    if (data_output_flush_due(output))
+        fflush(csv->file);
+}
+
+static void R_API_CALLCONV data_output_csv_flush(data_output_t *output)
+{
+    data_output_csv_t *csv = (data_output_csv_t *)output;
+
+    if (csv->file)
+        fflush(csv->file);
+    output->flush_pending = 0;
 }
 
 static void R_API_CALLCONV data_output_csv_free(data_output_t *output)
@@ -616,6 +716,8 @@ static void R_API_CALLCONV data_output_csv_free(data_output_t *output)
     data_output_csv_t *csv = (data_output_csv_t *)output;
 
     free((void *)csv->fields);
+    free(csv->index);
+    free(csv->row);
     free(csv);
 }
 
@@ -636,7 +738,86 @@ struct data_output *data_output_csv_create(int log_level, FILE *file)
     csv->output.output_start = data_output_csv_start;
     csv->output.output_print = data_output_csv_print;
     csv->output.output_free  = data_output_csv_free;
+    csv->output.output_flush = data_output_csv_flush;
+    csv->output.async_safe   = 1;
     csv->file                = file;
 
     return (struct data_output *)csv;
 }
+
+/* Buffered file stream wrapper */
+
+typedef struct {
+    struct data_output output;
+    data_output_t *inner;
+    FILE *file;
+    char *buf; ///< the full buffer set on the stream
+} data_output_buffered_t;
+
+static void R_API_CALLCONV print_buffered_data(data_output_t *output, data_t *data)
+{
+    data_output_buffered_t *wrap = (data_output_buffered_t *)output;
+
+    data_output_print(wrap->inner, data);
+}
+
+static void R_API_CALLCONV start_buffered_data(data_output_t *output, char const *const *fields, int num_fields)
+{
+    data_output_buffered_t *wrap = (data_output_buffered_t *)output;
+
+    data_output_start(wrap->inner, fields, num_fields);
+}
+
+static void R_API_CALLCONV flush_buffered_data(data_output_t *output)
+{
+    data_output_buffered_t *wrap = (data_output_buffered_t *)output;
+
+    data_output_flush(wrap->inner);
+}
+
+static void R_API_CALLCONV free_buffered_data(data_output_t *output)
+{
+    data_output_buffered_t *wrap = (data_output_buffered_t *)output;
+
+    data_output_free(wrap->inner);
+    // the stream uses the buffer until it is closed
+    fclose(wrap->file);
+    free(wrap->buf);
+    free(wrap);
+}
+
+struct data_output *data_output_file_buffer_wrap(struct data_output *output, FILE *file, size_t size)
+{
+    if (!output || !file)
+        return output;
+
+    data_output_buffered_t *wrap = calloc(1, sizeof(*wrap));
+    if (!wrap) {
+        WARN_CALLOC("data_output_file_buffer_wrap()");
+        return output; // NOTE: keeps the default buffer on alloc failure.
+    }
+    wrap->buf = malloc(size);
+    if (!wrap->buf) {
+        WARN_MALLOC("data_output_file_buffer_wrap()");
+        free(wrap);
+        return output; // NOTE: keeps the default buffer on alloc failure.
+    }
+    if (setvbuf(file, wrap->buf, _IOFBF, size)) {
+        free(wrap->buf);
+        free(wrap);
+        return output;
+    }
+
+    wrap->output.output_print = print_buffered_data;
+    wrap->output.output_start = start_buffered_data;
+    wrap->output.output_free  = free_buffered_data;
+    wrap->output.output_flush = output->output_flush ? flush_buffered_data : NULL;
+    wrap->output.log_level    = output->log_level;
+    wrap->output.async_safe   = output->async_safe;
+    wrap->output.flush_events = output->flush_events;
+    wrap->output.flush_msec   = output->flush_msec;
+    wrap->inner               = output;
+    wrap->file                = file;
+
+    return &wrap->output;
+}
@@ -25,8 +25,16 @@
 
 #include "mongoose.h"
 
+#ifdef ZLIB
+#include <zlib.h>
+#endif
+
 /* InfluxDB client abstraction / printer */
 
+#define INFLUX_BATCH_SIZE (64 * 1024)     ///< default maximum size of a batch in bytes
+#define INFLUX_MAX_MEM    (4 * 1024 * 1024) ///< default maximum size of queued data in bytes
+#define INFLUX_LINE_MAX   20000           ///< space reserved for a line
+
 typedef struct {
     struct data_output output;
     struct mg_mgr *mgr;
@@ -37,15 +45,97 @@ typedef struct {
     int prev_resp_code;
     char hostname[64];
     char url[400];
+    char address[300];  ///< connect address, "tcp://host:port"
+    char host[300];     ///< Host header
+    char target[400];   ///< request target, path and query
     char extra_headers[150];
     tls_opts_t tls_opts;
-    int databufidxfill;
-    struct mbuf databufs[2];
-
+    struct mbuf databuf; ///< queued line protocol, whole lines
+    struct mbuf sendbuf; ///< batch in flight or to be retried, possibly compressed
+    int in_flight;       ///< a request was sent and no reply received yet
+    double linger_until; ///< time the queued lines are due to be sent
+    double retry_at;     ///< time to retry after a failure
+    size_t batch_size;   ///< maximum size of a batch in bytes
+    int linger;          ///< time to wait for more lines in milliseconds
+    size_t max_mem;      ///< maximum size of queued data in bytes
+    int gzip;            ///< compress the request body
+    unsigned dropped;    ///< lines dropped since the last successful request
 } influx_client_t;
 
 static void influx_client_send(influx_client_t *ctx);
 
+/// Arm the timer for @p when unless it is already armed earlier.
+static void influx_client_schedule(influx_client_t *ctx, double when)
+{
+    if (!ctx->timer)
+        return;
+    if (ctx->timer->ev_timer_time <= 0 || when < ctx->timer->ev_timer_time)
+        mg_set_timer(ctx->timer, when);
+}
+
+/// Backoff after a failure, the batch is kept for the retry.
+static void influx_client_backoff(influx_client_t *ctx)
+{
+    if (ctx->reconnect_delay < 60) {
+        // 1, 3, 6, 10, 16, 25, 39, 60
+        ctx->reconnect_delay = (ctx->reconnect_delay + 1) * 3 / 2;
+    }
+    ctx->retry_at = mg_time() + ctx->reconnect_delay;
+    influx_client_schedule(ctx, ctx->retry_at);
+}
+
+static void influx_client_reply(influx_client_t *ctx, struct http_message *hm)
+{
+    ctx->in_flight = 0;
+
+    if (hm->resp_code >= 200 && hm->resp_code < 300) {
+        // mark influx data as sent
+        ctx->sendbuf.len     = 0;
+        ctx->reconnect_delay = 0;
+        ctx->retry_at        = 0;
+        if (ctx->dropped) {
+            print_logf(LOG_WARNING, "InfluxDB", "InfluxDB queue was full, dropped %u lines", ctx->dropped);
+            ctx->dropped = 0;
+        }
+    }
+    else {
+        if (ctx->prev_resp_code != hm->resp_code)
+            print_logf(LOG_WARNING, "InfluxDB", "InfluxDB replied HTTP code: %d with message:\n%.*s", hm->resp_code, (int)hm->body.len, hm->body.p);
+        if (hm->resp_code == 408 || hm->resp_code == 429 || hm->resp_code >= 500) {
+            influx_client_backoff(ctx);
+        }
+        else {
+            // the request is bad and won't succeed on retry
+            ctx->sendbuf.len = 0;
+        }
+    }
+    ctx->prev_resp_code = hm->resp_code;
+
+    influx_client_send(ctx);
+}
+
+/// Check if the server will close the connection after a reply.
+static int influx_reply_closes(struct http_message *hm, int has_body)
+{
+    struct mg_str *connection = mg_get_http_header(hm, "Connection");
+    if (connection && mg_vcasecmp(connection, "close") == 0)
+        return 1;
+    // a body without length is read until the connection is closed
+    return has_body
+            && !mg_get_http_header(hm, "Content-Length")
+            && !mg_get_http_header(hm, "Transfer-Encoding");
+}
+
+/// Let a closing connection go, the next request opens a new connection.
+static void influx_client_detach(influx_client_t *ctx)
+{
+    if (!ctx->conn)
+        return;
+    ctx->conn->user_data = NULL;
+    ctx->conn->flags |= MG_F_CLOSE_IMMEDIATELY;
+    ctx->conn = NULL;
+}
+
 static void influx_client_event(struct mg_connection *nc, int ev, void *ev_data)
 {
     // note that while shutting down the ctx is NULL
@@ -57,15 +147,11 @@ static void influx_client_event(struct mg_connection *nc, int ev, void *ev_data)
         int connect_status = *(int *)ev_data;
         if (connect_status == 0) {
             // Success
-            if (ctx) {
-                ctx->reconnect_delay = 0;
-            }
         } else {
             // Error, print only once
             if (ctx) {
                 if (ctx->prev_status != connect_status)
                     print_logf(LOG_WARNING, "InfluxDB", "InfluxDB connect error: %s", strerror(connect_status));
-                ctx->conn = NULL;
             }
         }
         if (ctx) {
@@ -73,33 +159,35 @@ static void influx_client_event(struct mg_connection *nc, int ev, void *ev_data)
         }
         break;
     }
-    case MG_EV_HTTP_CHUNK: // response is normally empty (so mongoose thinks we received a chunk only)
+    case MG_EV_HTTP_CHUNK:
+        // a response without Content-Length is read until close, but 204 has no body
+        if (!ctx || !ctx->in_flight || hm->message.len != (size_t)~0 || hm->resp_code != 204)
+            break;
+        mbuf_remove(&nc->recv_mbuf, hm->body.p - nc->recv_mbuf.buf);
+        if (influx_reply_closes(hm, 0))
+            influx_client_detach(ctx);
+        influx_client_reply(ctx, hm);
+        break;
     case MG_EV_HTTP_REPLY:
-        nc->flags |= MG_F_CLOSE_IMMEDIATELY;
-        if (hm->resp_code == 204) {
-            // mark influx data as sent
-        }
-        else {
-            if (ctx && ctx->prev_resp_code != hm->resp_code)
-                print_logf(LOG_WARNING, "InfluxDB", "InfluxDB replied HTTP code: %d with message:\n%s", hm->resp_code, hm->body.p);
-        }
-        if (ctx) {
-            ctx->prev_resp_code = hm->resp_code;
-        }
+        if (!ctx || !ctx->in_flight)
+            break;
+        if (influx_reply_closes(hm, 1))
+            influx_client_detach(ctx);
+        influx_client_reply(ctx, hm);
         break;
     case MG_EV_CLOSE:
         if (!ctx) {
             break; // shutting down
         }
         ctx->conn = NULL;
-        if (!ctx->timer) {
-            break; // shutting down
+        if (ctx->in_flight) {
+            // connect failed or the connection was lost, retry the batch
+            ctx->in_flight = 0;
+            influx_client_backoff(ctx);
         }
-        // Timer for next connect attempt, sends us MG_EV_TIMER event
-        mg_set_timer(ctx->timer, mg_time() + ctx->reconnect_delay);
-        if (ctx->reconnect_delay < 60) {
-            // 0, 1, 3, 6, 10, 16, 25, 39, 60
-            ctx->reconnect_delay = (ctx->reconnect_delay + 1) * 3 / 2;
+        else {
+            // idle keep-alive connection closed by the server, reconnect on demand
+            influx_client_send(ctx);
         }
         break;
     }
@@ -113,8 +201,9 @@ static void influx_client_timer(struct mg_connection *nc, int ev, void *ev_data)
 
     switch (ev) {
     case MG_EV_TIMER: {
-        // Try to reconnect, ends if no data to send
-        influx_client_send(ctx);
+        // Send due data or retry, ends if no data to send
+        if (ctx)
+            influx_client_send(ctx);
         break;
     }
     }
@@ -125,20 +214,68 @@ static influx_client_t *influx_client_init(influx_client_t *ctx, char const *url
     snprintf(ctx->url, sizeof(ctx->url), "%s", url);
     snprintf(ctx->extra_headers, sizeof (ctx->extra_headers), "Authorization: Token %s\r\n", token);
 
+    struct mg_str scheme, host, path, query;
+    unsigned port = 0;
+    mg_parse_uri(mg_mk_str(url), &scheme, NULL, &host, &port, &path, &query, NULL);
+    if (!port)
+        port = ctx->tls_opts.tls_ca_cert ? 443 : 80;
+    snprintf(ctx->address, sizeof(ctx->address), "tcp://%.*s:%u", (int)host.len, host.p, port);
+    snprintf(ctx->host, sizeof(ctx->host), "%.*s:%u", (int)host.len, host.p, port);
+    snprintf(ctx->target, sizeof(ctx->target), "%.*s?%.*s", (int)path.len, path.p, (int)query.len, query.p);
+
     return ctx;
 }
 
-static void influx_client_send(influx_client_t *ctx)
+/// Move a batch of whole lines from the queue to the send buffer, compress if enabled.
+static void influx_client_batch(influx_client_t *ctx)
 {
-    struct mbuf *buf = &ctx->databufs[ctx->databufidxfill];
+    struct mbuf *buf = &ctx->databuf;
+
+    // up to the last line end in the batch size, at least one line
+    size_t len = buf->len < ctx->batch_size ? buf->len : ctx->batch_size;
+    while (len > 0 && buf->buf[len - 1] != '\n')
+        len--;
+    if (!len) {
+        char *eol = memchr(buf->buf, '\n', buf->len);
+        len = eol ? (size_t)(eol - buf->buf) + 1 : buf->len;
+    }
 
-    /*fprintf(stderr, "Influx %p msg: \"%s\" with %lu/%lu %s\n",
-            (void*)ctx, buf->buf, buf->len, buf->size,
-            ctx->conn ? "buffering" : "to be sent");*/
+#ifdef ZLIB
+    if (ctx->gzip) {
+        z_stream zs = {0};
+        // gzip wrapper with default window size and memory level
+        if (deflateInit2(&zs, Z_DEFAULT_COMPRESSION, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+            print_log(LOG_ERROR, "InfluxDB", "deflateInit2() failed");
+            ctx->gzip = 0;
+        }
+        else {
+            size_t bound = deflateBound(&zs, (uLong)len);
+            ctx->sendbuf.len = 0;
+            mbuf_resize(&ctx->sendbuf, bound);
+            zs.next_in   = (Bytef *)buf->buf;
+            zs.avail_in  = (uInt)len;
+            zs.next_out  = (Bytef *)ctx->sendbuf.buf;
+            zs.avail_out = (uInt)(ctx->sendbuf.size);
+            int r = deflate(&zs, Z_FINISH);
+            ctx->sendbuf.len = zs.total_out;
+            deflateEnd(&zs);
+            if (r == Z_STREAM_END) {
+                mbuf_remove(buf, len);
+                return;
+            }
+            print_log(LOG_ERROR, "InfluxDB", "deflate() failed");
+            ctx->gzip = 0;
+        }
+    }
+#endif
 
-    if (ctx->conn || !buf->len)
-        return;
+    ctx->sendbuf.len = 0;
+    mbuf_append(&ctx->sendbuf, buf->buf, len);
+    mbuf_remove(buf, len);
+}
 
+static void influx_client_connect(influx_client_t *ctx)
+{
     char const *error_string = NULL;
     struct mg_connect_opts opts = {.user_data = ctx, .error_string = &error_string};
     if (ctx->tls_opts.tls_ca_cert) {
@@ -171,14 +308,72 @@ static void influx_client_send(influx_client_t *ctx)
         exit(1);
 #endif
     }
-    if ((ctx->conn = mg_connect_http_opt(ctx->mgr, influx_client_event, opts, ctx->url, ctx->extra_headers, buf->buf)) == NULL) {
+    if ((ctx->conn = mg_connect_opt(ctx->mgr, ctx->address, influx_client_event, opts)) == NULL) {
         print_logf(LOG_WARNING, "InfluxDB", "Connect to InfluxDB (%s) failed (%s)", ctx->url, error_string);
+        return;
     }
-    else {
-        ctx->databufidxfill ^= 1;
-        buf->len = 0;
-        *buf->buf = '\0';
+    mg_set_protocol_http_websocket(ctx->conn);
+}
+
+static void influx_client_send(influx_client_t *ctx)
+{
+    /*fprintf(stderr, "Influx %p queued %lu, batch %lu %s\n",
+            (void*)ctx, ctx->databuf.len, ctx->sendbuf.len,
+            ctx->in_flight ? "in flight" : "to be sent");*/
+
+    if (ctx->in_flight)
+        return;
+
+    double now = mg_time();
+    if (now < ctx->retry_at) {
+        influx_client_schedule(ctx, ctx->retry_at);
+        return;
     }
+
+    if (!ctx->sendbuf.len) {
+        if (!ctx->databuf.len)
+            return;
+        if (ctx->databuf.len < ctx->batch_size && now < ctx->linger_until) {
+            influx_client_schedule(ctx, ctx->linger_until);
+            return;
+        }
+        influx_client_batch(ctx);
+    }
+
+    if (!ctx->conn)
+        influx_client_connect(ctx);
+    if (!ctx->conn) {
+        influx_client_backoff(ctx);
+        return;
+    }
+
+    // keep-alive is the default with HTTP/1.1
+    mg_printf(ctx->conn, "POST %s HTTP/1.1\r\n"
+                         "Host: %s\r\n"
+                         "Content-Length: %lu\r\n"
+                         "%s%s\r\n",
+            ctx->target, ctx->host, (unsigned long)ctx->sendbuf.len,
+            ctx->gzip ? "Content-Encoding: gzip\r\n" : "", ctx->extra_headers);
+    mg_send(ctx->conn, ctx->sendbuf.buf, ctx->sendbuf.len);
+    ctx->in_flight = 1;
+}
+
+/// Queue a complete line, enforce the memory cap by dropping the oldest lines.
+static void influx_client_queued(influx_client_t *ctx)
+{
+    struct mbuf *buf = &ctx->databuf;
+
+    while (buf->len && buf->len + ctx->sendbuf.len > ctx->max_mem) {
+        if (!ctx->dropped)
+            print_log(LOG_WARNING, "InfluxDB", "InfluxDB queue full, dropping oldest data");
+        char *eol = memchr(buf->buf, '\n', buf->len);
+        mbuf_remove(buf, eol ? (size_t)(eol - buf->buf) + 1 : buf->len);
+        ctx->dropped++;
+    }
+    if (buf->len)
+        buf->buf[buf->len] = '\0';
+
+    influx_client_send(ctx);
 }
 
 /* Helper */
@@ -248,22 +443,22 @@ static void R_API_CALLCONV print_influx_array(data_output_t *output, data_array_
     UNUSED(array);
     UNUSED(format);
     influx_client_t *influx = (influx_client_t *)output;
-    struct mbuf *buf = &influx->databufs[influx->databufidxfill];
+    struct mbuf *buf = &influx->databuf;
     mbuf_snprintf(buf, "\"array\""); // TODO
 }
 
 static void R_API_CALLCONV print_influx_data_escaped(data_output_t *output, data_t *data, char const *format)
 {
-    char str[1000];
-    data_print_jsons(data, str, sizeof (str));
-    output->print_string(output, str, format);
+    char const *str = data_jsons(data, NULL);
+    if (str)
+        output->print_string(output, str, format);
 }
 
 static void R_API_CALLCONV print_influx_string_escaped(data_output_t *output, char const *str, char const *format)
 {
     UNUSED(format);
     influx_client_t *influx = (influx_client_t *)output;
-    struct mbuf *databuf = &influx->databufs[influx->databufidxfill];
+    struct mbuf *databuf = &influx->databuf;
     size_t size = databuf->size - databuf->len;
     char *buf = &databuf->buf[databuf->len];
 
@@ -315,7 +510,7 @@ static void R_API_CALLCONV print_influx_string(data_output_t *output, char const
 {
     UNUSED(format);
     influx_client_t *influx = (influx_client_t *)output;
-    struct mbuf *buf = &influx->databufs[influx->databufidxfill];
+    struct mbuf *buf = &influx->databuf;
     mbuf_snprintf(buf, "%s", str);
 }
 
@@ -326,16 +521,21 @@ static void R_API_CALLCONV print_influx_data(data_output_t *output, data_t *data
     influx_client_t *influx = (influx_client_t *)output;
     char *str;
     char *end;
-    struct mbuf *buf = &influx->databufs[influx->databufidxfill];
+    struct mbuf *buf = &influx->databuf;
     bool comma = false;
 
+    if (!buf->len) {
+        // the first queued line starts the linger time
+        influx->linger_until = mg_time() + influx->linger / 1000.0;
+    }
+
     data_t *data_org = data;
     data_t *data_model = NULL;
     data_t *data_time = NULL;
     for (data_t *d = data; d; d = d->next) {
-        if (!strcmp(d->key, "model"))
+        if (d->key_id == DATA_KEY_MODEL)
             data_model = d;
-        if (!strcmp(d->key, "time"))
+        if (d->key_id == DATA_KEY_TIME)
             data_time = d;
     }
 
@@ -343,7 +543,7 @@ static void R_API_CALLCONV print_influx_data(data_output_t *output, data_t *data
         // data isn't from device (maybe report for example)
         // use hostname for measurement
 
-        mbuf_reserve(buf, 20000);
+        mbuf_reserve(buf, INFLUX_LINE_MAX);
         mbuf_snprintf(buf, "rtl_433_%s", influx->hostname);
     }
     else {
@@ -357,15 +557,15 @@ static void R_API_CALLCONV print_influx_data(data_output_t *output, data_t *data
 
     // write tags
     while (data) {
-        if (!strcmp(data->key, "model")
-                || !strcmp(data->key, "time")) {
+        if (data->key_id == DATA_KEY_MODEL
+                || data->key_id == DATA_KEY_TIME) {
             // skip
         }
-        else if (!strcmp(data->key, "type")
-                || !strcmp(data->key, "subtype")
-                || !strcmp(data->key, "id")
-                || !strcmp(data->key, "channel")
-                || !strcmp(data->key, "mic")) {
+        else if (data->key_id == DATA_KEY_TYPE
+                || data->key_id == DATA_KEY_SUBTYPE
+                || data->key_id == DATA_KEY_ID
+                || data->key_id == DATA_KEY_CHANNEL
+                || data->key_id == DATA_KEY_MIC) {
             str = mbuf_snprintf(buf, ",%s=", data->key);
             str++;
             end = &buf->buf[buf->len - 1];
@@ -386,15 +586,15 @@ static void R_API_CALLCONV print_influx_data(data_output_t *output, data_t *data
     // write fields
     data = data_org;
     while (data) {
-        if (!strcmp(data->key, "model")
-                || !strcmp(data->key, "time")) {
+        if (data->key_id == DATA_KEY_MODEL
+                || data->key_id == DATA_KEY_TIME) {
             // skip
         }
-        else if (!strcmp(data->key, "type")
-                || !strcmp(data->key, "subtype")
-                || !strcmp(data->key, "id")
-                || !strcmp(data->key, "channel")
-                || !strcmp(data->key, "mic")) {
+        else if (data->key_id == DATA_KEY_TYPE
+                || data->key_id == DATA_KEY_SUBTYPE
+                || data->key_id == DATA_KEY_ID
+                || data->key_id == DATA_KEY_CHANNEL
+                || data->key_id == DATA_KEY_MIC) {
             // skip
         }
         else {
@@ -435,14 +635,14 @@ static void R_API_CALLCONV print_influx_data(data_output_t *output, data_t *data
     }
     mbuf_snprintf(buf, "\n");
 
-    influx_client_send(influx);
+    influx_client_queued(influx);
 }
 
 static void R_API_CALLCONV print_influx_double(data_output_t *output, double data, char const *format)
 {
     UNUSED(format);
     influx_client_t *influx = (influx_client_t *)output;
-    struct mbuf *buf = &influx->databufs[influx->databufidxfill];
+    struct mbuf *buf = &influx->databuf;
     mbuf_snprintf(buf, "%f", data);
 }
 
@@ -450,10 +650,19 @@ static void R_API_CALLCONV print_influx_int(data_output_t *output, int data, cha
 {
     UNUSED(format);
     influx_client_t *influx = (influx_client_t *)output;
-    struct mbuf *buf = &influx->databufs[influx->databufidxfill];
+    struct mbuf *buf = &influx->databuf;
     mbuf_snprintf(buf, "%d", data);
 }
 
+static void R_API_CALLCONV data_output_influx_flush(data_output_t *output)
+{
+    influx_client_t *influx = (influx_client_t *)output;
+
+    // send queued lines without waiting for the linger time
+    influx->linger_until = 0;
+    influx_client_send(influx);
+}
+
 static void R_API_CALLCONV data_output_influx_free(data_output_t *output)
 {
     influx_client_t *influx = (influx_client_t *)output;
@@ -466,7 +675,13 @@ static void R_API_CALLCONV data_output_influx_free(data_output_t *output)
         influx->conn->user_data = NULL;
         influx->conn->flags |= MG_F_CLOSE_IMMEDIATELY;
     }
+    if (influx->timer) {
+        influx->timer->user_data = NULL;
+        influx->timer->flags |= MG_F_CLOSE_IMMEDIATELY;
+    }
 
+    mbuf_free(&influx->databuf);
+    mbuf_free(&influx->sendbuf);
     free(influx);
 }
 
@@ -485,6 +700,9 @@ struct data_output *data_output_influx_create(struct mg_mgr *mgr, char *opts)
         *dot = '\0';
     influx_sanitize_tag(influx->hostname, NULL);
 
+    influx->batch_size = INFLUX_BATCH_SIZE;
+    influx->max_mem    = INFLUX_MAX_MEM;
+
     char *token = NULL;
 
     // param/opts starts with URL
@@ -527,6 +745,21 @@ struct data_output *data_output_influx_create(struct mg_mgr *mgr, char *opts)
             continue;
         else if (!strcasecmp(key, "t") || !strcasecmp(key, "token"))
             token = val;
+        else if (!strcasecmp(key, "batch"))
+            influx->batch_size = atouint32_metric(val, "-F influx batch= ");
+        else if (!strcasecmp(key, "linger"))
+            influx->linger = atouint32_metric(val, "-F influx linger= ");
+        else if (!strcasecmp(key, "max_mem"))
+            influx->max_mem = atouint32_metric(val, "-F influx max_mem= ");
+        else if (!strcasecmp(key, "gzip")) {
+            influx->gzip = atobv(val, 1);
+#ifndef ZLIB
+            if (influx->gzip) {
+                print_log(LOG_FATAL, __func__, "influx gzip not available");
+                exit(1);
+            }
+#endif
+        }
         else if (!tls_param(&influx->tls_opts, key, val)) {
             // ok
         }
@@ -541,6 +774,7 @@ struct data_output *data_output_influx_create(struct mg_mgr *mgr, char *opts)
     influx->output.print_string = print_influx_string;
     influx->output.print_double = print_influx_double;
     influx->output.print_int    = print_influx_int;
+    influx->output.output_flush = data_output_influx_flush;
     influx->output.output_free  = data_output_influx_free;
 
     print_logf(LOG_CRITICAL, "InfluxDB", "Publishing data to InfluxDB (%s)", url);
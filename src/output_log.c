@@ -90,11 +90,11 @@ static void R_API_CALLCONV data_output_log_print(data_output_t *output, data_t *
     data_t *data_lvl = NULL;
     data_t *data_msg = NULL;
     for (data_t *d = data; d; d = d->next) {
-        if (!strcmp(d->key, "src"))
+        if (d->key_id == DATA_KEY_SRC)
             data_src = d;
-        else if (!strcmp(d->key, "lvl"))
+        else if (d->key_id == DATA_KEY_LVL)
             data_lvl = d;
-        else if (!strcmp(d->key, "msg"))
+        else if (d->key_id == DATA_KEY_MSG)
             data_msg = d;
     }
 
@@ -116,11 +116,11 @@ static void R_API_CALLCONV data_output_log_print(data_output_t *output, data_t *
 
     for (; data; data = data->next) {
         // skip logging keys
-        if (!strcmp(data->key, "time")
-                || !strcmp(data->key, "src")
-                || !strcmp(data->key, "lvl")
-                || !strcmp(data->key, "msg")
-                || !strcmp(data->key, "num_rows")) {
+        if (data->key_id == DATA_KEY_TIME
+                || data->key_id == DATA_KEY_SRC
+                || data->key_id == DATA_KEY_LVL
+                || data->key_id == DATA_KEY_MSG
+                || data->key_id == DATA_KEY_NUM_ROWS) {
             continue;
         }
 
@@ -131,7 +131,17 @@ static void R_API_CALLCONV data_output_log_print(data_output_t *output, data_t *
     }
 
     fputc('\n', log->file);
-    fflush(log->file);
+    if (data_output_flush_due(output))
+        fflush(log->file);
+}
+
+static void R_API_CALLCONV data_output_log_flush(data_output_t *output)
+{
+    data_output_log_t *log = (data_output_log_t *)output;
+
+    if (log->file)
+        fflush(log->file);
+    output->flush_pending = 0;
 }
 
 static void R_API_CALLCONV data_output_log_free(data_output_t *output)
@@ -162,6 +172,8 @@ struct data_output *data_output_log_create(int log_level, FILE *file)
     log->output.print_int    = print_log_int;
     log->output.output_print = data_output_log_print;
     log->output.output_free  = data_output_log_free;
+    log->output.output_flush = data_output_log_flush;
+    log->output.async_safe   = 1;
     log->file                = file;
 
     return (struct data_output *)log;
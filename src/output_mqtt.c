@@ -25,6 +25,14 @@
 
 /* MQTT client abstraction */
 
+/// A QoS 1 PUBLISH packet kept until the broker acknowledges it.
+typedef struct mqtt_msg {
+    uint16_t message_id;
+    int acked;
+    size_t len;
+    uint8_t *packet;
+} mqtt_msg_t;
+
 typedef struct mqtt_client {
     struct mg_connect_opts connect_opts;
     struct mg_send_mqtt_handshake_opts mqtt_opts;
@@ -32,12 +40,128 @@ typedef struct mqtt_client {
     struct mg_connection *timer;
     int reconnect_delay;
     int prev_status;
+    int connected; // CONNACK accepted
     char address[253 + 6 + 1]; // dns max + port
     char client_id[256];
     uint16_t message_id;
     int publish_flags; // MG_MQTT_RETAIN | MG_MQTT_QOS(0)
+    mqtt_msg_t *queue; // QoS 1 ring of messages in order, the first `inflight` are sent
+    int queue_size;
+    int queue_head;
+    int queue_len;
+    int inflight;
+    int inflight_max;
+    unsigned dropped;
 } mqtt_client_t;
 
+/// Reserve space at the end of the send buffer.
+/// Mongoose writes the whole send buffer with one send() on the next poll,
+/// appending all packets of an event here coalesces them into one socket write.
+static uint8_t *mqtt_client_reserve(mqtt_client_t *ctx, size_t len)
+{
+    struct mbuf *io = &ctx->conn->send_mbuf;
+    if (io->size - io->len < len)
+        mbuf_resize(io, io->len + len + io->len / 2);
+    if (io->size - io->len < len)
+        return NULL; // NOTE: returns NULL on alloc failure.
+
+    // we bypass mg_send() and mg_mqtt_publish(), keep their timestamps
+    struct mg_mqtt_proto_data *pd = (struct mg_mqtt_proto_data *)ctx->conn->proto_data;
+    ctx->conn->last_io_time = (time_t)mg_time();
+    pd->last_control_time   = mg_time();
+
+    return (uint8_t *)io->buf + io->len;
+}
+
+/// Maximum size of an encoded PUBLISH packet.
+static size_t mqtt_publish_size(size_t topic_len, size_t str_len)
+{
+    return 1 + 4 + 2 + topic_len + 2 + str_len;
+}
+
+/// Encode a PUBLISH packet like mg_mqtt_publish(), returns the length.
+static size_t mqtt_publish_encode(uint8_t *dst, char const *topic, size_t topic_len, uint16_t message_id, int flags, char const *str, size_t str_len)
+{
+    int qos    = MG_MQTT_GET_QOS(flags);
+    size_t len = 2 + topic_len + (qos > 0 ? 2 : 0) + str_len;
+    uint8_t *p = dst;
+
+    *p++ = (uint8_t)(MG_MQTT_CMD_PUBLISH << 4 | flags);
+    // mqtt variable length encoding
+    do {
+        *p = len % 0x80;
+        len /= 0x80;
+        if (len > 0)
+            *p |= 0x80;
+        p++;
+    } while (len > 0);
+
+    *p++ = (uint8_t)(topic_len >> 8);
+    *p++ = (uint8_t)topic_len;
+    memcpy(p, topic, topic_len);
+    p += topic_len;
+    if (qos > 0) {
+        *p++ = (uint8_t)(message_id >> 8);
+        *p++ = (uint8_t)message_id;
+    }
+    memcpy(p, str, str_len);
+    p += str_len;
+
+    return (size_t)(p - dst);
+}
+
+static mqtt_msg_t *mqtt_client_queued(mqtt_client_t *ctx, int idx)
+{
+    return &ctx->queue[(ctx->queue_head + idx) % ctx->queue_size];
+}
+
+static void mqtt_client_pop(mqtt_client_t *ctx)
+{
+    mqtt_msg_t *msg = mqtt_client_queued(ctx, 0);
+    free(msg->packet);
+    msg->packet = NULL;
+    msg->acked  = 0;
+    ctx->queue_head = (ctx->queue_head + 1) % ctx->queue_size;
+    ctx->queue_len--;
+    if (ctx->inflight > 0)
+        ctx->inflight--;
+}
+
+/// Send queued QoS 1 messages up to the inflight window.
+static void mqtt_client_drain(mqtt_client_t *ctx)
+{
+    while (ctx->connected && ctx->inflight < ctx->inflight_max && ctx->inflight < ctx->queue_len) {
+        mqtt_msg_t *msg = mqtt_client_queued(ctx, ctx->inflight);
+        uint8_t *dst    = mqtt_client_reserve(ctx, msg->len);
+        if (!dst)
+            break; // retry with the next message or ack
+        memcpy(dst, msg->packet, msg->len);
+        ctx->conn->send_mbuf.len += msg->len;
+        msg->packet[0] |= MG_MQTT_DUP; // a resend after reconnect is a duplicate
+        ctx->inflight++;
+    }
+}
+
+static void mqtt_client_acked(mqtt_client_t *ctx, uint16_t message_id)
+{
+    // the broker acknowledges in order, but dropped messages leave gaps
+    for (int i = 0; i < ctx->inflight; ++i) {
+        mqtt_msg_t *msg = mqtt_client_queued(ctx, i);
+        if (msg->message_id == message_id) {
+            msg->acked = 1;
+            break;
+        }
+    }
+    while (ctx->inflight > 0 && mqtt_client_queued(ctx, 0)->acked) {
+        mqtt_client_pop(ctx);
+    }
+    if (ctx->dropped && ctx->queue_len == 0) {
+        print_logf(LOG_WARNING, "MQTT", "MQTT queue recovered, %u messages were dropped", ctx->dropped);
+        ctx->dropped = 0;
+    }
+    mqtt_client_drain(ctx);
+}
+
 static void mqtt_client_event(struct mg_connection *nc, int ev, void *ev_data)
 {
     // note that while shutting down the ctx is NULL
@@ -77,10 +201,17 @@ static void mqtt_client_event(struct mg_connection *nc, int ev, void *ev_data)
         }
         else {
             print_log(LOG_NOTICE, "MQTT", "MQTT Connection established.");
+            if (ctx) {
+                ctx->connected = 1;
+                mqtt_client_drain(ctx);
+            }
         }
         break;
     case MG_EV_MQTT_PUBACK:
-        print_logf(LOG_NOTICE, "MQTT", "MQTT Message publishing acknowledged (msg_id: %u)", msg->message_id);
+        print_logf(LOG_DEBUG, "MQTT", "MQTT Message publishing acknowledged (msg_id: %u)", msg->message_id);
+        if (ctx && ctx->queue) {
+            mqtt_client_acked(ctx, msg->message_id);
+        }
         break;
     case MG_EV_MQTT_SUBACK:
         print_log(LOG_NOTICE, "MQTT", "MQTT Subscription acknowledged.");
@@ -94,7 +225,9 @@ static void mqtt_client_event(struct mg_connection *nc, int ev, void *ev_data)
         if (!ctx) {
             break; // shutting down
         }
-        ctx->conn = NULL;
+        ctx->conn      = NULL;
+        ctx->connected = 0;
+        ctx->inflight  = 0; // unacknowledged messages are sent again after reconnect
         if (!ctx->timer) {
             break; // shutting down
         }
@@ -136,7 +269,7 @@ static void mqtt_client_timer(struct mg_connection *nc, int ev, void *ev_data)
     }
 }
 
-static mqtt_client_t *mqtt_client_init(struct mg_mgr *mgr, tls_opts_t *tls_opts, char const *host, char const *port, char const *user, char const *pass, char const *client_id, int retain, int qos)
+static mqtt_client_t *mqtt_client_init(struct mg_mgr *mgr, tls_opts_t *tls_opts, char const *host, char const *port, char const *user, char const *pass, char const *client_id, int retain, int qos, int inflight, int queue)
 {
     mqtt_client_t *ctx = calloc(1, sizeof(*ctx));
     if (!ctx)
@@ -145,6 +278,13 @@ static mqtt_client_t *mqtt_client_init(struct mg_mgr *mgr, tls_opts_t *tls_opts,
     ctx->mqtt_opts.user_name = user;
     ctx->mqtt_opts.password  = pass;
     ctx->publish_flags  = MG_MQTT_QOS(qos) | (retain ? MG_MQTT_RETAIN : 0);
+    if (qos > 0) {
+        ctx->queue = calloc(queue, sizeof(*ctx->queue));
+        if (!ctx->queue)
+            FATAL_CALLOC("mqtt_client_init()");
+        ctx->queue_size   = queue;
+        ctx->inflight_max = inflight;
+    }
     // TODO: these should be user configurable options
     //ctx->opts.keepalive = 60;
     //ctx->timeout = 10000L;
@@ -207,11 +347,42 @@ static mqtt_client_t *mqtt_client_init(struct mg_mgr *mgr, tls_opts_t *tls_opts,
 
 static void mqtt_client_publish(mqtt_client_t *ctx, char const *topic, char const *str)
 {
-    if (!ctx->conn || !ctx->conn->proto_handler)
+    size_t topic_len = strlen(topic);
+    size_t str_len   = strlen(str);
+
+    if (!ctx->queue) {
+        // QoS 0, messages are lost while disconnected
+        if (!ctx->conn || !ctx->conn->proto_handler)
+            return;
+        uint8_t *dst = mqtt_client_reserve(ctx, mqtt_publish_size(topic_len, str_len));
+        if (!dst)
+            return; // NOTE: skip output on alloc failure.
+        ctx->conn->send_mbuf.len += mqtt_publish_encode(dst, topic, topic_len, 0, ctx->publish_flags, str, str_len);
         return;
+    }
 
-    ctx->message_id++;
-    mg_mqtt_publish(ctx->conn, topic, ctx->message_id, ctx->publish_flags, str, strlen(str));
+    // QoS 1, queue the message until the broker acknowledges it
+    if (ctx->queue_len == ctx->queue_size) {
+        // the broker is gone or not keeping up, drop the oldest message
+        mqtt_client_pop(ctx);
+        if (!ctx->dropped++)
+            print_log(LOG_WARNING, "MQTT", "MQTT queue full, dropping oldest messages");
+    }
+    uint8_t *packet = malloc(mqtt_publish_size(topic_len, str_len));
+    if (!packet) {
+        WARN_MALLOC("mqtt_client_publish()");
+        return; // NOTE: skip output on alloc failure.
+    }
+    if (++ctx->message_id == 0)
+        ctx->message_id = 1; // zero is not a valid message id
+    mqtt_msg_t *msg = mqtt_client_queued(ctx, ctx->queue_len);
+    msg->message_id = ctx->message_id;
+    msg->acked      = 0;
+    msg->packet     = packet;
+    msg->len        = mqtt_publish_encode(packet, topic, topic_len, ctx->message_id, ctx->publish_flags, str, str_len);
+    ctx->queue_len++;
+
+    mqtt_client_drain(ctx);
 }
 
 static void mqtt_client_free(mqtt_client_t *ctx)
@@ -220,21 +391,325 @@ static void mqtt_client_free(mqtt_client_t *ctx)
         ctx->conn->user_data = NULL;
         ctx->conn->flags |= MG_F_CLOSE_IMMEDIATELY;
     }
+    if (ctx && ctx->queue) {
+        if (ctx->queue_len)
+            print_logf(LOG_NOTICE, "MQTT", "MQTT discarding %d unacknowledged messages", ctx->queue_len);
+        while (ctx->queue_len)
+            mqtt_client_pop(ctx);
+        free(ctx->queue);
+    }
     free(ctx);
 }
 
-/* Helper */
+/* MQTT topic templates */
+
+#define FNV_OFFSET 14695981039346656037ULL
+#define FNV_PRIME 1099511628211ULL
+
+/// Data keys usable as topic tokens.
+enum mqtt_topic_key {
+    TOPIC_TYPE,
+    TOPIC_MODEL,
+    TOPIC_SUBTYPE,
+    TOPIC_CHANNEL,
+    TOPIC_ID,
+    TOPIC_PROTOCOL,
+    TOPIC_KEYS, ///< number of keys, also marks the trailing text
+};
+
+/// Literal text followed by a token.
+typedef struct mqtt_token {
+    char const *text; ///< literal text preceding the token
+    size_t text_len;
+    int key;          ///< one of enum mqtt_topic_key
+    char slash;       ///< leading separator or 0
+    char const *def;  ///< default value or NULL
+    size_t def_len;
+} mqtt_token_t;
+
+#define MQTT_TOPIC_CACHE 64 ///< cached topics per template, must be a power of two
+#define MQTT_TOPIC_KEY_MAX 256 ///< maximum size of the token values of a cached topic
+
+typedef struct mqtt_topic_cache {
+    char *key;      ///< the token values the topic was expanded from, NULL marks an unused slot
+    size_t key_len;
+    size_t len;
+    char *topic;
+} mqtt_topic_cache_t;
+
+/// A topic template compiled to tokens, expanded topics are cached by token values.
+typedef struct mqtt_topic {
+    char *format; ///< the template as given, defaults point into this
+    char *text;   ///< literal text with the hostname resolved
+    mqtt_token_t *tokens;
+    int num_tokens; ///< the last token only holds the trailing text
+    mqtt_topic_cache_t cache[MQTT_TOPIC_CACHE];
+} mqtt_topic_t;
+
+static mqtt_topic_t *mqtt_topic_compile(char const *format, char const *hostname)
+{
+    // each '[' starts at most one token and may add the hostname to the text
+    size_t max_tokens = 1;
+    for (char const *p = format; *p; ++p) {
+        if (*p == '[')
+            max_tokens++;
+    }
+
+    mqtt_topic_t *tpl = calloc(1, sizeof(*tpl));
+    if (!tpl)
+        FATAL_CALLOC("mqtt_topic_compile()");
+    tpl->format = strdup(format);
+    if (!tpl->format)
+        FATAL_STRDUP("mqtt_topic_compile()");
+    tpl->tokens = calloc(max_tokens, sizeof(*tpl->tokens));
+    if (!tpl->tokens)
+        FATAL_CALLOC("mqtt_topic_compile()");
+    tpl->text = malloc(strlen(format) + max_tokens * (strlen(hostname) + 1) + 1);
+    if (!tpl->text)
+        FATAL_MALLOC("mqtt_topic_compile()");
+
+    char const *fmt   = tpl->format;
+    char *text        = tpl->text;
+    mqtt_token_t *tok = tpl->tokens;
+    tok->text         = text;
+
+    // consume entire format string
+    while (*fmt) {
+        char slash          = 0;
+        char const *t_start = NULL;
+        size_t t_len        = 0;
+        char const *d_start = NULL;
+        size_t d_len        = 0;
+        // copy until '['
+        while (*fmt && *fmt != '[')
+            *text++ = *fmt++;
+        // skip '['
+        if (!*fmt)
+            break;
+        ++fmt;
+        // read slash
+        if (*fmt && (*fmt < 'a' || *fmt > 'z')) {
+            slash = *fmt;
+            fmt++;
+        }
+        // read key until : or ]
+        t_start = fmt;
+        while (*fmt && *fmt != ':' && *fmt != ']' && *fmt != '[')
+            ++fmt;
+        t_len = (size_t)(fmt - t_start);
+        // read default until ]
+        if (*fmt == ':') {
+            d_start = ++fmt;
+            while (*fmt && *fmt != ']' && *fmt != '[')
+                ++fmt;
+            d_len = (size_t)(fmt - d_start);
+        }
+        // check for proper closing
+        if (*fmt != ']') {
+            print_log(LOG_FATAL, __func__, "unterminated token");
+            exit(1);
+        }
+        ++fmt;
+
+        // resolve token
+        int key;
+        if (!strncmp(t_start, "hostname", t_len)) {
+            // the hostname is fixed, fold it into the text
+            if (slash)
+                *text++ = slash;
+            text += sprintf(text, "%s", hostname);
+            continue;
+        }
+        else if (!strncmp(t_start, "type", t_len))
+            key = TOPIC_TYPE;
+        else if (!strncmp(t_start, "model", t_len))
+            key = TOPIC_MODEL;
+        else if (!strncmp(t_start, "subtype", t_len))
+            key = TOPIC_SUBTYPE;
+        else if (!strncmp(t_start, "channel", t_len))
+            key = TOPIC_CHANNEL;
+        else if (!strncmp(t_start, "id", t_len))
+            key = TOPIC_ID;
+        else if (!strncmp(t_start, "protocol", t_len))
+            key = TOPIC_PROTOCOL;
+        else {
+            print_logf(LOG_FATAL, __func__, "unknown token \"%.*s\"", (int)t_len, t_start);
+            exit(1);
+        }
+
+        tok->text_len = (size_t)(text - tok->text);
+        tok->key      = key;
+        tok->slash    = slash;
+        tok->def      = d_start;
+        tok->def_len  = d_len;
+        ++tok;
+        tok->text = text;
+    }
+
+    tok->text_len   = (size_t)(text - tok->text);
+    tok->key        = TOPIC_KEYS;
+    tpl->num_tokens = (int)(tok - tpl->tokens) + 1;
+
+    return tpl;
+}
+
+static void mqtt_topic_free(mqtt_topic_t *tpl)
+{
+    if (!tpl)
+        return;
+
+    for (int i = 0; i < MQTT_TOPIC_CACHE; ++i) {
+        free(tpl->cache[i].key);
+        free(tpl->cache[i].topic);
+    }
+    free(tpl->tokens);
+    free(tpl->text);
+    free(tpl->format);
+    free(tpl);
+}
 
-/// clean the topic inplace to [-.A-Za-z0-9], esp. not whitespace, +, #, /, $
-static char *mqtt_sanitize_topic(char *topic)
+/// clean the char to [-.A-Za-z0-9], esp. not whitespace, +, #, /, $
+static char mqtt_sanitize_char(char c)
 {
-    for (char *p = topic; *p; ++p)
-        if (*p != '-' && *p != '.' && (*p < 'A' || *p > 'Z') && (*p < 'a' || *p > 'z') && (*p < '0' || *p > '9'))
-            *p = '_';
+    if (c != '-' && c != '.' && (c < 'A' || c > 'Z') && (c < 'a' || c > 'z') && (c < '0' || c > '9'))
+        return '_';
+    return c;
+}
 
+static char *mqtt_topic_append(char *topic, char const *end, char const *src, size_t len)
+{
+    if (len > (size_t)(end - topic))
+        len = (size_t)(end - topic);
+    memcpy(topic, src, len);
+    return topic + len;
+}
+
+static char *mqtt_topic_render(mqtt_topic_t const *tpl, char *topic, char const *end, data_t *const *keys)
+{
+    for (int i = 0; i < tpl->num_tokens; ++i) {
+        mqtt_token_t const *tok = &tpl->tokens[i];
+        topic = mqtt_topic_append(topic, end, tok->text, tok->text_len);
+        if (tok->key == TOPIC_KEYS)
+            break;
+
+        // append token or default
+        data_t *data = keys[tok->key];
+        if (!data && !tok->def)
+            continue;
+        if (tok->slash && topic < end)
+            *topic++ = tok->slash;
+        if (!data) {
+            topic = mqtt_topic_append(topic, end, tok->def, tok->def_len);
+        }
+        else if (data->type == DATA_STRING) {
+            for (char const *p = data->value.v_ptr; *p && topic < end; ++p)
+                *topic++ = mqtt_sanitize_char(*p);
+        }
+        else if (data->type == DATA_INT) {
+            char num[12];
+            int len = snprintf(num, sizeof(num), "%d", data->value.v_int);
+            topic   = mqtt_topic_append(topic, end, num, (size_t)len);
+        }
+        else {
+            print_logf(LOG_ERROR, __func__, "Can't append data type %d to topic", data->type);
+        }
+    }
+
+    *topic = '\0';
     return topic;
 }
 
+static uint64_t mqtt_hash_bytes(uint64_t h, void const *buf, size_t len)
+{
+    unsigned char const *p = buf;
+    for (size_t i = 0; i < len; ++i) {
+        h ^= p[i];
+        h *= FNV_PRIME;
+    }
+    return h;
+}
+
+static int mqtt_key_append(char *key, size_t *pos, void const *src, size_t len)
+{
+    if (*pos + len > MQTT_TOPIC_KEY_MAX)
+        return -1;
+    memcpy(key + *pos, src, len);
+    *pos += len;
+    return 0;
+}
+
+/// Serialize the token values to @p key, returns the length or 0 if the values can't be cached.
+static size_t mqtt_topic_key(mqtt_topic_t const *tpl, data_t *const *keys, char *key)
+{
+    size_t pos = 0;
+    for (int i = 0; i < tpl->num_tokens - 1; ++i) {
+        data_t *data = keys[tpl->tokens[i].key];
+        char type    = data ? (char)data->type : -1;
+        if (mqtt_key_append(key, &pos, &type, sizeof(type)))
+            return 0;
+        if (!data)
+            continue;
+        int ret = 0;
+        if (data->type == DATA_STRING)
+            ret = mqtt_key_append(key, &pos, data->value.v_ptr, strlen(data->value.v_ptr) + 1); // include the terminator
+        else if (data->type == DATA_INT)
+            ret = mqtt_key_append(key, &pos, &data->value.v_int, sizeof(data->value.v_int));
+        else if (data->type == DATA_DOUBLE)
+            ret = mqtt_key_append(key, &pos, &data->value.v_dbl, sizeof(data->value.v_dbl));
+        else
+            ret = -1; // not a plain value
+        if (ret)
+            return 0;
+    }
+    return pos;
+}
+
+/// Expand the template for the given well-known keys, returns the end of the topic.
+static char *mqtt_topic_expand(mqtt_topic_t *tpl, char *topic, size_t size, data_t *const *keys)
+{
+    char const *end = topic + size - 1;
+
+    // a template without tokens is a fixed topic
+    if (tpl->num_tokens == 1)
+        return mqtt_topic_render(tpl, topic, end, keys);
+
+    // most events repeat a few (model, channel, id) tuples
+    char key[MQTT_TOPIC_KEY_MAX];
+    size_t key_len = mqtt_topic_key(tpl, keys, key);
+    if (!key_len)
+        return mqtt_topic_render(tpl, topic, end, keys);
+
+    uint64_t hash             = mqtt_hash_bytes(FNV_OFFSET, key, key_len);
+    mqtt_topic_cache_t *entry = &tpl->cache[hash & (MQTT_TOPIC_CACHE - 1)];
+    if (entry->key && entry->key_len == key_len && !memcmp(entry->key, key, key_len)) {
+        memcpy(topic, entry->topic, entry->len + 1);
+        return topic + entry->len;
+    }
+
+    char *pos  = mqtt_topic_render(tpl, topic, end, keys);
+    size_t len = (size_t)(pos - topic);
+    char *copy = realloc(entry->topic, len + 1);
+    if (!copy) {
+        WARN_REALLOC("mqtt_topic_expand()");
+        return pos; // NOTE: skip caching on alloc failure.
+    }
+    entry->topic = copy;
+    memcpy(entry->topic, topic, len + 1);
+    entry->len = len;
+
+    char *key_copy = realloc(entry->key, key_len);
+    if (!key_copy) {
+        WARN_REALLOC("mqtt_topic_expand()");
+        free(entry->key);
+        entry->key = NULL; // NOTE: skip caching on alloc failure.
+        return pos;
+    }
+    entry->key = key_copy;
+    memcpy(entry->key, key, key_len);
+    entry->key_len = key_len;
+    return pos;
+}
+
 /* MQTT printer */
 
 typedef struct {
@@ -242,9 +717,9 @@ typedef struct {
     mqtt_client_t *mqc;
     char topic[256];
     char hostname[64];
-    char *devices;
-    char *events;
-    char *states;
+    mqtt_topic_t *devices;
+    mqtt_topic_t *events;
+    mqtt_topic_t *states;
     //char *homie;
     //char *hass;
 } data_output_mqtt_t;
@@ -253,129 +728,36 @@ static void R_API_CALLCONV print_mqtt_array(data_output_t *output, data_array_t
 {
     data_output_mqtt_t *mqtt = (data_output_mqtt_t *)output;
 
-    char *orig = mqtt->topic + strlen(mqtt->topic); // save current topic
+    char *orig  = mqtt->topic + strlen(mqtt->topic); // save current topic
+    size_t size = sizeof(mqtt->topic) - (size_t)(orig - mqtt->topic);
 
     for (int c = 0; c < array->num_values; ++c) {
-        sprintf(orig, "/%d", c);
+        snprintf(orig, size, "/%d", c);
         print_array_value(output, array, format, c);
     }
     *orig = '\0'; // restore topic
 }
 
-static char *append_topic(char *topic, data_t *data)
+static void print_mqtt_fields(data_output_t *output, data_t *data, char *end)
 {
-    if (data->type == DATA_STRING) {
-        strcpy(topic, data->value.v_ptr); // NOLINT
-        mqtt_sanitize_topic(topic);
-        topic += strlen(data->value.v_ptr);
-    }
-    else if (data->type == DATA_INT) {
-        topic += sprintf(topic, "%d", data->value.v_int);
-    }
-    else {
-        print_logf(LOG_ERROR, __func__, "Can't append data type %d to topic", data->type);
-    }
-
-    return topic;
-}
-
-static char *expand_topic(char *topic, char const *format, data_t *data, char const *hostname)
-{
-    // collect well-known top level keys
-    data_t *data_type    = NULL;
-    data_t *data_model   = NULL;
-    data_t *data_subtype = NULL;
-    data_t *data_channel = NULL;
-    data_t *data_id      = NULL;
-    data_t *data_protocol = NULL;
-    for (data_t *d = data; d; d = d->next) {
-        if (!strcmp(d->key, "type"))
-            data_type = d;
-        else if (!strcmp(d->key, "model"))
-            data_model = d;
-        else if (!strcmp(d->key, "subtype"))
-            data_subtype = d;
-        else if (!strcmp(d->key, "channel"))
-            data_channel = d;
-        else if (!strcmp(d->key, "id"))
-            data_id = d;
-        else if (!strcmp(d->key, "protocol")) // NOTE: needs "-M protocol"
-            data_protocol = d;
-    }
-
-    // consume entire format string
-    while (format && *format) {
-        data_t *data_token  = NULL;
-        char const *string_token = NULL;
-        int leading_slash   = 0;
-        char const *t_start = NULL;
-        char const *t_end   = NULL;
-        char const *d_start = NULL;
-        char const *d_end   = NULL;
-        // copy until '['
-        while (*format && *format != '[')
-            *topic++ = *format++;
-        // skip '['
-        if (!*format)
-            break;
-        ++format;
-        // read slash
-        if (!leading_slash && (*format < 'a' || *format > 'z')) {
-            leading_slash = *format;
-            format++;
-        }
-        // read key until : or ]
-        t_start = t_end = format;
-        while (*format && *format != ':' && *format != ']' && *format != '[')
-            t_end = ++format;
-        // read default until ]
-        if (*format == ':') {
-            d_start = d_end = ++format;
-            while (*format && *format != ']' && *format != '[')
-                d_end = ++format;
-        }
-        // check for proper closing
-        if (*format != ']') {
-            print_log(LOG_FATAL, __func__, "unterminated token");
-            exit(1);
-        }
-        ++format;
+    data_output_mqtt_t *mqtt = (data_output_mqtt_t *)output;
+    char const *limit        = mqtt->topic + sizeof(mqtt->topic) - 1;
 
-        // resolve token
-        if (!strncmp(t_start, "hostname", t_end - t_start))
-            string_token = hostname;
-        else if (!strncmp(t_start, "type", t_end - t_start))
-            data_token = data_type;
-        else if (!strncmp(t_start, "model", t_end - t_start))
-            data_token = data_model;
-        else if (!strncmp(t_start, "subtype", t_end - t_start))
-            data_token = data_subtype;
-        else if (!strncmp(t_start, "channel", t_end - t_start))
-            data_token = data_channel;
-        else if (!strncmp(t_start, "id", t_end - t_start))
-            data_token = data_id;
-        else if (!strncmp(t_start, "protocol", t_end - t_start))
-            data_token = data_protocol;
-        else {
-            print_logf(LOG_FATAL, __func__, "unknown token \"%.*s\"", (int)(t_end - t_start), t_start);
-            exit(1);
+    for (; data; data = data->next) {
+        if (data->key_id == DATA_KEY_TYPE
+                || data->key_id == DATA_KEY_MODEL
+                || data->key_id == DATA_KEY_SUBTYPE) {
+            continue; // skip, except "id", "channel"
         }
-
-        // append token or default
-        if (!data_token && !string_token && !d_start)
-            continue;
-        if (leading_slash)
-            *topic++ = leading_slash;
-        if (data_token)
-            topic = append_topic(topic, data_token);
-        else if (string_token)
-            topic += sprintf(topic, "%s", string_token);
-        else
-            topic += sprintf(topic, "%.*s", (int)(d_end - d_start), d_start);
+        // push topic
+        char *pos = end;
+        if (pos < limit)
+            *pos++ = '/';
+        pos  = mqtt_topic_append(pos, limit, data->key, strlen(data->key));
+        *pos = '\0';
+        print_value(output, data->type, data->value, data->format);
+        *end = '\0'; // pop topic
     }
-
-    *topic = '\0';
-    return topic;
 }
 
 // <prefix>[/type][/model][/subtype][/channel][/id]/battery: "OK"|"LOW"
@@ -384,69 +766,62 @@ static void R_API_CALLCONV print_mqtt_data(data_output_t *output, data_t *data,
     UNUSED(format);
     data_output_mqtt_t *mqtt = (data_output_mqtt_t *)output;
 
-    char *orig = mqtt->topic + strlen(mqtt->topic); // save current topic
-    char *end  = orig;
-
-    // top-level only
-    if (!*mqtt->topic) {
-        // collect well-known top level keys
-        data_t *data_model = NULL;
-        for (data_t *d = data; d; d = d->next) {
-            if (!strcmp(d->key, "model"))
-                data_model = d;
-        }
+    // nested data continues the current topic
+    if (*mqtt->topic) {
+        char *orig = mqtt->topic + strlen(mqtt->topic); // save current topic
+        print_mqtt_fields(output, data, orig);
+        *orig = '\0'; // restore topic
+        return;
+    }
 
-        // "states" topic
-        if (!data_model) {
-            if (mqtt->states) {
-                size_t message_size = 20000; // state message need a large buffer
-                char *message       = malloc(message_size);
-                if (!message) {
-                    WARN_MALLOC("print_mqtt_data()");
-                    return; // NOTE: skip output on alloc failure.
-                }
-                data_print_jsons(data, message, message_size);
-                expand_topic(mqtt->topic, mqtt->states, data, mqtt->hostname);
-                mqtt_client_publish(mqtt->mqc, mqtt->topic, message);
-                *mqtt->topic = '\0'; // clear topic
-                free(message);
-            }
-            return;
-        }
+    // collect well-known top level keys
+    data_t *keys[TOPIC_KEYS] = {0};
+    for (data_t *d = data; d; d = d->next) {
+        if (d->key_id == DATA_KEY_TYPE)
+            keys[TOPIC_TYPE] = d;
+        else if (d->key_id == DATA_KEY_MODEL)
+            keys[TOPIC_MODEL] = d;
+        else if (d->key_id == DATA_KEY_SUBTYPE)
+            keys[TOPIC_SUBTYPE] = d;
+        else if (d->key_id == DATA_KEY_CHANNEL)
+            keys[TOPIC_CHANNEL] = d;
+        else if (d->key_id == DATA_KEY_ID)
+            keys[TOPIC_ID] = d;
+        else if (d->key_id == DATA_KEY_PROTOCOL) // NOTE: needs "-M protocol"
+            keys[TOPIC_PROTOCOL] = d;
+    }
 
-        // "events" topic
-        if (mqtt->events) {
-            char message[2048]; // we expect the biggest strings to be around 500 bytes.
-            data_print_jsons(data, message, sizeof(message));
-            expand_topic(mqtt->topic, mqtt->events, data, mqtt->hostname);
+    // "states" topic
+    if (!keys[TOPIC_MODEL]) {
+        if (mqtt->states) {
+            char const *message = data_jsons(data, NULL);
+            if (!message)
+                return; // NOTE: skip output on alloc failure.
+            mqtt_topic_expand(mqtt->states, mqtt->topic, sizeof(mqtt->topic), keys);
             mqtt_client_publish(mqtt->mqc, mqtt->topic, message);
             *mqtt->topic = '\0'; // clear topic
         }
+        return;
+    }
 
-        // "devices" topic
-        if (!mqtt->devices) {
-            return;
-        }
-
-        end = expand_topic(mqtt->topic, mqtt->devices, data, mqtt->hostname);
+    // "events" topic
+    if (mqtt->events) {
+        char const *message = data_jsons(data, NULL);
+        if (!message)
+            return; // NOTE: skip output on alloc failure.
+        mqtt_topic_expand(mqtt->events, mqtt->topic, sizeof(mqtt->topic), keys);
+        mqtt_client_publish(mqtt->mqc, mqtt->topic, message);
+        *mqtt->topic = '\0'; // clear topic
     }
 
-    while (data) {
-        if (!strcmp(data->key, "type")
-                || !strcmp(data->key, "model")
-                || !strcmp(data->key, "subtype")) {
-            // skip, except "id", "channel"
-        }
-        else {
-            // push topic
-            *end = '/';
-            strcpy(end + 1, data->key); // NOLINT
-            print_value(output, data->type, data->value, data->format);
-            *end = '\0'; // pop topic
-        }
-        data = data->next;
+    // "devices" topic
+    if (!mqtt->devices) {
+        return;
     }
-    *orig = '\0'; // restore topic
+
+    char *end = mqtt_topic_expand(mqtt->devices, mqtt->topic, sizeof(mqtt->topic), keys);
+    print_mqtt_fields(output, data, end);
+    *mqtt->topic = '\0'; // clear topic
 }
 
 static void R_API_CALLCONV print_mqtt_string(data_output_t *output, char const *str, char const *format)
@@ -489,9 +864,9 @@ static void R_API_CALLCONV data_output_mqtt_free(data_output_t *output)
     if (!mqtt)
         return;
 
-    free(mqtt->devices);
-    free(mqtt->events);
-    free(mqtt->states);
+    mqtt_topic_free(mqtt->devices);
+    mqtt_topic_free(mqtt->events);
+    mqtt_topic_free(mqtt->states);
     //free(mqtt->homie);
     //free(mqtt->hass);
 
@@ -558,6 +933,11 @@ struct data_output *data_output_mqtt_create(struct mg_mgr *mgr, char *param, cha
     char *pass = getenv("MQTT_PASSWORD");
     int retain = 0;
     int qos = 0;
+    int inflight = 16;
+    int queue = 10000;
+    char *devices = NULL;
+    char *events = NULL;
+    char *states = NULL;
 
     // parse host and port
     tls_opts_t tls_opts = {0};
@@ -585,11 +965,15 @@ struct data_output *data_output_mqtt_create(struct mg_mgr *mgr, char *param, cha
             retain = atobv(val, 1);
         else if (!strcasecmp(key, "q") || !strcasecmp(key, "qos"))
             qos = atoiv(val, 1);
+        else if (!strcasecmp(key, "inflight"))
+            inflight = atoiv(val, 16);
+        else if (!strcasecmp(key, "queue"))
+            queue = atoiv(val, 10000);
         else if (!strcasecmp(key, "b") || !strcasecmp(key, "base"))
             base_topic = val;
         // Simple key-topic mapping
         else if (!strcasecmp(key, "d") || !strcasecmp(key, "devices"))
-            mqtt->devices = mqtt_topic_default(val, base_topic, path_devices);
+            devices = mqtt_topic_default(val, base_topic, path_devices);
         // deprecated, remove this
         else if (!strcasecmp(key, "c") || !strcasecmp(key, "usechannel")) {
             print_log(LOG_FATAL, "MQTT", "\"usechannel=...\" has been removed. Use a topic format string:");
@@ -601,10 +985,10 @@ struct data_output *data_output_mqtt_create(struct mg_mgr *mgr, char *param, cha
         }
         // JSON events to single topic
         else if (!strcasecmp(key, "e") || !strcasecmp(key, "events"))
-            mqtt->events = mqtt_topic_default(val, base_topic, path_events);
+            events = mqtt_topic_default(val, base_topic, path_events);
         // JSON states to single topic
         else if (!strcasecmp(key, "s") || !strcasecmp(key, "states"))
-            mqtt->states = mqtt_topic_default(val, base_topic, path_states);
+            states = mqtt_topic_default(val, base_topic, path_states);
         // TODO: Homie Convention https://homieiot.github.io/
         //else if (!strcasecmp(key, "o") || !strcasecmp(key, "homie"))
         //    mqtt->homie = mqtt_topic_default(val, NULL, "homie"); // base topic
@@ -621,17 +1005,37 @@ struct data_output *data_output_mqtt_create(struct mg_mgr *mgr, char *param, cha
     }
 
     // Default is to use all formats
-    if (!mqtt->devices && !mqtt->events && !mqtt->states) {
-        mqtt->devices = mqtt_topic_default(NULL, base_topic, path_devices);
-        mqtt->events  = mqtt_topic_default(NULL, base_topic, path_events);
-        mqtt->states  = mqtt_topic_default(NULL, base_topic, path_states);
-    }
-    if (mqtt->devices)
-        print_logf(LOG_NOTICE, "MQTT", "Publishing device info to MQTT topic \"%s\".", mqtt->devices);
-    if (mqtt->events)
-        print_logf(LOG_NOTICE, "MQTT", "Publishing events info to MQTT topic \"%s\".", mqtt->events);
-    if (mqtt->states)
-        print_logf(LOG_NOTICE, "MQTT", "Publishing states info to MQTT topic \"%s\".", mqtt->states);
+    if (!devices && !events && !states) {
+        devices = mqtt_topic_default(NULL, base_topic, path_devices);
+        events  = mqtt_topic_default(NULL, base_topic, path_events);
+        states  = mqtt_topic_default(NULL, base_topic, path_states);
+    }
+    if (devices) {
+        print_logf(LOG_NOTICE, "MQTT", "Publishing device info to MQTT topic \"%s\".", devices);
+        mqtt->devices = mqtt_topic_compile(devices, mqtt->hostname);
+    }
+    if (events) {
+        print_logf(LOG_NOTICE, "MQTT", "Publishing events info to MQTT topic \"%s\".", events);
+        mqtt->events = mqtt_topic_compile(events, mqtt->hostname);
+    }
+    if (states) {
+        print_logf(LOG_NOTICE, "MQTT", "Publishing states info to MQTT topic \"%s\".", states);
+        mqtt->states = mqtt_topic_compile(states, mqtt->hostname);
+    }
+    free(devices);
+    free(events);
+    free(states);
+
+    if (qos > 1) {
+        print_log(LOG_WARNING, "MQTT", "MQTT QoS 2 is not supported, using QoS 1.");
+        qos = 1;
+    }
+    if (qos > 0 && (inflight < 1 || queue < inflight)) {
+        print_log(LOG_FATAL, "MQTT", "MQTT needs inflight=<n> of at least 1 and queue=<n> of at least inflight.");
+        exit(1);
+    }
+    if (qos > 0)
+        print_logf(LOG_NOTICE, "MQTT", "Publishing with QoS 1, up to %d messages in flight, %d queued.", inflight, queue);
 
     mqtt->output.print_data   = print_mqtt_data;
     mqtt->output.print_array  = print_mqtt_array;
@@ -640,7 +1044,7 @@ struct data_output *data_output_mqtt_create(struct mg_mgr *mgr, char *param, cha
     mqtt->output.print_int    = print_mqtt_int;
     mqtt->output.output_free  = data_output_mqtt_free;
 
-    mqtt->mqc = mqtt_client_init(mgr, &tls_opts, host, port, user, pass, client_id, retain, qos);
+    mqtt->mqc = mqtt_client_init(mgr, &tls_opts, host, port, user, pass, client_id, retain, qos, inflight, queue);
 
     return (struct data_output *)mqtt;
 }
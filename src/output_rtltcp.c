@@ -12,11 +12,13 @@
 #include "output_rtltcp.h"
 
 #include "rtl_433.h"
+#include "r_private.h"
 #include "r_api.h"
 #include "r_util.h"
 #include "optparse.h"
 #include "logger.h"
 #include "fatal.h"
+#include "metrics.h"
 #include "compat_pthread.h"
 
 #include <string.h>
@@ -24,6 +26,7 @@
 #include <stdlib.h>
 #include <stdbool.h>
 #include <signal.h>
+#include <math.h>
 
 #include <limits.h>
 // gethostname() needs _XOPEN_SOURCE 500 on unistd.h
@@ -43,6 +46,7 @@
 
     #include <winsock2.h>
     #include <ws2tcpip.h>
+    #define SHUT_RDWR SD_BOTH
 #else
     #include <sys/types.h>
     #include <sys/socket.h>
@@ -93,31 +97,276 @@ typedef SSIZE_T ssize_t;
 /* rtl_tcp server */
 
 // Only available if Threads are enabled.
-// Currently serves a maximum of 1 client connection.
-// The data backing from the SDR is assumed to be persistent, which is the case
-// since we never restart the SDR with different parameters or close it while active.
-// Should use shared memory for sendfile() someday.
+// Serves up to `clients=` (default 8) connections, each on its own thread.
+// Each SDR frame is copied once into a reference counted block, every client
+// has a bounded queue (`queue=` blocks, default 16) of blocks to send.
+// A slow client loses the oldest blocks and never stalls the demod, the loss is counted.
+// Clients can request decimation, a frequency shift, and a sample format,
+// the conversion is done once per distinct setting and shared by the clients.
 
 #ifdef THREADS
 
+#define RTLTCP_MAX_CLIENTS 8
+#define RTLTCP_QUEUE_DEPTH 16
+#define RTLTCP_MAX_DECIMATION 1024
+
+/// A copy of one SDR frame shared by all clients.
+typedef struct rtltcp_block {
+    struct rtltcp_block *next; ///< free list link
+    unsigned refs;             ///< references from client queues
+    uint32_t size;             ///< allocated data size in bytes
+    uint32_t len;              ///< data length in bytes
+    uint8_t *data;
+} rtltcp_block_t;
+
+/// A distinct client setting, each frame is converted once for all clients using it.
+typedef struct rtltcp_stream {
+    struct rtltcp_stream *next;
+    unsigned decimation;   ///< output every n-th sample, averaged over n samples
+    int shift;             ///< frequency shift in Hz, the new center is at center + shift
+    int format;            ///< output sample format, CU8_IQ, CS8_IQ, CS16_IQ, or 0 for unchanged
+    unsigned refs;         ///< number of clients using this stream
+    rtltcp_block_t *block; ///< the current frame, only used by the producer
+    double nco_i;          ///< NCO phasor, only used by the producer
+    double nco_q;
+    float acc_i;           ///< decimation sums, only used by the producer
+    float acc_q;
+    unsigned acc_n;
+} rtltcp_stream_t;
+
+typedef struct rtltcp_client {
+    struct rtltcp_server *srv;
+    struct rtltcp_client *next;
+    rtltcp_stream_t *stream; ///< the stream for the settings, guarded by the lock
+    unsigned decimation;     ///< requested decimation, only used by the client thread
+    int shift;               ///< requested frequency shift, only used by the client thread
+    int format;              ///< requested sample format, only used by the client thread
+    SOCKET sock;
+    pthread_t thread;
+    rtltcp_block_t **queue; ///< ring of blocks to send
+    unsigned head;          ///< first queued block
+    unsigned len;           ///< number of queued blocks
+    unsigned dropped;       ///< blocks dropped on a full queue
+    int done;               ///< set when the client thread finished
+    char host[INET6_ADDRSTRLEN];
+    char port[NI_MAXSERV];
+} rtltcp_client_t;
+
 typedef struct rtltcp_server {
     struct sockaddr_storage addr;
     socklen_t addr_len;
     SOCKET sock;
     int client_count; ///< number of connected clients
     int control;      ///< are clients allowed to change SDR parameters
+    int max_clients;  ///< maximum number of connected clients
+    unsigned depth;   ///< queue depth per client in blocks
+    unsigned dropped; ///< total blocks dropped for slow clients
+    int stop;         ///< set to stop all threads
 
-    uint8_t const *data_buf; ///< data buffer with most recent data, NULL otherwise
-    uint32_t data_len;       ///< data buffer length in bytes, 0 otherwise
-    unsigned data_cnt;       ///< data buffer update counter
+    rtltcp_client_t *clients; ///< connected clients, guarded by the lock
+    rtltcp_stream_t *streams; ///< client settings, guarded by the lock, freed by the producer
+    rtltcp_block_t *free;     ///< unused blocks, guarded by the lock
 
     pthread_t thread;
-    pthread_mutex_t lock; ///< lock for data buffer
-    pthread_cond_t cond;  ///< wait for data buffer
+    pthread_mutex_t lock; ///< lock for clients, queues, and blocks
+    pthread_cond_t cond;  ///< wait for queued blocks
     r_cfg_t *cfg;
     struct raw_output *output;
 } rtltcp_server_t;
 
+// get an unused block for len bytes, called with the lock held
+static rtltcp_block_t *block_get(rtltcp_server_t *srv, uint32_t len)
+{
+    rtltcp_block_t *block = srv->free;
+    if (block) {
+        srv->free = block->next;
+    }
+    else {
+        block = calloc(1, sizeof(*block));
+        if (!block) {
+            WARN_CALLOC("block_get()");
+            return NULL;
+        }
+    }
+    if (block->size < len) {
+        uint8_t *data = realloc(block->data, len);
+        if (!data) {
+            WARN_REALLOC("block_get()");
+            block->next = srv->free;
+            srv->free   = block;
+            return NULL;
+        }
+        block->data = data;
+        block->size = len;
+    }
+    block->next = NULL;
+    block->refs = 0;
+    block->len  = len;
+    return block;
+}
+
+// drop a reference, called with the lock held
+static void block_release(rtltcp_server_t *srv, rtltcp_block_t *block)
+{
+    if (block->refs > 0)
+        block->refs -= 1;
+    if (block->refs == 0) {
+        block->next = srv->free;
+        srv->free   = block;
+    }
+}
+
+// find or add the stream for a setting, called with the lock held
+static rtltcp_stream_t *stream_get(rtltcp_server_t *srv, unsigned decimation, int shift, int format)
+{
+    for (rtltcp_stream_t *stream = srv->streams; stream; stream = stream->next) {
+        if (stream->decimation == decimation && stream->shift == shift && stream->format == format)
+            return stream;
+    }
+
+    rtltcp_stream_t *stream = calloc(1, sizeof(*stream));
+    if (!stream) {
+        WARN_CALLOC("stream_get()");
+        return NULL;
+    }
+    stream->decimation = decimation;
+    stream->shift      = shift;
+    stream->format     = format;
+    stream->nco_i      = 1.0;
+    stream->next       = srv->streams;
+    srv->streams       = stream;
+    return stream;
+}
+
+// drop all queued blocks of a client, called with the lock held
+static void client_flush(rtltcp_client_t *client)
+{
+    rtltcp_server_t *srv = client->srv;
+
+    while (client->len) {
+        block_release(srv, client->queue[client->head]);
+        client->head = (client->head + 1) % srv->depth;
+        client->len -= 1;
+    }
+}
+
+// switch a client to the stream for its settings, called with the lock held
+static int client_set_stream(rtltcp_client_t *client)
+{
+    rtltcp_stream_t *stream = stream_get(client->srv, client->decimation, client->shift, client->format);
+    if (!stream)
+        return -1;
+    if (stream == client->stream)
+        return 0;
+
+    stream->refs += 1;
+    if (client->stream)
+        client->stream->refs -= 1;
+    client->stream = stream;
+    // the queued blocks have the old setting
+    client_flush(client);
+    return 0;
+}
+
+// store a sample with clipping, returns the size in bytes
+static unsigned put_sample(uint8_t *out, int format, float i, float q)
+{
+    if (format == CS16_IQ) {
+        int16_t *out16 = (int16_t *)out;
+        out16[0]       = (int16_t)(i > 0.99997f ? 32767 : i < -1.0f ? -32768 : lrintf(i * 32768.0f));
+        out16[1]       = (int16_t)(q > 0.99997f ? 32767 : q < -1.0f ? -32768 : lrintf(q * 32768.0f));
+        return 4;
+    }
+    // 8 bit samples are x - 127.5 scaled, flooring maps each level back to its code
+    float vi = floorf(i * 128.0f);
+    float vq = floorf(q * 128.0f);
+    vi       = vi > 127.0f ? 127.0f : vi < -128.0f ? -128.0f : vi;
+    vq       = vq > 127.0f ? 127.0f : vq < -128.0f ? -128.0f : vq;
+    if (format == CS8_IQ) {
+        out[0] = (uint8_t)(int8_t)vi;
+        out[1] = (uint8_t)(int8_t)vq;
+        return 2;
+    }
+    else { // CU8_IQ
+        out[0] = (uint8_t)(vi + 128.0f);
+        out[1] = (uint8_t)(vq + 128.0f);
+        return 2;
+    }
+}
+
+/// Convert a frame to the stream setting, returns the output length in bytes.
+/// Only called on the producer, the output needs room for `len` and `2 * len / decimation + 8` bytes.
+static uint32_t stream_convert(rtltcp_stream_t *stream, uint8_t const *data, uint32_t len, int in_format, uint32_t samp_rate, uint8_t *out)
+{
+    int out_format = stream->format ? stream->format : in_format;
+    if (stream->decimation == 1 && !stream->shift && out_format == in_format) {
+        memcpy(out, data, len);
+        return len;
+    }
+    if (stream->decimation == 1 && !stream->shift && in_format == CU8_IQ && out_format == CS8_IQ) {
+        for (uint32_t n = 0; n < len; ++n)
+            out[n] = data[n] ^ 0x80;
+        return len;
+    }
+
+    // the NCO rotates by -shift, i.e. the signal at center + shift is moved to 0 Hz
+    double rot_i = 1.0;
+    double rot_q = 0.0;
+    if (stream->shift && samp_rate) {
+        double w = -2.0 * M_PI * stream->shift / samp_rate;
+        rot_i    = cos(w);
+        rot_q    = sin(w);
+    }
+    double nco_i = stream->nco_i;
+    double nco_q = stream->nco_q;
+    float acc_i  = stream->acc_i;
+    float acc_q  = stream->acc_q;
+    unsigned acc_n = stream->acc_n;
+    float scale    = 1.0f / stream->decimation;
+
+    unsigned n_samples = len / (in_format == CS16_IQ ? 4 : 2);
+    int16_t const *data16 = (int16_t const *)data;
+    uint32_t pos = 0;
+    for (unsigned n = 0; n < n_samples; ++n) {
+        float i, q;
+        if (in_format == CS16_IQ) {
+            i = data16[2 * n] * (1.0f / 32768.0f);
+            q = data16[2 * n + 1] * (1.0f / 32768.0f);
+        }
+        else {
+            i = (data[2 * n] - 127.5f) * (1.0f / 128.0f);
+            q = (data[2 * n + 1] - 127.5f) * (1.0f / 128.0f);
+        }
+        if (stream->shift) {
+            float mi = (float)(i * nco_i - q * nco_q);
+            float mq = (float)(i * nco_q + q * nco_i);
+            i        = mi;
+            q        = mq;
+            double t = nco_i * rot_i - nco_q * rot_q;
+            nco_q    = nco_i * rot_q + nco_q * rot_i;
+            nco_i    = t;
+        }
+        acc_i += i;
+        acc_q += q;
+        acc_n += 1;
+        if (acc_n == stream->decimation) {
+            pos += put_sample(&out[pos], out_format, acc_i * scale, acc_q * scale);
+            acc_i = 0.0f;
+            acc_q = 0.0f;
+            acc_n = 0;
+        }
+    }
+
+    // keep the phasor on the unit circle
+    double mag    = sqrt(nco_i * nco_i + nco_q * nco_q);
+    stream->nco_i = nco_i / mag;
+    stream->nco_q = nco_q / mag;
+    stream->acc_i = acc_i;
+    stream->acc_q = acc_q;
+    stream->acc_n = acc_n;
+    return pos;
+}
+
 static ssize_t send_all(int sockfd, void const *buf, size_t len, int flags)
 {
     size_t sent = 0;
@@ -150,6 +399,10 @@ static void send_header(SOCKET sock)
 #define RTLTCP_SET_TUNER_XTAL 0x0c
 #define RTLTCP_SET_TUNER_GAIN_BY_ID 0x0d
 #define RTLTCP_SET_BIAS_TEE 0x0e
+// rtl_433 extensions, these only change the stream of the client and are always allowed
+#define RTLTCP_SET_DECIMATION 0x80
+#define RTLTCP_SET_FREQ_SHIFT 0x81
+#define RTLTCP_SET_SAMPLE_FORMAT 0x82
 
 /*
 E.g. initialization from Gqrx:
@@ -163,11 +416,29 @@ E.g. initialization from Gqrx:
 - RTLTCP_SET_GAIN  with 0
 - RTLTCP_SET_GAIN  with 0
 - RTLTCP_SET_FREQ  with 433968000
+
+The client stream can be changed with:
+- RTLTCP_SET_DECIMATION  with 1 to 1024, averaged over the decimation
+- RTLTCP_SET_FREQ_SHIFT  with the shift in Hz as signed 32 bit
+- RTLTCP_SET_SAMPLE_FORMAT  with 0 (unchanged), 1 (CU8), 2 (CS8), 3 (CS16)
 */
 
-static int parse_command(r_cfg_t *cfg, int control, uint8_t const *buf, int len)
+// apply a new stream setting for a client, called on the client thread
+static void client_update_stream(rtltcp_client_t *client)
 {
-    UNUSED(cfg);
+    rtltcp_server_t *srv = client->srv;
+
+    pthread_mutex_lock(&srv->lock);
+    int r = client_set_stream(client);
+    pthread_mutex_unlock(&srv->lock);
+    if (r < 0)
+        print_logf(LOG_WARNING, "rtl_tcp", "client from %s port %s keeps the previous stream", client->host, client->port);
+}
+
+static int parse_command(rtltcp_client_t *client, uint8_t const *buf, int len)
+{
+    r_cfg_t *cfg = client->srv->cfg;
+    int control  = client->srv->control;
 
     if (len < 5)
         return 0;
@@ -230,6 +501,29 @@ static int parse_command(r_cfg_t *cfg, int control, uint8_t const *buf, int len)
     case RTLTCP_SET_BIAS_TEE:
         print_logf(LOG_DEBUG, "rtl_tcp", "received command SET_BIAS_TEE with %u", arg);
         break;
+    case RTLTCP_SET_DECIMATION:
+        print_logf(LOG_DEBUG, "rtl_tcp", "received command SET_DECIMATION with %u", arg);
+        if (arg < 1 || arg > RTLTCP_MAX_DECIMATION) {
+            print_logf(LOG_WARNING, "rtl_tcp", "invalid decimation %u", arg);
+            break;
+        }
+        client->decimation = arg;
+        client_update_stream(client);
+        break;
+    case RTLTCP_SET_FREQ_SHIFT:
+        print_logf(LOG_DEBUG, "rtl_tcp", "received command SET_FREQ_SHIFT with %d", (int)arg);
+        client->shift = (int)arg;
+        client_update_stream(client);
+        break;
+    case RTLTCP_SET_SAMPLE_FORMAT:
+        print_logf(LOG_DEBUG, "rtl_tcp", "received command SET_SAMPLE_FORMAT with %u", arg);
+        if (arg > 3) {
+            print_logf(LOG_WARNING, "rtl_tcp", "invalid sample format %u", arg);
+            break;
+        }
+        client->format = arg == 1 ? CU8_IQ : arg == 2 ? CS8_IQ : arg == 3 ? CS16_IQ : 0;
+        client_update_stream(client);
+        break;
     default:
         print_logf(LOG_WARNING, "rtl_tcp", "received unknown command %d with %u", cmd, arg);
         break;
@@ -238,21 +532,228 @@ static int parse_command(r_cfg_t *cfg, int control, uint8_t const *buf, int len)
     return 5;
 }
 
-// event handler to broadcast to all our sockets
+// queue a frame for all clients, the SDR buffer is converted once per stream
 static void rtltcp_broadcast_send(rtltcp_server_t *srv, uint8_t const *data, uint32_t len)
 {
     // print_logf(LOG_TRACE, __func__, "%d byte frame", len);
+    int in_format = srv->cfg->demod->sample_size == 4 ? CS16_IQ : CU8_IQ;
+    uint32_t samp_rate = srv->cfg->samp_rate;
+
+    pthread_mutex_lock(&srv->lock);
+    if (!srv->client_count) {
+        pthread_mutex_unlock(&srv->lock);
+        return; // no clients, nothing to copy
+    }
+    // only the producer frees streams, unused streams are not converted
+    for (rtltcp_stream_t **p = &srv->streams; *p;) {
+        rtltcp_stream_t *stream = *p;
+        if (!stream->refs) {
+            *p = stream->next;
+            free(stream);
+            continue;
+        }
+        p = &stream->next;
+        // room for the converted samples, CS16 from CU8 doubles the size
+        uint32_t out_len = (len / stream->decimation + 4) * 2;
+        stream->block = block_get(srv, out_len > len ? out_len : len);
+        // NOTE: the frame is lost for this stream on alloc failure.
+    }
+    // the streams in the list stay valid until the producer runs again
+    rtltcp_stream_t *streams = srv->streams;
+    pthread_mutex_unlock(&srv->lock);
+
+    // the blocks are not shared yet, convert without the lock
+    for (rtltcp_stream_t *stream = streams; stream; stream = stream->next) {
+        if (stream->block)
+            stream->block->len = stream_convert(stream, data, len, in_format, samp_rate, stream->block->data);
+    }
+
+    pthread_mutex_lock(&srv->lock);
+    for (rtltcp_client_t *client = srv->clients; client; client = client->next) {
+        if (client->done)
+            continue;
+        rtltcp_block_t *block = client->stream->block;
+        if (!block || !block->len)
+            continue; // a new stream or nothing to send yet
+        if (client->len == srv->depth) {
+            // slow client, drop the oldest block
+            block_release(srv, client->queue[client->head]);
+            client->head = (client->head + 1) % srv->depth;
+            client->len -= 1;
+            client->dropped += 1;
+            srv->dropped += 1;
+        }
+        client->queue[(client->head + client->len) % srv->depth] = block;
+        client->len += 1;
+        block->refs += 1;
+    }
+    for (rtltcp_stream_t *stream = srv->streams; stream; stream = stream->next) {
+        if (stream->block && !stream->block->refs)
+            block_release(srv, stream->block); // all clients left or switched meanwhile
+        stream->block = NULL;
+    }
+    pthread_mutex_unlock(&srv->lock);
+    pthread_cond_broadcast(&srv->cond);
+}
+
+static THREAD_RETURN THREAD_CALL client_thread(void *arg)
+{
+    rtltcp_client_t *client = arg;
+    rtltcp_server_t *srv    = client->srv;
+    SOCKET sock             = client->sock;
+
+    send_header(sock);
+
+    for (;;) {
+        // Read available commands
+        int abort = 0;
+        for (;;) {
+            fd_set fds;
+            FD_ZERO(&fds);
+            FD_SET(sock, &fds);
+            struct timeval timeout = {0};
+
+            int ready = select(sock + 1, &fds, NULL, NULL, &timeout);
+            if (ready <= 0)
+                break;
+
+            uint8_t buf[128] = {0};
+            ssize_t len = recv(sock, buf, sizeof(buf), 0);
+            //print_logf(LOG_TRACE, "rtl_tcp", "recv %zd bytes (%d)", len, ready);
+            if (len <= 0) {
+                abort = 1;
+                break;
+            }
+            int pos = 0;
+            while (pos + 5 <= len) {
+                pos += parse_command(client, & buf[pos], (int)len - pos);
+            }
+        }
+        if (abort) {
+            break;
+        }
+
+        // Wait for the next block
+        pthread_mutex_lock(&srv->lock);
+        while (!client->len && !srv->stop)
+            pthread_cond_wait(&srv->cond, &srv->lock);
+        if (srv->stop) {
+            pthread_mutex_unlock(&srv->lock);
+            break;
+        }
+        rtltcp_block_t *block = client->queue[client->head];
+        client->head = (client->head + 1) % srv->depth;
+        client->len -= 1;
+        pthread_mutex_unlock(&srv->lock);
+
+        // Send the block, only this client waits for a slow connection
+        ssize_t sent = send_all(sock, block->data, block->len, MSG_NOSIGNAL); // ignore SIGPIPE
+
+        pthread_mutex_lock(&srv->lock);
+        block_release(srv, block);
+        pthread_mutex_unlock(&srv->lock);
+
+        if (sent < 0)
+            break;
+    }
+
     pthread_mutex_lock(&srv->lock);
+    client_flush(client);
+    client->stream->refs -= 1;
+    client->done = 1;
+    srv->client_count -= 1;
+    unsigned dropped = client->dropped;
+    pthread_mutex_unlock(&srv->lock);
 
-    // update the data buffer reference
-    srv->data_buf = data;
-    srv->data_len = len;
-    srv->data_cnt += 1;
+    if (dropped)
+        print_logf(LOG_NOTICE, "rtl_tcp", "client disconnected from %s port %s, %u frames dropped", client->host, client->port, dropped);
+    else
+        print_logf(LOG_NOTICE, "rtl_tcp", "client disconnected from %s port %s", client->host, client->port);
+    return 0;
+}
+
+// join a finished client thread and free the client
+static void client_free(rtltcp_client_t *client)
+{
+    pthread_join(client->thread, NULL);
+    closesocket(client->sock);
+    free(client->queue);
+    free(client);
+}
 
+// free finished clients, all if the server is stopping
+static void reap_clients(rtltcp_server_t *srv)
+{
+    rtltcp_client_t *done = NULL;
+
+    pthread_mutex_lock(&srv->lock);
+    for (rtltcp_client_t **p = &srv->clients; *p;) {
+        rtltcp_client_t *client = *p;
+        if (client->done || srv->stop) {
+            *p           = client->next;
+            client->next = done;
+            done         = client;
+        }
+        else {
+            p = &client->next;
+        }
+    }
     pthread_mutex_unlock(&srv->lock);
-    pthread_cond_signal(&srv->cond);
-    // perhaps broadcast if we want to support multiple clients
-    //int pthread_cond_broadcast(&srv->cond);
+
+    while (done) {
+        rtltcp_client_t *client = done;
+        done = client->next;
+        client_free(client);
+    }
+}
+
+static void add_client(rtltcp_server_t *srv, SOCKET sock, char const *host, char const *port)
+{
+    rtltcp_client_t *client = calloc(1, sizeof(*client));
+    if (!client) {
+        WARN_CALLOC("add_client()");
+        closesocket(sock);
+        return;
+    }
+    client->queue = calloc(srv->depth, sizeof(*client->queue));
+    if (!client->queue) {
+        WARN_CALLOC("add_client()");
+        free(client);
+        closesocket(sock);
+        return;
+    }
+    client->srv        = srv;
+    client->sock       = sock;
+    client->decimation = 1;
+    snprintf(client->host, sizeof(client->host), "%s", host);
+    snprintf(client->port, sizeof(client->port), "%s", port);
+
+    pthread_mutex_lock(&srv->lock);
+    if (client_set_stream(client) < 0) {
+        pthread_mutex_unlock(&srv->lock);
+        closesocket(sock);
+        free(client->queue);
+        free(client);
+        return;
+    }
+    client->next = srv->clients;
+    srv->clients = client;
+    srv->client_count += 1;
+    // signals are blocked on this thread, the client thread inherits that
+    int r = pthread_create(&client->thread, NULL, client_thread, client);
+    if (r) {
+        srv->clients = client->next;
+        srv->client_count -= 1;
+        client->stream->refs -= 1;
+    }
+    pthread_mutex_unlock(&srv->lock);
+
+    if (r) {
+        print_logf(LOG_ERROR, __func__, "error in pthread_create, rc: %d", r);
+        closesocket(sock);
+        free(client->queue);
+        free(client);
+    }
 }
 
 static THREAD_RETURN THREAD_CALL accept_thread(void *arg)
@@ -261,16 +762,32 @@ static THREAD_RETURN THREAD_CALL accept_thread(void *arg)
 
     // Start listening for clients, waits for an incoming connection
     int listen_sock = srv->sock; // make it easy for the checker
-    int r = listen(listen_sock, 1);
+    int r = listen(listen_sock, srv->max_clients);
     if (r < 0) {
         perror("ERROR on listen");
-        closesocket(listen_sock);
-        srv->sock = INVALID_SOCKET;
         return 0;
     }
     // print_log(LOG_DEBUG, "rtl_tcp", "rtl_tcp listening...");
 
     for (;;) {
+        reap_clients(srv);
+
+        // Wait for a connection, check for stop every 200 ms
+        fd_set fds;
+        FD_ZERO(&fds);
+        FD_SET(listen_sock, &fds);
+        struct timeval timeout = {.tv_usec = 200000};
+        int ready = select(listen_sock + 1, &fds, NULL, NULL, &timeout);
+
+        pthread_mutex_lock(&srv->lock);
+        int stop         = srv->stop;
+        int client_count = srv->client_count;
+        pthread_mutex_unlock(&srv->lock);
+        if (stop)
+            break;
+        if (ready <= 0)
+            continue;
+
         // Accept actual connection from the client
         struct sockaddr_storage addr = {0};
         unsigned addr_len = sizeof(addr);
@@ -302,83 +819,40 @@ static THREAD_RETURN THREAD_CALL accept_thread(void *arg)
             closesocket(sock);
             continue;
         }
-        print_logf(LOG_NOTICE, "rtl_tcp", "client connected from %s port %s", host, port);
 
-        pthread_mutex_lock(&srv->lock);
-        srv->client_count += 1;
-        unsigned prev_cnt = srv->data_cnt + 9; // data sent in previous loop, random value to get the current buffer
-        pthread_mutex_unlock(&srv->lock);
-
-        send_header(sock);
-
-        // Client loop
-        for (;;) {
-            // Read available commands
-            int abort = 0;
-            for (;;) {
-                fd_set fds;
-                FD_ZERO(&fds);
-                FD_SET(sock, &fds);
-                struct timeval timeout = {0};
-
-                int ready = select(sock + 1, &fds, NULL, NULL, &timeout);
-                if (ready <= 0)
-                    break;
-
-                uint8_t buf[128] = {0};
-                ssize_t len = recv(sock, buf, sizeof(buf), 0);
-                //print_logf(LOG_TRACE, "rtl_tcp", "recv %zd bytes (%d)", len, ready);
-                if (len <= 0) {
-                    abort = 1;
-                    break;
-                }
-                int pos = 0;
-                while (pos + 5 <= len) {
-                    pos += parse_command(srv->cfg, srv->control, & buf[pos], (int)len - pos);
-                }
-            }
-            if (abort) {
-                break;
-            }
-
-            // Wait for send buffer to clear
-            fd_set fds;
-            FD_ZERO(&fds);
-            FD_SET(sock, &fds);
-            struct timeval timeout = {.tv_usec = 100000}; // Wait at most 100 ms
-
-            int ready = select(sock + 1, NULL, &fds, NULL, &timeout);
-            if (ready <= 0) {
-                print_log(LOG_ERROR, "rtl_tcp", "send not ready for write?");
-                break; // Cancel the connection on network problems
-            }
-
-            // Wait for next frame
-            pthread_mutex_lock(&srv->lock);
-            while (srv->data_cnt == prev_cnt || srv->data_buf == NULL)
-                pthread_cond_wait(&srv->cond, &srv->lock);
-            // Maybe timeout to check recv()
-            // pthread_cond_timedwait(&srv->cond, &srv->lock, const struct timespec *abstime);
-
-            // Get data buffer reference
-            void const *data = srv->data_buf;
-            int data_len     = srv->data_len;
-            prev_cnt         = srv->data_cnt;
+        if (client_count >= srv->max_clients) {
+            print_logf(LOG_WARNING, "rtl_tcp", "client from %s port %s rejected, %d clients connected", host, port, client_count);
+            closesocket(sock);
+            continue;
+        }
+        print_logf(LOG_NOTICE, "rtl_tcp", "client connected from %s port %s", host, port);
 
-            pthread_mutex_unlock(&srv->lock);
+        add_client(srv, sock, host, port);
+    }
 
-            // Send frame
-            send_all(sock, data, data_len, MSG_NOSIGNAL); // ignore SIGPIPE
-        }
+    return 0;
+}
 
-        pthread_mutex_lock(&srv->lock);
-        srv->client_count -= 1;
-        pthread_mutex_unlock(&srv->lock);
+// OpenMetrics of the server, called on the main thread
+static void collect_rtltcp_metrics(metrics_out_t *out, void *ctx)
+{
+    rtltcp_server_t *srv = ctx;
 
-        print_logf(LOG_NOTICE, "rtl_tcp", "client disconnected from %s port %s", host, port);
-        closesocket(sock);
+    pthread_mutex_lock(&srv->lock);
+    int client_count = srv->client_count;
+    unsigned dropped = srv->dropped;
+    unsigned streams = 0;
+    for (rtltcp_stream_t *stream = srv->streams; stream; stream = stream->next) {
+        streams += stream->refs ? 1 : 0;
     }
-    return 0;
+    pthread_mutex_unlock(&srv->lock);
+
+    metrics_family(out, "rtltcp_clients", "gauge", NULL, "Number of rtl_tcp clients.");
+    metrics_count(out, "rtltcp_clients", NULL, (unsigned)client_count);
+    metrics_family(out, "rtltcp_streams", "gauge", NULL, "Number of distinct rtl_tcp client settings.");
+    metrics_count(out, "rtltcp_streams", NULL, streams);
+    metrics_family(out, "rtltcp_dropped_frames", "counter", "frames", "Number of frames dropped for slow rtl_tcp clients.");
+    metrics_count(out, "rtltcp_dropped_frames_total", NULL, dropped);
 }
 
 static int rtltcp_server_start(rtltcp_server_t *srv, char const *host, char const *port, r_cfg_t *cfg, struct raw_output *output)
@@ -454,6 +928,10 @@ static int rtltcp_server_start(rtltcp_server_t *srv, char const *host, char cons
     if (r) {
         fprintf(stderr, "%s: error in pthread_create, rc: %d\n", __func__, r);
         closesocket(sock);
+        srv->sock = INVALID_SOCKET;
+    }
+    else {
+        metrics_register(cfg->metrics, collect_rtltcp_metrics, srv);
     }
 
     return r;
@@ -466,10 +944,34 @@ static int rtltcp_server_stop(rtltcp_server_t *srv)
 
     print_logf(LOG_NOTICE, "rtl_tcp server", "Stopping rtl_tcp server...");
 
-    // thread is likely blocking in accept, recv, or send
-    int r = pthread_cancel(srv->thread);
-    if (r) {
-        fprintf(stderr, "%s: error in pthread_cancel, rc: %d\n", __func__, r);
+    metrics_unregister(srv->cfg->metrics, collect_rtltcp_metrics, srv);
+
+    // the accept thread checks for stop, client threads wait for blocks or send
+    pthread_mutex_lock(&srv->lock);
+    srv->stop = 1;
+    for (rtltcp_client_t *client = srv->clients; client; client = client->next) {
+        shutdown(client->sock, SHUT_RDWR);
+    }
+    pthread_mutex_unlock(&srv->lock);
+    pthread_cond_broadcast(&srv->cond);
+
+    if (srv->sock != INVALID_SOCKET)
+        pthread_join(srv->thread, NULL);
+    reap_clients(srv);
+
+    if (srv->dropped)
+        print_logf(LOG_NOTICE, "rtl_tcp server", "%u frames dropped for slow clients", srv->dropped);
+
+    while (srv->streams) {
+        rtltcp_stream_t *stream = srv->streams;
+        srv->streams = stream->next;
+        free(stream);
+    }
+    while (srv->free) {
+        rtltcp_block_t *block = srv->free;
+        srv->free = block->next;
+        free(block->data);
+        free(block);
     }
     pthread_mutex_destroy(&srv->lock);
     pthread_cond_destroy(&srv->cond);
@@ -533,13 +1035,39 @@ struct raw_output *raw_output_rtltcp_create(const char *host, const char *port,
     }
 #endif
 
-    // If clients allowed to change SDR parameters
-    if (opts && !strcasecmp(opts, "control"))
-        rtltcp->server.control = 1;
-    else if (opts && *opts) {
-        print_logf(LOG_FATAL, __func__, "Invalid \"%s\" option.", opts);
-        exit(1);
+    rtltcp->server.max_clients = RTLTCP_MAX_CLIENTS;
+    rtltcp->server.depth       = RTLTCP_QUEUE_DEPTH;
+
+    char *args = strdup(opts ? opts : "");
+    if (!args) {
+        WARN_STRDUP("raw_output_rtltcp_create()");
+        free(rtltcp);
+        return NULL;
+    }
+    char *p = args;
+    char *key, *val;
+    while (getkwargs(&p, &key, &val)) {
+        key = remove_ws(key);
+        val = trim_ws(val);
+        if (!key || !*key)
+            continue;
+        // If clients allowed to change SDR parameters
+        else if (!strcasecmp(key, "control"))
+            rtltcp->server.control = 1;
+        else if (!strcasecmp(key, "clients"))
+            rtltcp->server.max_clients = atoiv(val, RTLTCP_MAX_CLIENTS);
+        else if (!strcasecmp(key, "queue"))
+            rtltcp->server.depth = (unsigned)atoiv(val, RTLTCP_QUEUE_DEPTH);
+        else {
+            print_logf(LOG_FATAL, __func__, "Invalid \"%s\" option.", key);
+            exit(1);
+        }
     }
+    free(args);
+    if (rtltcp->server.max_clients < 1)
+        rtltcp->server.max_clients = 1;
+    if (rtltcp->server.depth < 1)
+        rtltcp->server.depth = 1;
 
     rtltcp->output.output_frame  = raw_output_rtltcp_frame;
     rtltcp->output.output_free   = raw_output_rtltcp_free;
@@ -52,6 +52,7 @@ struct data_output *data_output_trigger_create(FILE *file)
 
     trigger->output.output_print = data_output_trigger_print;
     trigger->output.output_free  = data_output_trigger_free;
+    trigger->output.async_safe   = 1;
     trigger->file                = file;
 
     return (struct data_output *)trigger;
@@ -12,6 +12,7 @@
 #include "output_udp.h"
 
 #include "data.h"
+#include "output_cbor.h"
 #include "abuf.h"
 #include "r_util.h"
 #include "logger.h"
@@ -146,32 +147,131 @@ static void datagram_client_close(datagram_client_t *client)
 #endif
 }
 
-static void datagram_client_send(datagram_client_t *client, const char *message, size_t message_len)
+static int datagram_client_send(datagram_client_t *client, const char *message, size_t message_len)
 {
     int r =  sendto(client->sock, message, message_len, 0, (struct sockaddr *)&client->addr, client->addr_len);
     if (r == -1) {
         perror("sendto");
     }
+    return r;
 }
 
 /* Syslog UDP printer, RFC 5424 (IETF-syslog protocol) */
 
+// we expect a normal message around 500 bytes
+// full stats report would be 12k and we want a max of MTU anyway
+#define SYSLOG_MSG_SIZE 1024
+/// Default number of datagrams in a batch which is flushed on a timer or when full.
+#define SYSLOG_BATCH_DEFAULT 64
+/// Maximum number of datagrams in a batch, this is the sendmmsg() limit (UIO_MAXIOV).
+#define SYSLOG_BATCH_MAX 1024
+
 typedef struct {
     struct data_output output;
     datagram_client_t client;
     int pri;
     char hostname[_POSIX_HOST_NAME_MAX + 1];
+    char *batch;       ///< queued datagrams, SYSLOG_MSG_SIZE bytes each
+    size_t *batch_len; ///< length of each queued datagram
+#ifdef HAVE_SENDMMSG
+    struct mmsghdr *msgs;
+    struct iovec *iovs;
+#endif
+    int batch_size;    ///< capacity of the batch
+    int batch_count;   ///< number of queued datagrams
+    unsigned sent;     ///< datagrams sent
+    unsigned batched;  ///< datagrams sent together with others
+    unsigned dropped;  ///< datagrams lost to overflow or send errors
 } data_output_syslog_t;
 
+/// Allocate the batch, sized by the flush policy.
+static int syslog_batch_init(data_output_syslog_t *syslog)
+{
+    int size = syslog->output.flush_events > 0 ? syslog->output.flush_events : SYSLOG_BATCH_DEFAULT;
+    if (size > SYSLOG_BATCH_MAX)
+        size = SYSLOG_BATCH_MAX;
+
+    syslog->batch = malloc((size_t)size * SYSLOG_MSG_SIZE);
+    if (!syslog->batch) {
+        WARN_MALLOC("syslog_batch_init()");
+        return -1; // NOTE: sends unbatched on alloc failure.
+    }
+    syslog->batch_len = calloc(size, sizeof(*syslog->batch_len));
+    if (!syslog->batch_len) {
+        WARN_CALLOC("syslog_batch_init()");
+        return -1; // NOTE: sends unbatched on alloc failure.
+    }
+#ifdef HAVE_SENDMMSG
+    syslog->msgs = calloc(size, sizeof(*syslog->msgs));
+    if (!syslog->msgs) {
+        WARN_CALLOC("syslog_batch_init()");
+        return -1; // NOTE: sends unbatched on alloc failure.
+    }
+    syslog->iovs = calloc(size, sizeof(*syslog->iovs));
+    if (!syslog->iovs) {
+        WARN_CALLOC("syslog_batch_init()");
+        return -1; // NOTE: sends unbatched on alloc failure.
+    }
+    for (int i = 0; i < size; ++i) {
+        syslog->iovs[i].iov_base           = syslog->batch + (size_t)i * SYSLOG_MSG_SIZE;
+        syslog->msgs[i].msg_hdr.msg_name    = &syslog->client.addr;
+        syslog->msgs[i].msg_hdr.msg_namelen = syslog->client.addr_len;
+        syslog->msgs[i].msg_hdr.msg_iov     = &syslog->iovs[i];
+        syslog->msgs[i].msg_hdr.msg_iovlen  = 1;
+    }
+#endif
+    syslog->batch_size = size;
+    return 0;
+}
+
+/// Send all queued datagrams, with one sendmmsg() call if available.
+static void syslog_batch_send(data_output_syslog_t *syslog)
+{
+    int count = syslog->batch_count;
+    int done  = 0;
+    syslog->batch_count = 0;
+
+#ifdef HAVE_SENDMMSG
+    for (int i = 0; i < count; ++i)
+        syslog->iovs[i].iov_len = syslog->batch_len[i];
+    while (done < count) {
+        int r = sendmmsg(syslog->client.sock, syslog->msgs + done, (unsigned)(count - done), 0);
+        if (r < 0 && errno == EINTR)
+            continue;
+        if (r < 0) {
+            perror("sendmmsg");
+            syslog->dropped++; // skip the failing datagram
+            done++;
+            continue;
+        }
+        syslog->sent += r;
+        if (count > 1)
+            syslog->batched += r;
+        done += r;
+    }
+#else
+    for (; done < count; ++done) {
+        if (datagram_client_send(&syslog->client, syslog->batch + (size_t)done * SYSLOG_MSG_SIZE, syslog->batch_len[done]) < 0)
+            syslog->dropped++;
+        else
+            syslog->sent++;
+    }
+#endif
+}
+
 static void R_API_CALLCONV data_output_syslog_print(data_output_t *output, data_t *data)
 {
     data_output_syslog_t *syslog = (data_output_syslog_t *)output;
 
-    // we expect a normal message around 500 bytes
-    // full stats report would be 12k and we want a max of MTU anyway
-    char message[1024];
+    // queue into the batch if the output has a flush policy
+    if (output->flush_events && !syslog->batch_size && syslog_batch_init(syslog)) {
+        output->flush_events = 0;
+    }
+
+    char buf[SYSLOG_MSG_SIZE];
+    char *message = syslog->batch_size ? syslog->batch + (size_t)syslog->batch_count * SYSLOG_MSG_SIZE : buf;
     abuf_t msg = {0};
-    abuf_init(&msg, message, sizeof(message));
+    abuf_init(&msg, message, SYSLOG_MSG_SIZE);
 
     time_t now;
     struct tm tm_info;
@@ -186,12 +286,35 @@ static void R_API_CALLCONV data_output_syslog_print(data_output_t *output, data_
 
     abuf_printf(&msg, "<%d>1 %s %s rtl_433 - - - ", syslog->pri, timestamp, syslog->hostname);
 
-    msg.tail += data_print_jsons(data, msg.tail, msg.left);
-    if (msg.tail >= msg.head + sizeof(message))
+    size_t json_len;
+    char const *json = data_jsons(data, &json_len);
+    if (!json || json_len >= msg.left) {
+        syslog->dropped++;
         return; // abort on overflow, we don't actually want to send more than fits the MTU
+    }
+    abuf_cat(&msg, json);
 
     size_t abuf_len = msg.tail - msg.head;
-    datagram_client_send(&syslog->client, message, abuf_len);
+    if (!syslog->batch_size) {
+        if (datagram_client_send(&syslog->client, message, abuf_len) < 0)
+            syslog->dropped++;
+        else
+            syslog->sent++;
+        return;
+    }
+
+    syslog->batch_len[syslog->batch_count++] = abuf_len;
+    if (data_output_flush_due(output) || syslog->batch_count == syslog->batch_size)
+        syslog_batch_send(syslog);
+}
+
+static void R_API_CALLCONV data_output_syslog_flush(data_output_t *output)
+{
+    data_output_syslog_t *syslog = (data_output_syslog_t *)output;
+
+    if (syslog->batch_count)
+        syslog_batch_send(syslog);
+    output->flush_pending = 0;
 }
 
 static void R_API_CALLCONV data_output_syslog_free(data_output_t *output)
@@ -201,8 +324,20 @@ static void R_API_CALLCONV data_output_syslog_free(data_output_t *output)
     if (!syslog)
         return;
 
+    if (syslog->batch_count)
+        syslog_batch_send(syslog);
+    if (syslog->batch_size || syslog->dropped)
+        print_logf(LOG_NOTICE, "Syslog UDP", "Sent %u datagrams (%u batched), dropped %u",
+                syslog->sent, syslog->batched, syslog->dropped);
+
     datagram_client_close(&syslog->client);
 
+    free(syslog->batch);
+    free(syslog->batch_len);
+#ifdef HAVE_SENDMMSG
+    free(syslog->msgs);
+    free(syslog->iovs);
+#endif
     free(syslog);
 }
 
@@ -226,6 +361,8 @@ struct data_output *data_output_syslog_create(int log_level, const char *host, c
     syslog->output.log_level    = log_level;
     syslog->output.output_print = data_output_syslog_print;
     syslog->output.output_free  = data_output_syslog_free;
+    syslog->output.output_flush = data_output_syslog_flush;
+    syslog->output.async_safe   = 1;
     // Severity 5 "Notice", Facility 20 "local use 4"
     syslog->pri = 20 * 8 + 5;
     #ifdef ESP32
@@ -245,3 +382,72 @@ struct data_output *data_output_syslog_create(int log_level, const char *host, c
 
     return (struct data_output *)syslog;
 }
+
+/* CBOR UDP printer, one event per datagram */
+
+typedef struct {
+    struct data_output output;
+    datagram_client_t client;
+} data_output_cbor_udp_t;
+
+static void R_API_CALLCONV data_output_cbor_udp_print(data_output_t *output, data_t *data)
+{
+    data_output_cbor_udp_t *cbor = (data_output_cbor_udp_t *)output;
+
+    // a normal event is well below the MTU, a full stats report might need more
+    uint8_t message[1472];
+    size_t len = data_print_cbor(data, message, sizeof(message));
+    if (len <= sizeof(message)) {
+        datagram_client_send(&cbor->client, (char const *)message, len);
+        return;
+    }
+    if (len > 65507)
+        return; // abort on overflow, this won't fit a datagram
+
+    uint8_t *buf = malloc(len);
+    if (!buf) {
+        WARN_MALLOC("data_output_cbor_udp_print()");
+        return; // NOTE: skip output on alloc failure.
+    }
+    data_print_cbor(data, buf, len);
+    datagram_client_send(&cbor->client, (char const *)buf, len);
+    free(buf);
+}
+
+static void R_API_CALLCONV data_output_cbor_udp_free(data_output_t *output)
+{
+    data_output_cbor_udp_t *cbor = (data_output_cbor_udp_t *)output;
+
+    if (!cbor)
+        return;
+
+    datagram_client_close(&cbor->client);
+
+    free(cbor);
+}
+
+struct data_output *data_output_cbor_udp_create(int log_level, const char *host, const char *port)
+{
+    data_output_cbor_udp_t *cbor = calloc(1, sizeof(data_output_cbor_udp_t));
+    if (!cbor) {
+        WARN_CALLOC("data_output_cbor_udp_create()");
+        return NULL; // NOTE: returns NULL on alloc failure.
+    }
+#ifdef _WIN32
+    WSADATA wsa;
+
+    if (WSAStartup(MAKEWORD(2,2),&wsa) != 0) {
+        perror("WSAStartup()");
+        free(cbor);
+        return NULL;
+    }
+#endif
+
+    cbor->output.log_level    = log_level;
+    cbor->output.output_print = data_output_cbor_udp_print;
+    cbor->output.output_free  = data_output_cbor_udp_free;
+    cbor->output.async_safe   = 1;
+    datagram_client_open(&cbor->client, host, port);
+
+    return (struct data_output *)cbor;
+}
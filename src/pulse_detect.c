@@ -92,6 +92,15 @@ void pulse_detect_set_levels(pulse_detect_t *pulse_detect, int use_mag_est, floa
     //        high_low_ratio, pulse_detect->ook_high_low_ratio);
 }
 
+int pulse_detect_get_idle(pulse_detect_t const *pulse_detect, pulse_detect_idle_t *idle)
+{
+    // the pulse and FSK state is reset at the start of a package
+    idle->lead_in_counter   = pulse_detect->lead_in_counter;
+    idle->ook_low_estimate  = pulse_detect->ook_low_estimate;
+    idle->ook_high_estimate = pulse_detect->ook_high_estimate;
+    return pulse_detect->ook_state == PD_OOK_STATE_IDLE && pulse_detect->data_counter == 0;
+}
+
 /// convert amplitude (16384 FS) to attenuation in (integer) dB, offset by 3.
 static inline int amp_to_att(int a)
 {
@@ -27,16 +27,22 @@
 #include "sdr.h"
 #include "data.h"
 #include "data_tag.h"
+#include "data_dedup.h"
+#include "data_convert.h"
 #include "list.h"
 #include "optparse.h"
 #include "output_file.h"
+#include "output_cbor.h"
 #include "output_log.h"
 #include "output_udp.h"
 #include "output_mqtt.h"
 #include "output_influx.h"
 #include "output_trigger.h"
+#include "output_async.h"
 #include "output_rtltcp.h"
 #include "write_sigrok.h"
+#include "activity_index.h"
+#include "metrics.h"
 #include "mongoose.h"
 #include "compat_time.h"
 #include "logger.h"
@@ -146,6 +152,9 @@ void set_gain_str(struct r_cfg *cfg, char const *gain_str)
 
 /* general */
 
+static void collect_metrics(metrics_out_t *out, void *ctx);
+static void flush_timer_handler(struct mg_connection *nc, int ev, void *ev_data);
+
 void r_init_cfg(r_cfg_t *cfg)
 {
     cfg->out_block_size  = DEFAULT_BUF_LENGTH;
@@ -197,6 +206,11 @@ void r_init_cfg(r_cfg_t *cfg)
 
     list_ensure_size(&cfg->demod->r_devs, 100);
     list_ensure_size(&cfg->demod->dumper, 32);
+
+    cfg->metrics = metrics_create();
+    if (!cfg->metrics)
+        FATAL_CALLOC("r_init_cfg()");
+    metrics_register(cfg->metrics, collect_metrics, cfg);
 }
 
 r_cfg_t *r_create_cfg(void)
@@ -210,6 +224,25 @@ r_cfg_t *r_create_cfg(void)
     return cfg;
 }
 
+int r_reset_demod(struct dm_state *demod)
+{
+    memset(&demod->lowpass_filter_state, 0, sizeof(demod->lowpass_filter_state));
+    memset(&demod->demod_FM_state, 0, sizeof(demod->demod_FM_state));
+    memset(&demod->pulse_data, 0, sizeof(demod->pulse_data));
+    memset(&demod->fsk_pulse_data, 0, sizeof(demod->fsk_pulse_data));
+    demod->frame_event_count = 0;
+    demod->frame_start_ago   = 0;
+    demod->frame_end_ago     = 0;
+
+    pulse_detect_free(demod->pulse_detect);
+    demod->pulse_detect = pulse_detect_create();
+    if (!demod->pulse_detect) {
+        return -1;
+    }
+    pulse_detect_set_levels(demod->pulse_detect, demod->use_mag_est, demod->level_limit, demod->min_level, demod->min_snr, demod->detect_verbosity);
+    return 0;
+}
+
 void r_free_cfg(r_cfg_t *cfg)
 {
     if (cfg->dev) {
@@ -241,10 +274,34 @@ void r_free_cfg(r_cfg_t *cfg)
 
     r_logger_set_log_handler(NULL, NULL);
 
+    // flush all batched events, the flush is queued after pending async events
+    for (size_t i = 0; i < cfg->output_handler.len; ++i) { // list might contain NULLs
+        data_output_flush(cfg->output_handler.elems[i]);
+    }
+
+    // print all queued events before the outputs are freed
+    output_async_free(cfg->output_async);
+    cfg->output_async = NULL;
+
+    // the flush timers fire once more when the mgr is freed, detach them from the outputs
+    for (struct mg_connection *nc = cfg->mgr ? mg_next(cfg->mgr, NULL) : NULL; nc; nc = mg_next(cfg->mgr, nc)) {
+        if (nc->handler == flush_timer_handler)
+            nc->user_data = NULL;
+    }
+
     list_free_elems(&cfg->output_handler, (list_elem_free_fn)data_output_free);
 
+    metrics_free(cfg->metrics);
+    cfg->metrics = NULL;
+
     list_free_elems(&cfg->data_tags, (list_elem_free_fn)data_tag_free);
 
+    data_dedup_free(cfg->dedup);
+    cfg->dedup = NULL;
+
+    data_convert_free(cfg->convert);
+    cfg->convert = NULL;
+
     list_free_elems(&cfg->in_files, NULL);
 
     free(cfg->demod);
@@ -279,6 +336,12 @@ void register_protocol(r_cfg_t *cfg, r_device *r_dev, char *arg)
     r_device *p;
     if (r_dev->create_fn) {
         p = r_dev->create_fn(arg);
+        // keep the argument to create copies
+        if (arg && *arg) {
+            p->create_arg = strdup(arg);
+            if (!p->create_arg)
+                WARN_STRDUP("register_protocol()");
+        }
     }
     else {
         if (arg && *arg) {
@@ -290,6 +353,7 @@ void register_protocol(r_cfg_t *cfg, r_device *r_dev, char *arg)
         *p = *r_dev; // copy
     }
 
+    p->protocol_num = r_dev->protocol_num;
     p->verbose      = dev_verbose ? dev_verbose : (cfg->verbosity > 4 ? cfg->verbosity - 5 : 0);
     p->verbose_bits = cfg->verbose_bits;
     p->log_fn       = log_device_handler;
@@ -307,10 +371,51 @@ void register_protocol(r_cfg_t *cfg, r_device *r_dev, char *arg)
 void free_protocol(r_device *r_dev)
 {
     // free(r_dev->name);
-    free(r_dev->decode_ctx);
+    if (r_dev->free_fn)
+        r_dev->free_fn(r_dev);
+    else
+        free(r_dev->decode_ctx);
+    free(r_dev->create_arg);
     free(r_dev);
 }
 
+r_device *copy_protocol(r_device const *r_dev)
+{
+    r_device *p;
+    if (r_dev->create_fn) {
+        p = r_dev->create_fn(r_dev->create_arg);
+        if (!p)
+            return NULL; // NOTE: returns NULL on alloc failure.
+    }
+    else {
+        p = malloc(sizeof(*p));
+        if (!p) {
+            WARN_MALLOC("copy_protocol()");
+            return NULL; // NOTE: returns NULL on alloc failure.
+        }
+        *p = *r_dev; // copy, shares the decode_ctx
+        p->decode_events   = 0;
+        p->decode_ok       = 0;
+        p->decode_messages = 0;
+        memset(p->decode_fails, 0, sizeof(p->decode_fails));
+    }
+    p->protocol_num = r_dev->protocol_num;
+    p->verbose      = r_dev->verbose;
+    p->verbose_bits = r_dev->verbose_bits;
+    return p;
+}
+
+void free_protocol_copy(r_device *r_dev)
+{
+    if (!r_dev)
+        return;
+    // only a copy with create_fn owns its decode_ctx
+    if (r_dev->create_fn)
+        free_protocol(r_dev);
+    else
+        free(r_dev);
+}
+
 void unregister_protocol(r_cfg_t *cfg, r_device *r_dev)
 {
     for (size_t i = 0; i < cfg->demod->r_devs.len; ++i) { // list might contain NULLs
@@ -613,7 +718,7 @@ static void log_handler(log_level_t level, char const *src, char const *msg, voi
         return;
     }
     /* clang-format off */
-    data_t *data = data_make(
+    data_t *data = data_make_static(
             "src",     "",     DATA_STRING, src,
             "lvl",      "",     DATA_INT,    level,
             "msg",      "",     DATA_STRING, msg,
@@ -703,135 +808,16 @@ void data_acquired_handler(r_device *r_dev, data_t *data)
     }
 #endif
 
-    if (cfg->conversion_mode == CONVERT_SI) {
-        for (data_t *d = data; d; d = d->next) {
-            // Convert double type fields ending in _F to _C
-            if ((d->type == DATA_DOUBLE) && str_endswith(d->key, "_F")) {
-                d->value.v_dbl = fahrenheit2celsius(d->value.v_dbl);
-                char *new_label = str_replace(d->key, "_F", "_C");
-                free(d->key);
-                d->key = new_label;
-                char *pos;
-                if (d->format && (pos = strrchr(d->format, 'F'))) {
-                    *pos = 'C';
-                }
-            }
-            // Convert double type fields ending in _mi_h to _km_h
-            else if ((d->type == DATA_DOUBLE) && str_endswith(d->key, "_mi_h")) {
-                d->value.v_dbl = mph2kmph(d->value.v_dbl);
-                char *new_label = str_replace(d->key, "_mi_h", "_km_h");
-                free(d->key);
-                d->key = new_label;
-                char *new_format_label = str_replace(d->format, "mi/h", "km/h");
-                free(d->format);
-                d->format = new_format_label;
-            }
-            // Convert double type fields ending in _in to _mm
-            else if ((d->type == DATA_DOUBLE) && str_endswith(d->key, "_in")) {
-                d->value.v_dbl = inch2mm(d->value.v_dbl);
-                char *new_label = str_replace(d->key, "_in", "_mm");
-                free(d->key);
-                d->key = new_label;
-                char *new_format_label = str_replace(d->format, "in", "mm");
-                free(d->format);
-                d->format = new_format_label;
-            }
-            // Convert double type fields ending in _in_h to _mm_h
-            else if ((d->type == DATA_DOUBLE) && str_endswith(d->key, "_in_h")) {
-                d->value.v_dbl = inch2mm(d->value.v_dbl);
-                char *new_label = str_replace(d->key, "_in_h", "_mm_h");
-                free(d->key);
-                d->key = new_label;
-                char *new_format_label = str_replace(d->format, "in/h", "mm/h");
-                free(d->format);
-                d->format = new_format_label;
-            }
-            // Convert double type fields ending in _inHg to _hPa
-            else if ((d->type == DATA_DOUBLE) && str_endswith(d->key, "_inHg")) {
-                d->value.v_dbl = inhg2hpa(d->value.v_dbl);
-                char *new_label = str_replace(d->key, "_inHg", "_hPa");
-                free(d->key);
-                d->key = new_label;
-                char *new_format_label = str_replace(d->format, "inHg", "hPa");
-                free(d->format);
-                d->format = new_format_label;
-            }
-            // Convert double type fields ending in _PSI to _kPa
-            else if ((d->type == DATA_DOUBLE) && str_endswith(d->key, "_PSI")) {
-                d->value.v_dbl = psi2kpa(d->value.v_dbl);
-                char *new_label = str_replace(d->key, "_PSI", "_kPa");
-                free(d->key);
-                d->key = new_label;
-                char *new_format_label = str_replace(d->format, "PSI", "kPa");
-                free(d->format);
-                d->format = new_format_label;
-            }
-        }
+    // drop repeated transmissions before any processing
+    if (cfg->dedup && data_dedup_check(cfg->dedup, data, cfg->input_pos, cfg->samp_rate)) {
+        data_free(data);
+        return;
     }
-    if (cfg->conversion_mode == CONVERT_CUSTOMARY) {
-        for (data_t *d = data; d; d = d->next) {
-            // Convert double type fields ending in _C to _F
-            if ((d->type == DATA_DOUBLE) && str_endswith(d->key, "_C")) {
-                d->value.v_dbl = celsius2fahrenheit(d->value.v_dbl);
-                char *new_label = str_replace(d->key, "_C", "_F");
-                free(d->key);
-                d->key = new_label;
-                char *pos;
-                if (d->format && (pos = strrchr(d->format, 'C'))) {
-                    *pos = 'F';
-                }
-            }
-            // Convert double type fields ending in _km_h to _mi_h
-            else if ((d->type == DATA_DOUBLE) && str_endswith(d->key, "_km_h")) {
-                d->value.v_dbl = kmph2mph(d->value.v_dbl);
-                char *new_label = str_replace(d->key, "_km_h", "_mi_h");
-                free(d->key);
-                d->key = new_label;
-                char *new_format_label = str_replace(d->format, "km/h", "mi/h");
-                free(d->format);
-                d->format = new_format_label;
-            }
-            // Convert double type fields ending in _mm to _in
-            else if ((d->type == DATA_DOUBLE) && str_endswith(d->key, "_mm")) {
-                d->value.v_dbl = mm2inch(d->value.v_dbl);
-                char *new_label = str_replace(d->key, "_mm", "_in");
-                free(d->key);
-                d->key = new_label;
-                char *new_format_label = str_replace(d->format, "mm", "in");
-                free(d->format);
-                d->format = new_format_label;
-            }
-            // Convert double type fields ending in _mm_h to _in_h
-            else if ((d->type == DATA_DOUBLE) && str_endswith(d->key, "_mm_h")) {
-                d->value.v_dbl = mm2inch(d->value.v_dbl);
-                char *new_label = str_replace(d->key, "_mm_h", "_in_h");
-                free(d->key);
-                d->key = new_label;
-                char *new_format_label = str_replace(d->format, "mm/h", "in/h");
-                free(d->format);
-                d->format = new_format_label;
-            }
-            // Convert double type fields ending in _hPa to _inHg
-            else if ((d->type == DATA_DOUBLE) && str_endswith(d->key, "_hPa")) {
-                d->value.v_dbl = hpa2inhg(d->value.v_dbl);
-                char *new_label = str_replace(d->key, "_hPa", "_inHg");
-                free(d->key);
-                d->key = new_label;
-                char *new_format_label = str_replace(d->format, "hPa", "inHg");
-                free(d->format);
-                d->format = new_format_label;
-            }
-            // Convert double type fields ending in _kPa to _PSI
-            else if ((d->type == DATA_DOUBLE) && str_endswith(d->key, "_kPa")) {
-                d->value.v_dbl = kpa2psi(d->value.v_dbl);
-                char *new_label = str_replace(d->key, "_kPa", "_PSI");
-                free(d->key);
-                d->key = new_label;
-                char *new_format_label = str_replace(d->format, "kPa", "PSI");
-                free(d->format);
-                d->format = new_format_label;
-            }
-        }
+
+    if (cfg->conversion_mode != CONVERT_NATIVE) {
+        if (!cfg->convert)
+            cfg->convert = data_convert_create();
+        data_convert_apply(cfg->convert, cfg->conversion_mode, r_dev, data);
     }
 
     // prepend "description" if requested
@@ -846,20 +832,29 @@ void data_acquired_handler(r_device *r_dev, data_t *data)
                 data_int(NULL, "protocol", "Protocol", NULL, r_dev->protocol_num));
     }
 
+    // append meta data if requested, the keys are literals and need no copy
     if (cfg->report_meta && cfg->demod->fsk_pulse_data.fsk_f2_est) {
-        data = data_str(data, "mod",   "Modulation",  NULL,         "FSK");
-        data = data_dbl(data, "freq1", "Freq1",       "%.1f MHz",   cfg->demod->fsk_pulse_data.freq1_hz / 1000000.0);
-        data = data_dbl(data, "freq2", "Freq2",       "%.1f MHz",   cfg->demod->fsk_pulse_data.freq2_hz / 1000000.0);
-        data = data_dbl(data, "rssi",  "RSSI",        "%.1f dB",    cfg->demod->fsk_pulse_data.rssi_db);
-        data = data_dbl(data, "snr",   "SNR",         "%.1f dB",    cfg->demod->fsk_pulse_data.snr_db);
-        data = data_dbl(data, "noise", "Noise",       "%.1f dB",    cfg->demod->fsk_pulse_data.noise_db);
+        /* clang-format off */
+        data = data_prepend(data_make_static(
+                "mod",   "Modulation",  DATA_STRING, "FSK",
+                "freq1", "Freq1",       DATA_FORMAT, "%.1f MHz",    DATA_DOUBLE, cfg->demod->fsk_pulse_data.freq1_hz / 1000000.0,
+                "freq2", "Freq2",       DATA_FORMAT, "%.1f MHz",    DATA_DOUBLE, cfg->demod->fsk_pulse_data.freq2_hz / 1000000.0,
+                "rssi",  "RSSI",        DATA_FORMAT, "%.1f dB",     DATA_DOUBLE, cfg->demod->fsk_pulse_data.rssi_db,
+                "snr",   "SNR",         DATA_FORMAT, "%.1f dB",     DATA_DOUBLE, cfg->demod->fsk_pulse_data.snr_db,
+                "noise", "Noise",       DATA_FORMAT, "%.1f dB",     DATA_DOUBLE, cfg->demod->fsk_pulse_data.noise_db,
+                NULL), data);
+        /* clang-format on */
     }
     else if (cfg->report_meta) {
-        data = data_str(data, "mod",   "Modulation",  NULL,         "ASK");
-        data = data_dbl(data, "freq",  "Freq",        "%.1f MHz",   cfg->demod->pulse_data.freq1_hz / 1000000.0);
-        data = data_dbl(data, "rssi",  "RSSI",        "%.1f dB",    cfg->demod->pulse_data.rssi_db);
-        data = data_dbl(data, "snr",   "SNR",         "%.1f dB",    cfg->demod->pulse_data.snr_db);
-        data = data_dbl(data, "noise", "Noise",       "%.1f dB",    cfg->demod->pulse_data.noise_db);
+        /* clang-format off */
+        data = data_prepend(data_make_static(
+                "mod",   "Modulation",  DATA_STRING, "ASK",
+                "freq",  "Freq",        DATA_FORMAT, "%.1f MHz",    DATA_DOUBLE, cfg->demod->pulse_data.freq1_hz / 1000000.0,
+                "rssi",  "RSSI",        DATA_FORMAT, "%.1f dB",     DATA_DOUBLE, cfg->demod->pulse_data.rssi_db,
+                "snr",   "SNR",         DATA_FORMAT, "%.1f dB",     DATA_DOUBLE, cfg->demod->pulse_data.snr_db,
+                "noise", "Noise",       DATA_FORMAT, "%.1f dB",     DATA_DOUBLE, cfg->demod->pulse_data.noise_db,
+                NULL), data);
+        /* clang-format on */
     }
 
     // prepend "time" if requested
@@ -881,6 +876,9 @@ void data_acquired_handler(r_device *r_dev, data_t *data)
         data_output_print(output, data);
     }
     data_free(data);
+
+    if (cfg->acquired_time > 0.0)
+        histogram_observe(&cfg->output_latency, mg_time() - cfg->acquired_time);
 }
 
 // level 0: do not report (don't call this), 1: report successful devices, 2: report active devices, 3: report all
@@ -900,7 +898,7 @@ data_t *create_report_data(r_cfg_t *cfg, int level)
         if (level <= 0)
             continue;
 
-        data = data_make(
+        data = data_make_static(
                 "device",       "", DATA_INT, r_dev->protocol_num,
                 "name",         "", DATA_STRING, r_dev->name,
                 "events",       "", DATA_INT, r_dev->decode_events,
@@ -922,16 +920,24 @@ data_t *create_report_data(r_cfg_t *cfg, int level)
         list_push(&dev_data_list, data);
     }
 
-    data = data_make(
+    unsigned queued = 0, queue_peak = 0, queue_dropped = 0;
+    if (cfg->output_async)
+        output_async_stats(cfg->output_async, &queued, &queue_peak, &queue_dropped, 0);
+
+    data = data_make_static(
             "count",            "", DATA_INT, cfg->frames_ook,
             "fsk",              "", DATA_INT, cfg->frames_fsk,
             "events",           "", DATA_INT, cfg->frames_events,
+            "dedup",            "", DATA_COND, cfg->dedup != NULL, DATA_INT, cfg->dedup ? cfg->dedup->suppressed : 0,
+            "queued",           "", DATA_COND, cfg->output_async != NULL, DATA_INT, queued,
+            "queue_peak",       "", DATA_COND, cfg->output_async != NULL, DATA_INT, queue_peak,
+            "queue_dropped",    "", DATA_COND, cfg->output_async != NULL, DATA_INT, queue_dropped,
             NULL);
 
     char since_str[LOCAL_TIME_BUFLEN];
     format_time_str(since_str, "%Y-%m-%dT%H:%M:%S", cfg->report_time_tz, cfg->frames_since);
 
-    data = data_make(
+    data = data_make_static(
             "enabled",          "", DATA_INT, r_devs->len,
             "since",            "", DATA_STRING, since_str,
             "frames",           "", DATA_DATA, data,
@@ -950,6 +956,10 @@ void flush_report_data(r_cfg_t *cfg)
     cfg->frames_ook = 0;
     cfg->frames_fsk = 0;
     cfg->frames_events = 0;
+    if (cfg->dedup)
+        cfg->dedup->suppressed = 0;
+    if (cfg->output_async)
+        output_async_stats(cfg->output_async, NULL, NULL, NULL, 1);
 
     for (void **iter = r_devs->elems; iter && *iter; ++iter) {
         r_device *r_dev = *iter;
@@ -965,6 +975,83 @@ void flush_report_data(r_cfg_t *cfg)
     }
 }
 
+static char const *const decode_fail_names[] = {"fail_other", "abort_length", "abort_early", "fail_mic", "fail_sanity"};
+
+// OpenMetrics of the receiver and all enabled decoders
+static void collect_metrics(metrics_out_t *out, void *ctx)
+{
+    r_cfg_t *cfg = ctx;
+    list_t *r_devs = &cfg->demod->r_devs;
+    time_t now;
+    time(&now);
+
+    metrics_family(out, "uptime_seconds", "counter", "seconds", "Program uptime.");
+    metrics_value(out, "uptime_seconds_total", NULL, (double)(now - cfg->running_since));
+    metrics_value(out, "uptime_seconds_created", NULL, (double)cfg->running_since);
+    metrics_family(out, "decoder_enabled", "gauge", NULL, "Number of enabled decoders.");
+    metrics_count(out, "decoder_enabled", NULL, (unsigned)r_devs->len);
+
+    metrics_family(out, "input_uptime_seconds", "counter", "seconds", "SDR Receiver uptime.");
+    metrics_value(out, "input_uptime_seconds_total", NULL, (double)(now - cfg->sdr_since));
+    metrics_value(out, "input_uptime_seconds_created", NULL, (double)cfg->sdr_since);
+    metrics_family(out, "input_count_frames", "counter", "frames", "Number of SDR frames received.");
+    metrics_count(out, "input_count_frames_total", NULL, cfg->total_frames_count);
+    metrics_family(out, "input_squelch_frames", "counter", "frames", "Number of SDR frames skipped by squelch.");
+    metrics_count(out, "input_squelch_frames_total", NULL, cfg->total_frames_squelch);
+    metrics_family(out, "input_ook_frames", "counter", "frames", "Number of SDR frames with OOK demodulation.");
+    metrics_count(out, "input_ook_frames_total", NULL, cfg->total_frames_ook);
+    metrics_family(out, "input_fsk_frames", "counter", "frames", "Number of SDR frames with FSK demodulation.");
+    metrics_count(out, "input_fsk_frames_total", NULL, cfg->total_frames_fsk);
+    metrics_family(out, "input_event_frames", "counter", "frames", "Number of SDR frames with decode events.");
+    metrics_count(out, "input_event_frames_total", NULL, cfg->total_frames_events);
+    metrics_family(out, "input_dropped_buffers", "counter", "buffers", "Number of SDR sample buffers lost before processing.");
+    metrics_count(out, "input_dropped_buffers_total", NULL, cfg->dropped_buffers);
+    metrics_family(out, "input_squelch_ratio", "gauge", "ratio", "Fraction of SDR frames skipped by squelch.");
+    metrics_value(out, "input_squelch_ratio", NULL, cfg->total_frames_count ? (double)cfg->total_frames_squelch / cfg->total_frames_count : 0.0);
+    metrics_family(out, "input_noise_level_db", "gauge", NULL, "Estimated noise level in dB.");
+    metrics_value(out, "input_noise_level_db", NULL, cfg->demod->noise_level);
+    metrics_family(out, "input_min_level_db", "gauge", NULL, "Minimum detection level in dB.");
+    metrics_value(out, "input_min_level_db", NULL, cfg->demod->min_level_auto != 0.0f ? cfg->demod->min_level_auto : cfg->demod->min_level);
+
+    metrics_histogram(out, "input_buffer_processing_seconds", "Time to process a sample buffer.", &cfg->buffer_time);
+    metrics_histogram(out, "output_latency_seconds", "Time from receiving a sample buffer to the output of an event.", &cfg->output_latency);
+
+    if (cfg->output_async) {
+        unsigned queued = 0, queue_peak = 0, queue_dropped = 0;
+        output_async_stats(cfg->output_async, &queued, &queue_peak, &queue_dropped, 0);
+        metrics_family(out, "output_async_queued_events", "gauge", "events", "Number of events queued for the output thread.");
+        metrics_count(out, "output_async_queued_events", NULL, queued);
+        metrics_family(out, "output_async_dropped_events", "gauge", "events", "Number of events dropped on a full output queue since the last stats report.");
+        metrics_count(out, "output_async_dropped_events", NULL, queue_dropped);
+    }
+
+    // per decoder counts, these reset with the stats report and are gauges
+    char name[256];
+    metrics_family(out, "decoder_events", "gauge", NULL, "Number of decoder runs since the last stats report.");
+    for (size_t i = 0; i < r_devs->len; ++i) {
+        r_device *r_dev = r_devs->elems[i];
+        metrics_printf(out, "decoder_events{protocol=\"%u\",name=\"%s\"} %u\n", r_dev->protocol_num, metrics_label_escape(name, sizeof(name), r_dev->name), r_dev->decode_events);
+    }
+    metrics_family(out, "decoder_ok", "gauge", NULL, "Number of successful decoder runs since the last stats report.");
+    for (size_t i = 0; i < r_devs->len; ++i) {
+        r_device *r_dev = r_devs->elems[i];
+        metrics_printf(out, "decoder_ok{protocol=\"%u\",name=\"%s\"} %u\n", r_dev->protocol_num, metrics_label_escape(name, sizeof(name), r_dev->name), r_dev->decode_ok);
+    }
+    metrics_family(out, "decoder_messages", "gauge", NULL, "Number of decoded messages since the last stats report.");
+    for (size_t i = 0; i < r_devs->len; ++i) {
+        r_device *r_dev = r_devs->elems[i];
+        metrics_printf(out, "decoder_messages{protocol=\"%u\",name=\"%s\"} %u\n", r_dev->protocol_num, metrics_label_escape(name, sizeof(name), r_dev->name), r_dev->decode_messages);
+    }
+    metrics_family(out, "decoder_fails", "gauge", NULL, "Number of aborted or failed decoder runs by reason since the last stats report.");
+    for (size_t i = 0; i < r_devs->len; ++i) {
+        r_device *r_dev = r_devs->elems[i];
+        for (int j = 0; j < 5; ++j) {
+            if (r_dev->decode_fails[j])
+                metrics_printf(out, "decoder_fails{protocol=\"%u\",name=\"%s\",reason=\"%s\"} %u\n", r_dev->protocol_num, metrics_label_escape(name, sizeof(name), r_dev->name), decode_fail_names[j], r_dev->decode_fails[j]);
+        }
+    }
+}
+
 /* setup */
 
 static int lvlarg_param(char **param, int default_verb)
@@ -1004,6 +1091,79 @@ static int lvlarg_param(char **param, int default_verb)
     return val;
 }
 
+/// Size of the stream buffer for batched file outputs.
+#define FLUSH_BUFFER_SIZE (64 * 1024)
+
+/// Flush policy for file outputs, see data_output_t.
+typedef struct {
+    int events;
+    int msec;
+} flush_policy_t;
+
+/// Parse file output options ", v = %d" and ", flush = %d | %dms | full" in any order.
+static int fileargs_param(char **param, int default_verb, flush_policy_t *flush)
+{
+    int log_level = default_verb;
+    while (param && *param && **param == ',') {
+        char *p = *param + 1;
+        while (*p == ' ' || *p == '\t')
+            p++;
+        if (strncmp(p, "flush", 5) != 0) {
+            log_level = lvlarg_param(param, default_verb);
+            continue;
+        }
+        p += 5;
+        while (*p == ' ' || *p == '\t')
+            p++;
+        if (*p != '=') {
+            fprintf(stderr, "Unknown output option \"%s\"\n", *param);
+            exit(1);
+        }
+        p++;
+        while (*p == ' ' || *p == '\t')
+            p++;
+        if (strncmp(p, "full", 4) == 0) {
+            flush->events = -1;
+            flush->msec   = 0;
+            *param        = p + 4;
+            continue;
+        }
+        char *endptr;
+        int val = strtol(p, &endptr, 10);
+        if (p == endptr || val < 0) {
+            fprintf(stderr, "Invalid output option \"%s\"\n", *param);
+            exit(1);
+        }
+        if (strncmp(endptr, "ms", 2) == 0) {
+            flush->events = val ? -1 : 0;
+            flush->msec   = val;
+            endptr += 2;
+        }
+        else {
+            flush->events = val > 1 ? val : 0;
+            flush->msec   = 0;
+        }
+        *param = endptr;
+    }
+    return log_level;
+}
+
+/// Set the flush policy on a file output, a batched file gets a large buffer.
+static data_output_t *flush_policy_apply(data_output_t *output, FILE *file, flush_policy_t flush)
+{
+    if (!output || !file || !flush.events)
+        return output;
+
+    output->flush_events = flush.events;
+    output->flush_msec   = flush.msec;
+
+    // the standard streams might already be in use, a buffer can only be set before the first I/O
+    if (file == stdout || file == stderr)
+        return output;
+
+    return data_output_file_buffer_wrap(output, file, FLUSH_BUFFER_SIZE);
+}
+
 /// Opens the path @p param (or STDOUT if empty or `-`) for append writing, removes leading `,` and `:` from path name.
 static FILE *fopen_output(char const *param)
 {
@@ -1029,14 +1189,66 @@ static FILE *fopen_output(char const *param)
 
 void add_json_output(r_cfg_t *cfg, char *param)
 {
-    int log_level = lvlarg_param(&param, 0);
-    list_push(&cfg->output_handler, data_output_json_create(log_level, fopen_output(param)));
+    flush_policy_t flush = {0};
+    int log_level = fileargs_param(&param, 0, &flush);
+    FILE *file = fopen_output(param);
+    list_push(&cfg->output_handler, flush_policy_apply(data_output_json_create(log_level, file), file, flush));
 }
 
 void add_csv_output(r_cfg_t *cfg, char *param)
 {
-    int log_level = lvlarg_param(&param, 0);
-    list_push(&cfg->output_handler, data_output_csv_create(log_level, fopen_output(param)));
+    flush_policy_t flush = {0};
+    int log_level = fileargs_param(&param, 0, &flush);
+    FILE *file = fopen_output(param);
+    list_push(&cfg->output_handler, flush_policy_apply(data_output_csv_create(log_level, file), file, flush));
+}
+
+void add_cbor_output(r_cfg_t *cfg, char *param)
+{
+    // parse optional ",frame=seq|len" before the log level
+    cbor_framing_t framing = CBOR_FRAMING_SEQUENCE;
+    if (param && strncmp(param, ",frame=", 7) == 0) {
+        param += 7;
+        if (strncmp(param, "len", 3) == 0) {
+            framing = CBOR_FRAMING_LENGTH;
+        }
+        else if (strncmp(param, "seq", 3) != 0) {
+            fprintf(stderr, "Invalid CBOR framing \"%s\"\n", param);
+            exit(1);
+        }
+        param += 3;
+    }
+    flush_policy_t flush = {0};
+    int log_level = fileargs_param(&param, 0, &flush);
+
+    if (param && *param == ':')
+        param++;
+    if (param && strncmp(param, "udp:", 4) == 0) {
+        char const *host = "localhost";
+        char const *port = "8433";
+        char const *extra = hostport_param(param + 4, &host, &port);
+        if (extra && *extra) {
+            print_logf(LOG_FATAL, "CBOR UDP", "Unknown parameters \"%s\"", extra);
+        }
+        print_logf(LOG_CRITICAL, "CBOR UDP", "Sending datagrams to %s port %s", host, port);
+
+        list_push(&cfg->output_handler, data_output_cbor_udp_create(log_level, host, port));
+        return;
+    }
+
+    FILE *file = fopen_output(param);
+    list_push(&cfg->output_handler, flush_policy_apply(data_output_cbor_create(log_level, file, framing), file, flush));
+}
+
+static void flush_timer_handler(struct mg_connection *nc, int ev, void *ev_data)
+{
+    UNUSED(ev_data);
+    data_output_t *output = nc->user_data;
+
+    if (ev == MG_EV_TIMER && output) {
+        data_output_flush(output);
+        mg_set_timer(nc, mg_time() + output->flush_msec / 1000.0);
+    }
 }
 
 void start_outputs(r_cfg_t *cfg, char const *const *well_known)
@@ -1050,18 +1262,39 @@ void start_outputs(r_cfg_t *cfg, char const *const *well_known)
     }
 
     free((void *)output_fields);
+
+    // move outputs which don't need the main loop to the dispatch thread
+    for (size_t i = 0; cfg->output_async && i < cfg->output_handler.len; ++i) {
+        data_output_t *output = cfg->output_handler.elems[i];
+        if (output && output->async_safe)
+            cfg->output_handler.elems[i] = output_async_wrap(cfg->output_async, output);
+    }
+
+    // flush batched outputs on a timer
+    for (size_t i = 0; i < cfg->output_handler.len; ++i) {
+        data_output_t *output = cfg->output_handler.elems[i];
+        if (output && output->flush_msec > 0) {
+            struct mg_add_sock_opts opts = {.user_data = output};
+            struct mg_connection *nc = mg_add_sock_opt(get_mgr(cfg), INVALID_SOCKET, flush_timer_handler, opts);
+            mg_set_timer(nc, mg_time() + output->flush_msec / 1000.0);
+        }
+    }
 }
 
 void add_log_output(r_cfg_t *cfg, char *param)
 {
-    int log_level = lvlarg_param(&param, LOG_TRACE);
-    list_push(&cfg->output_handler, data_output_log_create(log_level, fopen_output(param)));
+    flush_policy_t flush = {0};
+    int log_level = fileargs_param(&param, LOG_TRACE, &flush);
+    FILE *file = fopen_output(param);
+    list_push(&cfg->output_handler, flush_policy_apply(data_output_log_create(log_level, file), file, flush));
 }
 
 void add_kv_output(r_cfg_t *cfg, char *param)
 {
-    int log_level = lvlarg_param(&param, LOG_TRACE);
-    list_push(&cfg->output_handler, data_output_kv_create(log_level, fopen_output(param)));
+    flush_policy_t flush = {0};
+    int log_level = fileargs_param(&param, LOG_TRACE, &flush);
+    FILE *file = fopen_output(param);
+    list_push(&cfg->output_handler, flush_policy_apply(data_output_kv_create(log_level, file), file, flush));
 }
 
 void add_mqtt_output(r_cfg_t *cfg, char *param)
@@ -1076,7 +1309,10 @@ void add_influx_output(r_cfg_t *cfg, char *param)
 
 void add_syslog_output(r_cfg_t *cfg, char *param)
 {
-    int log_level = lvlarg_param(&param, LOG_WARNING);
+    flush_policy_t flush = {0};
+    int log_level = fileargs_param(&param, LOG_WARNING, &flush);
+    if (param && *param == ':')
+        param++;
     char const *host = "localhost";
     char const *port = "514";
     char const *extra = hostport_param(param, &host, &port);
@@ -1085,7 +1321,13 @@ void add_syslog_output(r_cfg_t *cfg, char *param)
     }
     print_logf(LOG_CRITICAL, "Syslog UDP", "Sending datagrams to %s port %s", host, port);
 
-    list_push(&cfg->output_handler, data_output_syslog_create(log_level, host, port));
+    data_output_t *output = data_output_syslog_create(log_level, host, port);
+    if (output && flush.events) {
+        // datagrams are queued and sent in batches
+        output->flush_events = flush.events;
+        output->flush_msec   = flush.msec;
+    }
+    list_push(&cfg->output_handler, output);
 }
 
 void add_http_output(r_cfg_t *cfg, char *param)
@@ -1093,13 +1335,25 @@ void add_http_output(r_cfg_t *cfg, char *param)
     // Note: no log_level, the HTTP-API consumes all log levels.
     char const *host = "0.0.0.0";
     char const *port = "8433";
-    char const *extra = hostport_param(param, &host, &port);
-    if (extra && *extra) {
-        print_logf(LOG_FATAL, "HTTP server", "Unknown parameters \"%s\"", extra);
+    char *opts = hostport_param(param, &host, &port);
+    int history = 0;
+
+    char *key, *val;
+    while (getkwargs(&opts, &key, &val)) {
+        key = remove_ws(key);
+        val = trim_ws(val);
+        if (!key || !*key)
+            continue;
+        else if (!strcasecmp(key, "history"))
+            history = atoiv(val, 0);
+        else {
+            print_logf(LOG_FATAL, "HTTP server", "Unknown parameter \"%s\"", key);
+            exit(1);
+        }
     }
     print_logf(LOG_CRITICAL, "HTTP server", "Starting HTTP server at %s port %s", host, port);
 
-    list_push(&cfg->output_handler, data_output_http_create(get_mgr(cfg), host, port, cfg));
+    list_push(&cfg->output_handler, data_output_http_create(get_mgr(cfg), host, port, history, cfg));
 }
 
 void add_trigger_output(r_cfg_t *cfg, char *param)
@@ -1119,9 +1373,6 @@ void add_rtltcp_output(r_cfg_t *cfg, char *param)
     char const *host = "localhost";
     char const *port = "1234";
     char const *extra = hostport_param(param, &host, &port);
-    if (extra && *extra) {
-        print_logf(LOG_FATAL, "rtl_tcp server", "Unknown parameters \"%s\"", extra);
-    }
     print_logf(LOG_CRITICAL, "rtl_tcp server", "Starting rtl_tcp server at %s port %s", host, port);
 
     list_push(&cfg->raw_handler, raw_output_rtltcp_create(host, port, extra, cfg));
@@ -1221,6 +1472,13 @@ void add_dumper(r_cfg_t *cfg, char const *spec, int overwrite)
     list_push(&cfg->demod->dumper, dumper);
 
     file_info_parse_filename(dumper, spec);
+    if (dumper->compression) {
+        fprintf(stderr, "Writing compressed files is not supported: %s\n", spec);
+        exit(1);
+    }
+    if (dumper->activity_index) {
+        dumper->format = ACTIVITY_INDEX; // the index of a recording, whatever the recording format
+    }
     if (strcmp(dumper->path, "-") == 0) { /* Write samples to stdout */
         dumper->file = stdout;
 #ifdef _WIN32
@@ -1244,6 +1502,9 @@ void add_dumper(r_cfg_t *cfg, char const *spec, int overwrite)
     if (dumper->format == PULSE_OOK) {
         pulse_data_print_pulse_header(dumper->file);
     }
+    if (dumper->format == ACTIVITY_INDEX) {
+        activity_index_print_header(dumper->file);
+    }
 }
 
 void add_infile(r_cfg_t *cfg, char *in_file)
@@ -40,11 +40,16 @@
 #include "pulse_slicer.h"
 #include "rfraw.h"
 #include "data.h"
+#include "data_dedup.h"
+#include "output_async.h"
 #include "raw_output.h"
 #include "r_util.h"
 #include "optparse.h"
 #include "abuf.h"
 #include "fileformat.h"
+#include "input_file.h"
+#include "input_segments.h"
+#include "activity_index.h"
 #include "samp_grab.h"
 #include "am_analyze.h"
 #include "confparse.h"
@@ -122,6 +127,34 @@ static void delay_timer_wait(delay_timer_t *delay_timer, unsigned delay_us)
         usleep(delay_us - elapsed_us);
 }
 
+// load the activity index given as input file and point the file info to the recording
+static activity_index_t *load_activity_index(r_cfg_t *cfg, char **sample_path)
+{
+    file_info_t *info = &cfg->demod->load_info;
+    size_t len = strlen(info->path);
+    if (len < 4 || strncasecmp(info->path + len - 4, ".idx", 4) != 0) {
+        print_logf(LOG_ERROR, "Input", "Activity index \"%s\" needs an \".idx\" suffix after the recording name", info->path);
+        return NULL;
+    }
+    activity_index_t *index = activity_index_load(info->path, (uint64_t)(ACTIVITY_INDEX_PAD_SEC * cfg->samp_rate));
+    if (!index) {
+        print_logf(LOG_ERROR, "Input", "Reading activity index \"%s\" failed!", info->path);
+        return NULL;
+    }
+    *sample_path = strdup(info->path);
+    if (!*sample_path)
+        FATAL_STRDUP("load_activity_index()");
+    (*sample_path)[len - 4] = '\0';
+    info->path = *sample_path;
+
+    if (cfg->verbosity >= LOG_NOTICE) {
+        uint64_t samples;
+        unsigned regions = activity_index_regions(index, &samples);
+        print_logf(LOG_NOTICE, "Input", "Activity index lists %u regions of %.1f s", regions, (double)samples / cfg->samp_rate);
+    }
+    return index;
+}
+
 r_device *flex_create_device(char *spec); // maybe put this in some header file?
 
 static void print_version(void)
@@ -179,13 +212,14 @@ static void usage(int exit_code)
             "  [-S none | all | unknown | known] Signal auto save. Creates one file per signal.\n"
             "       Note: Saves raw I/Q samples (uint8 pcm, 2 channel). Preferred mode for generating test files.\n"
             "  [-r <filename> | help] Read data from input file instead of a receiver\n"
+            "  [-j <threads>] Decode multiple input files, or segments of a file, on multiple threads (default: 1)\n"
             "  [-w <filename> | help] Save data stream to output file (a '-' dumps samples to stdout)\n"
             "  [-W <filename> | help] Save data stream to output file, overwrite existing file\n"
             "\t\t= Data output options =\n"
-            "  [-F log | kv | json | csv | mqtt | influx | syslog | trigger | null | help] Produce decoded output in given format.\n"
+            "  [-F log | kv | json | cbor | csv | mqtt | influx | syslog | trigger | null | help] Produce decoded output in given format.\n"
             "       Append output to file with :<filename> (e.g. -F csv:log.csv), defaults to stdout.\n"
             "       Specify host/port for syslog with e.g. -F syslog:127.0.0.1:1514\n"
-            "  [-M time[:<options>] | protocol | level | noise[:<secs>] | stats | bits | help] Add various meta data to each output.\n"
+            "  [-M time[:<options>] | protocol | level | noise[:<secs>] | stats | bits | dedup | async | help] Add various meta data to each output.\n"
             "  [-K FILE | PATH | <tag> | <key>=<tag>] Add an expanded token or fixed tag to every output line.\n"
             "  [-C native | si | customary] Convert units in decoded output.\n"
             "  [-n <value>] Specify number of samples to take (each sample is an I/Q pair)\n"
@@ -275,13 +309,17 @@ static void help_output(void)
 {
     term_help_fprintf(stdout,
             "\t\t= Output format option =\n"
-            "  [-F log|kv|json|csv|mqtt|influx|syslog|trigger|null] Produce decoded output in given format.\n"
+            "  [-F log|kv|json|cbor|csv|mqtt|influx|syslog|trigger|null] Produce decoded output in given format.\n"
             "\tWithout this option the default is LOG and KV output. Use \"-F null\" to remove the default.\n"
             "\tAppend output to file with :<filename> (e.g. -F csv:log.csv), defaults to stdout.\n"
+            "\tFile outputs flush every event, batch writes with ,flush=<n> events, ,flush=<msec>ms, or ,flush=full\n"
+            "\t  (e.g. -F json,flush=250ms:log.json), the timer needs a live input, all outputs flush on exit.\n"
             "\tSpecify MQTT server with e.g. -F mqtt://localhost:1883\n"
             "\tDefault user and password are read from MQTT_USERNAME and MQTT_PASSWORD env vars.\n"
             "\tAdd MQTT options with e.g. -F \"mqtt://host:1883,opt=arg\"\n"
-            "\tMQTT options are: user=foo, pass=bar, retain[=0|1], <format>[=topic]\n"
+            "\tMQTT options are: user=foo, pass=bar, retain[=0|1], qos=<0|1>, <format>[=topic]\n"
+            "\t  With qos=1 messages are queued until acknowledged, up to inflight=<n> (default 16) are sent\n"
+            "\t  and up to queue=<n> (default 10000) are kept, the oldest are dropped on overflow.\n"
             "\tSupported MQTT formats: (default is all)\n"
             "\t  events: posts JSON event data, default \"<base>/events\"\n"
             "\t  states: posts JSON state data, default \"<base>/states\"\n"
@@ -295,7 +333,12 @@ static void help_output(void)
             "\tSpecify InfluxDB 2.0 server with e.g. -F \"influx://localhost:9999/api/v2/write?org=<org>&bucket=<bucket>,token=<authtoken>\"\n"
             "\tSpecify InfluxDB 1.x server with e.g. -F \"influx://localhost:8086/write?db=<db>&p=<password>&u=<user>\"\n"
             "\t  Additional parameter -M time:unix:usec:utc for correct timestamps in InfluxDB recommended\n"
-            "\tSpecify host/port for syslog with e.g. -F syslog:127.0.0.1:1514\n");
+            "\tInfluxDB options are: batch=<bytes>, linger=<msec>, gzip, max_mem=<bytes>\n"
+            "\tSpecify host/port for syslog with e.g. -F syslog:127.0.0.1:1514\n"
+            "\t  Batch datagrams with ,flush=<n> or ,flush=<msec>ms (e.g. -F syslog,flush=64:127.0.0.1:1514)\n"
+            "\tCBOR output writes a CBOR sequence (RFC 8742) of binary events, e.g. -F cbor:events.cbor\n"
+            "\t  Use -F cbor,frame=len to prefix each event with a 32-bit big-endian length.\n"
+            "\t  Send each event as a UDP datagram with e.g. -F cbor:udp://127.0.0.1:8433\n");
     exit(0);
 }
 
@@ -325,7 +368,7 @@ static void help_meta(void)
 {
     term_help_fprintf(stdout,
             "\t\t= Meta information option =\n"
-            "  [-M time[:<options>]|protocol|level|noise[:<secs>]|stats|bits] Add various metadata to every output line.\n"
+            "  [-M time[:<options>]|protocol|level|noise[:<secs>]|stats|bits|dedup|async] Add various metadata to every output line.\n"
             "\tUse \"time\" to add current date and time meta data (preset for live inputs).\n"
             "\tUse \"time:rel\" to add sample position meta data (preset for read-file and stdin).\n"
             "\tUse \"time:unix\" to show the seconds since unix epoch as time meta data. This is always UTC.\n"
@@ -342,7 +385,11 @@ static void help_meta(void)
             "\tUse \"noise[:<secs>]\" to report estimated noise level at intervals (default: 10 seconds).\n"
             "\tUse \"stats[:[<level>][:<interval>]]\" to report statistics (default: 600 seconds).\n"
             "\t  level 0: no report, 1: report successful devices, 2: report active devices, 3: report all\n"
-            "\tUse \"bits\" to add bit representation to code outputs (for debug).\n");
+            "\tUse \"bits\" to add bit representation to code outputs (for debug).\n"
+            "\tUse \"dedup[:<msec>]\" to suppress repeated identical events (default: 1000 ms).\n"
+            "\t  Events are matched by model, id, and channel, ignoring time and level meta data.\n"
+            "\tUse \"async[:<depth>[:drop|block]]\" to print file and syslog outputs on a separate thread.\n"
+            "\t  Up to <depth> events are queued (default: 256), on overflow drop events (default) or block.\n");
     exit(0);
 }
 
@@ -364,7 +411,13 @@ static void help_read(void)
             "\tE.g. default detection by extension: path/filename.am.s16\n"
             "\tforced overrides: am:s16:path/filename.ext\n\n"
             "\tReading from pipes also support format options.\n"
-            "\tE.g reading complex 32-bit float: CU32:-\n");
+            "\tE.g reading complex 32-bit float: CU32:-\n\n"
+            "\tFiles are memory mapped if possible and read in blocks of '-b' bytes (default 256k).\n\n"
+            "\tCompressed files with a 'gz' or 'zst' suffix are decompressed while reading,\n"
+            "\te.g. path/filename.cu8.gz or path/filename.cu8.zst\n\n"
+            "\tAn activity index written with '-w' can be read in place of the recording,\n"
+            "\tonly the blocks around the indexed packages are decoded,\n"
+            "\te.g. path/filename.cu8.idx for path/filename.cu8\n");
     exit(0);
 }
 
@@ -380,6 +433,9 @@ static void help_write(void)
             "\t'cu8', 'cs8', 'cs16', 'cf32' ('IQ' implied),\n"
             "\t'am.s16', 'am.f32', 'fm.s16', 'fm.f32',\n"
             "\t'i.f32', 'q.f32', 'logic.u8', 'ook', and 'vcd'.\n\n"
+            "\tAn activity index of the recording ('idx') lists the sample offset, length,\n"
+            "\tmodulation, RSSI, and SNR of each detected package,\n"
+            "\te.g. -w path/filename.cu8 -w path/filename.cu8.idx\n\n"
             "\tParameters must be separated by non-alphanumeric chars and are case-insensitive.\n"
             "\tOverrides can be prefixed, separated by colon (':')\n\n"
             "\tE.g. default detection by extension: path/filename.am.s16\n"
@@ -423,6 +479,7 @@ static void sdr_callback(unsigned char *iq_buf, uint32_t len, void *ctx)
         print_log(LOG_WARNING, __func__, "Sample buffer too short!");
         return; // keep the watchdog timer running
     }
+    double start_time = mg_time();
 
     // age the frame position if there is one
     if (demod->frame_start_ago)
@@ -553,6 +610,7 @@ static void sdr_callback(unsigned char *iq_buf, uint32_t len, void *ctx)
                     if (dumper->format == VCD_LOGIC) pulse_data_print_vcd(dumper->file, &demod->pulse_data, '\'');
                     if (dumper->format == U8_LOGIC) pulse_data_dump_raw(demod->u8_buf, n_samples, cfg->input_pos, &demod->pulse_data, 0x02);
                     if (dumper->format == PULSE_OOK) pulse_data_dump(dumper->file, &demod->pulse_data);
+                    if (dumper->format == ACTIVITY_INDEX) activity_index_print(dumper->file, &demod->pulse_data, "ook");
                 }
 
                 if (cfg->verbosity >= LOG_TRACE) pulse_data_print(&demod->pulse_data);
@@ -580,6 +638,7 @@ static void sdr_callback(unsigned char *iq_buf, uint32_t len, void *ctx)
                     if (dumper->format == VCD_LOGIC) pulse_data_print_vcd(dumper->file, &demod->fsk_pulse_data, '"');
                     if (dumper->format == U8_LOGIC) pulse_data_dump_raw(demod->u8_buf, n_samples, cfg->input_pos, &demod->fsk_pulse_data, 0x04);
                     if (dumper->format == PULSE_OOK) pulse_data_dump(dumper->file, &demod->fsk_pulse_data);
+                    if (dumper->format == ACTIVITY_INDEX) activity_index_print(dumper->file, &demod->fsk_pulse_data, "fsk");
                 }
 
                 if (cfg->verbosity >= LOG_TRACE) pulse_data_print(&demod->fsk_pulse_data);
@@ -634,7 +693,8 @@ static void sdr_callback(unsigned char *iq_buf, uint32_t len, void *ctx)
         file_info_t const *dumper = *iter;
         if (!dumper->file
                 || dumper->format == VCD_LOGIC
-                || dumper->format == PULSE_OOK)
+                || dumper->format == PULSE_OOK
+                || dumper->format == ACTIVITY_INDEX)
             continue;
         uint8_t *out_buf = iq_buf;  // Default is to dump IQ samples
         unsigned long out_len = n_samples * demod->sample_size;
@@ -730,6 +790,8 @@ static void sdr_callback(unsigned char *iq_buf, uint32_t len, void *ctx)
         }
     }
 
+    histogram_observe(&cfg->buffer_time, mg_time() - start_time);
+
     cfg->input_pos += n_samples;
     if (cfg->bytes_to_read > 0)
         cfg->bytes_to_read -= len;
@@ -786,7 +848,7 @@ static int hasopt(int test, int argc, char *argv[], char const *optstring)
 
 static void parse_conf_option(r_cfg_t *cfg, int opt, char *arg);
 
-#define OPTSTRING "hVvqD:c:x:z:p:a:AI:S:m:M:r:w:W:l:d:t:f:H:g:s:b:n:R:X:F:K:C:T:UGy:E:Y:"
+#define OPTSTRING "hVvqD:c:x:z:p:a:AI:S:m:M:r:j:w:W:l:d:t:f:H:g:s:b:n:R:X:F:K:C:T:UGy:E:Y:"
 
 // these should match the short options exactly
 static struct conf_keywords const conf_keywords[] = {
@@ -813,6 +875,7 @@ static struct conf_keywords const conf_keywords[] = {
         {"analyze_pulses", 'A'},
         {"include_only", 'I'},
         {"read_file", 'r'},
+        {"threads", 'j'},
         {"write_file", 'w'},
         {"overwrite_file", 'W'},
         {"signal_grabber", 'S'},
@@ -1009,6 +1072,13 @@ static void parse_conf_option(r_cfg_t *cfg, int opt, char *arg)
         add_infile(cfg, arg);
         // TODO: file_info_check_read()
         break;
+    case 'j':
+        cfg->in_threads = atoiv(arg, 1);
+        if (cfg->in_threads < 1 || cfg->in_threads > SEGMENT_THREADS_MAX) {
+            fprintf(stderr, "Number of threads must be 1 to %d.\n", SEGMENT_THREADS_MAX);
+            exit(1);
+        }
+        break;
     case 'w':
         if (!arg)
             help_write();
@@ -1124,6 +1194,22 @@ static void parse_conf_option(r_cfg_t *cfg, int opt, char *arg)
         }
         else if (!strncasecmp(arg, "replay", 6))
             cfg->in_replay = atobv(arg_param(arg), 1);
+        else if (!strncasecmp(arg, "dedup", 5)) {
+            int window_ms = atoiv(arg_param(arg), 1000);
+            data_dedup_free(cfg->dedup);
+            cfg->dedup = window_ms > 0 ? data_dedup_create(window_ms) : NULL;
+        }
+        else if (!strncasecmp(arg, "async", 5)) {
+            char *p = arg_param(arg);
+            int depth = atoiv(p, 256);
+            char *policy = arg_param(p);
+            if (policy && strcasecmp(policy, "drop") && strcasecmp(policy, "block")) {
+                fprintf(stderr, "Invalid async overflow policy: %s\n", policy);
+                usage(1);
+            }
+            output_async_free(cfg->output_async);
+            cfg->output_async = depth > 0 ? output_async_create(depth, policy && !strcasecmp(policy, "block")) : NULL;
+        }
         else
             cfg->report_meta = atobv(arg, 1);
         break;
@@ -1179,6 +1265,7 @@ static void parse_conf_option(r_cfg_t *cfg, int opt, char *arg)
 
         flex_device = flex_create_device(arg);
         register_protocol(cfg, flex_device, "");
+        free(flex_device); // the registered copy owns the decode_ctx now
         break;
     case 'q':
         fprintf(stderr, "quiet option (-q) is default and deprecated. See -v to increase verbosity\n");
@@ -1190,6 +1277,9 @@ static void parse_conf_option(r_cfg_t *cfg, int opt, char *arg)
         if (strncmp(arg, "json", 4) == 0) {
             add_json_output(cfg, arg_param(arg));
         }
+        else if (strncmp(arg, "cbor", 4) == 0) {
+            add_cbor_output(cfg, arg_param(arg));
+        }
         else if (strncmp(arg, "csv", 3) == 0) {
             add_csv_output(cfg, arg_param(arg));
         }
@@ -1387,6 +1477,13 @@ static void sighandler(int signum)
 
 static void timer_handler(struct mg_connection *nc, int ev, void *ev_data);
 
+/// A sdr event with the time and sequence number of acquisition.
+typedef struct {
+    sdr_event_t ev;
+    double time;  ///< time the event was received from the SDR
+    unsigned seq; ///< sequence number of data events
+} acquire_event_t;
+
 // called by mg_mgr_poll() for each connection.
 // NOTE: this handler might be called while already in `r_free_cfg()`.
 static void sdr_handler(struct mg_connection *nc, int ev_type, void *ev_data)
@@ -1402,7 +1499,8 @@ static void sdr_handler(struct mg_connection *nc, int ev_type, void *ev_data)
     }
 
     r_cfg_t *cfg     = nc->user_data;
-    sdr_event_t *ev = ev_data;
+    acquire_event_t *aev = ev_data;
+    sdr_event_t *ev = &aev->ev;
     //fprintf(stderr, "sdr_handler...\n");
 
     data_t *data = NULL;
@@ -1430,8 +1528,12 @@ static void sdr_handler(struct mg_connection *nc, int ev_type, void *ev_data)
     }
 
     if (ev->ev == SDR_EV_DATA) {
+        // a gap in the sequence means the broadcast of buffers was lost
+        cfg->dropped_buffers += aev->seq - cfg->receive_seq;
+        cfg->receive_seq = aev->seq + 1;
         cfg->samp_rate        = ev->sample_rate;
         cfg->center_frequency = ev->center_frequency;
+        cfg->acquired_time    = aev->time;
         sdr_callback((unsigned char *)ev->buf, ev->len, cfg);
     }
 
@@ -1450,14 +1552,19 @@ static void acquire_callback(sdr_event_t *ev, void *ctx)
     //get_time_now(&now);
     //fprintf(stderr, "%ld.%06ld acquire_callback...\n", (long)now.tv_sec, (long)now.tv_usec);
 
-    struct mg_mgr *mgr = ctx;
+    r_cfg_t *cfg = ctx;
 
     // TODO: We should run the demod here to unblock the event loop
 
+    // stamp data events, the sequence number is only used on this thread
+    acquire_event_t aev = {.ev = *ev, .time = mg_time()};
+    if (ev->ev == SDR_EV_DATA)
+        aev.seq = cfg->acquire_seq++;
+
     // thread-safe dispatch, ev_data is the iq buffer pointer and length
     // mg_mgr_poll() calls specified callback for each connection.
     //fprintf(stderr, "acquire_callback bc send...\n");
-    mg_broadcast(mgr, sdr_handler, (void *)ev, sizeof(*ev));
+    mg_broadcast(cfg->mgr, sdr_handler, &aev, sizeof(aev));
     //fprintf(stderr, "acquire_callback bc done...\n");
 }
 
@@ -1507,7 +1614,8 @@ static int start_sdr(r_cfg_t *cfg)
 
     sdr_set_center_freq(cfg->dev, cfg->center_frequency, 1); // always verbose
 
-    r = sdr_start(cfg->dev, acquire_callback, (void *)get_mgr(cfg),
+    get_mgr(cfg); // ensure the manager exists before the acquire thread uses it
+    r = sdr_start(cfg->dev, acquire_callback, (void *)cfg,
             DEFAULT_ASYNC_BUF_NUMBER, cfg->out_block_size);
     if (r < 0) {
         print_logf(LOG_ERROR, "Input", "async start failed (%d).", r);
@@ -1836,18 +1944,26 @@ int main(int argc, char **argv) {
 
     // Special case for in files
     if (cfg->in_files.len) {
-        unsigned char *test_mode_buf = malloc(DEFAULT_BUF_LENGTH * sizeof(unsigned char));
+        // blocks of whole CS16 samples
+        uint32_t block_size = cfg->out_block_size & ~3u;
+        unsigned char *test_mode_buf = malloc(block_size * sizeof(unsigned char));
         if (!test_mode_buf)
             FATAL_MALLOC("test_mode_buf");
-        float *test_mode_float_buf = malloc(DEFAULT_BUF_LENGTH / sizeof(int16_t) * sizeof(float));
-        if (!test_mode_float_buf)
-            FATAL_MALLOC("test_mode_float_buf");
 
         if (cfg->duration > 0) {
             time(&cfg->stop_time);
             cfg->stop_time += cfg->duration;
         }
 
+        // decode many files on multiple threads, otherwise segments of each file
+        input_pool_t *pool = NULL;
+        if (cfg->in_threads > 1 && cfg->in_files.len > 1) {
+            if (input_pool_possible(cfg))
+                pool = input_pool_start(cfg, sdr_callback);
+            else if (cfg->verbosity >= LOG_NOTICE)
+                print_log(LOG_NOTICE, "Input", "Options depend on the sample history, decoding files serially");
+        }
+
         for (void **iter = cfg->in_files.elems; iter && *iter; ++iter) {
             cfg->in_filename = *iter;
 
@@ -1857,18 +1973,9 @@ int main(int argc, char **argv) {
             cfg->samp_rate        = demod->load_info.sample_rate ? demod->load_info.sample_rate : sample_rate_0;
             cfg->center_frequency = demod->load_info.center_frequency ? demod->load_info.center_frequency : cfg->frequency[0];
 
-            FILE *in_file;
             if (strcmp(demod->load_info.path, "-") == 0) { // read samples from stdin
-                in_file = stdin;
                 cfg->in_filename = "<stdin>";
-            } else {
-                in_file = fopen(demod->load_info.path, "rb");
-                if (!in_file) {
-                    print_logf(LOG_ERROR, "Input", "Opening file \"%s\" failed!", cfg->in_filename);
-                    break;
-                }
             }
-            print_logf(LOG_CRITICAL, "Input", "Test mode active. Reading samples from file: %s", cfg->in_filename); // Essential information (not quiet)
             if (demod->load_info.format == CU8_IQ
                     || demod->load_info.format == CS8_IQ
                     || demod->load_info.format == S16_AM
@@ -1883,13 +1990,23 @@ int main(int argc, char **argv) {
                 print_logf(LOG_ERROR, "Input", "Input format invalid \"%s\"", file_info_string(&demod->load_info));
                 break;
             }
-            if (cfg->verbosity >= LOG_NOTICE) {
-                print_logf(LOG_NOTICE, "Input", "Input format \"%s\"", file_info_string(&demod->load_info));
-            }
-            demod->sample_file_pos = 0.0;
 
             // special case for pulse data file-inputs
             if (demod->load_info.format == PULSE_OOK) {
+                FILE *in_file = stdin;
+                if (strcmp(demod->load_info.path, "-") != 0) {
+                    in_file = fopen(demod->load_info.path, "rb");
+                    if (!in_file) {
+                        print_logf(LOG_ERROR, "Input", "Opening file \"%s\" failed!", cfg->in_filename);
+                        break;
+                    }
+                }
+                print_logf(LOG_CRITICAL, "Input", "Test mode active. Reading samples from file: %s", cfg->in_filename); // Essential information (not quiet)
+                if (cfg->verbosity >= LOG_NOTICE) {
+                    print_logf(LOG_NOTICE, "Input", "Input format \"%s\"", file_info_string(&demod->load_info));
+                }
+                demod->sample_file_pos = 0.0;
+
                 while (!cfg->exit_async) {
                     pulse_data_load(in_file, &demod->pulse_data, cfg->samp_rate);
                     if (!demod->pulse_data.num_pulses)
@@ -1928,77 +2045,127 @@ int main(int argc, char **argv) {
                 continue;
             }
 
-            // default case for file-inputs
+            // an activity index is read in place of the recording to only decode the active regions
+            activity_index_t *act_index = NULL;
+            char *sample_path = NULL;
+            if (demod->load_info.activity_index) {
+                act_index = load_activity_index(cfg, &sample_path);
+                if (!act_index)
+                    break;
+            }
+
+            // default case for file-inputs, CS8 is read as CU8, CF32 as CS16
+            input_file_t *in_file = input_file_open(&demod->load_info, block_size);
+            if (!in_file) {
+                print_logf(LOG_ERROR, "Input", "Opening file \"%s\" failed!", cfg->in_filename);
+                activity_index_free(act_index);
+                free(sample_path);
+                break;
+            }
+            print_logf(LOG_CRITICAL, "Input", "Test mode active. Reading samples from file: %s", cfg->in_filename); // Essential information (not quiet)
+            if (cfg->verbosity >= LOG_NOTICE) {
+                print_logf(LOG_NOTICE, "Input", "Input format \"%s\"", file_info_string(&demod->load_info));
+            }
+            demod->sample_file_pos = 0.0;
+
             int n_blocks = 0;
-            unsigned long n_read;
+            uint64_t n_bytes = 0; // converted bytes
+            double read_start = mg_time();
+            int n_segments = 0;
+            if (pool) {
+                n_segments = input_pool_decode(pool, (int)(iter - cfg->in_files.elems), &n_blocks, &n_bytes);
+            }
+            else if (cfg->in_threads > 1) {
+                if (input_segments_possible(cfg))
+                    n_segments = input_segments_decode(cfg, in_file, sdr_callback, &n_blocks, &n_bytes);
+                else if (cfg->verbosity >= LOG_NOTICE)
+                    print_log(LOG_NOTICE, "Input", "Options depend on the sample history, decoding in one segment");
+            }
             delay_timer_t delay_timer;
             delay_timer_init(&delay_timer);
-            do {
+            uint64_t block_samples = block_size / demod->sample_size;
+            uint64_t in_block_size = demod->load_info.format == CF32_IQ ? block_size * 2 : block_size;
+            int reset_failed = 0;
+            while (!n_segments && !cfg->exit_async) {
+                if (act_index) {
+                    // skip to the block with the next active sample
+                    uint64_t block = n_bytes / block_size;
+                    uint64_t next  = activity_index_next(act_index, block * block_samples);
+                    if (next == UINT64_MAX)
+                        break; // no more active regions
+                    uint64_t skip = next / block_samples - block;
+                    if (skip) {
+                        if (input_file_seek(in_file, (block + skip) * in_block_size) != 0)
+                            break;
+                        n_bytes += skip * block_size;
+                        cfg->input_pos += skip * block_samples;
+                        // drop any package in progress, the next region is not contiguous
+                        if (r_reset_demod(demod) < 0) {
+                            reset_failed = 1;
+                            break;
+                        }
+                    }
+                }
+                uint8_t *block;
+                uint32_t n_read = input_file_read(in_file, &block);
+                if (n_read == 0)
+                    break; // sdr_callback() will Segmentation Fault with len=0
                 // Replay in realtime if requested
                 if (cfg->in_replay) {
                     // per block delay
-                    unsigned delay_us = (unsigned)(1000000llu * DEFAULT_BUF_LENGTH / cfg->samp_rate / demod->sample_size / cfg->in_replay);
-                    if (demod->load_info.format == CF32_IQ)
-                        delay_us /= 2; // adjust for float only reading half as many samples
+                    unsigned delay_us = (unsigned)(1000000llu * n_read / cfg->samp_rate / demod->sample_size / cfg->in_replay);
                     delay_timer_wait(&delay_timer, delay_us);
                 }
-                // Convert CF32 file to CS16 buffer
-                if (demod->load_info.format == CF32_IQ) {
-                    n_read = fread(test_mode_float_buf, sizeof(float), DEFAULT_BUF_LENGTH / 2, in_file);
-                    // clamp float to [-1,1] and scale to Q0.15
-                    for (unsigned long n = 0; n < n_read; n++) {
-                        int s_tmp = test_mode_float_buf[n] * INT16_MAX;
-                        if (s_tmp < -INT16_MAX)
-                            s_tmp = -INT16_MAX;
-                        else if (s_tmp > INT16_MAX)
-                            s_tmp = INT16_MAX;
-                        ((int16_t *)test_mode_buf)[n] = s_tmp;
-                    }
-                    n_read *= 2; // convert to byte count
-                } else {
-                    n_read = fread(test_mode_buf, 1, DEFAULT_BUF_LENGTH, in_file);
-
-                    // Convert CS8 file to CU8 buffer
-                    if (demod->load_info.format == CS8_IQ) {
-                        for (unsigned long n = 0; n < n_read; n++) {
-                            test_mode_buf[n] = ((int8_t)test_mode_buf[n]) + 128;
-                        }
-                    }
-                }
-                if (n_read == 0) break;  // sdr_callback() will Segmentation Fault with len=0
-                demod->sample_file_pos = ((float)n_blocks * DEFAULT_BUF_LENGTH + n_read) / cfg->samp_rate / demod->sample_size;
-                n_blocks++; // this assumes n_read == DEFAULT_BUF_LENGTH
-                sdr_callback(test_mode_buf, n_read, cfg);
-            } while (n_read != 0 && !cfg->exit_async);
-
-            // Call a last time with cleared samples to ensure EOP detection
-            if (demod->sample_size == 2) { // CU8
-                memset(test_mode_buf, 128, DEFAULT_BUF_LENGTH); // 128 is 0 in unsigned data
-                // or is 127.5 a better 0 in cu8 data?
-                //for (unsigned long n = 0; n < DEFAULT_BUF_LENGTH/2; n++)
-                //    ((uint16_t *)test_mode_buf)[n] = 0x807f;
+                n_bytes += n_read;
+                demod->sample_file_pos = (float)n_bytes / cfg->samp_rate / demod->sample_size;
+                n_blocks++;
+                sdr_callback(block, n_read, cfg);
             }
-            else { // CF32, CS16
-                    memset(test_mode_buf, 0, DEFAULT_BUF_LENGTH);
+            double read_time = mg_time() - read_start;
+
+            if (reset_failed) {
+                print_logf(LOG_ERROR, "Input", "Resetting the demodulator failed, aborting file \"%s\"", cfg->in_filename);
+                input_file_close(in_file);
+                activity_index_free(act_index);
+                free(sample_path);
+                break;
+            }
+
+            // Call a last time with cleared samples to ensure EOP detection, the last segment already did
+            if (!n_segments) {
+                if (demod->sample_size == 2) { // CU8
+                    memset(test_mode_buf, 128, block_size); // 128 is 0 in unsigned data
+                    // or is 127.5 a better 0 in cu8 data?
+                    //for (unsigned long n = 0; n < DEFAULT_BUF_LENGTH/2; n++)
+                    //    ((uint16_t *)test_mode_buf)[n] = 0x807f;
+                }
+                else { // CF32, CS16
+                        memset(test_mode_buf, 0, block_size);
+                }
+                demod->sample_file_pos = ((float)n_bytes + block_size) / cfg->samp_rate / demod->sample_size;
+                sdr_callback(test_mode_buf, block_size, cfg);
             }
-            demod->sample_file_pos = ((float)n_blocks + 1) * DEFAULT_BUF_LENGTH / cfg->samp_rate / demod->sample_size;
-            sdr_callback(test_mode_buf, DEFAULT_BUF_LENGTH, cfg);
 
             //Always classify a signal at the end of the file
             if (demod->am_analyze)
                 am_analyze_classify(demod->am_analyze);
             if (cfg->verbosity >= LOG_NOTICE) {
                 print_logf(LOG_NOTICE, "Input", "Test mode file issued %d packets", n_blocks);
+                double mbytes = (n_segments ? input_file_size(in_file) : input_file_bytes(in_file)) / 1e6;
+                double secs   = (double)n_bytes / cfg->samp_rate / demod->sample_size;
+                print_logf(LOG_NOTICE, "Input", "Read %.1f MB (%s) in %.3f s, %.1f MB/s, %.1f times realtime",
+                        mbytes, input_file_mapped(in_file) ? "mapped" : "buffered", read_time,
+                        read_time > 0.0 ? mbytes / read_time : 0.0, read_time > 0.0 ? secs / read_time : 0.0);
             }
 
-            if (in_file != stdin) {
-                fclose(in_file);
-            }
+            input_file_close(in_file);
+            activity_index_free(act_index);
+            free(sample_path);
         }
+        input_pool_stop(pool);
 
         close_dumpers(cfg);
         free(test_mode_buf);
-        free(test_mode_float_buf);
         r_free_cfg(cfg);
         exit(0);
     }
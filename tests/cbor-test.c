@@ -0,0 +1,291 @@
+/** @file
+    Round-trip test for the CBOR output.
+
+    Copyright (C) 2026 agent <agent@local>
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+*/
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "data.h"
+#include "output_cbor.h"
+
+/// Minimal CBOR decoder, renders items like the compact JSON encoder.
+typedef struct {
+    uint8_t const *pos;
+    uint8_t const *end;
+    char out[4096];
+    size_t len;
+    int err;
+} cbor_dec_t;
+
+static void out_cat(cbor_dec_t *dec, char const *str)
+{
+    size_t n = strlen(str);
+    if (dec->len + n >= sizeof(dec->out)) {
+        dec->err = 1;
+        return;
+    }
+    memcpy(dec->out + dec->len, str, n + 1);
+    dec->len += n;
+}
+
+static uint64_t read_be(cbor_dec_t *dec, int n)
+{
+    uint64_t val = 0;
+    if (dec->pos + n > dec->end) {
+        dec->err = 1;
+        return 0;
+    }
+    for (int i = 0; i < n; ++i)
+        val = val << 8 | *dec->pos++;
+    return val;
+}
+
+static void out_double(cbor_dec_t *dec, double data)
+{
+    char buf[64];
+    if (data > 1e7 || data < 1e-4) {
+        snprintf(buf, sizeof(buf), "%g", data);
+    }
+    else {
+        snprintf(buf, sizeof(buf), "%.5f", data);
+        size_t n = strlen(buf);
+        while (buf[n - 1] == '0' && buf[n - 2] != '.')
+            buf[--n] = '\0';
+    }
+    out_cat(dec, buf);
+}
+
+static void out_text(cbor_dec_t *dec, uint64_t n)
+{
+    if (dec->pos + n > dec->end) {
+        dec->err = 1;
+        return;
+    }
+    out_cat(dec, "\"");
+    for (; n; --n) {
+        char c      = (char)*dec->pos++;
+        char esc[3] = {'\\', c, '\0'};
+        if (c == '\r')
+            esc[1] = 'r';
+        else if (c == '\n')
+            esc[1] = 'n';
+        else if (c == '\t')
+            esc[1] = 't';
+        out_cat(dec, (c == '\r' || c == '\n' || c == '\t' || c == '"' || c == '\\') ? esc : esc + 1);
+    }
+    out_cat(dec, "\"");
+}
+
+static void decode_item(cbor_dec_t *dec)
+{
+    if (dec->err || dec->pos >= dec->end) {
+        dec->err = 1;
+        return;
+    }
+    uint8_t ib    = *dec->pos++;
+    unsigned major = ib >> 5;
+    unsigned info  = ib & 0x1f;
+
+    if (major == 7 && (info == 26 || info == 27)) {
+        if (info == 26) {
+            uint32_t u = (uint32_t)read_be(dec, 4);
+            float f;
+            memcpy(&f, &u, sizeof(f));
+            out_double(dec, f);
+        }
+        else {
+            uint64_t u = read_be(dec, 8);
+            double d;
+            memcpy(&d, &u, sizeof(d));
+            out_double(dec, d);
+        }
+        return;
+    }
+
+    uint64_t val = info;
+    if (info == 24)
+        val = read_be(dec, 1);
+    else if (info == 25)
+        val = read_be(dec, 2);
+    else if (info == 26)
+        val = read_be(dec, 4);
+    else if (info == 27)
+        val = read_be(dec, 8);
+    else if (info > 27)
+        dec->err = 1;
+
+    char buf[32];
+    switch (major) {
+    case 0:
+        snprintf(buf, sizeof(buf), "%llu", (unsigned long long)val);
+        out_cat(dec, buf);
+        break;
+    case 1:
+        snprintf(buf, sizeof(buf), "%lld", -1 - (long long)val);
+        out_cat(dec, buf);
+        break;
+    case 3:
+        out_text(dec, val);
+        break;
+    case 4:
+        out_cat(dec, "[");
+        for (uint64_t i = 0; i < val && !dec->err; ++i) {
+            if (i)
+                out_cat(dec, ",");
+            decode_item(dec);
+        }
+        out_cat(dec, "]");
+        break;
+    case 5:
+        out_cat(dec, "{");
+        for (uint64_t i = 0; i < val && !dec->err; ++i) {
+            if (i)
+                out_cat(dec, ",");
+            decode_item(dec);
+            out_cat(dec, ":");
+            decode_item(dec);
+        }
+        out_cat(dec, "}");
+        break;
+    default:
+        dec->err = 1;
+    }
+}
+
+static int check_roundtrip(char const *name, data_t *data)
+{
+    uint8_t buf[2048];
+    size_t len = data_print_cbor(data, buf, sizeof(buf));
+    if (len > sizeof(buf)) {
+        fprintf(stderr, "%s: encoding too large (%zu)\n", name, len);
+        return 1;
+    }
+
+    // a short buffer reports the same length and writes nothing past the end
+    uint8_t shrt[8] = {0};
+    if (data_print_cbor(data, shrt, 4) != len || shrt[4] != 0) {
+        fprintf(stderr, "%s: short buffer mismatch\n", name);
+        return 1;
+    }
+
+    cbor_dec_t dec = {.pos = buf, .end = buf + len};
+    decode_item(&dec);
+    if (dec.err || dec.pos != dec.end) {
+        fprintf(stderr, "%s: malformed encoding\n", name);
+        return 1;
+    }
+
+    char const *json = data_jsons(data, NULL);
+    if (!json || strcmp(json, dec.out) != 0) {
+        fprintf(stderr, "%s: mismatch\n  json: %s\n  cbor: %s\n", name, json, dec.out);
+        return 1;
+    }
+    return 0;
+}
+
+static int check_framing(data_t *data)
+{
+    uint8_t buf[2048];
+    size_t len = data_print_cbor(data, buf, sizeof(buf));
+
+    FILE *file = tmpfile();
+    if (!file)
+        return 0; // no temp files available, skip
+    struct data_output *output = data_output_cbor_create(0, file, CBOR_FRAMING_LENGTH);
+    data_output_print(output, data);
+    data_output_print(output, data);
+    data_output_free(output);
+
+    uint8_t got[4096];
+    rewind(file);
+    size_t got_len = fread(got, 1, sizeof(got), file);
+    fclose(file);
+
+    int fail = got_len != 2 * (len + 4);
+    for (int i = 0; !fail && i < 2; ++i) {
+        uint8_t const *frame = got + i * (len + 4);
+        size_t frame_len     = (size_t)frame[0] << 24 | frame[1] << 16 | frame[2] << 8 | frame[3];
+        fail = frame_len != len || memcmp(frame + 4, buf, len) != 0;
+    }
+    if (fail)
+        fprintf(stderr, "framing: mismatch\n");
+    return fail;
+}
+
+int main(void)
+{
+    int fail = 0;
+
+    /* clang-format off */
+    data_t *data = data_make(
+            "label",        "",             DATA_STRING, "1.2.3",
+            "house_code",   "House Code",   DATA_INT,    42,
+            "temp",         "Temperature",  DATA_DOUBLE, 99.9,
+            "array",        "Array",        DATA_ARRAY, data_array(2, DATA_STRING, (char*[2]){"hello", "world"}),
+            "array2",       "Array 2",      DATA_ARRAY, data_array(2, DATA_INT, (int[2]){4, 2}),
+            "array3",       "Array 3",      DATA_ARRAY, data_array(2, DATA_ARRAY, (data_array_t*[2]){
+                                                            data_array(2, DATA_INT, (int[2]){4, 2}),
+                                                            data_array(2, DATA_INT, (int[2]){5, 5}) }),
+            "data",         "Data",        DATA_DATA, data_make("Hello", "hello", DATA_STRING, "world", NULL),
+            NULL);
+    /* clang-format on */
+    fail |= check_roundtrip("default", data);
+    fail |= check_framing(data);
+    data_free(data);
+
+    /* clang-format off */
+    data = data_make(
+            "zero",         "",             DATA_INT,    0,
+            "small",        "",             DATA_INT,    23,
+            "byte",         "",             DATA_INT,    255,
+            "word",         "",             DATA_INT,    65536,
+            "max",          "",             DATA_INT,    2147483647,
+            "neg",          "",             DATA_INT,    -1,
+            "neg_byte",     "",             DATA_INT,    -256,
+            "min",          "",             DATA_INT,    -2147483647 - 1,
+            NULL);
+    /* clang-format on */
+    fail |= check_roundtrip("integers", data);
+    data_free(data);
+
+    /* clang-format off */
+    data = data_make(
+            "half",         "",             DATA_DOUBLE, 0.5,
+            "tenth",        "",             DATA_DOUBLE, 0.1,
+            "negative",     "",             DATA_DOUBLE, -12.25,
+            "tiny",         "",             DATA_DOUBLE, 1.5e-6,
+            "huge",         "",             DATA_DOUBLE, 433.92e6,
+            "rssi",         "",             DATA_DOUBLE, -0.123456,
+            "doubles",      "",             DATA_ARRAY, data_array(3, DATA_DOUBLE, (double[3]){1.0, -2.5, 3.14159}),
+            NULL);
+    /* clang-format on */
+    fail |= check_roundtrip("doubles", data);
+    data_free(data);
+
+    /* clang-format off */
+    data = data_make(
+            "empty",        "",             DATA_STRING, "",
+            "escapes",      "",             DATA_STRING, "quote\" backslash\\ tab\t cr\r lf\n",
+            "utf8",         "",             DATA_STRING, "\xc2\xb0" "C",
+            "long",         "",             DATA_STRING, "0123456789012345678901234567890123456789",
+            "none",         "",             DATA_ARRAY, data_array(0, DATA_INT, NULL),
+            "nested",       "",             DATA_DATA, data_make(
+                "inner",        "",             DATA_DATA, data_make("id", "", DATA_INT, 7, NULL),
+                "list",         "",             DATA_ARRAY, data_array(1, DATA_DATA, (data_t*[1]){
+                                                                data_make("k", "", DATA_STRING, "v", NULL) }),
+                NULL),
+            NULL);
+    /* clang-format on */
+    fail |= check_roundtrip("strings", data);
+    data_free(data);
+
+    return fail;
+}
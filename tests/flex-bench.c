@@ -0,0 +1,332 @@
+/** @file
+    Flex decoder evaluation.
+
+    Functional and speed test of the flex decoders from conf files,
+    run on random bit buffers with the match and preamble patterns implanted.
+
+    The outputs are checked against an expected file. The expected outputs
+    were recorded with the plain flex interpreter, before match and extract
+    plans were compiled, and should only be rewritten (-w) when the conf
+    corpus changes.
+
+    Copyright (C) 2026 agent <agent@local>
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+*/
+
+// ./tests/flex-bench ../tests/flex-bench.expected ../conf/*.conf
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <ctype.h>
+#include <time.h>
+
+#include "r_device.h"
+#include "r_api.h"
+#include "bitbuffer.h"
+#include "confparse.h"
+#include "data.h"
+#include "fatal.h"
+
+#define NUM_BUFFERS 200
+#define NUM_ITERATIONS 50
+#define MAX_DECODERS 256
+
+r_device *flex_create_device(char *spec); // from src/devices/flex.c
+
+/// a pattern from the decoder spec to implant in the test data
+typedef struct {
+    uint8_t bits[BITBUF_COLS];
+    unsigned len;
+} pattern_t;
+
+typedef struct {
+    r_device *dev;
+    pattern_t match;
+    pattern_t preamble;
+    unsigned count; ///< number of events from the first pass
+    uint32_t hash;  ///< hash of the JSON events from the first pass
+} bench_decoder_t;
+
+typedef struct {
+    char name[256];
+    unsigned count;
+    unsigned hash;
+    int used;
+} expected_t;
+
+static unsigned output_count;
+static uint32_t output_hash;
+
+/// xorshift32, the test data needs to be the same with any libc
+static uint32_t rand_state = 42;
+
+static uint32_t next_rand(void)
+{
+    rand_state ^= rand_state << 13;
+    rand_state ^= rand_state >> 17;
+    rand_state ^= rand_state << 5;
+    return rand_state;
+}
+
+static void bench_output(r_device *decoder, data_t *data)
+{
+    (void)decoder;
+    char buf[8192];
+    data_print_jsons(data, buf, sizeof(buf));
+    // FNV-1a over the JSON output of all events
+    for (char const *p = buf; *p; ++p)
+        output_hash = (output_hash ^ (unsigned char)*p) * 16777619u;
+    output_hash = (output_hash ^ '\n') * 16777619u;
+    output_count++;
+    data_free(data);
+}
+
+static void bench_log(r_device *decoder, int level, data_t *data)
+{
+    (void)decoder;
+    (void)level;
+    data_free(data);
+}
+
+/// find a "key=value" in the spec and parse the value as bits
+static void parse_pattern(char const *spec, char const *key, pattern_t *pattern)
+{
+    size_t key_len = strlen(key);
+    char const *p  = spec;
+    while (*p) {
+        while (*p == ',' || isspace((unsigned char)*p))
+            p++;
+        if (!strncasecmp(p, key, key_len) && p[key_len] == '=') {
+            char code[256];
+            size_t n = 0;
+            for (p += key_len + 1; *p && *p != ',' && n < sizeof(code) - 1; ++p)
+                if (!isspace((unsigned char)*p))
+                    code[n++] = *p;
+            code[n] = '\0';
+            bitbuffer_t bits = {0};
+            bitbuffer_parse(&bits, code);
+            if (bits.num_rows == 1 && bits.bits_per_row[0] <= BITBUF_COLS * 8) {
+                pattern->len = bits.bits_per_row[0];
+                memcpy(pattern->bits, bits.bb[0], (pattern->len + 7) / 8);
+            }
+            return;
+        }
+        while (*p && *p != ',')
+            p++;
+    }
+}
+
+static void implant_bits(uint8_t *row, unsigned pos, pattern_t const *pattern)
+{
+    for (unsigned b = 0; b < pattern->len; ++b, ++pos) {
+        if (pattern->bits[b >> 3] & (0x80 >> (b & 7)))
+            row[pos >> 3] |= 0x80 >> (pos & 7);
+        else
+            row[pos >> 3] &= ~(0x80 >> (pos & 7));
+    }
+}
+
+static void fill_bitbuffer(bench_decoder_t const *d, bitbuffer_t *bitbuffer)
+{
+    unsigned rows     = 1 + next_rand() % 4;
+    unsigned min_bits = d->match.len + d->preamble.len + 8;
+    unsigned max_bits = min_bits + 128;
+    if (max_bits > BITBUF_COLS * 8)
+        max_bits = BITBUF_COLS * 8;
+    if (min_bits > max_bits)
+        min_bits = max_bits;
+
+    bitbuffer_clear(bitbuffer);
+    for (unsigned i = 0; i < rows && i < BITBUF_ROWS; ++i) {
+        unsigned len = min_bits + next_rand() % (max_bits - min_bits + 1);
+        for (unsigned col = 0; col < BITBUF_COLS; ++col)
+            bitbuffer->bb[i][col] = (uint8_t)next_rand();
+        bitbuffer->bits_per_row[i] = len;
+        bitbuffer->num_rows++;
+
+        // implant the patterns in about half the rows
+        if (d->preamble.len && d->preamble.len < len && next_rand() % 2)
+            implant_bits(bitbuffer->bb[i], next_rand() % (len - d->preamble.len), &d->preamble);
+        if (d->match.len && d->match.len < len && next_rand() % 2)
+            implant_bits(bitbuffer->bb[i], next_rand() % (len - d->match.len), &d->match);
+    }
+}
+
+/// decode all buffers once, the decoder may modify the buffer so work on a copy
+static void decode_buffers(r_device *dev, bitbuffer_t const *buffers, bitbuffer_t *work)
+{
+    output_count = 0;
+    output_hash  = 2166136261u;
+    for (int n = 0; n < NUM_BUFFERS; ++n) {
+        *work = buffers[n];
+        dev->decode_fn(dev, work);
+    }
+}
+
+static int read_expected(char const *path, expected_t *expected, int size)
+{
+    FILE *file = fopen(path, "r");
+    if (!file) {
+        perror(path);
+        return -1;
+    }
+    int len = 0;
+    char line[512];
+    while (len < size && fgets(line, sizeof(line), file)) {
+        if (*line == '#' || *line == '\n')
+            continue;
+        expected_t *e = &expected[len];
+        if (sscanf(line, "%u %x %255[^\n]", &e->count, &e->hash, e->name) == 3)
+            len++;
+    }
+    fclose(file);
+    return len;
+}
+
+static expected_t *find_expected(expected_t *expected, int len, char const *name)
+{
+    for (int i = 0; i < len; ++i) {
+        if (!expected[i].used && !strcmp(expected[i].name, name)) {
+            expected[i].used = 1;
+            return &expected[i];
+        }
+    }
+    return NULL;
+}
+
+static struct conf_keywords const conf_keywords[] = {
+        {"decoder", 'X'},
+        {"frequency", 0},
+        {"gain", 0},
+        {"sample_rate", 0},
+        {"protocol", 0},
+        {"pulse_detect", 0},
+        {"report_meta", 0},
+        {"convert", 0},
+        {"output", 0},
+        {NULL, 0},
+};
+
+int main(int argc, char *argv[])
+{
+    static bench_decoder_t decoders[MAX_DECODERS];
+    static expected_t expected[MAX_DECODERS];
+    int num_decoders   = 0;
+    int write_expected = 0;
+
+    if (argc > 1 && !strcmp(argv[1], "-w")) {
+        write_expected = 1;
+        argc--;
+        argv++;
+    }
+    if (argc < 3) {
+        fprintf(stderr, "Usage: %s [-w] EXPECTED_FILE CONF_FILES...\n", argv[0]);
+        return 1;
+    }
+    char const *expected_path = argv[1];
+
+    for (int a = 2; a < argc; ++a) {
+        char *conf = readconf(argv[a]);
+        if (!conf)
+            continue;
+        char *p = conf;
+        char *arg;
+        int opt;
+        while ((opt = getconf(&p, conf_keywords, &arg)) != -1) {
+            if (opt != 'X' || num_decoders >= MAX_DECODERS)
+                continue;
+            bench_decoder_t *d = &decoders[num_decoders];
+            parse_pattern(arg, "match", &d->match);
+            parse_pattern(arg, "preamble", &d->preamble);
+            d->dev = flex_create_device(arg);
+            if (!d->dev)
+                continue;
+            d->dev->log_fn    = bench_log;
+            d->dev->output_fn = bench_output;
+            num_decoders++;
+        }
+        free(conf);
+    }
+    printf("Loaded %d flex decoders from %d conf files\n", num_decoders, argc - 2);
+    if (!num_decoders)
+        return 1;
+
+    bitbuffer_t *buffers = calloc(NUM_BUFFERS + 1, sizeof(bitbuffer_t));
+    if (!buffers)
+        FATAL_CALLOC("main()");
+    bitbuffer_t *work = &buffers[NUM_BUFFERS];
+
+    double decode_ms = 0;
+    unsigned total   = 0;
+    int failed       = 0;
+
+    for (int d = 0; d < num_decoders; ++d) {
+        r_device *dev = decoders[d].dev;
+        for (int n = 0; n < NUM_BUFFERS; ++n)
+            fill_bitbuffer(&decoders[d], &buffers[n]);
+
+        // a first pass to check the output
+        decode_buffers(dev, buffers, work);
+        decoders[d].count = output_count;
+        decoders[d].hash  = output_hash;
+        total += output_count;
+
+        clock_t start = clock();
+        for (int it = 0; it < NUM_ITERATIONS; ++it) {
+            decode_buffers(dev, buffers, work);
+        }
+        clock_t stop = clock();
+        decode_ms += (double)(stop - start) * 1000.0 / CLOCKS_PER_SEC;
+
+        if (output_count != decoders[d].count || output_hash != decoders[d].hash) {
+            fprintf(stderr, "Output differs between passes for decoder \"%s\"\n", dev->name);
+            failed = 1;
+        }
+    }
+
+    printf("Time elapsed in ms: %f for: %d decoders on %d buffers x %d iterations\n",
+            decode_ms, num_decoders, NUM_BUFFERS, NUM_ITERATIONS);
+    printf("Decoded %u events per pass\n", total);
+
+    if (write_expected) {
+        FILE *file = fopen(expected_path, "w");
+        if (!file) {
+            perror(expected_path);
+            return 1;
+        }
+        fprintf(file, "# flex-bench expected outputs: events hash decoder\n");
+        for (int d = 0; d < num_decoders; ++d)
+            fprintf(file, "%u 0x%08x %s\n", decoders[d].count, (unsigned)decoders[d].hash, decoders[d].dev->name);
+        fclose(file);
+    }
+    else {
+        int num_expected = read_expected(expected_path, expected, MAX_DECODERS);
+        if (num_expected < 0)
+            return 1;
+        for (int d = 0; d < num_decoders; ++d) {
+            r_device *dev = decoders[d].dev;
+            expected_t *e = find_expected(expected, num_expected, dev->name);
+            if (!e) {
+                fprintf(stderr, "No expected output for decoder \"%s\"\n", dev->name);
+                failed = 1;
+            }
+            else if (e->count != decoders[d].count || e->hash != decoders[d].hash) {
+                fprintf(stderr, "Output mismatch for decoder \"%s\": %u events (0x%08x), expected %u (0x%08x)\n",
+                        dev->name, decoders[d].count, (unsigned)decoders[d].hash, e->count, e->hash);
+                failed = 1;
+            }
+        }
+        printf("Outputs %s the expected outputs of %d decoders\n", failed ? "DIFFER from" : "match", num_expected);
+    }
+
+    for (int d = 0; d < num_decoders; ++d)
+        free_protocol(decoders[d].dev);
+    free(buffers);
+    return failed;
+}